@@ -49,8 +49,6 @@
 #include "spdk/log.h"
 #include "spdk/nvme.h"
 
-struct rte_mempool *request_mempool;
-
 #define SPDK_NVMF_BUILD_ETC "/usr/local/etc/nvmf"
 #define SPDK_NVMF_DEFAULT_CONFIG SPDK_NVMF_BUILD_ETC "/nvmf.conf"
 
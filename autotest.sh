@@ -60,6 +60,7 @@ time test/lib/nvme/nvme.sh
 time test/lib/nvmf/nvmf.sh
 time test/lib/memory/memory.sh
 time test/lib/ioat/ioat.sh
+time test/lib/copy/copy.sh
 time test/lib/json/json.sh
 time test/lib/jsonrpc/jsonrpc.sh
 time test/lib/log/log.sh
@@ -36,13 +36,18 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
 #include <rte_config.h>
 #include <rte_malloc.h>
 #include <rte_eal.h>
 #include <rte_lcore.h>
 #include <rte_cycles.h>
 #include <rte_mempool.h>
+#include <rte_memcpy.h>
 
+#include "spdk/copy_engine.h"
 #include "spdk/ioat.h"
 #include "spdk/pci.h"
 #include "spdk/string.h"
@@ -50,11 +55,29 @@
 struct user_config {
 	int xfer_size_bytes;
 	int queue_depth;
+	int batch_size;
 	int time_in_sec;
 	bool verify;
+	bool cpu_copy;
 	char *core_mask;
 };
 
+/*
+ * The CPU copy comparison walks buffers much larger than the last level cache,
+ *  and rereads a small hot set between copies to stand in for the state of
+ *  the thread that issued them.
+ */
+#define CPU_COPY_REGION_SIZE	(256 * 1024 * 1024)
+#define CPU_COPY_HOT_SET_SIZE	(1024 * 1024)
+
+struct cpu_copy_result {
+	uint64_t copies;
+	uint64_t copy_ticks;
+	uint64_t hot_ticks;
+	uint64_t cache_misses;
+	bool cache_misses_valid;
+};
+
 struct ioat_device {
 	struct spdk_ioat_chan *ioat;
 	TAILQ_ENTRY(ioat_device) tailq;
@@ -70,6 +93,8 @@ struct thread_entry {
 	uint64_t xfer_completed;
 	uint64_t xfer_failed;
 	uint64_t current_queue_depth;
+	uint64_t unflushed;
+	uint64_t flushes;
 	unsigned lcore_id;
 	bool is_draining;
 	struct rte_mempool *data_pool;
@@ -90,8 +115,10 @@ construct_user_config(struct user_config *self)
 {
 	self->xfer_size_bytes = 4096;
 	self->queue_depth = 256;
+	self->batch_size = 1;
 	self->time_in_sec = 10;
 	self->verify = false;
+	self->cpu_copy = false;
 	self->core_mask = "0x1";
 }
 
@@ -99,8 +126,15 @@ static void
 dump_user_config(struct user_config *self)
 {
 	printf("User configuration:\n");
+	if (self->cpu_copy) {
+		printf("Mode:           CPU copy comparison\n");
+		printf("Transfer size:  %u bytes\n", self->xfer_size_bytes);
+		printf("Run time:       %u seconds per method\n\n", self->time_in_sec);
+		return;
+	}
 	printf("Transfer size:  %u bytes\n", self->xfer_size_bytes);
 	printf("Queue depth:    %u\n", self->queue_depth);
+	printf("Batch size:     %u\n", self->batch_size);
 	printf("Run time:       %u seconds\n", self->time_in_sec);
 	printf("Core mask:      %s\n", self->core_mask);
 	printf("Verify:         %s\n\n", self->verify ? "Yes" : "No");
@@ -197,6 +231,8 @@ usage(char *program_name)
 	printf("\t[-h help message]\n");
 	printf("\t[-c core mask for distributing I/O submission/completion work]\n");
 	printf("\t[-q queue depth]\n");
+	printf("\t[-b number of copies built per doorbell write (default 1)]\n");
+	printf("\t[-m compare rte_memcpy with non-temporal CPU copies instead of using ioat]\n");
 	printf("\t[-s transfer size in bytes]\n");
 	printf("\t[-t time in seconds]\n");
 	printf("\t[-v verify copy result if this switch is on]\n");
@@ -208,8 +244,11 @@ parse_args(int argc, char **argv)
 	int op;
 
 	construct_user_config(&g_user_config);
-	while ((op = getopt(argc, argv, "c:hq:s:t:v")) != -1) {
+	while ((op = getopt(argc, argv, "b:c:hmq:s:t:v")) != -1) {
 		switch (op) {
+		case 'b':
+			g_user_config.batch_size = atoi(optarg);
+			break;
 		case 's':
 			g_user_config.xfer_size_bytes = atoi(optarg);
 			break;
@@ -222,6 +261,9 @@ parse_args(int argc, char **argv)
 		case 'c':
 			g_user_config.core_mask = optarg;
 			break;
+		case 'm':
+			g_user_config.cpu_copy = true;
+			break;
 		case 'v':
 			g_user_config.verify = true;
 			break;
@@ -234,6 +276,7 @@ parse_args(int argc, char **argv)
 		}
 	}
 	if (!g_user_config.xfer_size_bytes || !g_user_config.queue_depth ||
+	    g_user_config.batch_size <= 0 ||
 	    !g_user_config.time_in_sec || !g_user_config.core_mask) {
 		usage(argv[0]);
 		return 1;
@@ -242,11 +285,22 @@ parse_args(int argc, char **argv)
 	return 0;
 }
 
+static void
+flush_xfers(struct thread_entry *thread_entry)
+{
+	if (thread_entry->unflushed > 0) {
+		spdk_ioat_flush(thread_entry->chan);
+		thread_entry->unflushed = 0;
+		thread_entry->flushes++;
+	}
+}
+
 static void
 drain_io(struct thread_entry *thread_entry)
 {
 	while (thread_entry->current_queue_depth > 0) {
 		spdk_ioat_process_events(thread_entry->chan);
+		flush_xfers(thread_entry);
 	}
 }
 
@@ -258,10 +312,17 @@ submit_single_xfer(struct thread_entry *thread_entry, struct ioat_task *ioat_tas
 	ioat_task->src = src;
 	ioat_task->dst = dst;
 
-	spdk_ioat_submit_copy(thread_entry->chan, ioat_task, ioat_done, dst, src,
-			      g_user_config.xfer_size_bytes);
+	/*
+	 * Build the descriptor now and write the doorbell once per batch; copies
+	 * left over are started after the next completion poll.
+	 */
+	spdk_ioat_build_copy(thread_entry->chan, ioat_task, ioat_done, dst, src,
+			     g_user_config.xfer_size_bytes);
 
 	thread_entry->current_queue_depth++;
+	if (++thread_entry->unflushed >= (uint64_t)g_user_config.batch_size) {
+		flush_xfers(thread_entry);
+	}
 }
 
 static void
@@ -308,8 +369,10 @@ work_fn(void *arg)
 
 	// begin to submit transfers
 	submit_xfers(t, g_user_config.queue_depth);
+	flush_xfers(t);
 	while (rte_get_timer_cycles() < tsc_end) {
 		spdk_ioat_process_events(t->chan);
+		flush_xfers(t);
 	}
 
 	// begin to drain io
@@ -339,6 +402,10 @@ init(void)
 
 	free(core_mask_conf);
 
+	if (g_user_config.cpu_copy) {
+		return 0;
+	}
+
 	if (ioat_init() != 0) {
 		fprintf(stderr, "Could not init ioat\n");
 		return 1;
@@ -353,6 +420,7 @@ dump_result(struct thread_entry *threads, int len)
 	int i;
 	uint64_t total_completed = 0;
 	uint64_t total_failed = 0;
+	uint64_t total_flushes = 0;
 	uint64_t total_xfer_per_sec, total_bw_in_MBps;
 
 	printf("lcore     Transfers        Bandwidth  Failed\n");
@@ -366,6 +434,7 @@ dump_result(struct thread_entry *threads, int len)
 
 		total_completed += t->xfer_completed;
 		total_failed += t->xfer_failed;
+		total_flushes += t->flushes;
 
 		if (xfer_per_sec) {
 			printf("%5d  %10" PRIu64 "/s  %10" PRIu64 " MB/s  %6" PRIu64 "\n",
@@ -380,6 +449,9 @@ dump_result(struct thread_entry *threads, int len)
 	printf("============================================\n");
 	printf("Total: %10" PRIu64 "/s  %10" PRIu64 " MB/s  %6" PRIu64 "\n",
 	       total_xfer_per_sec, total_bw_in_MBps, total_failed);
+	if (total_flushes) {
+		printf("Copies per doorbell: %.1f\n", (double)(total_completed + total_failed) / total_flushes);
+	}
 	return total_failed ? 1 : 0;
 }
 
@@ -400,6 +472,149 @@ get_next_chan(void)
 	return chan;
 }
 
+static int
+open_cache_miss_counter(void)
+{
+	struct perf_event_attr attr = {};
+
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_CACHE_MISSES;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	/* Count for this thread on any CPU. */
+	return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void
+cpu_copy_rte_memcpy(void *dst, const void *src, size_t nbytes)
+{
+	rte_memcpy(dst, src, nbytes);
+}
+
+static void
+run_cpu_copy(void (*copy_fn)(void *, const void *, size_t), uint8_t *src, uint8_t *dst,
+	     volatile uint64_t *hot, struct cpu_copy_result *result)
+{
+	uint64_t xfer_size = g_user_config.xfer_size_bytes;
+	uint64_t offset = 0, start, tsc_end, sum = 0;
+	int fd;
+	size_t i;
+
+	memset(result, 0, sizeof(*result));
+
+	fd = open_cache_miss_counter();
+	if (fd >= 0) {
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+
+	tsc_end = rte_get_timer_cycles() + g_user_config.time_in_sec * rte_get_timer_hz();
+	while (rte_get_timer_cycles() < tsc_end) {
+		start = rte_get_timer_cycles();
+		copy_fn(dst + offset, src + offset, xfer_size);
+		result->copy_ticks += rte_get_timer_cycles() - start;
+		result->copies++;
+
+		offset += xfer_size;
+		if (offset + xfer_size > CPU_COPY_REGION_SIZE) {
+			offset = 0;
+		}
+
+		/* One load per cache line of the hot set. */
+		start = rte_get_timer_cycles();
+		for (i = 0; i < CPU_COPY_HOT_SET_SIZE / sizeof(*hot); i += 8) {
+			sum += hot[i];
+		}
+		result->hot_ticks += rte_get_timer_cycles() - start;
+	}
+
+	if (fd >= 0) {
+		ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+		if (read(fd, &result->cache_misses, sizeof(result->cache_misses)) ==
+		    sizeof(result->cache_misses)) {
+			result->cache_misses_valid = true;
+		}
+		close(fd);
+	}
+
+	hot[0] = sum;
+}
+
+static void
+dump_cpu_copy_result(const char *name, struct cpu_copy_result *result)
+{
+	uint64_t hz = rte_get_timer_hz();
+	uint64_t bw_in_MBps = 0, hot_ns = 0, misses = 0;
+
+	if (result->copy_ticks) {
+		bw_in_MBps = (result->copies * g_user_config.xfer_size_bytes * hz) /
+			     (result->copy_ticks * 1024 * 1024);
+	}
+	if (result->copies) {
+		hot_ns = result->hot_ticks * 1000000000ULL / hz / result->copies;
+		misses = result->cache_misses / result->copies;
+	}
+
+	if (result->cache_misses_valid) {
+		printf("%-16s %10" PRIu64 " MB/s  %12" PRIu64 "  %10" PRIu64 " ns\n",
+		       name, bw_in_MBps, misses, hot_ns);
+	} else {
+		printf("%-16s %10" PRIu64 " MB/s  %12s  %10" PRIu64 " ns\n",
+		       name, bw_in_MBps, "n/a", hot_ns);
+	}
+}
+
+/*
+ * Compare rte_memcpy() with spdk_memcpy_nt() on the master core: copy
+ *  bandwidth, cache misses per copy, and how long it takes to reread the hot
+ *  set after each copy, which grows as copies evict it.
+ */
+static int
+cpu_copy_compare(void)
+{
+	struct cpu_copy_result memcpy_result, nt_result;
+	uint8_t *src, *dst;
+	uint64_t *hot;
+	char nt_name[32];
+
+	if ((uint64_t)g_user_config.xfer_size_bytes > CPU_COPY_REGION_SIZE) {
+		fprintf(stderr, "Transfer size must be at most %u bytes\n", CPU_COPY_REGION_SIZE);
+		return 1;
+	}
+
+	src = rte_malloc(NULL, CPU_COPY_REGION_SIZE, 0x200000);
+	dst = rte_malloc(NULL, CPU_COPY_REGION_SIZE, 0x200000);
+	hot = rte_zmalloc(NULL, CPU_COPY_HOT_SET_SIZE, 64);
+	if (src == NULL || dst == NULL || hot == NULL) {
+		fprintf(stderr, "Could not allocate copy buffers.\n");
+		rte_free(src);
+		rte_free(dst);
+		rte_free(hot);
+		return 1;
+	}
+
+	memset(src, 0x5a, CPU_COPY_REGION_SIZE);
+	memset(dst, 0, CPU_COPY_REGION_SIZE);
+
+	run_cpu_copy(cpu_copy_rte_memcpy, src, dst, hot, &memcpy_result);
+	run_cpu_copy(spdk_memcpy_nt, src, dst, hot, &nt_result);
+
+	snprintf(nt_name, sizeof(nt_name), "nt (%s)", spdk_memcpy_nt_get_isa());
+
+	printf("Copy                  Bandwidth  Misses/copy  Hot set reread\n");
+	printf("--------------------------------------------------------------\n");
+	dump_cpu_copy_result("rte_memcpy", &memcpy_result);
+	dump_cpu_copy_result(nt_name, &nt_result);
+
+	rte_free(src);
+	rte_free(dst);
+	rte_free(hot);
+	return 0;
+}
+
 int
 main(int argc, char **argv)
 {
@@ -417,6 +632,10 @@ main(int argc, char **argv)
 
 	dump_user_config(&g_user_config);
 
+	if (g_user_config.cpu_copy) {
+		return cpu_copy_compare();
+	}
+
 	g_next_device = TAILQ_FIRST(&g_devices);
 	RTE_LCORE_FOREACH_SLAVE(lcore_id) {
 		threads[lcore_id].chan = get_next_chan();
@@ -147,6 +147,26 @@ struct spdk_bdev {
 
 	/** True if another blockdev or a LUN is using this device */
 	bool claimed;
+
+	/** The backend can lend its memory through spdk_bdev_lease() */
+	bool lease_supported;
+
+	/**
+	 * NUMA socket holding the backend's memory or device, or -1 if not
+	 *  known.  Set by the backend before spdk_bdev_register(); the poller
+	 *  is placed on a core of this socket when one is in the core mask.
+	 */
+	int socket_id;
+
+	/** Number of I/O processed by this blockdev */
+	uint64_t num_io;
+
+	/**
+	 * Number of those I/O that crossed sockets, either because they were
+	 *  submitted from a core on another socket or because no core on the
+	 *  blockdev's socket was available for its poller.
+	 */
+	uint64_t num_remote_io;
 };
 
 /**
@@ -178,6 +198,7 @@ enum spdk_bdev_io_type {
 	SPDK_BDEV_IO_TYPE_UNMAP,
 	SPDK_BDEV_IO_TYPE_FLUSH,
 	SPDK_BDEV_IO_TYPE_RESET,
+	SPDK_BDEV_IO_TYPE_LEASE,
 };
 
 /** Blockdev I/O completion status */
@@ -276,6 +297,19 @@ struct spdk_bdev_io {
 		struct {
 			int32_t type;
 		} reset;
+		struct {
+			/** Pointer into the backend's memory, set when the lease is granted. */
+			void *buf;
+
+			/** Size of the leased range in bytes. */
+			uint64_t nbytes;
+
+			/** Starting offset (in bytes) of the blockdev for this lease. */
+			uint64_t offset;
+
+			/** True if the caller will write the leased range. */
+			bool write;
+		} lease;
 	} u;
 
 	/** User function that will be called when this completes */
@@ -304,6 +338,22 @@ struct spdk_bdev_io {
 	/** Number of children for this I/O */
 	int children;
 
+	/** Used in virtual device (e.g., RAID), timer cycles when this child I/O was submitted. */
+	uint64_t submit_tsc;
+
+	/**
+	 * Set by spdk_bdev_io_resubmit(): the blockdev, context, byte offset and
+	 *  length of the other view of this I/O.  The caller's view is swapped
+	 *  in before the completion callback and swapped out again on free.
+	 */
+	struct {
+		/** NULL if the I/O was never resubmitted. */
+		struct spdk_bdev *bdev;
+		void *ctx;
+		uint64_t offset;
+		uint64_t length;
+	} resubmit;
+
 	/** Entry to the list need_buf of struct spdk_bdev. */
 	TAILQ_ENTRY(spdk_bdev_io) rbuf_link;
 
@@ -375,6 +425,22 @@ struct spdk_bdev_io *spdk_bdev_unmap(struct spdk_bdev *bdev,
 struct spdk_bdev_io *spdk_bdev_flush(struct spdk_bdev *bdev,
 				     uint64_t offset, uint64_t length,
 				     spdk_bdev_io_completion_cb cb, void *cb_arg);
+
+/*
+ * Zero-copy access.  spdk_bdev_lease() asks the backend to lend the range
+ *  [offset, offset + nbytes) directly; on successful completion
+ *  u.lease.buf points into the backend's memory.  The caller reads from
+ *  it, or for a write lease fills it, and then hands it back with
+ *  spdk_bdev_lease_release().  Data written under a write lease belongs
+ *  to the blockdev once the lease is released.  Only backends that set
+ *  lease_supported accept leases; for others NULL is returned and the
+ *  caller should use spdk_bdev_read() and spdk_bdev_write() instead.
+ */
+struct spdk_bdev_io *spdk_bdev_lease(struct spdk_bdev *bdev,
+				     uint64_t nbytes, uint64_t offset, bool write,
+				     spdk_bdev_io_completion_cb cb, void *cb_arg);
+int spdk_bdev_lease_release(struct spdk_bdev_io *bdev_io);
+
 int spdk_bdev_io_submit(struct spdk_bdev_io *bdev_io);
 void spdk_bdev_do_work(void *ctx);
 int spdk_bdev_reset(struct spdk_bdev *bdev, int reset_type,
@@ -394,6 +460,18 @@ struct spdk_bdev_io *spdk_bdev_get_child_io(struct spdk_bdev_io *parent,
 		void *cb_arg);
 void spdk_bdev_io_complete(struct spdk_bdev_io *bdev_io,
 			   enum spdk_bdev_io_status status);
+
+/*
+ * Hand a read, write, flush or lease that a virtual blockdev received on to
+ *  the blockdev beneath it, without allocating a child, as offset bytes
+ *  into bdev and length bytes long.  The I/O then belongs to bdev, which
+ *  completes it straight to the original caller; the caller's blockdev,
+ *  offset and length are put back before its callback runs, and its
+ *  spdk_bdev_free_io() releases the I/O through bdev.  Returns -1 for
+ *  other I/O types.
+ */
+int spdk_bdev_io_resubmit(struct spdk_bdev_io *bdev_io, struct spdk_bdev *bdev,
+			  uint64_t offset, uint64_t length);
 void spdk_bdev_module_list_add(struct spdk_bdev_module_if *bdev_module);
 void spdk_vbdev_module_list_add(struct spdk_bdev_module_if *vbdev_module);
 
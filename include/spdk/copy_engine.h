@@ -40,6 +40,7 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <sys/uio.h>
 
 #include "spdk/queue.h"
 
@@ -53,9 +54,49 @@ struct copy_task {
 struct spdk_copy_engine {
 	int64_t	(*copy)(void *cb_arg, void *dst, void *src,
 			uint64_t nbytes, copy_completion_cb cb);
+
+	/*
+	 * Copy the data described by src_iovs into dst_iovs as one request,
+	 * completing it once.  Both lists must describe the same number of
+	 * bytes.  The iovec arrays belong to the caller and must not be used
+	 * after the call returns.  On failure nothing may have been started,
+	 * so that the request can be retried on the CPU.  Optional, like the
+	 * operations below.
+	 */
+	int64_t	(*copyv)(void *cb_arg, struct iovec *dst_iovs, int dst_iovcnt,
+			 struct iovec *src_iovs, int src_iovcnt, copy_completion_cb cb);
+
+	/*
+	 * The operations below are optional.  Any that a hardware engine
+	 * leaves NULL are carried out by the memcpy engine instead.
+	 */
+	int64_t	(*fill)(void *cb_arg, void *dst, uint8_t fill,
+			uint64_t nbytes, copy_completion_cb cb);
+	int64_t	(*compare)(void *cb_arg, void *src1, void *src2,
+			   uint64_t nbytes, copy_completion_cb cb);
+	int64_t	(*crc32c)(void *cb_arg, uint32_t *dst, void *src, uint32_t seed,
+			  uint64_t nbytes, copy_completion_cb cb);
+	int64_t	(*dualcast)(void *cb_arg, void *dst1, void *dst2, void *src,
+			    uint64_t nbytes, copy_completion_cb cb);
 	void	(*check_io)(void);
 };
 
+/*
+ * Per-lcore counts of where requests were routed.  Requests go to the
+ *  hardware engine unless they are smaller than the threshold or the lcore
+ *  already has the maximum number of hardware requests outstanding.
+ */
+struct spdk_copy_engine_stats {
+	uint64_t	hw_ops;
+	uint64_t	hw_bytes;
+	uint64_t	cpu_ops;
+	uint64_t	cpu_bytes;
+	/* Requests that ran on the CPU because they were below the threshold. */
+	uint64_t	cpu_small_ops;
+	/* Requests that ran on the CPU because the hardware queue was full. */
+	uint64_t	cpu_backlog_ops;
+};
+
 struct spdk_copy_module_if {
 	/** Initialization function for the module.  Called by the spdk
 	 *   application during startup.
@@ -84,7 +125,72 @@ struct spdk_copy_module_if {
 void spdk_copy_engine_register(struct spdk_copy_engine *copy_engine);
 int64_t spdk_copy_submit(struct copy_task *copy_req, void *dst, void *src,
 			 uint64_t nbytes, copy_completion_cb cb);
+
+/*
+ * Submit a batch of copies, from the buffers in src_iovs to those in dst_iovs,
+ * as a single request.  cb is called once all of them are done.  A hardware
+ * engine builds every piece before starting any, so the batch costs a single
+ * doorbell write.  Returns the number of bytes copied, or -1.
+ */
+int64_t spdk_copy_submitv(struct copy_task *copy_req, struct iovec *dst_iovs, int dst_iovcnt,
+			  struct iovec *src_iovs, int src_iovcnt, copy_completion_cb cb);
+
+/*
+ * Set nbytes of dst to the byte value fill.  Returns nbytes, or -1.
+ */
+int64_t spdk_copy_submit_fill(struct copy_task *copy_req, void *dst, uint8_t fill,
+			      uint64_t nbytes, copy_completion_cb cb);
+
+/*
+ * Compare nbytes of src1 and src2.  cb is called with status 0 if they match
+ * and -EILSEQ if they differ.  Returns nbytes, or -1.
+ */
+int64_t spdk_copy_submit_compare(struct copy_task *copy_req, void *src1, void *src2,
+				 uint64_t nbytes, copy_completion_cb cb);
+
+/*
+ * Compute the CRC-32C (Castagnoli) of nbytes of src and store it in *dst.  seed
+ * is the CRC of any preceding data, or 0, so a checksum can be built up over
+ * several calls.  Returns nbytes, or -1.
+ */
+int64_t spdk_copy_submit_crc32c(struct copy_task *copy_req, uint32_t *dst, void *src,
+				uint32_t seed, uint64_t nbytes, copy_completion_cb cb);
+
+/*
+ * Copy nbytes of src to both dst1 and dst2.  Returns nbytes, or -1.
+ */
+int64_t spdk_copy_submit_dualcast(struct copy_task *copy_req, void *dst1, void *dst2,
+				  void *src, uint64_t nbytes, copy_completion_cb cb);
 int spdk_copy_check_io(void);
+
+/*
+ * Return the size in bytes from which requests are sent to the hardware
+ *  engine, either configured or measured at startup.  UINT64_MAX means that
+ *  calibration failed and the hardware engine is not used.
+ */
+uint64_t spdk_copy_engine_get_hw_threshold(void);
+void spdk_copy_engine_get_stats(uint32_t lcore, struct spdk_copy_engine_stats *stats);
+
+/*
+ * Split a copy between two iovec lists into pieces that are contiguous in both,
+ * and call fn for each piece in order.  For use by copy engines.  Returns the
+ * total number of bytes, or -1 if fn fails or the lists differ in length.
+ */
+int64_t spdk_copy_iov_walk(struct iovec *dst_iovs, int dst_iovcnt,
+			   struct iovec *src_iovs, int src_iovcnt,
+			   int (*fn)(void *dst, void *src, uint64_t nbytes, void *ctx), void *ctx);
+
+/*
+ * Copy nbytes from src to dst, writing dst with non-temporal stores so that
+ *  it is not brought into the cache, using the widest vector instructions
+ *  the CPU supports.  The data is globally visible on return.  The memcpy
+ *  engine uses this for copies of at least its configured threshold.
+ */
+void spdk_memcpy_nt(void *dst, const void *src, size_t nbytes);
+
+/* Return the instruction set spdk_memcpy_nt() uses: "sse2", "avx2" or "avx512". */
+const char *spdk_memcpy_nt_get_isa(void);
+
 int spdk_copy_module_get_max_ctx_size(void);
 void spdk_copy_module_list_add(struct spdk_copy_module_if *copy_module);
 
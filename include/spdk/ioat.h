@@ -44,6 +44,7 @@ extern "C" {
 
 #include <inttypes.h>
 #include <stdbool.h>
+#include <sys/uio.h>
 
 #include "spdk/pci.h"
 
@@ -104,7 +105,55 @@ int spdk_ioat_probe(void *cb_ctx, spdk_ioat_probe_cb probe_cb, spdk_ioat_attach_
 int spdk_ioat_detach(struct spdk_ioat_chan *ioat);
 
 /**
- * Submit a DMA engine memory copy request.
+ * Build a DMA engine memory copy request without notifying the hardware.
+ *
+ * \param chan I/OAT channel to build request on.
+ * \param cb_arg Opaque value which will be passed back as the arg parameter in the completion callback.
+ * \param cb_fn Callback function which will be called when the request is complete.
+ * \param dst Destination virtual address.
+ * \param src Source virtual address.
+ * \param nbytes Number of bytes to copy.
+ *
+ * The request is not started until \ref spdk_ioat_flush() is called, so several
+ * requests can be built and then started with a single doorbell write.
+ */
+int64_t spdk_ioat_build_copy(struct spdk_ioat_chan *chan,
+			     void *cb_arg, spdk_ioat_req_cb cb_fn,
+			     void *dst, const void *src, uint64_t nbytes);
+
+/**
+ * Build a scatter-gather DMA engine memory copy request without notifying the hardware.
+ *
+ * \param chan I/OAT channel to build request on.
+ * \param cb_arg Opaque value which will be passed back as the arg parameter in the completion callback.
+ * \param cb_fn Callback function which will be called when the request is complete.
+ * \param dst_iovs Destination buffers.
+ * \param dst_iovcnt Number of entries in dst_iovs.
+ * \param src_iovs Source buffers.
+ * \param src_iovcnt Number of entries in src_iovs.
+ *
+ * Both lists must describe the same number of bytes.  One descriptor is used per
+ * physically contiguous piece, and only the last one signals completion.  Either
+ * the whole request is built or, if the ring is too full, none of it is and -1 is
+ * returned.  The iovec arrays are not referenced after this call returns.
+ */
+int64_t spdk_ioat_build_copyv(struct spdk_ioat_chan *chan,
+			      void *cb_arg, spdk_ioat_req_cb cb_fn,
+			      struct iovec *dst_iovs, int dst_iovcnt,
+			      struct iovec *src_iovs, int src_iovcnt);
+
+/**
+ * Build and submit a scatter-gather DMA engine memory copy request.
+ *
+ * See \ref spdk_ioat_build_copyv() for the parameters.
+ */
+int64_t spdk_ioat_submit_copyv(struct spdk_ioat_chan *chan,
+			       void *cb_arg, spdk_ioat_req_cb cb_fn,
+			       struct iovec *dst_iovs, int dst_iovcnt,
+			       struct iovec *src_iovs, int src_iovcnt);
+
+/**
+ * Build and submit a DMA engine memory copy request.
  *
  * \param chan I/OAT channel to submit request.
  * \param cb_arg Opaque value which will be passed back as the arg parameter in the completion callback.
@@ -118,7 +167,23 @@ int64_t spdk_ioat_submit_copy(struct spdk_ioat_chan *chan,
 			      void *dst, const void *src, uint64_t nbytes);
 
 /**
- * Submit a DMA engine memory fill request.
+ * Build a DMA engine memory fill request without notifying the hardware.
+ *
+ * \param chan I/OAT channel to build request on.
+ * \param cb_arg Opaque value which will be passed back as the cb_arg parameter in the completion callback.
+ * \param cb_fn Callback function which will be called when the request is complete.
+ * \param dst Destination virtual address.
+ * \param fill_pattern Repeating eight-byte pattern to use for memory fill.
+ * \param nbytes Number of bytes to fill.
+ *
+ * The request is not started until \ref spdk_ioat_flush() is called.
+ */
+int64_t spdk_ioat_build_fill(struct spdk_ioat_chan *chan,
+			     void *cb_arg, spdk_ioat_req_cb cb_fn,
+			     void *dst, uint64_t fill_pattern, uint64_t nbytes);
+
+/**
+ * Build and submit a DMA engine memory fill request.
  *
  * \param chan I/OAT channel to submit request.
  * \param cb_arg Opaque value which will be passed back as the cb_arg parameter in the completion callback.
@@ -131,6 +196,13 @@ int64_t spdk_ioat_submit_fill(struct spdk_ioat_chan *chan,
 			      void *cb_arg, spdk_ioat_req_cb cb_fn,
 			      void *dst, uint64_t fill_pattern, uint64_t nbytes);
 
+/**
+ * Start all requests built on an I/OAT channel since the last flush.
+ *
+ * \param chan I/OAT channel to flush.
+ */
+void spdk_ioat_flush(struct spdk_ioat_chan *chan);
+
 /**
  * Check for completed requests on an I/OAT channel.
  *
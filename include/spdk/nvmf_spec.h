@@ -127,6 +127,9 @@ enum spdk_nvmf_trtype {
 	/** Fibre Channel */
 	SPDK_NVMF_TRTYPE_FC		= 0x2,
 
+	/** TCP */
+	SPDK_NVMF_TRTYPE_TCP		= 0x3,
+
 	/** Intra-host transport (loopback) */
 	SPDK_NVMF_TRTYPE_INTRA_HOST	= 0xfe,
 };
@@ -353,12 +356,34 @@ struct spdk_nvmf_rdma_transport_specific_address_subtype {
 SPDK_STATIC_ASSERT(sizeof(struct spdk_nvmf_rdma_transport_specific_address_subtype) == 256,
 		   "Incorrect size");
 
+/** TCP Secure Socket Type */
+enum spdk_nvme_tcp_secure_socket_type {
+	/** No security */
+	SPDK_NVME_TCP_SECURITY_NONE			= 0,
+
+	/** TLS (Secure Sockets) */
+	SPDK_NVME_TCP_SECURITY_TLS			= 1,
+};
+
+/** TCP transport-specific address subtype */
+struct spdk_nvme_tcp_transport_specific_address_subtype {
+	/** Security type (\ref spdk_nvme_tcp_secure_socket_type) */
+	uint8_t		sectype;
+
+	uint8_t		reserved0[255];
+};
+SPDK_STATIC_ASSERT(sizeof(struct spdk_nvme_tcp_transport_specific_address_subtype) == 256,
+		   "Incorrect size");
+
 /** Transport-specific address subtype */
 union spdk_nvmf_transport_specific_address_subtype {
 	uint8_t raw[256];
 
 	/** RDMA */
 	struct spdk_nvmf_rdma_transport_specific_address_subtype rdma;
+
+	/** TCP */
+	struct spdk_nvme_tcp_transport_specific_address_subtype tcp;
 };
 SPDK_STATIC_ASSERT(sizeof(union spdk_nvmf_transport_specific_address_subtype) == 256,
 		   "Incorrect size");
@@ -464,6 +489,139 @@ enum spdk_nvmf_rdma_transport_errors {
 	SPDK_NVMF_RDMA_ERROR_INVALID_ORD			= 0x8,
 };
 
+/* NVMe/TCP */
+
+#define SPDK_NVME_TCP_PFV_1_0			0
+
+/** PDU types */
+enum spdk_nvme_tcp_pdu_type {
+	SPDK_NVME_TCP_PDU_TYPE_IC_REQ			= 0x00,
+	SPDK_NVME_TCP_PDU_TYPE_IC_RESP			= 0x01,
+	SPDK_NVME_TCP_PDU_TYPE_H2C_TERM_REQ		= 0x02,
+	SPDK_NVME_TCP_PDU_TYPE_C2H_TERM_REQ		= 0x03,
+	SPDK_NVME_TCP_PDU_TYPE_CAPSULE_CMD		= 0x04,
+	SPDK_NVME_TCP_PDU_TYPE_CAPSULE_RESP		= 0x05,
+	SPDK_NVME_TCP_PDU_TYPE_H2C_DATA			= 0x06,
+	SPDK_NVME_TCP_PDU_TYPE_C2H_DATA			= 0x07,
+	SPDK_NVME_TCP_PDU_TYPE_R2T			= 0x09,
+};
+
+/** Common header flags */
+#define SPDK_NVME_TCP_CH_FLAGS_HDGSTF		(1u << 0)
+#define SPDK_NVME_TCP_CH_FLAGS_DDGSTF		(1u << 1)
+
+/** H2C and C2H data PDU flags */
+#define SPDK_NVME_TCP_DATA_FLAGS_LAST_PDU	(1u << 2)
+#define SPDK_NVME_TCP_C2H_DATA_FLAGS_SUCCESS	(1u << 3)
+
+/** ICReq and ICResp digest bits */
+#define SPDK_NVME_TCP_DIGEST_HDGST_ENABLE	(1u << 0)
+#define SPDK_NVME_TCP_DIGEST_DDGST_ENABLE	(1u << 1)
+
+/** Common header of all PDUs */
+struct spdk_nvme_tcp_common_pdu_hdr {
+	uint8_t		pdu_type;
+	uint8_t		flags;
+	uint8_t		hlen;
+	uint8_t		pdo;
+	uint32_t	plen;
+};
+SPDK_STATIC_ASSERT(sizeof(struct spdk_nvme_tcp_common_pdu_hdr) == 8, "Incorrect size");
+
+/** ICReq */
+struct spdk_nvme_tcp_ic_req {
+	struct spdk_nvme_tcp_common_pdu_hdr	common;
+	uint16_t				pfv;
+	/** Host PDU data alignment, in dwords, 0's based */
+	uint8_t					hpda;
+	uint8_t					dgst;
+	/** Maximum number of outstanding R2Ts per command, 0's based */
+	uint32_t				maxr2t;
+	uint8_t					reserved16[112];
+};
+SPDK_STATIC_ASSERT(sizeof(struct spdk_nvme_tcp_ic_req) == 128, "Incorrect size");
+
+/** ICResp */
+struct spdk_nvme_tcp_ic_resp {
+	struct spdk_nvme_tcp_common_pdu_hdr	common;
+	uint16_t				pfv;
+	/** Controller PDU data alignment, in dwords, 0's based */
+	uint8_t					cpda;
+	uint8_t					dgst;
+	/** Maximum number of data bytes in one H2C data PDU */
+	uint32_t				maxh2cdata;
+	uint8_t					reserved16[112];
+};
+SPDK_STATIC_ASSERT(sizeof(struct spdk_nvme_tcp_ic_resp) == 128, "Incorrect size");
+
+/** H2CTermReq and C2HTermReq */
+struct spdk_nvme_tcp_term_req_hdr {
+	struct spdk_nvme_tcp_common_pdu_hdr	common;
+	/** Fatal error status (\ref spdk_nvme_tcp_term_req_fes) */
+	uint16_t				fes;
+	uint32_t				fei;
+	uint8_t					reserved14[10];
+};
+SPDK_STATIC_ASSERT(sizeof(struct spdk_nvme_tcp_term_req_hdr) == 24, "Incorrect size");
+
+enum spdk_nvme_tcp_term_req_fes {
+	SPDK_NVME_TCP_TERM_REQ_FES_INVALID_HEADER_FIELD		= 0x01,
+	SPDK_NVME_TCP_TERM_REQ_FES_PDU_SEQUENCE_ERROR		= 0x02,
+	SPDK_NVME_TCP_TERM_REQ_FES_HDGST_ERROR			= 0x03,
+	SPDK_NVME_TCP_TERM_REQ_FES_DATA_TRANSFER_OUT_OF_RANGE	= 0x04,
+	SPDK_NVME_TCP_TERM_REQ_FES_DATA_TRANSFER_LIMIT_EXCEEDED	= 0x05,
+	SPDK_NVME_TCP_TERM_REQ_FES_R2T_LIMIT_EXCEEDED		= 0x05,
+	SPDK_NVME_TCP_TERM_REQ_FES_INVALID_DATA_UNSUPPORTED_PARAMETER	= 0x06,
+};
+
+/** CapsuleCmd */
+struct spdk_nvme_tcp_cmd {
+	struct spdk_nvme_tcp_common_pdu_hdr	common;
+	struct spdk_nvme_cmd			ccsqe;
+	/* in-capsule data follows at common.pdo */
+};
+SPDK_STATIC_ASSERT(sizeof(struct spdk_nvme_tcp_cmd) == 72, "Incorrect size");
+
+/** CapsuleResp */
+struct spdk_nvme_tcp_rsp {
+	struct spdk_nvme_tcp_common_pdu_hdr	common;
+	struct spdk_nvme_cpl			rccqe;
+};
+SPDK_STATIC_ASSERT(sizeof(struct spdk_nvme_tcp_rsp) == 24, "Incorrect size");
+
+/** H2CData */
+struct spdk_nvme_tcp_h2c_data_hdr {
+	struct spdk_nvme_tcp_common_pdu_hdr	common;
+	uint16_t				cccid;
+	uint16_t				ttag;
+	uint32_t				datao;
+	uint32_t				datal;
+	uint8_t					reserved20[4];
+};
+SPDK_STATIC_ASSERT(sizeof(struct spdk_nvme_tcp_h2c_data_hdr) == 24, "Incorrect size");
+
+/** C2HData */
+struct spdk_nvme_tcp_c2h_data_hdr {
+	struct spdk_nvme_tcp_common_pdu_hdr	common;
+	uint16_t				cccid;
+	uint8_t					reserved10[2];
+	uint32_t				datao;
+	uint32_t				datal;
+	uint8_t					reserved20[4];
+};
+SPDK_STATIC_ASSERT(sizeof(struct spdk_nvme_tcp_c2h_data_hdr) == 24, "Incorrect size");
+
+/** R2T */
+struct spdk_nvme_tcp_r2t_hdr {
+	struct spdk_nvme_tcp_common_pdu_hdr	common;
+	uint16_t				cccid;
+	uint16_t				ttag;
+	uint32_t				r2to;
+	uint32_t				r2tl;
+	uint8_t					reserved20[4];
+};
+SPDK_STATIC_ASSERT(sizeof(struct spdk_nvme_tcp_r2t_hdr) == 24, "Incorrect size");
+
 #pragma pack(pop)
 
 #endif /* __NVMF_SPEC_H__ */
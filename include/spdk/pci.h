@@ -61,6 +61,11 @@ uint16_t spdk_pci_device_get_subdevice_id(struct spdk_pci_device *dev);
 uint32_t spdk_pci_device_get_class(struct spdk_pci_device *dev);
 const char *spdk_pci_device_get_device_name(struct spdk_pci_device *dev);
 
+/**
+ * Get the NUMA socket the device is attached to, or -1 if it is not known.
+ */
+int spdk_pci_device_get_socket_id(struct spdk_pci_device *dev);
+
 int spdk_pci_device_cfg_read8(struct spdk_pci_device *dev, uint8_t *value, uint32_t offset);
 int spdk_pci_device_cfg_write8(struct spdk_pci_device *dev, uint8_t value, uint32_t offset);
 int spdk_pci_device_cfg_read16(struct spdk_pci_device *dev, uint16_t *value, uint32_t offset);
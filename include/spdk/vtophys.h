@@ -42,12 +42,44 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
 #include <stdint.h>
 
 #define SPDK_VTOPHYS_ERROR	(0xFFFFFFFFFFFFFFFFULL)
 
+/** Granularity of memory regions accepted by spdk_mem_register(). */
+#define SPDK_MEM_REGISTER_ALIGN	(0x200000ULL)
+
 uint64_t spdk_vtophys(void *buf);
 
+/**
+ * \brief Register a memory region allocated outside of DPDK for address translation.
+ *
+ * \param vaddr Virtual address of the start of the region.  Must be 2MB aligned.
+ * \param len Length of the region in bytes.  Must be a multiple of 2MB.
+ *
+ * The region must be backed by huge pages (2MB or larger) so that each 2MB
+ * chunk is physically contiguous.  The region is locked into memory and
+ * its physical addresses are added to the spdk_vtophys() translation map, so
+ * buffers inside it may be passed directly to the NVMe, ioat and NVMf
+ * drivers.
+ *
+ * \return 0 on success or a negated errno value on failure.
+ */
+int spdk_mem_register(void *vaddr, size_t len);
+
+/**
+ * \brief Remove a memory region previously added with spdk_mem_register().
+ *
+ * \param vaddr Virtual address passed to spdk_mem_register().
+ * \param len Length passed to spdk_mem_register().
+ *
+ * The caller must ensure that no I/O referencing the region is outstanding.
+ *
+ * \return 0 on success or a negated errno value on failure.
+ */
+int spdk_mem_unregister(void *vaddr, size_t len);
+
 #ifdef __cplusplus
 }
 #endif
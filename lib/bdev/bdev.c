@@ -40,6 +40,7 @@
 #include <unistd.h>
 
 #include <rte_config.h>
+#include <rte_atomic.h>
 #include <rte_malloc.h>
 #include <rte_ring.h>
 #include <rte_mempool.h>
@@ -369,15 +370,24 @@ spdk_bdev_io_free_request(struct spdk_bdev_io *bdev_io)
 	spdk_bdev_put_io(bdev_io);
 }
 
-static void
-__submit_request(spdk_event_t event)
+static bool
+spdk_bdev_lcore_is_remote(struct spdk_bdev *bdev, uint32_t lcore)
 {
-	struct spdk_bdev *bdev = spdk_event_get_arg1(event);
-	struct spdk_bdev_io *bdev_io = spdk_event_get_arg2(event);
-
-	bdev_io->cb_event = spdk_event_get_next(event);
+	return bdev->socket_id >= 0 &&
+	       rte_lcore_to_socket_id(lcore) != (unsigned)bdev->socket_id;
+}
 
+static void
+spdk_bdev_dispatch(struct spdk_bdev *bdev, struct spdk_bdev_io *bdev_io)
+{
 	if (bdev_io->status == SPDK_BDEV_IO_STATUS_PENDING) {
+		/* Counted here, on the poller's core, so no locking is needed. */
+		bdev->num_io++;
+		if (spdk_bdev_lcore_is_remote(bdev, rte_lcore_id()) ||
+		    spdk_bdev_lcore_is_remote(bdev, bdev_io->cb_event->lcore)) {
+			bdev->num_remote_io++;
+		}
+
 		if (bdev_io->type == SPDK_BDEV_IO_TYPE_RESET) {
 			spdk_bdev_cleanup_pending_rbuf_io(bdev);
 		}
@@ -387,6 +397,16 @@ __submit_request(spdk_event_t event)
 	}
 }
 
+static void
+__submit_request(spdk_event_t event)
+{
+	struct spdk_bdev *bdev = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *bdev_io = spdk_event_get_arg2(event);
+
+	bdev_io->cb_event = spdk_event_get_next(event);
+	spdk_bdev_dispatch(bdev, bdev_io);
+}
+
 void
 spdk_bdev_do_work(void *ctx)
 {
@@ -395,6 +415,46 @@ spdk_bdev_do_work(void *ctx)
 	bdev->fn_table->check_io(bdev->ctxt);
 }
 
+/*
+ * Pick the core for a blockdev's poller: the submitting core if it is on
+ *  the blockdev's socket, otherwise the core of that socket running the
+ *  fewest blockdev pollers.  Falls back to the submitting core when the
+ *  core mask has nothing on the blockdev's socket.  First I/Os to different
+ *  blockdevs can arrive on several cores at once, so the counts are atomic.
+ *  Two cores may still pick the same least-loaded core, which only costs
+ *  balance.
+ */
+static uint32_t
+spdk_bdev_choose_lcore(struct spdk_bdev *bdev)
+{
+	static rte_atomic32_t pollers_per_lcore[RTE_MAX_LCORE];
+	uint64_t core_mask = spdk_app_get_core_mask();
+	uint32_t lcore = rte_lcore_id();
+	uint32_t i;
+
+	if (spdk_bdev_lcore_is_remote(bdev, lcore)) {
+		for (i = 0; i < RTE_MAX_LCORE && i < 64; i++) {
+			if (!(core_mask & (1ULL << i)) || spdk_bdev_lcore_is_remote(bdev, i)) {
+				continue;
+			}
+			if (!spdk_bdev_lcore_is_remote(bdev, lcore) &&
+			    rte_atomic32_read(&pollers_per_lcore[i]) >=
+			    rte_atomic32_read(&pollers_per_lcore[lcore])) {
+				continue;
+			}
+			lcore = i;
+		}
+
+		if (spdk_bdev_lcore_is_remote(bdev, lcore)) {
+			SPDK_WARNLOG("No core on socket %d for %s; its I/O will cross sockets\n",
+				     bdev->socket_id, bdev->name);
+		}
+	}
+
+	rte_atomic32_inc(&pollers_per_lcore[lcore]);
+	return lcore;
+}
+
 int
 spdk_bdev_io_submit(struct spdk_bdev_io *bdev_io)
 {
@@ -406,7 +466,7 @@ spdk_bdev_io_submit(struct spdk_bdev_io *bdev_io)
 	if (!bdev->is_running) {
 		bdev->is_running = true;
 		if (lcore == 0) {
-			lcore = rte_lcore_id();
+			lcore = spdk_bdev_choose_lcore(bdev);
 		}
 		spdk_poller_register(&bdev->poller, lcore, NULL);
 	}
@@ -425,6 +485,125 @@ spdk_bdev_io_submit(struct spdk_bdev_io *bdev_io)
 	return 0;
 }
 
+static int
+spdk_bdev_io_get_range(struct spdk_bdev_io *bdev_io, uint64_t *offset, uint64_t *length)
+{
+	switch (bdev_io->type) {
+	case SPDK_BDEV_IO_TYPE_READ:
+		*offset = bdev_io->u.read.offset;
+		*length = bdev_io->u.read.nbytes;
+		return 0;
+	case SPDK_BDEV_IO_TYPE_WRITE:
+		*offset = bdev_io->u.write.offset;
+		*length = bdev_io->u.write.len;
+		return 0;
+	case SPDK_BDEV_IO_TYPE_FLUSH:
+		*offset = bdev_io->u.flush.offset;
+		*length = bdev_io->u.flush.length;
+		return 0;
+	case SPDK_BDEV_IO_TYPE_LEASE:
+		*offset = bdev_io->u.lease.offset;
+		*length = bdev_io->u.lease.nbytes;
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+static void
+spdk_bdev_io_set_range(struct spdk_bdev_io *bdev_io, uint64_t offset, uint64_t length)
+{
+	switch (bdev_io->type) {
+	case SPDK_BDEV_IO_TYPE_READ:
+		bdev_io->u.read.offset = offset;
+		bdev_io->u.read.nbytes = length;
+		break;
+	case SPDK_BDEV_IO_TYPE_WRITE:
+		bdev_io->u.write.offset = offset;
+		bdev_io->u.write.len = length;
+		break;
+	case SPDK_BDEV_IO_TYPE_FLUSH:
+		bdev_io->u.flush.offset = offset;
+		bdev_io->u.flush.length = length;
+		break;
+	case SPDK_BDEV_IO_TYPE_LEASE:
+		bdev_io->u.lease.offset = offset;
+		bdev_io->u.lease.nbytes = length;
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Swap a resubmitted I/O between the view of the blockdev that owns it and
+ *  the view of the caller that submitted it.
+ */
+static void
+spdk_bdev_io_swap_view(struct spdk_bdev_io *bdev_io)
+{
+	struct spdk_bdev *bdev = bdev_io->bdev;
+	void *ctx = bdev_io->ctx;
+	uint64_t offset, length;
+
+	spdk_bdev_io_get_range(bdev_io, &offset, &length);
+	spdk_bdev_io_set_range(bdev_io, bdev_io->resubmit.offset, bdev_io->resubmit.length);
+	bdev_io->bdev = bdev_io->resubmit.bdev;
+	bdev_io->ctx = bdev_io->resubmit.ctx;
+
+	bdev_io->resubmit.bdev = bdev;
+	bdev_io->resubmit.ctx = ctx;
+	bdev_io->resubmit.offset = offset;
+	bdev_io->resubmit.length = length;
+}
+
+int
+spdk_bdev_io_resubmit(struct spdk_bdev_io *bdev_io, struct spdk_bdev *bdev,
+		      uint64_t offset, uint64_t length)
+{
+	struct spdk_event *event;
+	uint32_t lcore;
+
+	/* Keep the caller's view; a blockdev stacked lower down keeps the same one. */
+	if (bdev_io->resubmit.bdev == NULL) {
+		if (spdk_bdev_io_get_range(bdev_io, &bdev_io->resubmit.offset,
+					   &bdev_io->resubmit.length) < 0) {
+			return -1;
+		}
+		bdev_io->resubmit.bdev = bdev_io->bdev;
+		bdev_io->resubmit.ctx = bdev_io->ctx;
+	}
+
+	spdk_bdev_io_set_range(bdev_io, offset, length);
+	bdev_io->bdev = bdev;
+	bdev_io->ctx = bdev->ctxt;
+	bdev_io->gencnt = bdev->gencnt;
+
+	/*
+	 * A blockdev first reached this way runs its poller on this core, so
+	 *  the blockdev above it usually hands its I/O over with a plain call.
+	 */
+	if (!bdev->is_running) {
+		bdev->is_running = true;
+		if (bdev->poller.lcore == 0) {
+			bdev->poller.lcore = rte_lcore_id();
+		}
+		spdk_poller_register(&bdev->poller, bdev->poller.lcore, NULL);
+	}
+
+	lcore = bdev->poller.lcore;
+	if (lcore == rte_lcore_id()) {
+		spdk_bdev_dispatch(bdev, bdev_io);
+		return 0;
+	}
+
+	event = spdk_event_allocate(lcore, __submit_request, bdev, bdev_io, bdev_io->cb_event);
+	RTE_VERIFY(event != NULL);
+	spdk_event_call(event);
+
+	return 0;
+}
+
 static void
 spdk_bdev_io_init(struct spdk_bdev_io *bdev_io,
 		  struct spdk_bdev *bdev, void *cb_arg,
@@ -437,6 +616,7 @@ spdk_bdev_io_init(struct spdk_bdev_io *bdev_io,
 	bdev_io->gencnt = bdev->gencnt;
 	bdev_io->status = SPDK_BDEV_IO_STATUS_PENDING;
 	bdev_io->children = 0;
+	bdev_io->resubmit.bdev = NULL;
 	TAILQ_INIT(&bdev_io->child_io);
 }
 
@@ -671,6 +851,56 @@ spdk_bdev_flush(struct spdk_bdev *bdev,
 	return bdev_io;
 }
 
+struct spdk_bdev_io *
+spdk_bdev_lease(struct spdk_bdev *bdev,
+		uint64_t nbytes, uint64_t offset, bool write,
+		spdk_bdev_io_completion_cb cb, void *cb_arg)
+{
+	struct spdk_bdev_io *bdev_io;
+	int rc;
+
+	if (!bdev->lease_supported) {
+		return NULL;
+	}
+
+	/* Return failure if nbytes is not a multiple of bdev->blocklen */
+	if (nbytes % bdev->blocklen) {
+		return NULL;
+	}
+
+	/* Return failure if offset + nbytes is less than offset; indicates there
+	 * has been an overflow and hence the offset has been wrapped around */
+	if ((offset + nbytes) < offset) {
+		return NULL;
+	}
+
+	/* Return failure if offset + nbytes exceeds the size of the blockdev */
+	if ((offset + nbytes) > (bdev->blockcnt * bdev->blocklen)) {
+		return NULL;
+	}
+
+	bdev_io = spdk_bdev_get_io();
+	if (!bdev_io) {
+		SPDK_ERRLOG("bdev_io memory allocation failed duing lease\n");
+		return NULL;
+	}
+
+	bdev_io->type = SPDK_BDEV_IO_TYPE_LEASE;
+	bdev_io->u.lease.buf = NULL;
+	bdev_io->u.lease.nbytes = nbytes;
+	bdev_io->u.lease.offset = offset;
+	bdev_io->u.lease.write = write;
+	spdk_bdev_io_init(bdev_io, bdev, cb_arg, cb);
+
+	rc = spdk_bdev_io_submit(bdev_io);
+	if (rc < 0) {
+		spdk_bdev_put_io(bdev_io);
+		return NULL;
+	}
+
+	return bdev_io;
+}
+
 int
 spdk_bdev_reset(struct spdk_bdev *bdev, int reset_type,
 		spdk_bdev_io_completion_cb cb, void *cb_arg)
@@ -712,6 +942,11 @@ spdk_bdev_free_io(struct spdk_bdev_io *bdev_io)
 		return -1;
 	}
 
+	/* A resubmitted I/O is freed by the blockdev that completed it. */
+	if (bdev_io->resubmit.bdev != NULL) {
+		spdk_bdev_io_swap_view(bdev_io);
+	}
+
 	rc = spdk_bdev_io_submit(bdev_io);
 	if (rc < 0) {
 		spdk_bdev_put_io(bdev_io);
@@ -721,6 +956,21 @@ spdk_bdev_free_io(struct spdk_bdev_io *bdev_io)
 	return rc;
 }
 
+int
+spdk_bdev_lease_release(struct spdk_bdev_io *bdev_io)
+{
+	if (!bdev_io || bdev_io->type != SPDK_BDEV_IO_TYPE_LEASE) {
+		SPDK_ERRLOG("bdev_io is not a lease\n");
+		return -1;
+	}
+
+	/*
+	 * Releasing a lease is freeing its bdev_io: the backend sees it in
+	 *  free_request on its own core and can unpin or commit the range there.
+	 */
+	return spdk_bdev_free_io(bdev_io);
+}
+
 void
 spdk_bdev_io_complete(struct spdk_bdev_io *bdev_io, enum spdk_bdev_io_status status)
 {
@@ -747,6 +997,10 @@ spdk_bdev_io_complete(struct spdk_bdev_io *bdev_io, enum spdk_bdev_io_status sta
 
 	bdev_io->status = status;
 
+	if (bdev_io->resubmit.bdev != NULL) {
+		spdk_bdev_io_swap_view(bdev_io);
+	}
+
 	RTE_VERIFY(bdev_io->cb_event != NULL);
 	spdk_event_call(bdev_io->cb_event);
 }
@@ -757,6 +1011,8 @@ spdk_bdev_register(struct spdk_bdev *bdev)
 	/* initialize the reset generation value to zero */
 	bdev->gencnt = 0;
 	bdev->is_running = false;
+	bdev->num_io = 0;
+	bdev->num_remote_io = 0;
 	bdev->poller.fn = spdk_bdev_do_work;
 	bdev->poller.arg = bdev;
 
@@ -0,0 +1,924 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * DRAM read cache in front of another blockdev.
+ *
+ * Each cache blockdev owns a set of fixed-size lines in hugepage memory on
+ *  the base blockdev's socket, indexed by a hash of the line number and
+ *  replaced with the CLOCK algorithm.  All of its I/O, and the completions
+ *  of the child I/O and copies it starts, run on the blockdev's poller
+ *  core, so the cache is a per-core shard and needs no locks.
+ *
+ * Reads that hit are copied out of the cache with the copy engine or, when
+ *  the caller lets the blockdev provide the buffer, returned as a pointer
+ *  into the cache.  Reads that miss go to the base blockdev.  The lines
+ *  they cover completely are filled from their data, at the cost of a copy
+ *  on the poller core; only the partly covered lines at either end are
+ *  read again from the base blockdev, in the background.  Writes and
+ *  unmaps go to the base blockdev and drop the lines they cover when they
+ *  complete.  Only soft resets are passed on: a hard reset would silently
+ *  drop the fills in flight, leaving their lines pinned and filling for
+ *  good.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <endian.h>
+
+#include <rte_config.h>
+#include <rte_malloc.h>
+
+#include "blockdev_cache.h"
+#include "spdk/bdev.h"
+#include "spdk/bdev_db.h"
+#include "spdk/conf.h"
+#include "spdk/copy_engine.h"
+#include "spdk/log.h"
+#include "spdk/queue.h"
+#include "spdk/scsi_spec.h"
+
+#define CACHE_DEFAULT_LINE_SIZE_KB	64
+
+/* Largest read, in lines, that can be served from the cache */
+#define CACHE_MAX_IO_LINES		32
+
+/* Fills allowed in flight per cache blockdev */
+#define CACHE_MAX_FILLS			64
+
+#define CACHE_NONE			UINT32_MAX
+
+enum cache_line_state {
+	CACHE_LINE_FREE = 0,
+	CACHE_LINE_FILLING,
+	CACHE_LINE_VALID,
+};
+
+struct cache_line {
+	/* Line number on the base blockdev */
+	uint64_t		tag;
+
+	/* Next line in the same hash bucket */
+	uint32_t		hash_next;
+
+	/*
+	 * Reads and fills using the line's buffer.  A pinned line is not
+	 *  reused, even after it has been invalidated.
+	 */
+	uint32_t		pins;
+
+	uint8_t			state;
+
+	/* CLOCK reference bit, set by every hit */
+	bool			referenced;
+};
+
+struct cache_disk {
+	struct spdk_bdev	disk;	/* this must be the first element */
+	struct spdk_bdev	*base;
+
+	/* log2 of the line size in bytes */
+	uint32_t		line_shift;
+	uint32_t		num_lines;
+	struct cache_line	*lines;
+	uint8_t			*buf;
+
+	uint32_t		*buckets;
+	uint32_t		bucket_shift;
+
+	/* CLOCK hand */
+	uint32_t		hand;
+
+	uint32_t		fills_outstanding;
+	struct cache_disk_stats	stats;
+	TAILQ_ENTRY(cache_disk)	tailq;
+};
+
+struct cache_io {
+	/* Lines pinned by a read hit, released when the I/O is freed */
+	int			num_pins;
+	uint32_t		pins[CACHE_MAX_IO_LINES];
+
+	/* Lines a read miss fills from its own data when it completes */
+	int			num_fills;
+	uint32_t		fills[CACHE_MAX_IO_LINES];
+
+	/* This must be the last element; the copy engine's context follows it. */
+	struct copy_task	copy;
+};
+
+static TAILQ_HEAD(, cache_disk) g_cache_disks = TAILQ_HEAD_INITIALIZER(g_cache_disks);
+
+static int blockdev_cache_initialize(void);
+static void blockdev_cache_finish(void);
+static void blockdev_cache_get_spdk_running_config(FILE *fp);
+
+static int
+blockdev_cache_get_ctx_size(void)
+{
+	return sizeof(struct cache_io) + spdk_copy_module_get_max_ctx_size();
+}
+
+SPDK_VBDEV_MODULE_REGISTER(blockdev_cache_initialize, blockdev_cache_finish,
+			   blockdev_cache_get_spdk_running_config, blockdev_cache_get_ctx_size)
+
+static inline uint8_t *
+cache_line_buf(struct cache_disk *cdisk, uint32_t idx)
+{
+	return cdisk->buf + ((uint64_t)idx << cdisk->line_shift);
+}
+
+static inline uint32_t
+cache_bucket(struct cache_disk *cdisk, uint64_t tag)
+{
+	return (tag * 0x9E3779B97F4A7C15ULL) >> (64 - cdisk->bucket_shift);
+}
+
+static uint32_t
+cache_lookup(struct cache_disk *cdisk, uint64_t tag)
+{
+	uint32_t idx;
+
+	for (idx = cdisk->buckets[cache_bucket(cdisk, tag)]; idx != CACHE_NONE;
+	     idx = cdisk->lines[idx].hash_next) {
+		if (cdisk->lines[idx].tag == tag) {
+			return idx;
+		}
+	}
+
+	return CACHE_NONE;
+}
+
+static void
+cache_hash_insert(struct cache_disk *cdisk, uint32_t idx)
+{
+	uint32_t *head = &cdisk->buckets[cache_bucket(cdisk, cdisk->lines[idx].tag)];
+
+	cdisk->lines[idx].hash_next = *head;
+	*head = idx;
+}
+
+static void
+cache_hash_remove(struct cache_disk *cdisk, uint32_t idx)
+{
+	uint32_t *prev = &cdisk->buckets[cache_bucket(cdisk, cdisk->lines[idx].tag)];
+
+	while (*prev != idx) {
+		prev = &cdisk->lines[*prev].hash_next;
+	}
+	*prev = cdisk->lines[idx].hash_next;
+}
+
+/*
+ * Drop a line from the index.  If a read or fill still holds a pin, the
+ *  buffer is only reused once that pin is released.
+ */
+static void
+cache_line_drop(struct cache_disk *cdisk, uint32_t idx)
+{
+	cache_hash_remove(cdisk, idx);
+	cdisk->lines[idx].state = CACHE_LINE_FREE;
+}
+
+/*
+ * Find a line to fill, sweeping the CLOCK hand past pinned lines and giving
+ *  lines that were hit since the last sweep a second chance.  New lines
+ *  start with the reference bit clear, so data read only once is the first
+ *  to go.
+ */
+static uint32_t
+cache_alloc_line(struct cache_disk *cdisk)
+{
+	struct cache_line *line;
+	uint32_t idx, scanned;
+
+	for (scanned = 0; scanned < 2 * cdisk->num_lines; scanned++) {
+		idx = cdisk->hand;
+		if (++cdisk->hand == cdisk->num_lines) {
+			cdisk->hand = 0;
+		}
+
+		line = &cdisk->lines[idx];
+		if (line->pins != 0) {
+			continue;
+		}
+		if (line->state == CACHE_LINE_FREE) {
+			return idx;
+		}
+		if (line->referenced) {
+			line->referenced = false;
+			continue;
+		}
+
+		cache_line_drop(cdisk, idx);
+		cdisk->stats.evictions++;
+		return idx;
+	}
+
+	return CACHE_NONE;
+}
+
+static void
+cache_invalidate(struct cache_disk *cdisk, uint64_t offset, uint64_t nbytes)
+{
+	uint64_t first, last, tag;
+	uint32_t idx;
+
+	if (nbytes == 0) {
+		return;
+	}
+
+	first = offset >> cdisk->line_shift;
+	last = (offset + nbytes - 1) >> cdisk->line_shift;
+
+	if (last - first >= cdisk->num_lines) {
+		/* Cheaper to walk the lines than the range. */
+		for (idx = 0; idx < cdisk->num_lines; idx++) {
+			if (cdisk->lines[idx].state != CACHE_LINE_FREE &&
+			    cdisk->lines[idx].tag >= first && cdisk->lines[idx].tag <= last) {
+				cache_line_drop(cdisk, idx);
+				cdisk->stats.invalidations++;
+			}
+		}
+		return;
+	}
+
+	for (tag = first; tag <= last; tag++) {
+		idx = cache_lookup(cdisk, tag);
+		if (idx != CACHE_NONE) {
+			cache_line_drop(cdisk, idx);
+			cdisk->stats.invalidations++;
+		}
+	}
+}
+
+static void
+blockdev_cache_fill_done(spdk_event_t event)
+{
+	struct cache_disk *cdisk = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *bdev_io = spdk_event_get_arg2(event);
+	uint32_t idx = ((uint8_t *)bdev_io->u.read.buf - cdisk->buf) >> cdisk->line_shift;
+	struct cache_line *line = &cdisk->lines[idx];
+
+	cdisk->fills_outstanding--;
+	line->pins--;
+
+	/* A write may have invalidated the line while it was being filled. */
+	if (line->state == CACHE_LINE_FILLING) {
+		if (bdev_io->status == SPDK_BDEV_IO_STATUS_SUCCESS) {
+			line->state = CACHE_LINE_VALID;
+		} else {
+			cache_line_drop(cdisk, idx);
+			cdisk->stats.fill_errors++;
+		}
+	}
+
+	spdk_bdev_free_io(bdev_io);
+}
+
+/*
+ * Start reading the missing lines between first and last from the base
+ *  blockdev.  This does not hold up the read that missed.  A partial line
+ *  at the end of the blockdev is never cached.
+ */
+static void
+cache_fill(struct cache_disk *cdisk, uint64_t first, uint64_t last)
+{
+	uint64_t line_size = 1ULL << cdisk->line_shift;
+	uint64_t disk_size = cdisk->disk.blockcnt * cdisk->disk.blocklen;
+	struct cache_line *line;
+	uint64_t tag;
+	uint32_t idx;
+
+	for (tag = first; tag <= last; tag++) {
+		if ((tag + 1) * line_size > disk_size) {
+			break;
+		}
+		if (cache_lookup(cdisk, tag) != CACHE_NONE) {
+			continue;
+		}
+
+		if (cdisk->fills_outstanding == CACHE_MAX_FILLS) {
+			cdisk->stats.fills_skipped++;
+			continue;
+		}
+		idx = cache_alloc_line(cdisk);
+		if (idx == CACHE_NONE) {
+			cdisk->stats.fills_skipped++;
+			continue;
+		}
+
+		line = &cdisk->lines[idx];
+		line->tag = tag;
+		line->state = CACHE_LINE_FILLING;
+		line->referenced = false;
+		line->pins = 1;
+		cache_hash_insert(cdisk, idx);
+
+		if (spdk_bdev_read(cdisk->base, cache_line_buf(cdisk, idx), line_size,
+				   tag * line_size, blockdev_cache_fill_done, cdisk) == NULL) {
+			line->pins = 0;
+			cache_line_drop(cdisk, idx);
+			cdisk->stats.fills_skipped++;
+			break;
+		}
+
+		cdisk->fills_outstanding++;
+		cdisk->stats.fills++;
+	}
+}
+
+/*
+ * Claim the missing lines that a read from the base blockdev covers
+ *  completely, so that they are filled from its data instead of being read
+ *  a second time.
+ */
+static void
+cache_claim_read_lines(struct cache_disk *cdisk, struct cache_io *cio, uint64_t offset,
+		       uint64_t nbytes)
+{
+	uint64_t line_size = 1ULL << cdisk->line_shift;
+	uint64_t tag, end = (offset + nbytes) >> cdisk->line_shift;
+	struct cache_line *line;
+	uint32_t idx;
+
+	for (tag = (offset + line_size - 1) >> cdisk->line_shift; tag < end; tag++) {
+		if (cache_lookup(cdisk, tag) != CACHE_NONE) {
+			continue;
+		}
+
+		if (cio->num_fills == CACHE_MAX_IO_LINES) {
+			cdisk->stats.fills_skipped++;
+			continue;
+		}
+		idx = cache_alloc_line(cdisk);
+		if (idx == CACHE_NONE) {
+			cdisk->stats.fills_skipped++;
+			continue;
+		}
+
+		line = &cdisk->lines[idx];
+		line->tag = tag;
+		line->state = CACHE_LINE_FILLING;
+		line->referenced = false;
+		line->pins = 1;
+		cache_hash_insert(cdisk, idx);
+		cio->fills[cio->num_fills++] = idx;
+	}
+}
+
+/*
+ * Copy the claimed lines out of a completed read miss, or drop them if it
+ *  failed or never reached the base blockdev.
+ */
+static void
+cache_fill_from_read(struct cache_disk *cdisk, struct spdk_bdev_io *bdev_io,
+		     enum spdk_bdev_io_status status)
+{
+	struct cache_io *cio = (struct cache_io *)bdev_io->driver_ctx;
+	uint8_t *buf = bdev_io->u.read.buf;
+	struct cache_line *line;
+	int i;
+
+	for (i = 0; i < cio->num_fills; i++) {
+		line = &cdisk->lines[cio->fills[i]];
+		line->pins--;
+
+		/* A write may have invalidated the line while the read was in flight. */
+		if (line->state != CACHE_LINE_FILLING) {
+			continue;
+		}
+		if (status == SPDK_BDEV_IO_STATUS_SUCCESS) {
+			memcpy(cache_line_buf(cdisk, cio->fills[i]),
+			       buf + (line->tag << cdisk->line_shift) - bdev_io->u.read.offset,
+			       1ULL << cdisk->line_shift);
+			line->state = CACHE_LINE_VALID;
+			cdisk->stats.read_fills++;
+		} else {
+			cache_line_drop(cdisk, cio->fills[i]);
+			cdisk->stats.fill_errors++;
+		}
+	}
+	cio->num_fills = 0;
+}
+
+static void
+blockdev_cache_child_done(spdk_event_t event)
+{
+	struct spdk_bdev_io *parent = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *child = spdk_event_get_arg2(event);
+	struct cache_disk *cdisk = parent->ctx;
+	struct spdk_scsi_unmap_bdesc *desc;
+	enum spdk_bdev_io_status status = child->status;
+	int i;
+
+	/*
+	 * Dropping the lines only now, after the base blockdev has the new
+	 *  data, also catches fills that were started while it was in flight.
+	 */
+	switch (parent->type) {
+	case SPDK_BDEV_IO_TYPE_READ:
+		cache_fill_from_read(cdisk, parent, status);
+		break;
+	case SPDK_BDEV_IO_TYPE_WRITE:
+		cache_invalidate(cdisk, parent->u.write.offset, parent->u.write.len);
+		break;
+	case SPDK_BDEV_IO_TYPE_UNMAP:
+		desc = parent->u.unmap.unmap_bdesc;
+		for (i = 0; i < parent->u.unmap.bdesc_count; i++) {
+			cache_invalidate(cdisk, be64toh(desc[i].lba) * cdisk->disk.blocklen,
+					 (uint64_t)be32toh(desc[i].block_count) * cdisk->disk.blocklen);
+		}
+		break;
+	default:
+		break;
+	}
+
+	TAILQ_REMOVE(&parent->child_io, child, link);
+	parent->children--;
+	spdk_bdev_free_io(child);
+
+	spdk_bdev_io_complete(parent, status);
+}
+
+/* Pass an I/O through to the base blockdev unchanged. */
+static int
+blockdev_cache_submit_base(struct spdk_bdev_io *bdev_io)
+{
+	struct cache_disk *cdisk = bdev_io->ctx;
+	struct spdk_bdev_io *child;
+
+	child = spdk_bdev_get_child_io(bdev_io, cdisk->base, blockdev_cache_child_done, bdev_io);
+	if (child == NULL) {
+		return -1;
+	}
+
+	spdk_bdev_io_submit(child);
+	return 0;
+}
+
+static void
+blockdev_cache_read_base(struct spdk_bdev_io *bdev_io)
+{
+	if (blockdev_cache_submit_base(bdev_io) < 0) {
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+	}
+}
+
+static void
+blockdev_cache_copy_done(void *ref, int status)
+{
+	struct cache_io *cio = (struct cache_io *)((uint8_t *)ref - offsetof(struct cache_io, copy));
+
+	spdk_bdev_io_complete(spdk_bdev_io_from_ctx(cio),
+			      status == 0 ? SPDK_BDEV_IO_STATUS_SUCCESS : SPDK_BDEV_IO_STATUS_FAILED);
+}
+
+/* Copy a hit out of the pinned lines into the caller's buffer. */
+static void
+blockdev_cache_copy_hit(struct spdk_bdev_io *bdev_io)
+{
+	struct cache_disk *cdisk = bdev_io->ctx;
+	struct cache_io *cio = (struct cache_io *)bdev_io->driver_ctx;
+	struct iovec src[CACHE_MAX_IO_LINES], dst;
+	uint64_t line_size = 1ULL << cdisk->line_shift;
+	uint64_t offset = bdev_io->u.read.offset;
+	uint64_t remaining = bdev_io->u.read.nbytes;
+	uint64_t in_line, len;
+	int64_t rc;
+	int i;
+
+	for (i = 0; i < cio->num_pins; i++) {
+		in_line = offset & (line_size - 1);
+		len = line_size - in_line < remaining ? line_size - in_line : remaining;
+		src[i].iov_base = cache_line_buf(cdisk, cio->pins[i]) + in_line;
+		src[i].iov_len = len;
+		offset += len;
+		remaining -= len;
+	}
+
+	if (cio->num_pins == 1) {
+		rc = spdk_copy_submit(&cio->copy, bdev_io->u.read.buf, src[0].iov_base,
+				      src[0].iov_len, blockdev_cache_copy_done);
+	} else {
+		dst.iov_base = bdev_io->u.read.buf;
+		dst.iov_len = bdev_io->u.read.nbytes;
+		rc = spdk_copy_submitv(&cio->copy, &dst, 1, src, cio->num_pins,
+				       blockdev_cache_copy_done);
+	}
+
+	if (rc < 0) {
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+	}
+}
+
+/*
+ * Pin the lines holding [first, last] if every one of them is valid.
+ */
+static bool
+cache_pin_hit(struct cache_disk *cdisk, struct cache_io *cio, uint64_t first, uint64_t last)
+{
+	uint64_t tag;
+	uint32_t idx;
+	int i;
+
+	if (last - first >= CACHE_MAX_IO_LINES) {
+		return false;
+	}
+
+	for (tag = first; tag <= last; tag++) {
+		idx = cache_lookup(cdisk, tag);
+		if (idx == CACHE_NONE || cdisk->lines[idx].state != CACHE_LINE_VALID) {
+			return false;
+		}
+		cio->pins[tag - first] = idx;
+	}
+
+	cio->num_pins = last - first + 1;
+	for (i = 0; i < cio->num_pins; i++) {
+		cdisk->lines[cio->pins[i]].pins++;
+		cdisk->lines[cio->pins[i]].referenced = true;
+	}
+
+	return true;
+}
+
+static void
+blockdev_cache_read(struct spdk_bdev_io *bdev_io)
+{
+	struct cache_disk *cdisk = bdev_io->ctx;
+	struct cache_io *cio = (struct cache_io *)bdev_io->driver_ctx;
+	uint64_t offset = bdev_io->u.read.offset;
+	uint64_t nbytes = bdev_io->u.read.nbytes;
+	uint64_t first, last;
+
+	cdisk->stats.reads++;
+	cdisk->stats.read_bytes += nbytes;
+
+	if (nbytes == 0) {
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_SUCCESS);
+		return;
+	}
+
+	first = offset >> cdisk->line_shift;
+	last = (offset + nbytes - 1) >> cdisk->line_shift;
+
+	if (cache_pin_hit(cdisk, cio, first, last)) {
+		cdisk->stats.read_hits++;
+		cdisk->stats.hit_bytes += nbytes;
+
+		if (bdev_io->u.read.buf == NULL && cio->num_pins == 1) {
+			/*
+			 * The caller asked the blockdev for a buffer, so lend it the
+			 *  cached data itself.  The pin keeps the line in place until
+			 *  the I/O is freed.
+			 */
+			bdev_io->u.read.buf = cache_line_buf(cdisk, cio->pins[0]) +
+					      (offset & ((1ULL << cdisk->line_shift) - 1));
+			cdisk->stats.zcopy_hits++;
+			spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_SUCCESS);
+			return;
+		}
+
+		spdk_bdev_io_get_rbuf(bdev_io, blockdev_cache_copy_hit);
+		return;
+	}
+
+	/* Only the lines the read does not cover completely need a fill of their own. */
+	cache_claim_read_lines(cdisk, cio, offset, nbytes);
+	cache_fill(cdisk, first, first);
+	cache_fill(cdisk, last, last);
+	spdk_bdev_io_get_rbuf(bdev_io, blockdev_cache_read_base);
+}
+
+static void
+blockdev_cache_submit_request(struct spdk_bdev_io *bdev_io)
+{
+	struct cache_io *cio = (struct cache_io *)bdev_io->driver_ctx;
+
+	cio->num_pins = 0;
+	cio->num_fills = 0;
+
+	switch (bdev_io->type) {
+	case SPDK_BDEV_IO_TYPE_READ:
+		blockdev_cache_read(bdev_io);
+		return;
+
+	case SPDK_BDEV_IO_TYPE_RESET:
+		if (bdev_io->u.reset.type != SPDK_BDEV_RESET_SOFT) {
+			SPDK_ERRLOG("%s: only soft resets are supported on a cache blockdev\n",
+				    bdev_io->bdev->name);
+			break;
+		}
+	/* fallthrough */
+	case SPDK_BDEV_IO_TYPE_WRITE:
+	case SPDK_BDEV_IO_TYPE_UNMAP:
+	case SPDK_BDEV_IO_TYPE_FLUSH:
+		if (blockdev_cache_submit_base(bdev_io) == 0) {
+			return;
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+}
+
+static void
+blockdev_cache_free_request(struct spdk_bdev_io *bdev_io)
+{
+	struct cache_disk *cdisk = bdev_io->ctx;
+	struct cache_io *cio = (struct cache_io *)bdev_io->driver_ctx;
+	int i;
+
+	/* Freed on the poller core, like every other use of the lines. */
+	for (i = 0; i < cio->num_pins; i++) {
+		cdisk->lines[cio->pins[i]].pins--;
+	}
+	cio->num_pins = 0;
+
+	/* A read miss that failed before reaching the base still holds its lines. */
+	cache_fill_from_read(cdisk, bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+}
+
+static int
+blockdev_cache_check_io(struct spdk_bdev *bdev)
+{
+	/* Child I/O is polled by the base blockdev's own poller. */
+	return spdk_copy_check_io();
+}
+
+static void
+cache_disk_free(struct cache_disk *cdisk)
+{
+	cdisk->base->claimed = false;
+	rte_free(cdisk->buckets);
+	rte_free(cdisk->lines);
+	rte_free(cdisk->buf);
+	rte_free(cdisk);
+}
+
+static int
+blockdev_cache_destruct(struct spdk_bdev *bdev)
+{
+	struct cache_disk *cdisk = (struct cache_disk *)bdev;
+
+	TAILQ_REMOVE(&g_cache_disks, cdisk, tailq);
+	cache_disk_free(cdisk);
+
+	return 0;
+}
+
+static struct spdk_bdev_fn_table cache_fn_table = {
+	.destruct	= blockdev_cache_destruct,
+	.check_io	= blockdev_cache_check_io,
+	.submit_request	= blockdev_cache_submit_request,
+	.free_request	= blockdev_cache_free_request,
+};
+
+static struct cache_disk *
+create_cache_disk(const char *name, struct spdk_bdev *base, uint64_t size_mb,
+		  uint32_t line_size_kb)
+{
+	struct cache_disk *cdisk;
+	uint64_t line_size = (uint64_t)line_size_kb * 1024;
+	uint64_t num_lines;
+	uint32_t idx;
+
+	if (base->claimed) {
+		SPDK_ERRLOG("%s: %s is already in use\n", name, base->name);
+		return NULL;
+	}
+
+	if (line_size == 0 || (line_size & (line_size - 1)) != 0 ||
+	    line_size < base->blocklen || line_size % base->blocklen != 0) {
+		SPDK_ERRLOG("%s: line size %uKB must be a power of two and a multiple of %s's block size\n",
+			    name, line_size_kb, base->name);
+		return NULL;
+	}
+
+	num_lines = size_mb * 1024 * 1024 / line_size;
+	if (num_lines == 0 || num_lines >= CACHE_NONE) {
+		SPDK_ERRLOG("%s: cache of %" PRIu64 "MB does not hold a usable number of lines\n",
+			    name, size_mb);
+		return NULL;
+	}
+
+	cdisk = rte_zmalloc(NULL, sizeof(*cdisk), 0);
+	if (!cdisk) {
+		SPDK_ERRLOG("rte_zmalloc failed\n");
+		return NULL;
+	}
+
+	cdisk->base = base;
+	cdisk->line_shift = __builtin_ctzll(line_size);
+	cdisk->num_lines = num_lines;
+	/* At least one bucket per line, keeping the chains short. */
+	cdisk->bucket_shift = 64 - __builtin_clzll(num_lines);
+
+	cdisk->lines = rte_zmalloc_socket(NULL, num_lines * sizeof(struct cache_line), 0,
+					  base->socket_id < 0 ? SOCKET_ID_ANY : base->socket_id);
+	cdisk->buckets = rte_malloc_socket(NULL, sizeof(uint32_t) << cdisk->bucket_shift, 0,
+					   base->socket_id < 0 ? SOCKET_ID_ANY : base->socket_id);
+	cdisk->buf = rte_malloc_socket(NULL, num_lines * line_size, 0x1000,
+				       base->socket_id < 0 ? SOCKET_ID_ANY : base->socket_id);
+	if (!cdisk->lines || !cdisk->buckets || !cdisk->buf) {
+		SPDK_ERRLOG("%s: could not allocate %" PRIu64 "MB of cache\n", name, size_mb);
+		rte_free(cdisk->buckets);
+		rte_free(cdisk->lines);
+		rte_free(cdisk->buf);
+		rte_free(cdisk);
+		return NULL;
+	}
+
+	for (idx = 0; idx < (1U << cdisk->bucket_shift); idx++) {
+		cdisk->buckets[idx] = CACHE_NONE;
+	}
+
+	base->claimed = true;
+
+	snprintf(cdisk->disk.name, SPDK_BDEV_MAX_NAME_LENGTH, "%s", name);
+	snprintf(cdisk->disk.product_name, SPDK_BDEV_MAX_PRODUCT_NAME_LENGTH, "Cache disk");
+	cdisk->disk.blocklen = base->blocklen;
+	cdisk->disk.blockcnt = base->blockcnt;
+	cdisk->disk.need_aligned_buffer = base->need_aligned_buffer;
+	cdisk->disk.max_unmap_bdesc_count = base->max_unmap_bdesc_count;
+	cdisk->disk.socket_id = base->socket_id;
+	cdisk->disk.child_bdevs = &cdisk->base;
+	cdisk->disk.num_child_bdevs = 1;
+	cdisk->disk.ctxt = cdisk;
+	cdisk->disk.fn_table = &cache_fn_table;
+
+	spdk_bdev_register(&cdisk->disk);
+	TAILQ_INSERT_TAIL(&g_cache_disks, cdisk, tailq);
+
+	SPDK_NOTICELOG("%s: %" PRIu64 "MB cache in %uKB lines over %s\n",
+		       name, size_mb, line_size_kb, base->name);
+
+	return cdisk;
+}
+
+static int
+blockdev_cache_construct(struct spdk_conf_section *sp)
+{
+	struct spdk_bdev *base;
+	char name[SPDK_BDEV_MAX_NAME_LENGTH];
+	const char *val;
+	int size_mb, line_size_kb;
+
+	val = spdk_conf_section_get_val(sp, "Name");
+	if (val != NULL) {
+		snprintf(name, sizeof(name), "%s", val);
+	} else {
+		snprintf(name, sizeof(name), "Cache%d", sp->num);
+	}
+
+	val = spdk_conf_section_get_val(sp, "Device");
+	if (val == NULL) {
+		SPDK_ERRLOG("%s: Device is required\n", name);
+		return -1;
+	}
+	base = spdk_bdev_db_get_by_name(val);
+	if (base == NULL) {
+		SPDK_ERRLOG("%s: device %s not found\n", name, val);
+		return -1;
+	}
+
+	size_mb = spdk_conf_section_get_intval(sp, "SizeMB");
+	if (size_mb <= 0) {
+		SPDK_ERRLOG("%s: SizeMB is required\n", name);
+		return -1;
+	}
+
+	line_size_kb = spdk_conf_section_get_intval(sp, "LineSizeKB");
+	if (line_size_kb < 0) {
+		line_size_kb = CACHE_DEFAULT_LINE_SIZE_KB;
+	}
+
+	if (create_cache_disk(name, base, size_mb, line_size_kb) == NULL) {
+		return -1;
+	}
+
+	return 0;
+}
+
+static int
+blockdev_cache_initialize(void)
+{
+	struct spdk_conf_section *sp;
+
+	for (sp = spdk_conf_first_section(NULL); sp != NULL; sp = spdk_conf_next_section(sp)) {
+		if (!spdk_conf_section_match_prefix(sp, "Cache")) {
+			continue;
+		}
+		if (blockdev_cache_construct(sp) != 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void
+blockdev_cache_finish(void)
+{
+	struct cache_disk *cdisk;
+
+	while (!TAILQ_EMPTY(&g_cache_disks)) {
+		cdisk = TAILQ_FIRST(&g_cache_disks);
+		TAILQ_REMOVE(&g_cache_disks, cdisk, tailq);
+		cache_disk_free(cdisk);
+	}
+}
+
+static void
+blockdev_cache_get_spdk_running_config(FILE *fp)
+{
+	struct cache_disk *cdisk;
+	int i = 0;
+
+	TAILQ_FOREACH(cdisk, &g_cache_disks, tailq) {
+		fprintf(fp, "\n[Cache%d]\n", i++);
+		fprintf(fp, "  Name %s\n", cdisk->disk.name);
+		fprintf(fp, "  Device %s\n", cdisk->base->name);
+		fprintf(fp, "  SizeMB %" PRIu64 "\n",
+			((uint64_t)cdisk->num_lines << cdisk->line_shift) / (1024 * 1024));
+		fprintf(fp, "  LineSizeKB %u\n", (1U << cdisk->line_shift) / 1024);
+	}
+}
+
+struct cache_disk *
+cache_disk_first(void)
+{
+	return TAILQ_FIRST(&g_cache_disks);
+}
+
+struct cache_disk *
+cache_disk_next(struct cache_disk *cdisk)
+{
+	return TAILQ_NEXT(cdisk, tailq);
+}
+
+const char *
+cache_disk_get_name(struct cache_disk *cdisk)
+{
+	return cdisk->disk.name;
+}
+
+const char *
+cache_disk_get_base_name(struct cache_disk *cdisk)
+{
+	return cdisk->base->name;
+}
+
+uint64_t
+cache_disk_get_size(struct cache_disk *cdisk)
+{
+	return (uint64_t)cdisk->num_lines << cdisk->line_shift;
+}
+
+uint32_t
+cache_disk_get_line_size(struct cache_disk *cdisk)
+{
+	return 1U << cdisk->line_shift;
+}
+
+void
+cache_disk_get_stats(struct cache_disk *cdisk, struct cache_disk_stats *stats)
+{
+	*stats = cdisk->stats;
+}
@@ -0,0 +1,82 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SPDK_BLOCKDEV_CACHE_H
+#define SPDK_BLOCKDEV_CACHE_H
+
+#include <stdint.h>
+
+struct cache_disk;
+
+/*
+ * Counters kept by each cache blockdev.  They are updated without locks on
+ *  the blockdev's poller core, so a reader on another core may see them a
+ *  little out of date.
+ */
+struct cache_disk_stats {
+	/* Reads submitted, and those served entirely from the cache */
+	uint64_t	reads;
+	uint64_t	read_hits;
+
+	/* Hits returned without copying, as a pointer into the cache */
+	uint64_t	zcopy_hits;
+
+	uint64_t	read_bytes;
+	uint64_t	hit_bytes;
+
+	/*
+	 * Lines read from the base blockdev after a miss, and lines copied from
+	 *  the data of a miss that covered them completely
+	 */
+	uint64_t	fills;
+	uint64_t	read_fills;
+	uint64_t	fill_errors;
+
+	/* Fills not started because too many were outstanding or no line was free */
+	uint64_t	fills_skipped;
+
+	uint64_t	evictions;
+
+	/* Lines dropped because a write or unmap covered them */
+	uint64_t	invalidations;
+};
+
+struct cache_disk *cache_disk_first(void);
+struct cache_disk *cache_disk_next(struct cache_disk *cdisk);
+const char *cache_disk_get_name(struct cache_disk *cdisk);
+const char *cache_disk_get_base_name(struct cache_disk *cdisk);
+uint64_t cache_disk_get_size(struct cache_disk *cdisk);
+uint32_t cache_disk_get_line_size(struct cache_disk *cdisk);
+void cache_disk_get_stats(struct cache_disk *cdisk, struct cache_disk_stats *stats);
+
+#endif /* SPDK_BLOCKDEV_CACHE_H */
@@ -0,0 +1,99 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "blockdev_cache.h"
+#include "spdk/rpc.h"
+
+static void
+spdk_rpc_get_cache_stats(struct spdk_jsonrpc_server_conn *conn,
+			 const struct spdk_json_val *params,
+			 const struct spdk_json_val *id)
+{
+	struct spdk_json_write_ctx *w;
+	struct cache_disk_stats stats;
+	struct cache_disk *cdisk;
+
+	if (params != NULL) {
+		spdk_jsonrpc_send_error_response(conn, id, SPDK_JSONRPC_ERROR_INVALID_PARAMS,
+						 "get_cache_stats requires no parameters");
+		return;
+	}
+
+	if (id == NULL) {
+		return;
+	}
+
+	w = spdk_jsonrpc_begin_result(conn, id);
+	spdk_json_write_array_begin(w);
+	for (cdisk = cache_disk_first(); cdisk != NULL; cdisk = cache_disk_next(cdisk)) {
+		cache_disk_get_stats(cdisk, &stats);
+
+		spdk_json_write_object_begin(w);
+		spdk_json_write_name(w, "name");
+		spdk_json_write_string(w, cache_disk_get_name(cdisk));
+		spdk_json_write_name(w, "device");
+		spdk_json_write_string(w, cache_disk_get_base_name(cdisk));
+		spdk_json_write_name(w, "size");
+		spdk_json_write_uint64(w, cache_disk_get_size(cdisk));
+		spdk_json_write_name(w, "line_size");
+		spdk_json_write_uint32(w, cache_disk_get_line_size(cdisk));
+		spdk_json_write_name(w, "reads");
+		spdk_json_write_uint64(w, stats.reads);
+		spdk_json_write_name(w, "read_hits");
+		spdk_json_write_uint64(w, stats.read_hits);
+		spdk_json_write_name(w, "hit_rate_pct");
+		spdk_json_write_uint32(w, stats.reads ? stats.read_hits * 100 / stats.reads : 0);
+		spdk_json_write_name(w, "zcopy_hits");
+		spdk_json_write_uint64(w, stats.zcopy_hits);
+		spdk_json_write_name(w, "read_bytes");
+		spdk_json_write_uint64(w, stats.read_bytes);
+		spdk_json_write_name(w, "hit_bytes");
+		spdk_json_write_uint64(w, stats.hit_bytes);
+		spdk_json_write_name(w, "fills");
+		spdk_json_write_uint64(w, stats.fills);
+		spdk_json_write_name(w, "read_fills");
+		spdk_json_write_uint64(w, stats.read_fills);
+		spdk_json_write_name(w, "fill_errors");
+		spdk_json_write_uint64(w, stats.fill_errors);
+		spdk_json_write_name(w, "fills_skipped");
+		spdk_json_write_uint64(w, stats.fills_skipped);
+		spdk_json_write_name(w, "evictions");
+		spdk_json_write_uint64(w, stats.evictions);
+		spdk_json_write_name(w, "invalidations");
+		spdk_json_write_uint64(w, stats.invalidations);
+		spdk_json_write_object_end(w);
+	}
+	spdk_json_write_array_end(w);
+	spdk_jsonrpc_end_result(conn, w);
+}
+SPDK_RPC_REGISTER("get_cache_stats", spdk_rpc_get_cache_stats)
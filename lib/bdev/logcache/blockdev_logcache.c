@@ -0,0 +1,1086 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Write-back cache that logs writes on a fast blockdev in front of a
+ *  slower one.
+ *
+ * Writes are appended to a circular log that fills the whole cache device
+ *  and are completed as soon as the log write completes.  An in-memory map
+ *  from blocks of the base device to log positions sends reads of dirty
+ *  blocks to the log.  The poller destages the oldest dirty blocks in the
+ *  background, one batch at a time: it reads them from the log, sorts them
+ *  by block address and writes them to the base device in runs, so that
+ *  small random writes reach the base device as large ordered ones.  The
+ *  amount of dirty data is bounded by the size of the log; writes that do
+ *  not fit wait for a destage to free space.
+ *
+ * A flush completes once everything logged before it has been destaged and
+ *  the base device has been flushed.  Flushes waiting on a destage that
+ *  fails complete with an error.  After LOGCACHE_DESTAGE_RETRIES failed
+ *  destages in a row the base device is given up on: the dirty blocks stay
+ *  readable from the log, but writes, unmaps and flushes fail.  The map is
+ *  only kept in memory, so data that has not been destaged does not survive
+ *  a restart.
+ *
+ * A reset is passed on to the base device, and only soft resets are
+ *  accepted: a hard reset would silently drop destage writes in flight,
+ *  and the destage would never finish.
+ *
+ * The log, the map and the destage all run on the blockdev's poller core
+ *  and take no locks.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <endian.h>
+
+#include <rte_config.h>
+#include <rte_cycles.h>
+#include <rte_malloc.h>
+
+#include "spdk/bdev.h"
+#include "spdk/bdev_db.h"
+#include "spdk/conf.h"
+#include "spdk/log.h"
+#include "spdk/queue.h"
+#include "spdk/scsi_spec.h"
+
+#define LOGCACHE_DEFAULT_BATCH_SIZE_KB	4096
+#define LOGCACHE_DEFAULT_BYPASS_SIZE_KB	128
+
+/* Destage whatever is dirty once no write has arrived for this long */
+#define LOGCACHE_IDLE_DESTAGE_MS	10
+
+/* Give up on the base device after this many destages fail in a row */
+#define LOGCACHE_DESTAGE_RETRIES	5
+
+#define LOGCACHE_NONE			UINT32_MAX
+
+enum logcache_entry_state {
+	/* Not holding live data: never written, superseded or destaged */
+	LOGCACHE_ENTRY_FREE = 0,
+
+	/* Being written to the log */
+	LOGCACHE_ENTRY_PENDING,
+
+	/* Holds data not yet written to the base device */
+	LOGCACHE_ENTRY_DIRTY,
+
+	/* Part of the destage batch in flight */
+	LOGCACHE_ENTRY_DESTAGING,
+};
+
+/* One per block of the log */
+struct logcache_entry {
+	/* Block of the base device held at this position */
+	uint64_t		lba;
+
+	/* Next entry in the same hash bucket of the map */
+	uint32_t		hash_next;
+
+	/* Reads in flight from this position; the log tail stops here */
+	uint16_t		readers;
+
+	uint8_t			state;
+
+	/* The map sends reads of lba here */
+	bool			mapped;
+};
+
+struct logcache_destage {
+	uint64_t		lba;
+	uint32_t		pos;
+};
+
+struct logcache_disk {
+	struct spdk_bdev	disk;	/* this must be the first element */
+	struct spdk_bdev	*base;
+	struct spdk_bdev	*log;
+	struct spdk_bdev	*members[2];
+
+	/* Log size in blocks, and one entry per block */
+	uint32_t		log_blocks;
+	struct logcache_entry	*entries;
+
+	/* Map from base device blocks to log positions */
+	uint32_t		*buckets;
+	uint32_t		bucket_shift;
+
+	/*
+	 * Log sequence numbers of the next block to append and of the oldest
+	 *  block that may still be live.  A block's position in the log is
+	 *  its sequence number modulo log_blocks.
+	 */
+	uint64_t		head;
+	uint64_t		tail;
+
+	/* Blocks in the map */
+	uint32_t		dirty;
+
+	/* Writes of at least this many blocks bypass the log if clean */
+	uint32_t		bypass_blocks;
+
+	struct logcache_destage	*batch;
+	uint32_t		batch_max;
+	uint32_t		batch_count;
+	uint32_t		batch_outstanding;
+	bool			batch_failed;
+	bool			destaging;
+	uint8_t			*batch_buf;
+
+	uint64_t		last_write_tsc;
+	uint64_t		idle_ticks;
+
+	/* After a failed destage, the next one waits until this time */
+	uint64_t		destage_retry_tsc;
+
+	/* Destages that failed in a row, up to LOGCACHE_DESTAGE_RETRIES */
+	uint32_t		destage_failures;
+
+	/* Writes and unmaps waiting for log space or for a destage to end */
+	TAILQ_HEAD(, spdk_bdev_io) queued;
+
+	/* Flushes waiting for the destage to catch up */
+	TAILQ_HEAD(, spdk_bdev_io) flushes;
+
+	TAILQ_ENTRY(logcache_disk) tailq;
+};
+
+struct logcache_io {
+	enum spdk_bdev_io_status	status;
+
+	/* Log sequence number a flush waits for the tail to reach */
+	uint64_t			flush_seq;
+};
+
+static TAILQ_HEAD(, logcache_disk) g_logcache_disks = TAILQ_HEAD_INITIALIZER(g_logcache_disks);
+
+static int blockdev_logcache_initialize(void);
+static void blockdev_logcache_finish(void);
+static void blockdev_logcache_get_spdk_running_config(FILE *fp);
+
+static int
+blockdev_logcache_get_ctx_size(void)
+{
+	return sizeof(struct logcache_io);
+}
+
+SPDK_VBDEV_MODULE_REGISTER(blockdev_logcache_initialize, blockdev_logcache_finish,
+			   blockdev_logcache_get_spdk_running_config, blockdev_logcache_get_ctx_size)
+
+static inline uint32_t
+logcache_bucket(struct logcache_disk *ld, uint64_t lba)
+{
+	return (lba * 0x9E3779B97F4A7C15ULL) >> (64 - ld->bucket_shift);
+}
+
+static uint32_t
+logcache_map_lookup(struct logcache_disk *ld, uint64_t lba)
+{
+	uint32_t pos;
+
+	for (pos = ld->buckets[logcache_bucket(ld, lba)]; pos != LOGCACHE_NONE;
+	     pos = ld->entries[pos].hash_next) {
+		if (ld->entries[pos].lba == lba) {
+			return pos;
+		}
+	}
+
+	return LOGCACHE_NONE;
+}
+
+static void
+logcache_map_insert(struct logcache_disk *ld, uint32_t pos)
+{
+	uint32_t *head = &ld->buckets[logcache_bucket(ld, ld->entries[pos].lba)];
+
+	ld->entries[pos].hash_next = *head;
+	ld->entries[pos].mapped = true;
+	*head = pos;
+	ld->dirty++;
+}
+
+static void
+logcache_map_remove(struct logcache_disk *ld, uint32_t pos)
+{
+	uint32_t *prev = &ld->buckets[logcache_bucket(ld, ld->entries[pos].lba)];
+
+	while (*prev != pos) {
+		prev = &ld->entries[*prev].hash_next;
+	}
+	*prev = ld->entries[pos].hash_next;
+	ld->entries[pos].mapped = false;
+	ld->dirty--;
+}
+
+/*
+ * Drop a block from the map because newer data replaced it.  A block in
+ *  the destage batch keeps its position until the batch is done with it.
+ */
+static void
+logcache_forget(struct logcache_disk *ld, uint32_t pos)
+{
+	logcache_map_remove(ld, pos);
+	if (ld->entries[pos].state == LOGCACHE_ENTRY_DIRTY) {
+		ld->entries[pos].state = LOGCACHE_ENTRY_FREE;
+	}
+}
+
+static void
+logcache_forget_range(struct logcache_disk *ld, uint64_t lba, uint64_t num_blocks)
+{
+	uint32_t pos;
+	uint64_t i;
+
+	if (num_blocks > ld->log_blocks) {
+		/* Cheaper to walk the log than the range. */
+		for (pos = 0; pos < ld->log_blocks; pos++) {
+			if (ld->entries[pos].mapped && ld->entries[pos].lba >= lba &&
+			    ld->entries[pos].lba - lba < num_blocks) {
+				logcache_forget(ld, pos);
+			}
+		}
+		return;
+	}
+
+	for (i = 0; i < num_blocks; i++) {
+		pos = logcache_map_lookup(ld, lba + i);
+		if (pos != LOGCACHE_NONE) {
+			logcache_forget(ld, pos);
+		}
+	}
+}
+
+static bool
+logcache_range_dirty(struct logcache_disk *ld, uint64_t lba, uint64_t num_blocks)
+{
+	uint64_t i;
+
+	if (ld->dirty == 0) {
+		return false;
+	}
+
+	for (i = 0; i < num_blocks; i++) {
+		if (logcache_map_lookup(ld, lba + i) != LOGCACHE_NONE) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* Release log space up to the oldest block that is still live or being read. */
+static void
+logcache_advance_tail(struct logcache_disk *ld)
+{
+	struct logcache_entry *e;
+
+	while (ld->tail < ld->head) {
+		e = &ld->entries[ld->tail % ld->log_blocks];
+		if (e->state != LOGCACHE_ENTRY_FREE || e->readers != 0) {
+			break;
+		}
+		ld->tail++;
+	}
+}
+
+/*
+ * Reserve num_blocks contiguous positions at the head of the log.  A
+ *  request that would wrap starts over at position 0, skipping the rest of
+ *  the log.
+ */
+static int
+logcache_append(struct logcache_disk *ld, uint32_t num_blocks, uint32_t *pos)
+{
+	uint32_t head_pos = ld->head % ld->log_blocks;
+	uint32_t pad = 0, i;
+
+	if (head_pos + num_blocks > ld->log_blocks) {
+		pad = ld->log_blocks - head_pos;
+	}
+
+	if (ld->head + pad + num_blocks - ld->tail > ld->log_blocks) {
+		return -1;
+	}
+
+	ld->head += pad;
+	*pos = ld->head % ld->log_blocks;
+	ld->head += num_blocks;
+
+	for (i = 0; i < num_blocks; i++) {
+		ld->entries[*pos + i].state = LOGCACHE_ENTRY_PENDING;
+	}
+
+	return 0;
+}
+
+static void
+blockdev_logcache_child_done(spdk_event_t event)
+{
+	struct spdk_bdev_io *parent = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *child = spdk_event_get_arg2(event);
+	struct logcache_io *lio = (struct logcache_io *)parent->driver_ctx;
+	struct logcache_disk *ld = parent->ctx;
+	uint64_t blocklen = ld->disk.blocklen;
+	struct logcache_entry *e;
+	uint64_t lba;
+	uint32_t pos, old, num_blocks, i;
+	bool ok = (child->status == SPDK_BDEV_IO_STATUS_SUCCESS);
+
+	if (!ok) {
+		lio->status = SPDK_BDEV_IO_STATUS_FAILED;
+	}
+
+	if (child->bdev == ld->log && parent->type == SPDK_BDEV_IO_TYPE_READ) {
+		pos = child->u.read.offset / blocklen;
+		num_blocks = child->u.read.nbytes / blocklen;
+		for (i = 0; i < num_blocks; i++) {
+			ld->entries[pos + i].readers--;
+		}
+	} else if (child->bdev == ld->log) {
+		/* The write is in the log; point the map at it. */
+		pos = child->u.write.offset / blocklen;
+		num_blocks = child->u.write.len / blocklen;
+		lba = parent->u.write.offset / blocklen;
+		for (i = 0; i < num_blocks; i++) {
+			e = &ld->entries[pos + i];
+			if (!ok) {
+				e->state = LOGCACHE_ENTRY_FREE;
+				continue;
+			}
+			old = logcache_map_lookup(ld, lba + i);
+			if (old != LOGCACHE_NONE) {
+				logcache_forget(ld, old);
+			}
+			e->lba = lba + i;
+			e->state = LOGCACHE_ENTRY_DIRTY;
+			logcache_map_insert(ld, pos + i);
+		}
+	}
+
+	TAILQ_REMOVE(&parent->child_io, child, link);
+	parent->children--;
+	spdk_bdev_free_io(child);
+
+	if (parent->children == 0) {
+		spdk_bdev_io_complete(parent, lio->status);
+	}
+}
+
+static struct spdk_bdev_io *
+blockdev_logcache_get_child(struct spdk_bdev_io *parent, struct spdk_bdev *bdev)
+{
+	return spdk_bdev_get_child_io(parent, bdev, blockdev_logcache_child_done, parent);
+}
+
+/* Pass an I/O through to the base device unchanged. */
+static int
+blockdev_logcache_submit_base(struct spdk_bdev_io *bdev_io)
+{
+	struct logcache_disk *ld = bdev_io->ctx;
+	struct spdk_bdev_io *child;
+
+	child = blockdev_logcache_get_child(bdev_io, ld->base);
+	if (child == NULL) {
+		return -1;
+	}
+
+	spdk_bdev_io_submit(child);
+	return 0;
+}
+
+/*
+ * Read each run of blocks from wherever its newest copy is: the log for
+ *  dirty blocks, the base device for the rest.
+ */
+static void
+blockdev_logcache_read(struct spdk_bdev_io *bdev_io)
+{
+	struct logcache_disk *ld = bdev_io->ctx;
+	struct logcache_io *lio = (struct logcache_io *)bdev_io->driver_ctx;
+	uint64_t blocklen = ld->disk.blocklen;
+	uint64_t lba = bdev_io->u.read.offset / blocklen;
+	uint64_t num_blocks = bdev_io->u.read.nbytes / blocklen;
+	uint8_t *buf = bdev_io->u.read.buf;
+	struct spdk_bdev_io *child;
+	uint64_t i, run;
+	uint32_t pos, j;
+
+	if (num_blocks == 0) {
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_SUCCESS);
+		return;
+	}
+
+	for (i = 0; i < num_blocks; i += run) {
+		pos = logcache_map_lookup(ld, lba + i);
+		run = 1;
+		if (pos == LOGCACHE_NONE) {
+			while (i + run < num_blocks &&
+			       logcache_map_lookup(ld, lba + i + run) == LOGCACHE_NONE) {
+				run++;
+			}
+			child = blockdev_logcache_get_child(bdev_io, ld->base);
+			if (child == NULL) {
+				lio->status = SPDK_BDEV_IO_STATUS_FAILED;
+				break;
+			}
+			child->u.read.offset = (lba + i) * blocklen;
+		} else {
+			while (i + run < num_blocks && pos + run < ld->log_blocks &&
+			       logcache_map_lookup(ld, lba + i + run) == pos + run) {
+				run++;
+			}
+			child = blockdev_logcache_get_child(bdev_io, ld->log);
+			if (child == NULL) {
+				lio->status = SPDK_BDEV_IO_STATUS_FAILED;
+				break;
+			}
+			/* Keep the log from reusing these blocks until the read is done. */
+			for (j = 0; j < run; j++) {
+				ld->entries[pos + j].readers++;
+			}
+			child->u.read.offset = (uint64_t)pos * blocklen;
+		}
+
+		child->u.read.buf = buf + i * blocklen;
+		child->u.read.nbytes = run * blocklen;
+		spdk_bdev_io_submit(child);
+	}
+
+	if (bdev_io->children == 0) {
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+	}
+}
+
+/*
+ * Start a write or unmap.  Returns -EAGAIN if it has to wait for the
+ *  destage, leaving everything untouched.
+ */
+static int
+blockdev_logcache_start(struct spdk_bdev_io *bdev_io)
+{
+	struct logcache_disk *ld = bdev_io->ctx;
+	uint64_t blocklen = ld->disk.blocklen;
+	struct spdk_scsi_unmap_bdesc *desc;
+	struct spdk_bdev_io *child;
+	uint64_t lba, num_blocks;
+	uint32_t pos, i;
+
+	if (bdev_io->type == SPDK_BDEV_IO_TYPE_UNMAP) {
+		/* A destage in flight could write the blocks back after the unmap. */
+		if (ld->destaging) {
+			return -EAGAIN;
+		}
+		desc = bdev_io->u.unmap.unmap_bdesc;
+		for (i = 0; i < bdev_io->u.unmap.bdesc_count; i++) {
+			logcache_forget_range(ld, be64toh(desc[i].lba), be32toh(desc[i].block_count));
+		}
+		return blockdev_logcache_submit_base(bdev_io);
+	}
+
+	lba = bdev_io->u.write.offset / blocklen;
+	num_blocks = bdev_io->u.write.len / blocklen;
+	if (num_blocks == 0) {
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_SUCCESS);
+		return 0;
+	}
+
+	/*
+	 * Large writes gain nothing from the log.  They go straight to the
+	 *  base device unless an older copy of one of their blocks is still
+	 *  waiting to be destaged over them.
+	 */
+	if ((num_blocks >= ld->bypass_blocks || num_blocks > ld->log_blocks) &&
+	    !logcache_range_dirty(ld, lba, num_blocks)) {
+		return blockdev_logcache_submit_base(bdev_io);
+	}
+
+	if (num_blocks > ld->log_blocks || logcache_append(ld, num_blocks, &pos) != 0) {
+		return -EAGAIN;
+	}
+
+	child = blockdev_logcache_get_child(bdev_io, ld->log);
+	if (child == NULL) {
+		for (i = 0; i < num_blocks; i++) {
+			ld->entries[pos + i].state = LOGCACHE_ENTRY_FREE;
+		}
+		return -1;
+	}
+
+	child->u.write.offset = (uint64_t)pos * blocklen;
+	spdk_bdev_io_submit(child);
+	ld->last_write_tsc = rte_get_timer_cycles();
+
+	return 0;
+}
+
+static int
+logcache_destage_cmp(const void *a, const void *b)
+{
+	const struct logcache_destage *da = a, *db = b;
+
+	return da->lba < db->lba ? -1 : da->lba > db->lba;
+}
+
+/* Fail the flushes that wait for blocks the destage could not write. */
+static void
+logcache_fail_flushes(struct logcache_disk *ld)
+{
+	struct spdk_bdev_io *bdev_io, *tmp;
+	struct logcache_io *lio;
+
+	TAILQ_FOREACH_SAFE(bdev_io, &ld->flushes, link, tmp) {
+		lio = (struct logcache_io *)bdev_io->driver_ctx;
+		if (lio->flush_seq > ld->tail) {
+			TAILQ_REMOVE(&ld->flushes, bdev_io, link);
+			spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		}
+	}
+}
+
+/* Fail everything that waits for log space. */
+static void
+logcache_fail_queued(struct logcache_disk *ld)
+{
+	struct spdk_bdev_io *bdev_io;
+
+	while ((bdev_io = TAILQ_FIRST(&ld->queued)) != NULL) {
+		TAILQ_REMOVE(&ld->queued, bdev_io, link);
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+	}
+}
+
+static void
+logcache_destage_finish(struct logcache_disk *ld)
+{
+	struct logcache_entry *e;
+	uint32_t i;
+
+	for (i = 0; i < ld->batch_count; i++) {
+		e = &ld->entries[ld->batch[i].pos];
+		if (ld->batch_failed) {
+			/* Try again in a later batch, unless newer data replaced it. */
+			e->state = e->mapped ? LOGCACHE_ENTRY_DIRTY : LOGCACHE_ENTRY_FREE;
+			continue;
+		}
+		if (e->mapped) {
+			logcache_map_remove(ld, ld->batch[i].pos);
+		}
+		e->state = LOGCACHE_ENTRY_FREE;
+	}
+
+	ld->destaging = false;
+	logcache_advance_tail(ld);
+
+	if (!ld->batch_failed) {
+		ld->destage_failures = 0;
+		return;
+	}
+
+	SPDK_ERRLOG("%s: destage of %u blocks failed\n", ld->disk.name, ld->batch_count);
+	ld->destage_retry_tsc = rte_get_timer_cycles() + ld->idle_ticks;
+	logcache_fail_flushes(ld);
+
+	if (++ld->destage_failures == LOGCACHE_DESTAGE_RETRIES) {
+		SPDK_ERRLOG("%s: giving up on %s after %d failed destages in a row\n",
+			    ld->disk.name, ld->base->name, LOGCACHE_DESTAGE_RETRIES);
+		logcache_fail_queued(ld);
+	}
+}
+
+static void
+logcache_destage_write_done(spdk_event_t event)
+{
+	struct logcache_disk *ld = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *bdev_io = spdk_event_get_arg2(event);
+
+	if (bdev_io->status != SPDK_BDEV_IO_STATUS_SUCCESS) {
+		ld->batch_failed = true;
+	}
+	spdk_bdev_free_io(bdev_io);
+
+	if (--ld->batch_outstanding == 0) {
+		logcache_destage_finish(ld);
+	}
+}
+
+/* Write the batch to the base device in runs of consecutive blocks. */
+static void
+logcache_destage_write(struct logcache_disk *ld)
+{
+	uint64_t blocklen = ld->disk.blocklen;
+	uint32_t i, run;
+
+	for (i = 0; i < ld->batch_count; i += run) {
+		for (run = 1; i + run < ld->batch_count &&
+		     ld->batch[i + run].lba == ld->batch[i].lba + run; run++) {
+		}
+
+		if (spdk_bdev_write(ld->base, ld->batch_buf + i * blocklen, run * blocklen,
+				    ld->batch[i].lba * blocklen, logcache_destage_write_done, ld) == NULL) {
+			ld->batch_failed = true;
+			break;
+		}
+		ld->batch_outstanding++;
+	}
+
+	if (ld->batch_outstanding == 0) {
+		logcache_destage_finish(ld);
+	}
+}
+
+static void
+logcache_destage_read_done(spdk_event_t event)
+{
+	struct logcache_disk *ld = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *bdev_io = spdk_event_get_arg2(event);
+
+	if (bdev_io->status != SPDK_BDEV_IO_STATUS_SUCCESS) {
+		ld->batch_failed = true;
+	}
+	spdk_bdev_free_io(bdev_io);
+
+	if (--ld->batch_outstanding == 0) {
+		if (ld->batch_failed) {
+			logcache_destage_finish(ld);
+		} else {
+			logcache_destage_write(ld);
+		}
+	}
+}
+
+/*
+ * Collect up to batch_max of the oldest dirty blocks, sort them by address
+ *  and read them from the log into the batch buffer.
+ */
+static void
+logcache_destage_start(struct logcache_disk *ld)
+{
+	uint64_t blocklen = ld->disk.blocklen;
+	struct logcache_entry *e;
+	uint64_t seq;
+	uint32_t pos, i, run;
+
+	ld->batch_count = 0;
+	for (seq = ld->tail; seq < ld->head && ld->batch_count < ld->batch_max; seq++) {
+		pos = seq % ld->log_blocks;
+		e = &ld->entries[pos];
+		if (e->state != LOGCACHE_ENTRY_DIRTY) {
+			continue;
+		}
+		e->state = LOGCACHE_ENTRY_DESTAGING;
+		ld->batch[ld->batch_count].lba = e->lba;
+		ld->batch[ld->batch_count].pos = pos;
+		ld->batch_count++;
+	}
+
+	if (ld->batch_count == 0) {
+		return;
+	}
+
+	qsort(ld->batch, ld->batch_count, sizeof(*ld->batch), logcache_destage_cmp);
+
+	ld->destaging = true;
+	ld->batch_failed = false;
+	ld->batch_outstanding = 0;
+
+	for (i = 0; i < ld->batch_count; i += run) {
+		for (run = 1; i + run < ld->batch_count &&
+		     ld->batch[i + run].pos == ld->batch[i].pos + run; run++) {
+		}
+
+		if (spdk_bdev_read(ld->log, ld->batch_buf + i * blocklen, run * blocklen,
+				   (uint64_t)ld->batch[i].pos * blocklen, logcache_destage_read_done, ld) == NULL) {
+			ld->batch_failed = true;
+			break;
+		}
+		ld->batch_outstanding++;
+	}
+
+	if (ld->batch_outstanding == 0) {
+		logcache_destage_finish(ld);
+	}
+}
+
+static void
+blockdev_logcache_submit_request(struct spdk_bdev_io *bdev_io)
+{
+	struct logcache_disk *ld = bdev_io->ctx;
+	struct logcache_io *lio = (struct logcache_io *)bdev_io->driver_ctx;
+	int rc;
+
+	lio->status = SPDK_BDEV_IO_STATUS_SUCCESS;
+
+	switch (bdev_io->type) {
+	case SPDK_BDEV_IO_TYPE_READ:
+		spdk_bdev_io_get_rbuf(bdev_io, blockdev_logcache_read);
+		return;
+
+	case SPDK_BDEV_IO_TYPE_WRITE:
+	case SPDK_BDEV_IO_TYPE_UNMAP:
+		if (ld->destage_failures == LOGCACHE_DESTAGE_RETRIES) {
+			break;
+		}
+		/* Once anything waits, later writes wait behind it. */
+		rc = TAILQ_EMPTY(&ld->queued) ? blockdev_logcache_start(bdev_io) : -EAGAIN;
+		if (rc == -EAGAIN) {
+			TAILQ_INSERT_TAIL(&ld->queued, bdev_io, link);
+			return;
+		}
+		if (rc == 0) {
+			return;
+		}
+		break;
+
+	case SPDK_BDEV_IO_TYPE_FLUSH:
+		if (ld->destage_failures == LOGCACHE_DESTAGE_RETRIES) {
+			break;
+		}
+		lio->flush_seq = ld->head;
+		TAILQ_INSERT_TAIL(&ld->flushes, bdev_io, link);
+		return;
+
+	case SPDK_BDEV_IO_TYPE_RESET:
+		if (bdev_io->u.reset.type != SPDK_BDEV_RESET_SOFT) {
+			SPDK_ERRLOG("%s: only soft resets are supported on a log cache\n",
+				    ld->disk.name);
+			break;
+		}
+		if (blockdev_logcache_submit_base(bdev_io) == 0) {
+			return;
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+}
+
+static void
+blockdev_logcache_free_request(struct spdk_bdev_io *bdev_io)
+{
+}
+
+/*
+ * Runs on the blockdev's poller core: restart queued writes, complete
+ *  flushes the destage has caught up with and start the next batch.
+ */
+static int
+blockdev_logcache_check_io(struct spdk_bdev *bdev)
+{
+	struct logcache_disk *ld = (struct logcache_disk *)bdev;
+	struct logcache_io *lio;
+	struct spdk_bdev_io *bdev_io;
+	uint64_t now;
+	int rc;
+
+	logcache_advance_tail(ld);
+
+	while ((bdev_io = TAILQ_FIRST(&ld->queued)) != NULL) {
+		TAILQ_REMOVE(&ld->queued, bdev_io, link);
+		rc = blockdev_logcache_start(bdev_io);
+		if (rc == -EAGAIN) {
+			TAILQ_INSERT_HEAD(&ld->queued, bdev_io, link);
+			break;
+		}
+		if (rc < 0) {
+			spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		}
+	}
+
+	while ((bdev_io = TAILQ_FIRST(&ld->flushes)) != NULL) {
+		lio = (struct logcache_io *)bdev_io->driver_ctx;
+		if (lio->flush_seq > ld->tail) {
+			break;
+		}
+		TAILQ_REMOVE(&ld->flushes, bdev_io, link);
+		if (blockdev_logcache_submit_base(bdev_io) < 0) {
+			spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		}
+	}
+
+	if (ld->destaging || ld->dirty == 0 || ld->destage_failures == LOGCACHE_DESTAGE_RETRIES) {
+		return 0;
+	}
+
+	now = rte_get_timer_cycles();
+	if (now < ld->destage_retry_tsc) {
+		return 0;
+	}
+
+	if (ld->dirty >= ld->batch_max || !TAILQ_EMPTY(&ld->flushes) ||
+	    !TAILQ_EMPTY(&ld->queued) || now - ld->last_write_tsc >= ld->idle_ticks) {
+		logcache_destage_start(ld);
+	}
+
+	return 0;
+}
+
+static void
+logcache_disk_free(struct logcache_disk *ld)
+{
+	if (ld->dirty != 0) {
+		SPDK_ERRLOG("%s: %u blocks were not destaged to %s and are lost\n",
+			    ld->disk.name, ld->dirty, ld->base->name);
+	}
+
+	ld->base->claimed = false;
+	ld->log->claimed = false;
+	rte_free(ld->batch_buf);
+	rte_free(ld->batch);
+	rte_free(ld->buckets);
+	rte_free(ld->entries);
+	rte_free(ld);
+}
+
+static int
+blockdev_logcache_destruct(struct spdk_bdev *bdev)
+{
+	struct logcache_disk *ld = (struct logcache_disk *)bdev;
+
+	TAILQ_REMOVE(&g_logcache_disks, ld, tailq);
+	logcache_disk_free(ld);
+
+	return 0;
+}
+
+static struct spdk_bdev_fn_table logcache_fn_table = {
+	.destruct	= blockdev_logcache_destruct,
+	.check_io	= blockdev_logcache_check_io,
+	.submit_request	= blockdev_logcache_submit_request,
+	.free_request	= blockdev_logcache_free_request,
+};
+
+static struct logcache_disk *
+create_logcache_disk(const char *name, struct spdk_bdev *base, struct spdk_bdev *log,
+		     uint32_t batch_size_kb, uint32_t bypass_size_kb)
+{
+	struct logcache_disk *ld;
+	uint64_t blocklen = base->blocklen;
+	uint32_t i;
+
+	if (base == log) {
+		SPDK_ERRLOG("%s: the cache device must differ from the base device\n", name);
+		return NULL;
+	}
+	if (base->claimed || log->claimed) {
+		SPDK_ERRLOG("%s: %s is already in use\n", name, base->claimed ? base->name : log->name);
+		return NULL;
+	}
+	if (log->blocklen != blocklen) {
+		SPDK_ERRLOG("%s: %s and %s have different block sizes\n", name, base->name, log->name);
+		return NULL;
+	}
+	if (log->blockcnt == 0 || log->blockcnt >= LOGCACHE_NONE) {
+		SPDK_ERRLOG("%s: %s cannot be used as a log\n", name, log->name);
+		return NULL;
+	}
+
+	ld = rte_zmalloc(NULL, sizeof(*ld), 0);
+	if (!ld) {
+		SPDK_ERRLOG("rte_zmalloc failed\n");
+		return NULL;
+	}
+
+	ld->base = base;
+	ld->log = log;
+	ld->log_blocks = log->blockcnt;
+	ld->bucket_shift = 64 - __builtin_clzll(ld->log_blocks);
+	ld->batch_max = (uint64_t)batch_size_kb * 1024 / blocklen;
+	if (ld->batch_max == 0) {
+		ld->batch_max = 1;
+	} else if (ld->batch_max > ld->log_blocks) {
+		ld->batch_max = ld->log_blocks;
+	}
+	ld->bypass_blocks = UINT32_MAX;
+	if (bypass_size_kb != 0) {
+		ld->bypass_blocks = ((uint64_t)bypass_size_kb * 1024 + blocklen - 1) / blocklen;
+	}
+	ld->idle_ticks = rte_get_timer_hz() * LOGCACHE_IDLE_DESTAGE_MS / 1000;
+	TAILQ_INIT(&ld->queued);
+	TAILQ_INIT(&ld->flushes);
+
+	ld->entries = rte_zmalloc_socket(NULL, (uint64_t)ld->log_blocks * sizeof(*ld->entries), 0,
+					 log->socket_id < 0 ? SOCKET_ID_ANY : log->socket_id);
+	ld->buckets = rte_malloc_socket(NULL, sizeof(uint32_t) << ld->bucket_shift, 0,
+					log->socket_id < 0 ? SOCKET_ID_ANY : log->socket_id);
+	ld->batch = rte_malloc(NULL, ld->batch_max * sizeof(*ld->batch), 0);
+	ld->batch_buf = rte_malloc_socket(NULL, ld->batch_max * blocklen, 0x1000,
+					  base->socket_id < 0 ? SOCKET_ID_ANY : base->socket_id);
+	if (!ld->entries || !ld->buckets || !ld->batch || !ld->batch_buf) {
+		SPDK_ERRLOG("%s: could not allocate the log map\n", name);
+		rte_free(ld->batch_buf);
+		rte_free(ld->batch);
+		rte_free(ld->buckets);
+		rte_free(ld->entries);
+		rte_free(ld);
+		return NULL;
+	}
+
+	for (i = 0; i < (1U << ld->bucket_shift); i++) {
+		ld->buckets[i] = LOGCACHE_NONE;
+	}
+
+	base->claimed = true;
+	log->claimed = true;
+	ld->members[0] = base;
+	ld->members[1] = log;
+
+	snprintf(ld->disk.name, SPDK_BDEV_MAX_NAME_LENGTH, "%s", name);
+	snprintf(ld->disk.product_name, SPDK_BDEV_MAX_PRODUCT_NAME_LENGTH, "Log cache disk");
+	ld->disk.blocklen = blocklen;
+	ld->disk.blockcnt = base->blockcnt;
+	ld->disk.need_aligned_buffer = base->need_aligned_buffer || log->need_aligned_buffer;
+	ld->disk.max_unmap_bdesc_count = base->max_unmap_bdesc_count;
+	/* Writes complete once they are in the log, before they reach the base device. */
+	ld->disk.write_cache = 1;
+	/* Writes and most hot reads go to the log. */
+	ld->disk.socket_id = log->socket_id;
+	ld->disk.child_bdevs = ld->members;
+	ld->disk.num_child_bdevs = 2;
+	ld->disk.ctxt = ld;
+	ld->disk.fn_table = &logcache_fn_table;
+
+	spdk_bdev_register(&ld->disk);
+	TAILQ_INSERT_TAIL(&g_logcache_disks, ld, tailq);
+
+	SPDK_NOTICELOG("%s: %s logged on %u blocks of %s\n", name, base->name,
+		       ld->log_blocks, log->name);
+
+	return ld;
+}
+
+static int
+blockdev_logcache_construct(struct spdk_conf_section *sp)
+{
+	struct spdk_bdev *base, *log;
+	char name[SPDK_BDEV_MAX_NAME_LENGTH];
+	const char *val;
+	int batch_size_kb, bypass_size_kb;
+
+	val = spdk_conf_section_get_val(sp, "Name");
+	if (val != NULL) {
+		snprintf(name, sizeof(name), "%s", val);
+	} else {
+		snprintf(name, sizeof(name), "LogCache%d", sp->num);
+	}
+
+	val = spdk_conf_section_get_val(sp, "Device");
+	if (val == NULL) {
+		SPDK_ERRLOG("%s: Device is required\n", name);
+		return -1;
+	}
+	base = spdk_bdev_db_get_by_name(val);
+	if (base == NULL) {
+		SPDK_ERRLOG("%s: device %s not found\n", name, val);
+		return -1;
+	}
+
+	val = spdk_conf_section_get_val(sp, "CacheDevice");
+	if (val == NULL) {
+		SPDK_ERRLOG("%s: CacheDevice is required\n", name);
+		return -1;
+	}
+	log = spdk_bdev_db_get_by_name(val);
+	if (log == NULL) {
+		SPDK_ERRLOG("%s: device %s not found\n", name, val);
+		return -1;
+	}
+
+	batch_size_kb = spdk_conf_section_get_intval(sp, "BatchSizeKB");
+	if (batch_size_kb < 0) {
+		batch_size_kb = LOGCACHE_DEFAULT_BATCH_SIZE_KB;
+	}
+
+	bypass_size_kb = spdk_conf_section_get_intval(sp, "BypassSizeKB");
+	if (bypass_size_kb < 0) {
+		bypass_size_kb = LOGCACHE_DEFAULT_BYPASS_SIZE_KB;
+	}
+
+	if (create_logcache_disk(name, base, log, batch_size_kb, bypass_size_kb) == NULL) {
+		return -1;
+	}
+
+	return 0;
+}
+
+static int
+blockdev_logcache_initialize(void)
+{
+	struct spdk_conf_section *sp;
+
+	for (sp = spdk_conf_first_section(NULL); sp != NULL; sp = spdk_conf_next_section(sp)) {
+		if (!spdk_conf_section_match_prefix(sp, "LogCache")) {
+			continue;
+		}
+		if (blockdev_logcache_construct(sp) != 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void
+blockdev_logcache_finish(void)
+{
+	struct logcache_disk *ld;
+
+	while (!TAILQ_EMPTY(&g_logcache_disks)) {
+		ld = TAILQ_FIRST(&g_logcache_disks);
+		TAILQ_REMOVE(&g_logcache_disks, ld, tailq);
+		logcache_disk_free(ld);
+	}
+}
+
+static void
+blockdev_logcache_get_spdk_running_config(FILE *fp)
+{
+	struct logcache_disk *ld;
+	int i = 0;
+
+	TAILQ_FOREACH(ld, &g_logcache_disks, tailq) {
+		fprintf(fp, "\n[LogCache%d]\n", i++);
+		fprintf(fp, "  Name %s\n", ld->disk.name);
+		fprintf(fp, "  Device %s\n", ld->base->name);
+		fprintf(fp, "  CacheDevice %s\n", ld->log->name);
+		fprintf(fp, "  BatchSizeKB %" PRIu64 "\n", ld->batch_max * ld->disk.blocklen / 1024);
+		fprintf(fp, "  BypassSizeKB %" PRIu64 "\n", ld->bypass_blocks == UINT32_MAX ? 0 :
+			ld->bypass_blocks * ld->disk.blocklen / 1024);
+	}
+}
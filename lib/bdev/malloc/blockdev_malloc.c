@@ -33,6 +33,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <errno.h>
 #include <rte_config.h>
 #include <rte_malloc.h>
@@ -129,14 +130,27 @@ static int64_t
 blockdev_malloc_writev(struct malloc_disk *mdisk, struct copy_task *copy_req,
 		       struct iovec *iov, int iovcnt, size_t len, off_t offset)
 {
-	if ((iovcnt != 1) || (iov->iov_len != len))
-		return -1;
+	struct iovec dst_iov;
+
+	if (iovcnt == 1) {
+		if (iov->iov_len != len)
+			return -1;
+
+		SPDK_TRACELOG(SPDK_TRACE_MALLOC, "wrote %lu bytes to offset %#lx from %p\n",
+			      iov->iov_len, offset, iov->iov_base);
+
+		return spdk_copy_submit(copy_req, mdisk->malloc_buf + offset,
+					iov->iov_base, len, malloc_done);
+	}
+
+	SPDK_TRACELOG(SPDK_TRACE_MALLOC, "wrote %lu bytes to offset %#lx from %d iovs\n",
+		      len, offset, iovcnt);
 
-	SPDK_TRACELOG(SPDK_TRACE_MALLOC, "wrote %lu bytes to offset %#lx from %p\n",
-		      iov->iov_len, offset, iov->iov_base);
+	/* The source lengths must add up to len; the copy engine checks this. */
+	dst_iov.iov_base = mdisk->malloc_buf + offset;
+	dst_iov.iov_len = len;
 
-	return spdk_copy_submit(copy_req, mdisk->malloc_buf + offset,
-				iov->iov_base, len, malloc_done);
+	return spdk_copy_submitv(copy_req, &dst_iov, 1, iov, iovcnt, malloc_done);
 }
 
 static int
@@ -154,6 +168,21 @@ blockdev_malloc_flush(struct malloc_disk *mdisk, struct copy_task *copy_req,
 	return 0;
 }
 
+static int
+blockdev_malloc_lease(struct malloc_disk *mdisk, struct spdk_bdev_io *bdev_io)
+{
+	/* The whole disk is host memory, so a lease is just a pointer into it. */
+	bdev_io->u.lease.buf = mdisk->malloc_buf + bdev_io->u.lease.offset;
+
+	SPDK_TRACELOG(SPDK_TRACE_MALLOC, "leased %lu bytes at offset %#lx for %s\n",
+		      bdev_io->u.lease.nbytes, bdev_io->u.lease.offset,
+		      bdev_io->u.lease.write ? "write" : "read");
+
+	spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_SUCCESS);
+
+	return 0;
+}
+
 static int
 blockdev_malloc_reset(struct malloc_disk *mdisk, struct copy_task *copy_req)
 {
@@ -197,6 +226,10 @@ static int _blockdev_malloc_submit_request(struct spdk_bdev_io *bdev_io)
 					     (struct copy_task *)bdev_io->driver_ctx,
 					     bdev_io->u.flush.offset,
 					     bdev_io->u.flush.length);
+
+	case SPDK_BDEV_IO_TYPE_LEASE:
+		return blockdev_malloc_lease((struct malloc_disk *)bdev_io->ctx, bdev_io);
+
 	default:
 		return -1;
 	}
@@ -221,7 +254,7 @@ static struct spdk_bdev_fn_table malloc_fn_table = {
 	.free_request	= blockdev_malloc_free_request,
 };
 
-struct malloc_disk *create_malloc_disk(uint64_t num_blocks, uint32_t block_size)
+struct malloc_disk *create_malloc_disk(uint64_t num_blocks, uint32_t block_size, int socket_id)
 {
 	struct malloc_disk	*mdisk;
 
@@ -235,7 +268,12 @@ struct malloc_disk *create_malloc_disk(uint64_t num_blocks, uint32_t block_size)
 		return NULL;
 	}
 
-	mdisk = rte_zmalloc(NULL, sizeof(*mdisk), 0);
+	if (socket_id != SOCKET_ID_ANY && (socket_id < 0 || socket_id >= RTE_MAX_NUMA_NODES)) {
+		SPDK_ERRLOG("Invalid NUMA node %d\n", socket_id);
+		return NULL;
+	}
+
+	mdisk = rte_zmalloc_socket(NULL, sizeof(*mdisk), 0, socket_id);
 	if (!mdisk) {
 		perror("mdisk");
 		return NULL;
@@ -244,11 +282,10 @@ struct malloc_disk *create_malloc_disk(uint64_t num_blocks, uint32_t block_size)
 	/*
 	 * Allocate the large backend memory buffer using rte_malloc(),
 	 *  so that we guarantee it is allocated from hugepage memory.
-	 *
-	 * TODO: need to pass a hint so we know which socket to allocate
-	 *  from on multi-socket systems.
+	 *  With socket_id set to SOCKET_ID_ANY, DPDK picks the socket.
 	 */
-	mdisk->malloc_buf = rte_zmalloc(NULL, num_blocks * block_size, 2 * 1024 * 1024);
+	mdisk->malloc_buf = rte_zmalloc_socket(NULL, num_blocks * block_size, 2 * 1024 * 1024,
+					       socket_id);
 	if (!mdisk->malloc_buf) {
 		SPDK_ERRLOG("rte_zmalloc failed\n");
 		rte_free(mdisk);
@@ -262,6 +299,8 @@ struct malloc_disk *create_malloc_disk(uint64_t num_blocks, uint32_t block_size)
 	mdisk->disk.write_cache = 1;
 	mdisk->disk.blocklen = block_size;
 	mdisk->disk.blockcnt = num_blocks;
+	mdisk->disk.lease_supported = true;
+	mdisk->disk.socket_id = socket_id;
 
 	mdisk->disk.ctxt = mdisk;
 	mdisk->disk.fn_table = &malloc_fn_table;
@@ -284,6 +323,9 @@ static int blockdev_malloc_initialize()
 {
 	struct spdk_conf_section *sp = spdk_conf_find_section(NULL, "Malloc");
 	int NumberOfLuns, LunSizeInMB, BlockSize, i;
+	int num_nodes, socket_id;
+	const char *val;
+	char *end;
 	uint64_t size;
 	struct malloc_disk *mdisk;
 
@@ -299,9 +341,27 @@ static int blockdev_malloc_initialize()
 			/* Default is 512 bytes */
 			BlockSize = 512;
 		}
+		/*
+		 * NumaNode lists the socket for each LUN in turn; LUNs beyond
+		 *  the end of the list wrap around to its start.
+		 */
+		num_nodes = 0;
+		while (spdk_conf_section_get_nmval(sp, "NumaNode", 0, num_nodes) != NULL) {
+			num_nodes++;
+		}
 		size = (uint64_t)LunSizeInMB * 1024 * 1024;
 		for (i = 0; i < NumberOfLuns; i++) {
-			mdisk = create_malloc_disk(size / BlockSize, BlockSize);
+			socket_id = SOCKET_ID_ANY;
+			if (num_nodes > 0) {
+				val = spdk_conf_section_get_nmval(sp, "NumaNode", 0, i % num_nodes);
+				errno = 0;
+				socket_id = (int)strtol(val, &end, 10);
+				if (errno != 0 || end == val || *end != '\0' || socket_id < 0) {
+					SPDK_ERRLOG("Invalid NumaNode %s\n", val);
+					return EINVAL;
+				}
+			}
+			mdisk = create_malloc_disk(size / BlockSize, BlockSize, socket_id);
 			if (mdisk == NULL) {
 				SPDK_ERRLOG("Could not create malloc disk\n");
 				return EINVAL;
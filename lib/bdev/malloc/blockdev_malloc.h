@@ -38,6 +38,6 @@
 
 struct malloc_disk;
 
-struct malloc_disk *create_malloc_disk(uint64_t num_blocks, uint32_t block_size);
+struct malloc_disk *create_malloc_disk(uint64_t num_blocks, uint32_t block_size, int socket_id);
 
 #endif /* SPDK_BLOCKDEV_MALLOC_H */
@@ -38,11 +38,13 @@
 struct rpc_construct_malloc {
 	uint32_t num_blocks;
 	uint32_t block_size;
+	int32_t numa_node;
 };
 
 static const struct spdk_json_object_decoder rpc_construct_malloc_decoders[] = {
 	{"num_blocks", offsetof(struct rpc_construct_malloc, num_blocks), spdk_json_decode_uint32},
 	{"block_size", offsetof(struct rpc_construct_malloc, block_size), spdk_json_decode_uint32},
+	{"numa_node", offsetof(struct rpc_construct_malloc, numa_node), spdk_json_decode_int32, true},
 };
 
 static void
@@ -53,6 +55,8 @@ spdk_rpc_construct_malloc_lun(struct spdk_jsonrpc_server_conn *conn,
 	struct rpc_construct_malloc req = {};
 	struct spdk_json_write_ctx *w;
 
+	req.numa_node = -1;
+
 	if (spdk_json_decode_object(params, rpc_construct_malloc_decoders,
 				    sizeof(rpc_construct_malloc_decoders) / sizeof(*rpc_construct_malloc_decoders),
 				    &req)) {
@@ -60,7 +64,7 @@ spdk_rpc_construct_malloc_lun(struct spdk_jsonrpc_server_conn *conn,
 		goto invalid;
 	}
 
-	if (create_malloc_disk(req.num_blocks, req.block_size) == NULL) {
+	if (create_malloc_disk(req.num_blocks, req.block_size, req.numa_node) == NULL) {
 		goto invalid;
 	}
 
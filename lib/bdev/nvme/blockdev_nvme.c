@@ -76,8 +76,6 @@ struct nvme_blockdev {
 	struct spdk_nvme_ctrlr	*ctrlr;
 	struct spdk_nvme_ns	*ns;
 	struct spdk_nvme_qpair	*qpair;
-	uint64_t		lba_start;
-	uint64_t		lba_end;
 	uint64_t		blocklen;
 };
 
@@ -104,16 +102,14 @@ struct nvme_bdf_whitelist {
 #define NVME_MAX_BLOCKDEVS (NVME_MAX_BLOCKDEVS_PER_CONTROLLER * NVME_MAX_CONTROLLERS)
 static struct nvme_blockdev g_blockdev[NVME_MAX_BLOCKDEVS];
 static int blockdev_index_max = 0;
-static int nvme_luns_per_ns = 1;
 static int nvme_controller_index = 0;
-static int LunSizeInMB = 0;
 static int num_controllers = -1;
 static int unbindfromkernel = 0;
 
 static TAILQ_HEAD(, nvme_device)	g_nvme_devices = TAILQ_HEAD_INITIALIZER(g_nvme_devices);;
 
 static void nvme_ctrlr_initialize_blockdevs(struct spdk_nvme_ctrlr *ctrlr,
-		int bdev_per_ns, int ctrlr_id);
+		int ctrlr_id, int socket_id);
 static int nvme_library_init(void);
 static void nvme_library_fini(void);
 int nvme_queue_cmd(struct nvme_blockdev *bdev, struct nvme_blockio *bio,
@@ -367,7 +363,8 @@ attach_cb(void *cb_ctx, struct spdk_pci_device *pci_dev, struct spdk_nvme_ctrlr
 	dev->ctrlr = ctrlr;
 	dev->id = nvme_controller_index++;
 
-	nvme_ctrlr_initialize_blockdevs(dev->ctrlr, nvme_luns_per_ns, dev->id);
+	nvme_ctrlr_initialize_blockdevs(dev->ctrlr, dev->id,
+					spdk_pci_device_get_socket_id(pci_dev));
 	TAILQ_INSERT_TAIL(&g_nvme_devices, dev, tailq);
 
 	if (ctx->controllers_remaining > 0) {
@@ -395,21 +392,12 @@ nvme_library_init(void)
 
 	init_request_mempool();
 
-	nvme_luns_per_ns = spdk_conf_section_get_intval(sp, "NvmeLunsPerNs");
-	if (nvme_luns_per_ns < 1)
-		nvme_luns_per_ns = 1;
-
-	if (nvme_luns_per_ns > NVME_MAX_BLOCKDEVS_PER_CONTROLLER) {
-		SPDK_ERRLOG("The input value nvme_luns_per_ns(%d) exceeds the maximal "
-			    "value(%d)\n", nvme_luns_per_ns, NVME_MAX_BLOCKDEVS_PER_CONTROLLER);
-		return -1;
+	if (spdk_conf_section_get_val(sp, "NvmeLunsPerNs") != NULL ||
+	    spdk_conf_section_get_val(sp, "LunSizeInMB") != NULL) {
+		SPDK_WARNLOG("NvmeLunsPerNs and LunSizeInMB are no longer supported; "
+			     "use a [Split] section to partition a namespace\n");
 	}
 
-	LunSizeInMB = spdk_conf_section_get_intval(sp, "LunSizeInMB");
-
-	if (LunSizeInMB < 0)
-		LunSizeInMB = 0;
-
 	spdk_nvme_retry_count = spdk_conf_section_get_intval(sp, "NvmeRetryCount");
 	if (spdk_nvme_retry_count < 0)
 		spdk_nvme_retry_count = SPDK_NVME_DEFAULT_RETRY_COUNT;
@@ -487,80 +475,58 @@ nvme_library_fini(void)
 }
 
 void
-nvme_ctrlr_initialize_blockdevs(struct spdk_nvme_ctrlr *ctrlr, int bdev_per_ns, int ctrlr_id)
+nvme_ctrlr_initialize_blockdevs(struct spdk_nvme_ctrlr *ctrlr, int ctrlr_id, int socket_id)
 {
 	struct nvme_blockdev	*bdev;
 	struct spdk_nvme_ns	*ns;
 	const struct spdk_nvme_ctrlr_data *cdata;
-	uint64_t		bdev_size, lba_offset, sectors_per_stripe;
-	int			ns_id, num_ns, bdev_idx;
-	uint64_t LunSizeInsector;
+	int			ns_id, num_ns;
 
 	num_ns = spdk_nvme_ctrlr_get_num_ns(ctrlr);
 	cdata = spdk_nvme_ctrlr_get_data(ctrlr);
 
 	for (ns_id = 1; ns_id <= num_ns; ns_id++) {
+		if (blockdev_index_max >= NVME_MAX_BLOCKDEVS)
+			return;
+
 		ns = spdk_nvme_ctrlr_get_ns(ctrlr, ns_id);
-		bdev_size = spdk_nvme_ns_get_num_sectors(ns) / bdev_per_ns;
 
-		/*
-		 * Align each blockdev on a 1MB boundary - this helps cover Fultondale case
-		 *  where I/O that span a 128KB boundary must be split for optimal performance.
-		 *  Using a 1MB hardcoded boundary here so that we do not have to export
-		 *  stripe size information from the NVMe driver for now.
-		 */
-		sectors_per_stripe = (1 << 20) / spdk_nvme_ns_get_sector_size(ns);
-
-		LunSizeInsector = ((uint64_t)LunSizeInMB << 20) / spdk_nvme_ns_get_sector_size(ns);
-		if ((LunSizeInMB > 0) && (LunSizeInsector < bdev_size))
-			bdev_size = LunSizeInsector;
-
-		bdev_size &= ~(sectors_per_stripe - 1);
-
-		lba_offset = 0;
-		for (bdev_idx = 0; bdev_idx < bdev_per_ns; bdev_idx++) {
-			if (blockdev_index_max >= NVME_MAX_BLOCKDEVS)
-				return;
-
-			bdev = &g_blockdev[blockdev_index_max];
-			bdev->ctrlr = ctrlr;
-			bdev->ns = ns;
-			bdev->lba_start = lba_offset;
-			bdev->lba_end = lba_offset + bdev_size - 1;
-			lba_offset += bdev_size;
-
-			snprintf(bdev->disk.name, SPDK_BDEV_MAX_NAME_LENGTH,
-				 "Nvme%dn%dp%d", ctrlr_id, spdk_nvme_ns_get_id(ns), bdev_idx);
-			snprintf(bdev->disk.product_name, SPDK_BDEV_MAX_PRODUCT_NAME_LENGTH,
-				 "iSCSI NVMe disk");
-
-			bdev->qpair = spdk_nvme_ctrlr_alloc_io_qpair(ctrlr, 0);
-			if (!bdev->qpair) {
-				SPDK_ERRLOG("Could not allocate I/O queue pair for %s\n",
-					    bdev->disk.name);
-				continue;
-			}
+		bdev = &g_blockdev[blockdev_index_max];
+		bdev->ctrlr = ctrlr;
+		bdev->ns = ns;
 
-			if (cdata->oncs.dsm) {
-				/*
-				 * Enable the thin provisioning
-				 * if nvme controller supports
-				 * DataSet Management command.
-				 */
-				bdev->disk.thin_provisioning = 1;
-				bdev->disk.max_unmap_bdesc_count =
-					NVME_DEFAULT_MAX_UNMAP_BDESC_COUNT;
-			}
-			bdev->disk.write_cache = 1;
-			bdev->blocklen = spdk_nvme_ns_get_sector_size(ns);
-			bdev->disk.blocklen = bdev->blocklen;
-			bdev->disk.blockcnt = bdev->lba_end - bdev->lba_start + 1;
-			bdev->disk.ctxt = bdev;
-			bdev->disk.fn_table = &nvmelib_fn_table;
-			spdk_bdev_register(&bdev->disk);
-
-			blockdev_index_max++;
+		snprintf(bdev->disk.name, SPDK_BDEV_MAX_NAME_LENGTH,
+			 "Nvme%dn%d", ctrlr_id, spdk_nvme_ns_get_id(ns));
+		snprintf(bdev->disk.product_name, SPDK_BDEV_MAX_PRODUCT_NAME_LENGTH,
+			 "iSCSI NVMe disk");
+
+		bdev->qpair = spdk_nvme_ctrlr_alloc_io_qpair(ctrlr, 0);
+		if (!bdev->qpair) {
+			SPDK_ERRLOG("Could not allocate I/O queue pair for %s\n",
+				    bdev->disk.name);
+			continue;
 		}
+
+		if (cdata->oncs.dsm) {
+			/*
+			 * Enable the thin provisioning
+			 * if nvme controller supports
+			 * DataSet Management command.
+			 */
+			bdev->disk.thin_provisioning = 1;
+			bdev->disk.max_unmap_bdesc_count =
+				NVME_DEFAULT_MAX_UNMAP_BDESC_COUNT;
+		}
+		bdev->disk.write_cache = 1;
+		bdev->blocklen = spdk_nvme_ns_get_sector_size(ns);
+		bdev->disk.blocklen = bdev->blocklen;
+		bdev->disk.blockcnt = spdk_nvme_ns_get_num_sectors(ns);
+		bdev->disk.socket_id = socket_id;
+		bdev->disk.ctxt = bdev;
+		bdev->disk.fn_table = &nvmelib_fn_table;
+		spdk_bdev_register(&bdev->disk);
+
+		blockdev_index_max++;
 	}
 }
 
@@ -585,8 +551,7 @@ nvme_queue_cmd(struct nvme_blockdev *bdev, struct nvme_blockio *bio,
 {
 	uint32_t ss = spdk_nvme_ns_get_sector_size(bdev->ns);
 	uint32_t lba_count;
-	uint64_t relative_lba = offset / bdev->blocklen;
-	uint64_t next_lba = relative_lba + bdev->lba_start;
+	uint64_t next_lba = offset / bdev->blocklen;
 	int rc;
 
 	if (nbytes % ss) {
@@ -619,8 +584,7 @@ blockdev_nvme_unmap(struct nvme_blockdev *nbdev, struct nvme_blockio *bio,
 	int rc = 0, i;
 
 	for (i = 0; i < bdesc_count; i++) {
-		bio->dsm_range[i].starting_lba =
-			nbdev->lba_start + be64toh(unmap_d->lba);
+		bio->dsm_range[i].starting_lba = be64toh(unmap_d->lba);
 		bio->dsm_range[i].length = be32toh(unmap_d->block_count);
 		unmap_d++;
 	}
@@ -649,18 +613,12 @@ blockdev_nvme_get_spdk_running_config(FILE *fp)
 {
 	fprintf(fp,
 		"\n"
-		"# Users may change this to partition an NVMe namespace into multiple LUNs.\n"
 		"[Nvme]\n"
-		"  UnbindFromKernel %s\n"
-		"  NvmeLunsPerNs %d\n",
-		unbindfromkernel ? "Yes" : "No",
-		nvme_luns_per_ns);
+		"  UnbindFromKernel %s\n",
+		unbindfromkernel ? "Yes" : "No");
 	if (num_controllers != -1) {
 		fprintf(fp, "  NumControllers %d\n", num_controllers);
 	}
-	if (LunSizeInMB != 0) {
-		fprintf(fp, "  LunSizeInMB %d\n", LunSizeInMB);
-	}
 }
 
 SPDK_LOG_REGISTER_TRACE_FLAG("nvme", SPDK_TRACE_NVME)
@@ -0,0 +1,834 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (C) 2008-2012 Daisuke Aoyama <aoyama@peach.ne.jp>.
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * RAID virtual blockdevs built from other blockdevs.  Each I/O is split
+ *  into child I/O on the members; data buffers are passed through, never
+ *  copied.
+ *
+ * A reset is passed on to every member, and only soft resets are accepted:
+ *  a hard reset bumps a member's generation, which would silently drop the
+ *  other children in flight on it and leave their parents uncompleted.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <rte_config.h>
+#include <rte_cycles.h>
+#include <rte_malloc.h>
+
+#include "spdk/bdev.h"
+#include "spdk/bdev_db.h"
+#include "spdk/conf.h"
+#include "spdk/log.h"
+#include "spdk/queue.h"
+
+#define RAID_MAX_MEMBERS		32
+#define RAID_DEFAULT_STRIP_SIZE_KB	128
+
+/*
+ * Number of iovecs kept in each RAID I/O for child writes whose piece of
+ *  the data spans more than one of the parent's iovecs.  A piece inside a
+ *  single iovec uses the child's own embedded iovec instead.
+ */
+#define RAID_MAX_CHILD_IOVS		16
+
+/*
+ * Per-member state.  It is only touched on the RAID blockdev's poller core,
+ *  where children are submitted and completed.
+ */
+struct raid_member_state {
+	/* Child I/O submitted and not yet completed */
+	uint32_t		outstanding;
+
+	/* Moving average of child I/O latency, in timer cycles */
+	uint64_t		avg_latency;
+
+	/* A RAID-1 member is taken out of service after a failed child I/O */
+	bool			failed;
+};
+
+struct raid_disk {
+	struct spdk_bdev	disk;	/* this must be the first element */
+	int			level;
+	/* log2 of the strip size in blocks (RAID-0 only) */
+	uint32_t		strip_shift;
+	int			num_members;
+	struct spdk_bdev	*members[RAID_MAX_MEMBERS];
+	struct raid_member_state member_state[RAID_MAX_MEMBERS];
+	TAILQ_ENTRY(raid_disk)	tailq;
+};
+
+struct raid_io {
+	enum spdk_bdev_io_status	status;
+	/* Children that completed successfully */
+	int				num_ok;
+	int				iovs_used;
+	struct iovec			iovs[RAID_MAX_CHILD_IOVS];
+};
+
+static TAILQ_HEAD(, raid_disk) g_raid_disks = TAILQ_HEAD_INITIALIZER(g_raid_disks);
+
+static int blockdev_raid_initialize(void);
+static void blockdev_raid_finish(void);
+static void blockdev_raid_get_spdk_running_config(FILE *fp);
+
+static int
+blockdev_raid_get_ctx_size(void)
+{
+	return sizeof(struct raid_io);
+}
+
+SPDK_VBDEV_MODULE_REGISTER(blockdev_raid_initialize, blockdev_raid_finish,
+			   blockdev_raid_get_spdk_running_config, blockdev_raid_get_ctx_size)
+
+static int blockdev_raid1_read(struct spdk_bdev_io *bdev_io);
+
+static int
+blockdev_raid_member_index(struct raid_disk *rdisk, struct spdk_bdev *member)
+{
+	int m;
+
+	for (m = 0; m < rdisk->num_members; m++) {
+		if (rdisk->members[m] == member) {
+			return m;
+		}
+	}
+
+	return -1;
+}
+
+static void
+blockdev_raid_member_failed(struct raid_disk *rdisk, int m)
+{
+	if (rdisk->level != 1 || rdisk->member_state[m].failed) {
+		return;
+	}
+
+	rdisk->member_state[m].failed = true;
+	SPDK_ERRLOG("%s: member %s failed, continuing without it\n",
+		    rdisk->disk.name, rdisk->members[m]->name);
+}
+
+static void
+blockdev_raid_child_done(spdk_event_t event)
+{
+	struct spdk_bdev_io *parent = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *child = spdk_event_get_arg2(event);
+	struct raid_io *rio = (struct raid_io *)parent->driver_ctx;
+	struct raid_disk *rdisk = parent->ctx;
+	struct raid_member_state *ms;
+	bool ok = (child->status == SPDK_BDEV_IO_STATUS_SUCCESS);
+	int m;
+
+	/*
+	 * Children are submitted from the RAID blockdev's poller core, so
+	 *  their completions all come back here and need no locking.
+	 */
+	m = blockdev_raid_member_index(rdisk, child->bdev);
+	ms = &rdisk->member_state[m];
+	ms->outstanding--;
+	if (ok) {
+		/* Weight each new sample by 1/8. */
+		ms->avg_latency += ((int64_t)(rte_get_timer_cycles() - child->submit_tsc) -
+				    (int64_t)ms->avg_latency) / 8;
+		rio->num_ok++;
+	} else {
+		rio->status = SPDK_BDEV_IO_STATUS_FAILED;
+		blockdev_raid_member_failed(rdisk, m);
+	}
+
+	TAILQ_REMOVE(&parent->child_io, child, link);
+	parent->children--;
+	spdk_bdev_free_io(child);
+
+	if (!ok && rdisk->level == 1 && parent->type == SPDK_BDEV_IO_TYPE_READ) {
+		/* Try the read again on another mirror. */
+		rio->status = SPDK_BDEV_IO_STATUS_SUCCESS;
+		if (blockdev_raid1_read(parent) == 0) {
+			return;
+		}
+		rio->status = SPDK_BDEV_IO_STATUS_FAILED;
+	}
+
+	if (parent->children == 0) {
+		/* A mirrored write or flush succeeds if any member took it. */
+		if (rdisk->level == 1 && rio->num_ok > 0) {
+			rio->status = SPDK_BDEV_IO_STATUS_SUCCESS;
+		}
+		spdk_bdev_io_complete(parent, rio->status);
+	}
+}
+
+static struct spdk_bdev_io *
+blockdev_raid_get_child(struct spdk_bdev_io *parent, int m)
+{
+	struct raid_disk *rdisk = parent->ctx;
+	struct spdk_bdev_io *child;
+
+	child = spdk_bdev_get_child_io(parent, rdisk->members[m], blockdev_raid_child_done, parent);
+	if (child == NULL) {
+		((struct raid_io *)parent->driver_ctx)->status = SPDK_BDEV_IO_STATUS_FAILED;
+		/* A mirror that misses a write no longer holds current data. */
+		if (parent->type == SPDK_BDEV_IO_TYPE_WRITE) {
+			blockdev_raid_member_failed(rdisk, m);
+		}
+	}
+
+	return child;
+}
+
+static void
+blockdev_raid_submit_child(struct spdk_bdev_io *parent, struct spdk_bdev_io *child, int m)
+{
+	struct raid_disk *rdisk = parent->ctx;
+
+	rdisk->member_state[m].outstanding++;
+	child->submit_tsc = rte_get_timer_cycles();
+	spdk_bdev_io_submit(child);
+}
+
+/*
+ * Point a child write at the next nbytes of the parent's data, starting
+ *  *iov_off bytes into parent iovec *iov_idx, and advance both.  Fails if
+ *  the parent's iovecs hold less data than that.
+ */
+static int
+blockdev_raid_child_iovs(struct spdk_bdev_io *parent, struct spdk_bdev_io *child,
+			 int *iov_idx, size_t *iov_off, uint64_t nbytes)
+{
+	struct raid_io *rio = (struct raid_io *)parent->driver_ctx;
+	struct iovec *piov;
+	struct iovec *iovs;
+	size_t len;
+	int iovcnt = 0;
+
+	child->u.write.len = nbytes;
+
+	if (*iov_idx < parent->u.write.iovcnt &&
+	    parent->u.write.iovs[*iov_idx].iov_len - *iov_off >= nbytes) {
+		iovs = &child->u.write.iov;
+	} else {
+		iovs = &rio->iovs[rio->iovs_used];
+	}
+
+	while (nbytes > 0) {
+		if (iovs != &child->u.write.iov && rio->iovs_used + iovcnt == RAID_MAX_CHILD_IOVS) {
+			SPDK_ERRLOG("Write to %s needs more than %d iovecs\n",
+				    parent->bdev->name, RAID_MAX_CHILD_IOVS);
+			return -1;
+		}
+
+		if (*iov_idx == parent->u.write.iovcnt) {
+			SPDK_ERRLOG("Write to %s has less data in its iovecs than its length\n",
+				    parent->bdev->name);
+			return -1;
+		}
+
+		piov = &parent->u.write.iovs[*iov_idx];
+		len = piov->iov_len - *iov_off;
+		if (len > nbytes) {
+			len = nbytes;
+		}
+
+		iovs[iovcnt].iov_base = (uint8_t *)piov->iov_base + *iov_off;
+		iovs[iovcnt].iov_len = len;
+		iovcnt++;
+
+		*iov_off += len;
+		if (*iov_off == piov->iov_len) {
+			(*iov_idx)++;
+			*iov_off = 0;
+		}
+		nbytes -= len;
+	}
+
+	if (iovs != &child->u.write.iov) {
+		rio->iovs_used += iovcnt;
+	}
+
+	child->u.write.iovs = iovs;
+	child->u.write.iovcnt = iovcnt;
+
+	return 0;
+}
+
+/*
+ * Map a range of the RAID-0 blockdev onto the member holding its first
+ *  block.  Returns the member index and sets the offset on that member and
+ *  the number of blocks that stay within the same strip.
+ */
+static int
+blockdev_raid0_map(struct raid_disk *rdisk, uint64_t offset_blocks, uint64_t num_blocks,
+		   uint64_t *member_offset_blocks, uint64_t *member_num_blocks)
+{
+	uint64_t strip = offset_blocks >> rdisk->strip_shift;
+	uint64_t strip_blocks = 1ULL << rdisk->strip_shift;
+	uint64_t in_strip = offset_blocks & (strip_blocks - 1);
+
+	*member_offset_blocks = ((strip / rdisk->num_members) << rdisk->strip_shift) + in_strip;
+	*member_num_blocks = strip_blocks - in_strip;
+	if (*member_num_blocks > num_blocks) {
+		*member_num_blocks = num_blocks;
+	}
+
+	return strip % rdisk->num_members;
+}
+
+static void
+blockdev_raid0_read(struct spdk_bdev_io *bdev_io)
+{
+	struct raid_disk *rdisk = bdev_io->ctx;
+	uint64_t blocklen = rdisk->disk.blocklen;
+	uint64_t offset_blocks = bdev_io->u.read.offset / blocklen;
+	uint64_t num_blocks = bdev_io->u.read.nbytes / blocklen;
+	uint64_t member_offset_blocks, member_num_blocks;
+	uint8_t *buf = bdev_io->u.read.buf;
+	struct spdk_bdev_io *child;
+	int m;
+
+	while (num_blocks > 0) {
+		m = blockdev_raid0_map(rdisk, offset_blocks, num_blocks,
+				       &member_offset_blocks, &member_num_blocks);
+
+		child = blockdev_raid_get_child(bdev_io, m);
+		if (child == NULL) {
+			break;
+		}
+
+		child->u.read.buf = buf;
+		child->u.read.nbytes = member_num_blocks * blocklen;
+		child->u.read.offset = member_offset_blocks * blocklen;
+		blockdev_raid_submit_child(bdev_io, child, m);
+
+		buf += member_num_blocks * blocklen;
+		offset_blocks += member_num_blocks;
+		num_blocks -= member_num_blocks;
+	}
+}
+
+/*
+ * Send a RAID-1 read to the working mirror expected to answer first: the
+ *  one with the lowest product of queued I/O and recent latency.  Until a
+ *  member has latency samples this picks the one with the fewest I/O queued.
+ */
+static int
+blockdev_raid1_read(struct spdk_bdev_io *bdev_io)
+{
+	struct raid_disk *rdisk = bdev_io->ctx;
+	struct raid_member_state *ms;
+	struct spdk_bdev_io *child;
+	uint64_t cost, best_cost = UINT64_MAX;
+	int m, best = -1;
+
+	for (m = 0; m < rdisk->num_members; m++) {
+		ms = &rdisk->member_state[m];
+		if (ms->failed) {
+			continue;
+		}
+		cost = (uint64_t)(ms->outstanding + 1) * (ms->avg_latency ? ms->avg_latency : 1);
+		if (cost < best_cost) {
+			best_cost = cost;
+			best = m;
+		}
+	}
+
+	if (best < 0) {
+		SPDK_ERRLOG("%s: no working members left\n", rdisk->disk.name);
+		return -1;
+	}
+
+	child = blockdev_raid_get_child(bdev_io, best);
+	if (child == NULL) {
+		return -1;
+	}
+
+	blockdev_raid_submit_child(bdev_io, child, best);
+	return 0;
+}
+
+static void
+blockdev_raid_get_rbuf_cb(struct spdk_bdev_io *bdev_io)
+{
+	struct raid_disk *rdisk = bdev_io->ctx;
+
+	switch (rdisk->level) {
+	case 0:
+		blockdev_raid0_read(bdev_io);
+		break;
+	case 1:
+		blockdev_raid1_read(bdev_io);
+		break;
+	}
+
+	if (bdev_io->children == 0) {
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+	}
+}
+
+static void
+blockdev_raid0_write(struct spdk_bdev_io *bdev_io)
+{
+	struct raid_disk *rdisk = bdev_io->ctx;
+	uint64_t blocklen = rdisk->disk.blocklen;
+	uint64_t offset_blocks = bdev_io->u.write.offset / blocklen;
+	uint64_t num_blocks = bdev_io->u.write.len / blocklen;
+	uint64_t member_offset_blocks, member_num_blocks;
+	struct spdk_bdev_io *child;
+	size_t iov_off = 0;
+	int iov_idx = 0;
+	int m;
+
+	while (num_blocks > 0) {
+		m = blockdev_raid0_map(rdisk, offset_blocks, num_blocks,
+				       &member_offset_blocks, &member_num_blocks);
+
+		child = blockdev_raid_get_child(bdev_io, m);
+		if (child == NULL) {
+			break;
+		}
+
+		child->u.write.offset = member_offset_blocks * blocklen;
+		if (blockdev_raid_child_iovs(bdev_io, child, &iov_idx, &iov_off,
+					     member_num_blocks * blocklen) != 0) {
+			/* Never submitted, so complete it here as failed. */
+			child->status = SPDK_BDEV_IO_STATUS_FAILED;
+			TAILQ_REMOVE(&bdev_io->child_io, child, link);
+			bdev_io->children--;
+			((struct raid_io *)bdev_io->driver_ctx)->status = SPDK_BDEV_IO_STATUS_FAILED;
+			spdk_bdev_free_io(child);
+			break;
+		}
+		blockdev_raid_submit_child(bdev_io, child, m);
+
+		offset_blocks += member_num_blocks;
+		num_blocks -= member_num_blocks;
+	}
+}
+
+/*
+ * Mirror a write to every working member.  Each child carries a copy of
+ *  the parent's iovec list, so the data is not copied.
+ */
+static void
+blockdev_raid1_write(struct spdk_bdev_io *bdev_io)
+{
+	struct raid_disk *rdisk = bdev_io->ctx;
+	struct spdk_bdev_io *child;
+	int m;
+
+	for (m = 0; m < rdisk->num_members; m++) {
+		if (rdisk->member_state[m].failed) {
+			continue;
+		}
+
+		child = blockdev_raid_get_child(bdev_io, m);
+		if (child == NULL) {
+			continue;
+		}
+
+		blockdev_raid_submit_child(bdev_io, child, m);
+	}
+
+	if (bdev_io->children == 0) {
+		/* Nothing was sent: every mirror has failed. */
+		((struct raid_io *)bdev_io->driver_ctx)->status = SPDK_BDEV_IO_STATUS_FAILED;
+	}
+}
+
+/*
+ * Send a flush or reset to every member.  On RAID-0 a flush covers the
+ *  rows of strips that hold any part of the flushed range; on RAID-1 it is
+ *  passed through unchanged, and members that have failed are skipped.
+ */
+static void
+blockdev_raid_all_members(struct spdk_bdev_io *bdev_io)
+{
+	struct raid_disk *rdisk = bdev_io->ctx;
+	uint64_t blocklen = rdisk->disk.blocklen;
+	uint64_t first_row = 0, last_row = 0;
+	struct spdk_bdev_io *child;
+	int m;
+
+	if (bdev_io->type == SPDK_BDEV_IO_TYPE_FLUSH && rdisk->level == 0) {
+		if (bdev_io->u.flush.length == 0) {
+			return;
+		}
+		first_row = ((bdev_io->u.flush.offset / blocklen) >> rdisk->strip_shift) /
+			    rdisk->num_members;
+		last_row = (((bdev_io->u.flush.offset + bdev_io->u.flush.length - 1) / blocklen) >>
+			    rdisk->strip_shift) / rdisk->num_members;
+	}
+
+	for (m = 0; m < rdisk->num_members; m++) {
+		if (rdisk->member_state[m].failed) {
+			continue;
+		}
+
+		child = blockdev_raid_get_child(bdev_io, m);
+		if (child == NULL) {
+			break;
+		}
+
+		if (bdev_io->type == SPDK_BDEV_IO_TYPE_FLUSH && rdisk->level == 0) {
+			child->u.flush.offset = (first_row << rdisk->strip_shift) * blocklen;
+			child->u.flush.length = ((last_row - first_row + 1) << rdisk->strip_shift) * blocklen;
+		}
+		blockdev_raid_submit_child(bdev_io, child, m);
+	}
+
+	if (bdev_io->children == 0) {
+		/* Nothing was sent: every mirror has failed. */
+		((struct raid_io *)bdev_io->driver_ctx)->status = SPDK_BDEV_IO_STATUS_FAILED;
+	}
+}
+
+static int
+_blockdev_raid_submit_request(struct spdk_bdev_io *bdev_io)
+{
+	struct raid_disk *rdisk = bdev_io->ctx;
+	struct raid_io *rio = (struct raid_io *)bdev_io->driver_ctx;
+
+	rio->status = SPDK_BDEV_IO_STATUS_SUCCESS;
+	rio->num_ok = 0;
+	rio->iovs_used = 0;
+
+	switch (bdev_io->type) {
+	case SPDK_BDEV_IO_TYPE_READ:
+		/* A caller that passed no buffer gets one from the bdev layer's pool. */
+		spdk_bdev_io_get_rbuf(bdev_io, blockdev_raid_get_rbuf_cb);
+		return 0;
+
+	case SPDK_BDEV_IO_TYPE_WRITE:
+		switch (rdisk->level) {
+		case 0:
+			blockdev_raid0_write(bdev_io);
+			break;
+		case 1:
+			blockdev_raid1_write(bdev_io);
+			break;
+		}
+		break;
+
+	case SPDK_BDEV_IO_TYPE_RESET:
+		if (bdev_io->u.reset.type != SPDK_BDEV_RESET_SOFT) {
+			SPDK_ERRLOG("%s: only soft resets are supported on a RAID blockdev\n",
+				    rdisk->disk.name);
+			return -1;
+		}
+		blockdev_raid_all_members(bdev_io);
+		break;
+
+	case SPDK_BDEV_IO_TYPE_FLUSH:
+		blockdev_raid_all_members(bdev_io);
+		break;
+
+	default:
+		return -1;
+	}
+
+	if (bdev_io->children == 0) {
+		/* Nothing was submitted; only an empty flush succeeds that way. */
+		if (rio->status == SPDK_BDEV_IO_STATUS_SUCCESS) {
+			spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_SUCCESS);
+			return 0;
+		}
+		return -1;
+	}
+
+	return 0;
+}
+
+static void
+blockdev_raid_submit_request(struct spdk_bdev_io *bdev_io)
+{
+	if (_blockdev_raid_submit_request(bdev_io) < 0) {
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+	}
+}
+
+static void
+blockdev_raid_free_request(struct spdk_bdev_io *bdev_io)
+{
+}
+
+static int
+blockdev_raid_check_io(struct spdk_bdev *bdev)
+{
+	/* Child I/O is polled by the members' own pollers. */
+	return 0;
+}
+
+static void
+blockdev_raid_release_members(struct raid_disk *rdisk)
+{
+	int m;
+
+	for (m = 0; m < rdisk->num_members; m++) {
+		rdisk->members[m]->claimed = false;
+	}
+}
+
+static int
+blockdev_raid_destruct(struct spdk_bdev *bdev)
+{
+	struct raid_disk *rdisk = (struct raid_disk *)bdev;
+
+	TAILQ_REMOVE(&g_raid_disks, rdisk, tailq);
+	blockdev_raid_release_members(rdisk);
+	rte_free(rdisk);
+
+	return 0;
+}
+
+static struct spdk_bdev_fn_table raid_fn_table = {
+	.destruct	= blockdev_raid_destruct,
+	.check_io	= blockdev_raid_check_io,
+	.submit_request	= blockdev_raid_submit_request,
+	.free_request	= blockdev_raid_free_request,
+};
+
+static struct raid_disk *
+create_raid_disk(const char *name, int level, uint32_t strip_size_kb,
+		 struct spdk_bdev **members, int num_members)
+{
+	struct raid_disk *rdisk;
+	uint64_t strip_blocks = 1, member_blockcnt;
+	int m, j, min_members;
+
+	switch (level) {
+	case 0:
+		min_members = 1;
+		break;
+	case 1:
+		min_members = 2;
+		break;
+	default:
+		SPDK_ERRLOG("%s: RAID level %d is not supported\n", name, level);
+		return NULL;
+	}
+
+	if (num_members < min_members || num_members > RAID_MAX_MEMBERS) {
+		SPDK_ERRLOG("%s: RAID%d needs %d to %d member devices\n", name, level,
+			    min_members, RAID_MAX_MEMBERS);
+		return NULL;
+	}
+
+	for (m = 0; m < num_members; m++) {
+		if (members[m]->claimed) {
+			SPDK_ERRLOG("%s: %s is already in use\n", name, members[m]->name);
+			return NULL;
+		}
+		for (j = 0; j < m; j++) {
+			if (members[j] == members[m]) {
+				SPDK_ERRLOG("%s: %s is listed more than once\n", name, members[m]->name);
+				return NULL;
+			}
+		}
+		if (members[m]->blocklen != members[0]->blocklen) {
+			SPDK_ERRLOG("%s: members have different block sizes\n", name);
+			return NULL;
+		}
+	}
+
+	if (level == 0) {
+		strip_blocks = (uint64_t)strip_size_kb * 1024 / members[0]->blocklen;
+	}
+	if (strip_blocks == 0 || (strip_blocks & (strip_blocks - 1)) != 0 ||
+	    (level == 0 && strip_blocks * members[0]->blocklen != (uint64_t)strip_size_kb * 1024)) {
+		SPDK_ERRLOG("%s: strip size %uKB is not a power-of-two number of blocks\n",
+			    name, strip_size_kb);
+		return NULL;
+	}
+
+	/*
+	 * Use whole strips on every member, as many as the smallest one holds.
+	 *  Mirrors are not striped and use every block of the smallest member.
+	 */
+	member_blockcnt = members[0]->blockcnt;
+	for (m = 1; m < num_members; m++) {
+		if (members[m]->blockcnt < member_blockcnt) {
+			member_blockcnt = members[m]->blockcnt;
+		}
+	}
+	member_blockcnt &= ~(strip_blocks - 1);
+	if (member_blockcnt == 0) {
+		SPDK_ERRLOG("%s: members are smaller than one strip\n", name);
+		return NULL;
+	}
+
+	rdisk = rte_zmalloc(NULL, sizeof(*rdisk), 0);
+	if (!rdisk) {
+		SPDK_ERRLOG("rte_zmalloc failed\n");
+		return NULL;
+	}
+
+	rdisk->level = level;
+	rdisk->strip_shift = __builtin_ctzll(strip_blocks);
+	rdisk->num_members = num_members;
+	rdisk->disk.socket_id = members[0]->socket_id;
+	for (m = 0; m < num_members; m++) {
+		rdisk->members[m] = members[m];
+		members[m]->claimed = true;
+		if (members[m]->socket_id != rdisk->disk.socket_id) {
+			rdisk->disk.socket_id = -1;
+		}
+	}
+
+	snprintf(rdisk->disk.name, SPDK_BDEV_MAX_NAME_LENGTH, "%s", name);
+	snprintf(rdisk->disk.product_name, SPDK_BDEV_MAX_PRODUCT_NAME_LENGTH, "RAID%d disk", level);
+	rdisk->disk.blocklen = members[0]->blocklen;
+	rdisk->disk.blockcnt = level == 0 ? member_blockcnt * num_members : member_blockcnt;
+	rdisk->disk.child_bdevs = rdisk->members;
+	rdisk->disk.num_child_bdevs = num_members;
+	rdisk->disk.ctxt = rdisk;
+	rdisk->disk.fn_table = &raid_fn_table;
+
+	spdk_bdev_register(&rdisk->disk);
+	TAILQ_INSERT_TAIL(&g_raid_disks, rdisk, tailq);
+
+	if (level == 0) {
+		SPDK_NOTICELOG("%s: RAID0 over %d devices, %uKB strips, %" PRIu64 " blocks\n",
+			       name, num_members, strip_size_kb, rdisk->disk.blockcnt);
+	} else {
+		SPDK_NOTICELOG("%s: RAID1 over %d devices, %" PRIu64 " blocks\n",
+			       name, num_members, rdisk->disk.blockcnt);
+	}
+
+	return rdisk;
+}
+
+static int
+blockdev_raid_construct(struct spdk_conf_section *sp)
+{
+	struct spdk_bdev *members[RAID_MAX_MEMBERS];
+	char name[SPDK_BDEV_MAX_NAME_LENGTH];
+	const char *val;
+	int level, strip_size_kb, num_members;
+
+	val = spdk_conf_section_get_val(sp, "Name");
+	if (val != NULL) {
+		snprintf(name, sizeof(name), "%s", val);
+	} else {
+		snprintf(name, sizeof(name), "Raid%d", sp->num);
+	}
+
+	level = spdk_conf_section_get_intval(sp, "RaidLevel");
+	if (level < 0) {
+		SPDK_ERRLOG("%s: RaidLevel is required\n", name);
+		return -1;
+	}
+
+	strip_size_kb = spdk_conf_section_get_intval(sp, "StripSizeKB");
+	if (strip_size_kb < 0) {
+		strip_size_kb = RAID_DEFAULT_STRIP_SIZE_KB;
+	}
+
+	for (num_members = 0; ; num_members++) {
+		val = spdk_conf_section_get_nmval(sp, "Devices", 0, num_members);
+		if (val == NULL) {
+			break;
+		}
+		if (num_members == RAID_MAX_MEMBERS) {
+			SPDK_ERRLOG("%s: more than %d devices\n", name, RAID_MAX_MEMBERS);
+			return -1;
+		}
+		members[num_members] = spdk_bdev_db_get_by_name(val);
+		if (members[num_members] == NULL) {
+			SPDK_ERRLOG("%s: device %s not found\n", name, val);
+			return -1;
+		}
+	}
+
+	if (create_raid_disk(name, level, strip_size_kb, members, num_members) == NULL) {
+		return -1;
+	}
+
+	return 0;
+}
+
+static int
+blockdev_raid_initialize(void)
+{
+	struct spdk_conf_section *sp;
+
+	for (sp = spdk_conf_first_section(NULL); sp != NULL; sp = spdk_conf_next_section(sp)) {
+		if (!spdk_conf_section_match_prefix(sp, "Raid")) {
+			continue;
+		}
+		if (blockdev_raid_construct(sp) != 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void
+blockdev_raid_finish(void)
+{
+	struct raid_disk *rdisk;
+
+	while (!TAILQ_EMPTY(&g_raid_disks)) {
+		rdisk = TAILQ_FIRST(&g_raid_disks);
+		TAILQ_REMOVE(&g_raid_disks, rdisk, tailq);
+		blockdev_raid_release_members(rdisk);
+		rte_free(rdisk);
+	}
+}
+
+static void
+blockdev_raid_get_spdk_running_config(FILE *fp)
+{
+	struct raid_disk *rdisk;
+	int i = 0, m;
+
+	TAILQ_FOREACH(rdisk, &g_raid_disks, tailq) {
+		fprintf(fp, "\n[Raid%d]\n", i++);
+		fprintf(fp, "  Name %s\n", rdisk->disk.name);
+		fprintf(fp, "  RaidLevel %d\n", rdisk->level);
+		if (rdisk->level == 0) {
+			fprintf(fp, "  StripSizeKB %" PRIu64 "\n",
+				((uint64_t)1 << rdisk->strip_shift) * rdisk->disk.blocklen / 1024);
+		}
+		fprintf(fp, "  Devices");
+		for (m = 0; m < rdisk->num_members; m++) {
+			fprintf(fp, " %s", rdisk->members[m]->name);
+		}
+		fprintf(fp, "\n");
+	}
+}
@@ -0,0 +1,461 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Split a blockdev into partitions.
+ *
+ * Each partition is a blockdev covering a fixed range of the base blockdev.
+ *  An I/O to a partition is not copied into a child: the same spdk_bdev_io
+ *  is handed on to the base blockdev with its offset moved into the
+ *  partition's range, and the base completes it directly to the caller,
+ *  which gets its own offset back.  Unmaps and resets go through a child;
+ *  an unmap's block descriptors are moved in place while it runs.
+ *
+ * All partitions of a blockdev share its poller and, for NVMe, its queue
+ *  pair.  A reset of a partition is a reset of the whole base blockdev, so
+ *  it is passed on as a soft reset, and hard resets are refused: bumping
+ *  the base's generation would silently drop the I/O of every other
+ *  partition, while I/O already handed to the base would not be dropped.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <endian.h>
+
+#include <rte_config.h>
+#include <rte_malloc.h>
+
+#include "spdk/bdev.h"
+#include "spdk/bdev_db.h"
+#include "spdk/conf.h"
+#include "spdk/log.h"
+#include "spdk/queue.h"
+#include "spdk/scsi_spec.h"
+
+/* Partitions sized automatically start on a boundary of this many bytes. */
+#define SPLIT_ALIGNMENT		(1024 * 1024)
+
+#define SPLIT_MAX_COUNT		256
+
+struct split_base;
+
+struct split_disk {
+	struct spdk_bdev	disk;	/* this must be the first element */
+	struct spdk_bdev	*base;
+	struct split_base	*sbase;
+
+	/* First block of the partition on the base blockdev */
+	uint64_t		offset_blocks;
+};
+
+struct split_base {
+	struct spdk_bdev	*base;
+	int			split_count;
+
+	/* As configured; 0 when the partitions were sized automatically */
+	int			split_size_mb;
+
+	/* Partitions not yet destructed */
+	int			num_registered;
+	struct split_disk	*parts;
+	TAILQ_ENTRY(split_base)	tailq;
+};
+
+static TAILQ_HEAD(, split_base) g_split_bases = TAILQ_HEAD_INITIALIZER(g_split_bases);
+
+static int blockdev_split_initialize(void);
+static void blockdev_split_finish(void);
+static void blockdev_split_get_spdk_running_config(FILE *fp);
+
+static int
+blockdev_split_get_ctx_size(void)
+{
+	/* Partition I/O runs in the base blockdev's context. */
+	return 0;
+}
+
+SPDK_VBDEV_MODULE_REGISTER(blockdev_split_initialize, blockdev_split_finish,
+			   blockdev_split_get_spdk_running_config, blockdev_split_get_ctx_size)
+
+/* Move the unmap block descriptors by delta blocks. */
+static void
+blockdev_split_shift_unmap(struct spdk_bdev_io *bdev_io, int64_t delta)
+{
+	struct spdk_scsi_unmap_bdesc *bdesc = bdev_io->u.unmap.unmap_bdesc;
+	int i;
+
+	for (i = 0; i < bdev_io->u.unmap.bdesc_count; i++) {
+		bdesc[i].lba = htobe64(be64toh(bdesc[i].lba) + delta);
+	}
+}
+
+static void
+blockdev_split_child_done(spdk_event_t event)
+{
+	struct spdk_bdev_io *parent = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *child = spdk_event_get_arg2(event);
+	struct split_disk *part = parent->ctx;
+	enum spdk_bdev_io_status status = child->status;
+
+	TAILQ_REMOVE(&parent->child_io, child, link);
+	parent->children--;
+	spdk_bdev_free_io(child);
+
+	/* Give the caller back its own block descriptors. */
+	if (parent->type == SPDK_BDEV_IO_TYPE_UNMAP) {
+		blockdev_split_shift_unmap(parent, -(int64_t)part->offset_blocks);
+	}
+
+	spdk_bdev_io_complete(parent, status);
+}
+
+static int
+blockdev_split_reset(struct split_disk *part, struct spdk_bdev_io *bdev_io)
+{
+	struct spdk_bdev_io *child;
+
+	if (bdev_io->u.reset.type != SPDK_BDEV_RESET_SOFT) {
+		SPDK_ERRLOG("%s: only soft resets are supported on a partition\n",
+			    part->disk.name);
+		return -1;
+	}
+
+	child = spdk_bdev_get_child_io(bdev_io, part->base, blockdev_split_child_done, bdev_io);
+	if (child == NULL) {
+		return -1;
+	}
+
+	spdk_bdev_io_submit(child);
+	return 0;
+}
+
+static int
+blockdev_split_unmap(struct split_disk *part, struct spdk_bdev_io *bdev_io)
+{
+	struct spdk_scsi_unmap_bdesc *bdesc = bdev_io->u.unmap.unmap_bdesc;
+	struct spdk_bdev_io *child;
+	uint64_t lba;
+	uint32_t count;
+	int i;
+
+	/* Check them all first, so that a failed unmap leaves them unchanged. */
+	for (i = 0; i < bdev_io->u.unmap.bdesc_count; i++) {
+		lba = be64toh(bdesc[i].lba);
+		count = be32toh(bdesc[i].block_count);
+		if (lba >= part->disk.blockcnt || count > part->disk.blockcnt - lba) {
+			SPDK_ERRLOG("%s: unmap of %u blocks at %" PRIu64 " is out of range\n",
+				    part->disk.name, count, lba);
+			return -1;
+		}
+	}
+
+	/*
+	 * The child shares the caller's block descriptors, so they are moved
+	 *  into the base's range in place and moved back when it completes.
+	 */
+	child = spdk_bdev_get_child_io(bdev_io, part->base, blockdev_split_child_done, bdev_io);
+	if (child == NULL) {
+		return -1;
+	}
+
+	blockdev_split_shift_unmap(bdev_io, part->offset_blocks);
+	spdk_bdev_io_submit(child);
+	return 0;
+}
+
+static int
+_blockdev_split_submit_request(struct spdk_bdev_io *bdev_io)
+{
+	struct split_disk *part = bdev_io->ctx;
+	uint64_t size = part->disk.blockcnt * part->disk.blocklen;
+	uint64_t offset, length;
+
+	switch (bdev_io->type) {
+	case SPDK_BDEV_IO_TYPE_READ:
+		offset = bdev_io->u.read.offset;
+		length = bdev_io->u.read.nbytes;
+		break;
+
+	case SPDK_BDEV_IO_TYPE_WRITE:
+		offset = bdev_io->u.write.offset;
+		length = bdev_io->u.write.len;
+		break;
+
+	case SPDK_BDEV_IO_TYPE_LEASE:
+		offset = bdev_io->u.lease.offset;
+		length = bdev_io->u.lease.nbytes;
+		break;
+
+	case SPDK_BDEV_IO_TYPE_FLUSH:
+		offset = bdev_io->u.flush.offset;
+		if (offset >= size) {
+			spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_SUCCESS);
+			return 0;
+		}
+		length = bdev_io->u.flush.length;
+		if (length > size - offset) {
+			length = size - offset;
+		}
+		break;
+
+	case SPDK_BDEV_IO_TYPE_UNMAP:
+		return blockdev_split_unmap(part, bdev_io);
+
+	case SPDK_BDEV_IO_TYPE_RESET:
+		return blockdev_split_reset(part, bdev_io);
+
+	default:
+		return -1;
+	}
+
+	return spdk_bdev_io_resubmit(bdev_io, part->base,
+				     offset + part->offset_blocks * part->disk.blocklen, length);
+}
+
+static void
+blockdev_split_submit_request(struct spdk_bdev_io *bdev_io)
+{
+	if (_blockdev_split_submit_request(bdev_io) < 0) {
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+	}
+}
+
+static void
+blockdev_split_free_request(struct spdk_bdev_io *bdev_io)
+{
+	/*
+	 * Only failed I/O, resets and unmaps are freed here; everything else
+	 *  was handed to the base blockdev and is freed through it.
+	 */
+}
+
+static int
+blockdev_split_check_io(struct spdk_bdev *bdev)
+{
+	/* Partition I/O is polled by the base blockdev's own poller. */
+	return 0;
+}
+
+static void
+split_base_free(struct split_base *sbase)
+{
+	sbase->base->claimed = false;
+	rte_free(sbase->parts);
+	free(sbase);
+}
+
+static int
+blockdev_split_destruct(struct spdk_bdev *bdev)
+{
+	struct split_disk *part = (struct split_disk *)bdev;
+	struct split_base *sbase = part->sbase;
+
+	if (--sbase->num_registered == 0) {
+		TAILQ_REMOVE(&g_split_bases, sbase, tailq);
+		split_base_free(sbase);
+	}
+
+	return 0;
+}
+
+static struct spdk_bdev_fn_table split_fn_table = {
+	.destruct	= blockdev_split_destruct,
+	.check_io	= blockdev_split_check_io,
+	.submit_request	= blockdev_split_submit_request,
+	.free_request	= blockdev_split_free_request,
+};
+
+static int
+create_split_disks(struct spdk_bdev *base, int split_count, int split_size_mb)
+{
+	struct split_base *sbase;
+	struct split_disk *part;
+	uint64_t part_blocks, align_blocks;
+	int i;
+
+	if (base->claimed) {
+		SPDK_ERRLOG("Split: %s is already in use\n", base->name);
+		return -1;
+	}
+
+	if (split_size_mb > 0) {
+		part_blocks = ((uint64_t)split_size_mb * 1024 * 1024) / base->blocklen;
+		if (part_blocks * split_count > base->blockcnt) {
+			SPDK_ERRLOG("Split: %d partitions of %dMB do not fit on %s\n",
+				    split_count, split_size_mb, base->name);
+			return -1;
+		}
+	} else {
+		part_blocks = base->blockcnt / split_count;
+		align_blocks = SPLIT_ALIGNMENT / base->blocklen;
+		if (align_blocks > 0 && part_blocks >= align_blocks) {
+			part_blocks -= part_blocks % align_blocks;
+		}
+	}
+
+	if (part_blocks == 0) {
+		SPDK_ERRLOG("Split: %s is too small for %d partitions\n", base->name, split_count);
+		return -1;
+	}
+
+	sbase = calloc(1, sizeof(*sbase));
+	if (!sbase) {
+		SPDK_ERRLOG("could not allocate split_base\n");
+		return -1;
+	}
+
+	sbase->parts = rte_zmalloc_socket(NULL, split_count * sizeof(struct split_disk), 0,
+					  base->socket_id < 0 ? SOCKET_ID_ANY : base->socket_id);
+	if (!sbase->parts) {
+		SPDK_ERRLOG("rte_zmalloc failed\n");
+		free(sbase);
+		return -1;
+	}
+
+	sbase->base = base;
+	sbase->split_count = split_count;
+	sbase->split_size_mb = split_size_mb;
+	base->claimed = true;
+
+	for (i = 0; i < split_count; i++) {
+		part = &sbase->parts[i];
+		part->base = base;
+		part->sbase = sbase;
+		part->offset_blocks = part_blocks * i;
+
+		snprintf(part->disk.name, SPDK_BDEV_MAX_NAME_LENGTH, "%sp%d", base->name, i);
+		snprintf(part->disk.product_name, SPDK_BDEV_MAX_PRODUCT_NAME_LENGTH, "Split disk");
+		part->disk.blocklen = base->blocklen;
+		part->disk.blockcnt = part_blocks;
+		part->disk.write_cache = base->write_cache;
+		part->disk.need_aligned_buffer = base->need_aligned_buffer;
+		part->disk.thin_provisioning = base->thin_provisioning;
+		part->disk.max_unmap_bdesc_count = base->max_unmap_bdesc_count;
+		part->disk.lease_supported = base->lease_supported;
+		part->disk.socket_id = base->socket_id;
+		part->disk.child_bdevs = &sbase->base;
+		part->disk.num_child_bdevs = 1;
+		part->disk.ctxt = part;
+		part->disk.fn_table = &split_fn_table;
+
+		spdk_bdev_register(&part->disk);
+		sbase->num_registered++;
+	}
+
+	TAILQ_INSERT_TAIL(&g_split_bases, sbase, tailq);
+
+	SPDK_NOTICELOG("Split %s into %d partitions of %" PRIu64 " blocks\n",
+		       base->name, split_count, part_blocks);
+
+	return 0;
+}
+
+static int
+blockdev_split_construct(struct spdk_conf_section *sp)
+{
+	struct spdk_bdev *base;
+	const char *val;
+	int split_count, split_size_mb;
+
+	val = spdk_conf_section_get_val(sp, "Device");
+	if (val == NULL) {
+		SPDK_ERRLOG("Split%d: Device is required\n", sp->num);
+		return -1;
+	}
+	base = spdk_bdev_db_get_by_name(val);
+	if (base == NULL) {
+		SPDK_ERRLOG("Split%d: device %s not found\n", sp->num, val);
+		return -1;
+	}
+
+	split_count = spdk_conf_section_get_intval(sp, "SplitCount");
+	if (split_count < 1 || split_count > SPLIT_MAX_COUNT) {
+		SPDK_ERRLOG("Split%d: SplitCount must be between 1 and %d\n",
+			    sp->num, SPLIT_MAX_COUNT);
+		return -1;
+	}
+
+	split_size_mb = spdk_conf_section_get_intval(sp, "SplitSizeMB");
+	if (split_size_mb < 0) {
+		split_size_mb = 0;
+	}
+
+	return create_split_disks(base, split_count, split_size_mb);
+}
+
+static int
+blockdev_split_initialize(void)
+{
+	struct spdk_conf_section *sp;
+
+	for (sp = spdk_conf_first_section(NULL); sp != NULL; sp = spdk_conf_next_section(sp)) {
+		if (!spdk_conf_section_match_prefix(sp, "Split")) {
+			continue;
+		}
+		if (blockdev_split_construct(sp) != 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void
+blockdev_split_finish(void)
+{
+	struct split_base *sbase;
+
+	while (!TAILQ_EMPTY(&g_split_bases)) {
+		sbase = TAILQ_FIRST(&g_split_bases);
+		TAILQ_REMOVE(&g_split_bases, sbase, tailq);
+		split_base_free(sbase);
+	}
+}
+
+static void
+blockdev_split_get_spdk_running_config(FILE *fp)
+{
+	struct split_base *sbase;
+	int i = 0;
+
+	TAILQ_FOREACH(sbase, &g_split_bases, tailq) {
+		fprintf(fp, "\n[Split%d]\n", i++);
+		fprintf(fp, "  Device %s\n", sbase->base->name);
+		fprintf(fp, "  SplitCount %d\n", sbase->split_count);
+		if (sbase->split_size_mb != 0) {
+			fprintf(fp, "  SplitSizeMB %d\n", sbase->split_size_mb);
+		}
+	}
+}
@@ -35,22 +35,66 @@
 
 #include <stdio.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
 #include <rte_config.h>
 #include <rte_debug.h>
 #include <rte_malloc.h>
 #include <rte_memcpy.h>
 #include <rte_lcore.h>
+#include <rte_cycles.h>
+#include <rte_hash_crc.h>
 
+#include "spdk/conf.h"
 #include "spdk/log.h"
 #include "spdk/event.h"
 
+#include "copy_engine_internal.h"
+
 struct mem_request {
 	struct mem_request	*next;
 	copy_completion_cb	cb;
+	int			status;
 };
 
+/*
+ * Dualcast copies the source in pieces of this size so that it is still in
+ *  cache when it is copied to the second destination.
+ */
+#define MEM_DUALCAST_CHUNK_SIZE	(16 * 1024)
+
+/* rte_hash_crc() takes a 32-bit length. */
+#define MEM_CRC32C_CHUNK_SIZE	(1U << 30)
+
 struct mem_request *copy_engine_req_head[RTE_MAX_LCORE];
 
+/*
+ * Requests below this size run on the CPU even when a hardware engine is
+ *  present, as do requests made while an lcore already has the maximum number
+ *  outstanding on the hardware.
+ */
+#define COPY_DEFAULT_HW_MAX_OUTSTANDING	64
+#define COPY_CALIBRATE_MIN_SIZE		512
+#define COPY_CALIBRATE_MAX_SIZE		(1024 * 1024)
+#define COPY_CALIBRATE_ITERATIONS	32
+
+struct copy_engine_lcore {
+	uint32_t			hw_outstanding;
+	struct spdk_copy_engine_stats	stats;
+} __rte_cache_aligned;
+
+/*
+ * The memcpy engine writes copies of at least this size with non-temporal
+ *  stores so they do not evict the reactor's working set.  0 disables it.
+ */
+#define COPY_DEFAULT_NT_THRESHOLD	(64 * 1024)
+
+static struct copy_engine_lcore g_copy_lcore[RTE_MAX_LCORE];
+static uint64_t g_nt_threshold = COPY_DEFAULT_NT_THRESHOLD;
+static uint64_t g_hw_threshold = 0;
+static uint32_t g_hw_max_outstanding = COPY_DEFAULT_HW_MAX_OUTSTANDING;
+
 static struct spdk_copy_engine *hw_copy_engine = NULL;
 /* Memcpy engine always exist */
 static struct spdk_copy_engine *mem_copy_engine = NULL;
@@ -83,8 +127,9 @@ spdk_copy_check_io(void)
 {
 	if (spdk_has_copy_engine())
 		hw_copy_engine->check_io();
-	else
-		mem_copy_engine->check_io();
+
+	/* Operations the hardware engine lacks complete through the memcpy engine. */
+	mem_copy_engine->check_io();
 
 	return 0;
 }
@@ -97,23 +142,319 @@ copy_engine_done(void *ref, int status)
 	req->cb(req, status);
 }
 
+static void
+copy_engine_hw_done(void *ref, int status)
+{
+	struct copy_task *req = (struct copy_task *)ref;
+
+	g_copy_lcore[rte_lcore_id()].hw_outstanding--;
+	req->cb(req, status);
+}
+
+/*
+ * Decide whether a request of nbytes goes to the hardware engine.  hw_op is
+ *  false when there is no hardware engine or it lacks the operation.
+ */
+static bool
+copy_engine_route_hw(bool hw_op, uint64_t nbytes)
+{
+	struct copy_engine_lcore *lcore = &g_copy_lcore[rte_lcore_id()];
+
+	if (hw_op) {
+		if (nbytes < g_hw_threshold) {
+			lcore->stats.cpu_small_ops++;
+		} else if (lcore->hw_outstanding >= g_hw_max_outstanding) {
+			lcore->stats.cpu_backlog_ops++;
+		} else {
+			lcore->hw_outstanding++;
+			lcore->stats.hw_ops++;
+			lcore->stats.hw_bytes += nbytes;
+			return true;
+		}
+	}
+
+	lcore->stats.cpu_ops++;
+	lcore->stats.cpu_bytes += nbytes;
+	return false;
+}
+
+/*
+ * The hardware engine refused a request (usually because its ring is full)
+ *  without starting any of it, so it can be run on the CPU instead.
+ */
+static void
+copy_engine_hw_refused(uint64_t nbytes)
+{
+	struct copy_engine_lcore *lcore = &g_copy_lcore[rte_lcore_id()];
+
+	lcore->hw_outstanding--;
+	lcore->stats.hw_ops--;
+	lcore->stats.hw_bytes -= nbytes;
+	lcore->stats.cpu_backlog_ops++;
+	lcore->stats.cpu_ops++;
+	lcore->stats.cpu_bytes += nbytes;
+}
+
 int64_t
 spdk_copy_submit(struct copy_task *copy_req, void *dst, void *src,
 		 uint64_t nbytes, copy_completion_cb cb)
 {
 	struct copy_task *req = copy_req;
+	int64_t rc;
 
 	req->cb = cb;
 
-	if (spdk_has_copy_engine())
-		return hw_copy_engine->copy(req->offload_ctx, dst, src, nbytes,
-					    copy_engine_done);
+	if (copy_engine_route_hw(spdk_has_copy_engine(), nbytes)) {
+		rc = hw_copy_engine->copy(req->offload_ctx, dst, src, nbytes,
+					  copy_engine_hw_done);
+		if (rc >= 0) {
+			return rc;
+		}
+		copy_engine_hw_refused(nbytes);
+	}
 
 	return mem_copy_engine->copy(req->offload_ctx, dst, src, nbytes,
 				     copy_engine_done);
 }
 
+int64_t
+spdk_copy_submitv(struct copy_task *copy_req, struct iovec *dst_iovs, int dst_iovcnt,
+		  struct iovec *src_iovs, int src_iovcnt, copy_completion_cb cb)
+{
+	struct copy_task *req = copy_req;
+	uint64_t nbytes = 0;
+	int64_t rc;
+	int i;
+
+	req->cb = cb;
+
+	for (i = 0; i < src_iovcnt; i++) {
+		nbytes += src_iovs[i].iov_len;
+	}
+
+	if (copy_engine_route_hw(spdk_has_copy_engine() && hw_copy_engine->copyv, nbytes)) {
+		rc = hw_copy_engine->copyv(req->offload_ctx, dst_iovs, dst_iovcnt,
+					   src_iovs, src_iovcnt, copy_engine_hw_done);
+		if (rc >= 0) {
+			return rc;
+		}
+		copy_engine_hw_refused(nbytes);
+	}
+
+	return mem_copy_engine->copyv(req->offload_ctx, dst_iovs, dst_iovcnt,
+				      src_iovs, src_iovcnt, copy_engine_done);
+}
+
+int64_t
+spdk_copy_submit_fill(struct copy_task *copy_req, void *dst, uint8_t fill,
+		      uint64_t nbytes, copy_completion_cb cb)
+{
+	struct copy_task *req = copy_req;
+	int64_t rc;
+
+	req->cb = cb;
+
+	if (copy_engine_route_hw(spdk_has_copy_engine() && hw_copy_engine->fill, nbytes)) {
+		rc = hw_copy_engine->fill(req->offload_ctx, dst, fill, nbytes,
+					  copy_engine_hw_done);
+		if (rc >= 0) {
+			return rc;
+		}
+		copy_engine_hw_refused(nbytes);
+	}
+
+	return mem_copy_engine->fill(req->offload_ctx, dst, fill, nbytes,
+				     copy_engine_done);
+}
+
+int64_t
+spdk_copy_submit_compare(struct copy_task *copy_req, void *src1, void *src2,
+			 uint64_t nbytes, copy_completion_cb cb)
+{
+	struct copy_task *req = copy_req;
+	int64_t rc;
+
+	req->cb = cb;
+
+	if (copy_engine_route_hw(spdk_has_copy_engine() && hw_copy_engine->compare, nbytes)) {
+		rc = hw_copy_engine->compare(req->offload_ctx, src1, src2, nbytes,
+					     copy_engine_hw_done);
+		if (rc >= 0) {
+			return rc;
+		}
+		copy_engine_hw_refused(nbytes);
+	}
+
+	return mem_copy_engine->compare(req->offload_ctx, src1, src2, nbytes,
+					copy_engine_done);
+}
+
+int64_t
+spdk_copy_submit_crc32c(struct copy_task *copy_req, uint32_t *dst, void *src,
+			uint32_t seed, uint64_t nbytes, copy_completion_cb cb)
+{
+	struct copy_task *req = copy_req;
+	int64_t rc;
+
+	req->cb = cb;
+
+	if (copy_engine_route_hw(spdk_has_copy_engine() && hw_copy_engine->crc32c, nbytes)) {
+		rc = hw_copy_engine->crc32c(req->offload_ctx, dst, src, seed, nbytes,
+					    copy_engine_hw_done);
+		if (rc >= 0) {
+			return rc;
+		}
+		copy_engine_hw_refused(nbytes);
+	}
+
+	return mem_copy_engine->crc32c(req->offload_ctx, dst, src, seed, nbytes,
+				       copy_engine_done);
+}
+
+int64_t
+spdk_copy_submit_dualcast(struct copy_task *copy_req, void *dst1, void *dst2,
+			  void *src, uint64_t nbytes, copy_completion_cb cb)
+{
+	struct copy_task *req = copy_req;
+	int64_t rc;
+
+	req->cb = cb;
+
+	if (copy_engine_route_hw(spdk_has_copy_engine() && hw_copy_engine->dualcast, nbytes)) {
+		rc = hw_copy_engine->dualcast(req->offload_ctx, dst1, dst2, src, nbytes,
+					      copy_engine_hw_done);
+		if (rc >= 0) {
+			return rc;
+		}
+		copy_engine_hw_refused(nbytes);
+	}
+
+	return mem_copy_engine->dualcast(req->offload_ctx, dst1, dst2, src, nbytes,
+					 copy_engine_done);
+}
+
+uint64_t
+spdk_copy_engine_get_hw_threshold(void)
+{
+	return g_hw_threshold;
+}
+
+void
+spdk_copy_engine_get_stats(uint32_t lcore, struct spdk_copy_engine_stats *stats)
+{
+	RTE_VERIFY(lcore < RTE_MAX_LCORE);
+	*stats = g_copy_lcore[lcore].stats;
+}
+
+int64_t
+spdk_copy_iov_walk(struct iovec *dst_iovs, int dst_iovcnt, struct iovec *src_iovs, int src_iovcnt,
+		   int (*fn)(void *dst, void *src, uint64_t nbytes, void *ctx), void *ctx)
+{
+	uint64_t dst_off = 0, src_off = 0, len;
+	uint64_t dst_len = 0, src_len = 0;
+	int64_t total = 0;
+	int d = 0, s = 0;
+
+	for (d = 0; d < dst_iovcnt; d++) {
+		dst_len += dst_iovs[d].iov_len;
+	}
+	for (s = 0; s < src_iovcnt; s++) {
+		src_len += src_iovs[s].iov_len;
+	}
+	if (dst_len != src_len) {
+		SPDK_ERRLOG("Copy source length %" PRIu64 " differs from destination length %" PRIu64 "\n",
+			    src_len, dst_len);
+		return -1;
+	}
+
+	d = 0;
+	s = 0;
+	while (d < dst_iovcnt && s < src_iovcnt) {
+		len = dst_iovs[d].iov_len - dst_off;
+		if (src_iovs[s].iov_len - src_off < len) {
+			len = src_iovs[s].iov_len - src_off;
+		}
+
+		if (len > 0) {
+			if (fn((uint8_t *)dst_iovs[d].iov_base + dst_off,
+			       (uint8_t *)src_iovs[s].iov_base + src_off, len, ctx) != 0) {
+				return -1;
+			}
+			total += len;
+		}
+
+		dst_off += len;
+		if (dst_off == dst_iovs[d].iov_len) {
+			d++;
+			dst_off = 0;
+		}
+
+		src_off += len;
+		if (src_off == src_iovs[s].iov_len) {
+			s++;
+			src_off = 0;
+		}
+	}
+
+	return total;
+}
+
+void
+copy_engine_memcpy(void *dst, const void *src, uint64_t nbytes)
+{
+	if (g_nt_threshold != 0 && nbytes >= g_nt_threshold) {
+		spdk_memcpy_nt(dst, src, (size_t)nbytes);
+	} else {
+		rte_memcpy(dst, src, (size_t)nbytes);
+	}
+}
+
+uint32_t
+copy_engine_crc32c(const void *src, uint64_t nbytes, uint32_t seed)
+{
+	const uint8_t *buf = src;
+	uint64_t remaining = nbytes;
+	uint32_t len;
+	uint32_t crc = ~seed;
+
+	/*
+	 * rte_hash_crc() uses the SSE4.2 crc32 instruction when the CPU has it.
+	 *  It neither inverts its input nor its result, so do that here to get
+	 *  a standard CRC-32C that can be chained through seed.
+	 */
+	while (remaining > 0) {
+		len = remaining > MEM_CRC32C_CHUNK_SIZE ? MEM_CRC32C_CHUNK_SIZE : (uint32_t)remaining;
+		crc = rte_hash_crc(buf, len, crc);
+		buf += len;
+		remaining -= len;
+	}
+
+	return ~crc;
+}
+
+void
+copy_engine_dualcast(void *dst1, void *dst2, const void *src, uint64_t nbytes)
+{
+	uint64_t offset, len;
+
+	for (offset = 0; offset < nbytes; offset += len) {
+		len = nbytes - offset;
+		if (len > MEM_DUALCAST_CHUNK_SIZE) {
+			len = MEM_DUALCAST_CHUNK_SIZE;
+		}
+		rte_memcpy((uint8_t *)dst1 + offset, (const uint8_t *)src + offset, (size_t)len);
+		rte_memcpy((uint8_t *)dst2 + offset, (const uint8_t *)src + offset, (size_t)len);
+	}
+}
+
 /* memcpy default copy engine */
+static int
+mem_copy_segment(void *dst, void *src, uint64_t nbytes, void *ctx)
+{
+	copy_engine_memcpy(dst, src, nbytes);
+	return 0;
+}
+
 static void
 mem_copy_check_io(void)
 {
@@ -128,37 +469,120 @@ mem_copy_check_io(void)
 		req_next = req->next;
 		copy_req = (struct copy_task *)((uintptr_t)req -
 						offsetof(struct copy_task, offload_ctx));
-		req->cb((void *)copy_req, 0);
+		req->cb((void *)copy_req, req->status);
 		req = req_next;
 	}
 
 }
 
-static int64_t
-mem_copy_submit(void *cb_arg, void *dst, void *src, uint64_t nbytes,
-		copy_completion_cb cb)
+static void
+mem_request_queue(struct mem_request *req, copy_completion_cb cb, int status)
 {
 	struct mem_request **req_head = &copy_engine_req_head[rte_lcore_id()];
-	struct mem_request *req = (struct mem_request *)cb_arg;
 
 	req->next = *req_head;
 	*req_head = req;
 	req->cb = cb;
+	req->status = status;
+}
+
+static int64_t
+mem_copy_submit(void *cb_arg, void *dst, void *src, uint64_t nbytes,
+		copy_completion_cb cb)
+{
+	struct mem_request *req = (struct mem_request *)cb_arg;
 
-	rte_memcpy(dst, src, (size_t)nbytes);
+	copy_engine_memcpy(dst, src, nbytes);
+	mem_request_queue(req, cb, 0);
+
+	return nbytes;
+}
+
+static int64_t
+mem_copyv_submit(void *cb_arg, struct iovec *dst_iovs, int dst_iovcnt,
+		 struct iovec *src_iovs, int src_iovcnt, copy_completion_cb cb)
+{
+	struct mem_request *req = (struct mem_request *)cb_arg;
+	int64_t nbytes;
+
+	nbytes = spdk_copy_iov_walk(dst_iovs, dst_iovcnt, src_iovs, src_iovcnt,
+				    mem_copy_segment, NULL);
+	if (nbytes < 0) {
+		return -1;
+	}
+
+	mem_request_queue(req, cb, 0);
+
+	return nbytes;
+}
+
+static int64_t
+mem_fill_submit(void *cb_arg, void *dst, uint8_t fill, uint64_t nbytes,
+		copy_completion_cb cb)
+{
+	struct mem_request *req = (struct mem_request *)cb_arg;
+
+	memset(dst, fill, (size_t)nbytes);
+	mem_request_queue(req, cb, 0);
+
+	return nbytes;
+}
+
+static int64_t
+mem_compare_submit(void *cb_arg, void *src1, void *src2, uint64_t nbytes,
+		   copy_completion_cb cb)
+{
+	struct mem_request *req = (struct mem_request *)cb_arg;
+	int status = 0;
+
+	if (memcmp(src1, src2, (size_t)nbytes) != 0) {
+		status = -EILSEQ;
+	}
+	mem_request_queue(req, cb, status);
+
+	return nbytes;
+}
+
+static int64_t
+mem_crc32c_submit(void *cb_arg, uint32_t *dst, void *src, uint32_t seed,
+		  uint64_t nbytes, copy_completion_cb cb)
+{
+	struct mem_request *req = (struct mem_request *)cb_arg;
+
+	*dst = copy_engine_crc32c(src, nbytes, seed);
+	mem_request_queue(req, cb, 0);
+
+	return nbytes;
+}
+
+static int64_t
+mem_dualcast_submit(void *cb_arg, void *dst1, void *dst2, void *src,
+		    uint64_t nbytes, copy_completion_cb cb)
+{
+	struct mem_request *req = (struct mem_request *)cb_arg;
+
+	copy_engine_dualcast(dst1, dst2, src, nbytes);
+	mem_request_queue(req, cb, 0);
 
 	return nbytes;
 }
 
 static struct spdk_copy_engine memcpy_copy_engine = {
 	.copy		= mem_copy_submit,
+	.copyv		= mem_copyv_submit,
+	.fill		= mem_fill_submit,
+	.compare	= mem_compare_submit,
+	.crc32c		= mem_crc32c_submit,
+	.dualcast	= mem_dualcast_submit,
 	.check_io	= mem_copy_check_io,
 };
 
 static int
 copy_engine_mem_get_ctx_size(void)
 {
-	return sizeof(struct mem_request) + sizeof(struct copy_task);
+	/* The helper core engine, when enabled, runs out of the memcpy engine's contexts. */
+	return RTE_MAX(sizeof(struct mem_request), copy_engine_soft_get_ctx_size()) +
+	       sizeof(struct copy_task);
 }
 
 int spdk_copy_module_get_max_ctx_size(void)
@@ -194,6 +618,114 @@ copy_engine_mem_init(void)
 	return 0;
 }
 
+static volatile bool g_calibrate_done;
+
+static void
+copy_engine_calibrate_done(void *ref, int status)
+{
+	g_calibrate_done = true;
+}
+
+/*
+ * Time one hardware copy from submission to completion, or return UINT64_MAX
+ *  if it fails or does not complete within a second.
+ */
+static uint64_t
+copy_engine_calibrate_hw(struct copy_task *task, void *dst, void *src, uint64_t nbytes)
+{
+	uint64_t start, deadline;
+
+	g_calibrate_done = false;
+	start = rte_get_timer_cycles();
+	deadline = start + rte_get_timer_hz();
+
+	if (hw_copy_engine->copy(task->offload_ctx, dst, src, nbytes,
+				 copy_engine_calibrate_done) < 0) {
+		return UINT64_MAX;
+	}
+
+	while (!g_calibrate_done) {
+		hw_copy_engine->check_io();
+		if (rte_get_timer_cycles() > deadline) {
+			return UINT64_MAX;
+		}
+	}
+
+	return rte_get_timer_cycles() - start;
+}
+
+/*
+ * Find the smallest copy size for which the hardware engine, counting
+ *  submission and completion overhead, is at least as fast as a CPU copy on
+ *  this core.  Sizes above the largest one measured always use the hardware
+ *  so that big copies do not take reactor time.
+ */
+static uint64_t
+copy_engine_calibrate(void)
+{
+	struct copy_task *task;
+	void *src, *dst;
+	uint64_t nbytes, start, cpu_ticks, hw_ticks, ticks;
+	uint64_t threshold = COPY_CALIBRATE_MAX_SIZE;
+	int i;
+
+	task = rte_zmalloc(NULL, spdk_copy_module_get_max_ctx_size(), 0);
+	src = rte_zmalloc(NULL, COPY_CALIBRATE_MAX_SIZE, 0x1000);
+	dst = rte_zmalloc(NULL, COPY_CALIBRATE_MAX_SIZE, 0x1000);
+	if (task == NULL || src == NULL || dst == NULL) {
+		SPDK_ERRLOG("Could not allocate copy engine calibration buffers\n");
+		rte_free(task);
+		rte_free(src);
+		rte_free(dst);
+		return threshold;
+	}
+
+	for (nbytes = COPY_CALIBRATE_MIN_SIZE; nbytes <= COPY_CALIBRATE_MAX_SIZE; nbytes *= 2) {
+		/* Warm up the caches and the channel before measuring. */
+		copy_engine_memcpy(dst, src, nbytes);
+		if (copy_engine_calibrate_hw(task, dst, src, nbytes) == UINT64_MAX) {
+			goto hw_failed;
+		}
+
+		start = rte_get_timer_cycles();
+		for (i = 0; i < COPY_CALIBRATE_ITERATIONS; i++) {
+			copy_engine_memcpy(dst, src, nbytes);
+		}
+		cpu_ticks = rte_get_timer_cycles() - start;
+
+		hw_ticks = 0;
+		for (i = 0; i < COPY_CALIBRATE_ITERATIONS; i++) {
+			ticks = copy_engine_calibrate_hw(task, dst, src, nbytes);
+			if (ticks == UINT64_MAX) {
+				goto hw_failed;
+			}
+			hw_ticks += ticks;
+		}
+
+		SPDK_TRACELOG(SPDK_TRACE_COPY, "%" PRIu64 " bytes: cpu %" PRIu64 " hw %" PRIu64 " ticks\n",
+			      nbytes, cpu_ticks / COPY_CALIBRATE_ITERATIONS,
+			      hw_ticks / COPY_CALIBRATE_ITERATIONS);
+
+		if (hw_ticks <= cpu_ticks) {
+			threshold = nbytes;
+			break;
+		}
+	}
+
+	rte_free(task);
+	rte_free(src);
+	rte_free(dst);
+	return threshold;
+
+hw_failed:
+	/*
+	 * The hardware may still write to the buffers or complete the task, so
+	 *  they are deliberately not freed.
+	 */
+	SPDK_ERRLOG("Copy engine calibration failed; using the CPU for all copies\n");
+	return UINT64_MAX;
+}
+
 static void
 spdk_copy_engine_module_initialize(void)
 {
@@ -215,19 +747,86 @@ spdk_copy_engine_module_finish(void)
 	}
 }
 
+static void
+spdk_copy_engine_read_config(bool *threshold_set, uint64_t *helper_mask)
+{
+	struct spdk_conf_section *sp = spdk_conf_find_section(NULL, "Copy");
+	const char *mask;
+	int val;
+
+	*threshold_set = false;
+	*helper_mask = 0;
+	if (sp == NULL) {
+		return;
+	}
+
+	mask = spdk_conf_section_get_val(sp, "HelperCoreMask");
+	if (mask != NULL && spdk_app_parse_core_mask(mask, helper_mask) != 0) {
+		SPDK_ERRLOG("Invalid HelperCoreMask %s\n", mask);
+		*helper_mask = 0;
+	}
+
+	val = spdk_conf_section_get_intval(sp, "HwThreshold");
+	if (val >= 0) {
+		g_hw_threshold = val;
+		*threshold_set = true;
+	}
+
+	val = spdk_conf_section_get_intval(sp, "HwMaxOutstanding");
+	if (val > 0) {
+		g_hw_max_outstanding = val;
+	}
+
+	val = spdk_conf_section_get_intval(sp, "NonTemporalThreshold");
+	if (val >= 0) {
+		g_nt_threshold = val;
+	}
+}
+
 static int
 spdk_copy_engine_initialize(void)
 {
+	struct spdk_copy_engine *soft_engine;
+	bool threshold_set;
+	uint64_t helper_mask;
+
+	spdk_copy_engine_read_config(&threshold_set, &helper_mask);
 	spdk_copy_engine_module_initialize();
+
+	/* Without copy hardware, spare cores can take the copies instead. */
+	if (!spdk_has_copy_engine() && helper_mask != 0) {
+		soft_engine = copy_engine_soft_start(helper_mask);
+		if (soft_engine != NULL) {
+			spdk_copy_engine_register(soft_engine);
+		}
+	}
+
+	if (spdk_has_copy_engine() && !threshold_set) {
+		g_hw_threshold = copy_engine_calibrate();
+	}
+
+	if (g_nt_threshold != 0) {
+		SPDK_TRACELOG(SPDK_TRACE_COPY, "CPU copies of %" PRIu64 " bytes or more use %s streaming stores\n",
+			      g_nt_threshold, spdk_memcpy_nt_get_isa());
+	}
+
+	if (spdk_has_copy_engine() && g_hw_threshold != UINT64_MAX) {
+		SPDK_NOTICELOG("Copies of %" PRIu64 " bytes or more are offloaded, "
+			       "up to %u outstanding per core\n",
+			       g_hw_threshold, g_hw_max_outstanding);
+	}
+
 	return 0;
 }
 
 static int
 spdk_copy_engine_finish(void)
 {
+	copy_engine_soft_stop();
 	spdk_copy_engine_module_finish();
 	return 0;
 }
 
+SPDK_LOG_REGISTER_TRACE_FLAG("copy", SPDK_TRACE_COPY)
 SPDK_COPY_MODULE_REGISTER(copy_engine_mem_init, NULL, NULL, copy_engine_mem_get_ctx_size)
 SPDK_SUBSYSTEM_REGISTER(copy, spdk_copy_engine_initialize, spdk_copy_engine_finish, NULL)
@@ -0,0 +1,399 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Software copy engine that runs requests on helper threads pinned to cores
+ *  outside the reactor mask.  A reactor queues each request on a helper's
+ *  ring and carries on; the helper does the work and hands the request back
+ *  on the submitting lcore's completion ring, which check_io drains.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <rte_config.h>
+#include <rte_atomic.h>
+#include <rte_cycles.h>
+#include <rte_debug.h>
+#include <rte_lcore.h>
+#include <rte_ring.h>
+#include <rte_version.h>
+
+#include "spdk/event.h"
+#include "spdk/log.h"
+
+#include "copy_engine_internal.h"
+
+#define SOFT_MAX_HELPERS	64
+#define SOFT_RING_SIZE		4096
+#define SOFT_BURST_SIZE		32
+
+enum soft_op {
+	SOFT_OP_COPY,
+	SOFT_OP_FILL,
+	SOFT_OP_COMPARE,
+	SOFT_OP_CRC32C,
+	SOFT_OP_DUALCAST,
+};
+
+/* Lives in the copy_task's offload_ctx for the life of the request. */
+struct soft_request {
+	enum soft_op		op;
+	uint32_t		lcore;
+	int			status;
+	copy_completion_cb	cb;
+	void			*dst;
+	void			*dst2;
+	void			*src;
+	uint64_t		nbytes;
+	uint32_t		*crc_dst;
+	uint32_t		seed;
+	uint8_t			fill;
+};
+
+struct soft_helper {
+	pthread_t		thread;
+	uint32_t		cpu;
+	struct rte_ring		*ring;
+};
+
+static struct soft_helper g_helpers[SOFT_MAX_HELPERS];
+static uint32_t g_num_helpers;
+static struct rte_ring *g_done_ring[RTE_MAX_LCORE];
+static uint32_t g_next_helper[RTE_MAX_LCORE];
+static volatile bool g_soft_running;
+
+static void
+soft_execute(struct soft_request *req)
+{
+	req->status = 0;
+
+	switch (req->op) {
+	case SOFT_OP_COPY:
+		copy_engine_memcpy(req->dst, req->src, req->nbytes);
+		break;
+	case SOFT_OP_FILL:
+		memset(req->dst, req->fill, req->nbytes);
+		break;
+	case SOFT_OP_COMPARE:
+		if (memcmp(req->dst, req->src, req->nbytes) != 0) {
+			req->status = -EILSEQ;
+		}
+		break;
+	case SOFT_OP_CRC32C:
+		*req->crc_dst = copy_engine_crc32c(req->src, req->nbytes, req->seed);
+		break;
+	case SOFT_OP_DUALCAST:
+		copy_engine_dualcast(req->dst, req->dst2, req->src, req->nbytes);
+		break;
+	}
+}
+
+static void *
+soft_helper_run(void *arg)
+{
+	struct soft_helper *helper = arg;
+	struct soft_request *req;
+	void *reqs[SOFT_BURST_SIZE];
+	unsigned i, count;
+
+	while (g_soft_running) {
+		count = rte_ring_dequeue_burst(helper->ring, reqs, SOFT_BURST_SIZE);
+		if (count == 0) {
+			rte_pause();
+			continue;
+		}
+
+		for (i = 0; i < count; i++) {
+			req = reqs[i];
+			soft_execute(req);
+			/* The owning reactor drains its ring every poll, so this only waits briefly. */
+			while (rte_ring_enqueue(g_done_ring[req->lcore], req) == -ENOBUFS) {
+				rte_pause();
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static int64_t
+soft_submit(struct soft_request *req, enum soft_op op, copy_completion_cb cb, uint64_t nbytes)
+{
+	uint32_t lcore = rte_lcore_id();
+	struct soft_helper *helper;
+
+	helper = &g_helpers[g_next_helper[lcore]++ % g_num_helpers];
+
+	req->op = op;
+	req->lcore = lcore;
+	req->cb = cb;
+	req->nbytes = nbytes;
+
+	if (rte_ring_enqueue(helper->ring, req) == -ENOBUFS) {
+		return -1;
+	}
+
+	return nbytes;
+}
+
+static int64_t
+soft_copy_submit(void *cb_arg, void *dst, void *src, uint64_t nbytes,
+		 copy_completion_cb cb)
+{
+	struct soft_request *req = cb_arg;
+
+	req->dst = dst;
+	req->src = src;
+	return soft_submit(req, SOFT_OP_COPY, cb, nbytes);
+}
+
+static int64_t
+soft_fill_submit(void *cb_arg, void *dst, uint8_t fill, uint64_t nbytes,
+		 copy_completion_cb cb)
+{
+	struct soft_request *req = cb_arg;
+
+	req->dst = dst;
+	req->fill = fill;
+	return soft_submit(req, SOFT_OP_FILL, cb, nbytes);
+}
+
+static int64_t
+soft_compare_submit(void *cb_arg, void *src1, void *src2, uint64_t nbytes,
+		    copy_completion_cb cb)
+{
+	struct soft_request *req = cb_arg;
+
+	req->dst = src1;
+	req->src = src2;
+	return soft_submit(req, SOFT_OP_COMPARE, cb, nbytes);
+}
+
+static int64_t
+soft_crc32c_submit(void *cb_arg, uint32_t *dst, void *src, uint32_t seed,
+		   uint64_t nbytes, copy_completion_cb cb)
+{
+	struct soft_request *req = cb_arg;
+
+	req->crc_dst = dst;
+	req->src = src;
+	req->seed = seed;
+	return soft_submit(req, SOFT_OP_CRC32C, cb, nbytes);
+}
+
+static int64_t
+soft_dualcast_submit(void *cb_arg, void *dst1, void *dst2, void *src,
+		     uint64_t nbytes, copy_completion_cb cb)
+{
+	struct soft_request *req = cb_arg;
+
+	req->dst = dst1;
+	req->dst2 = dst2;
+	req->src = src;
+	return soft_submit(req, SOFT_OP_DUALCAST, cb, nbytes);
+}
+
+static void
+soft_check_io(void)
+{
+	struct rte_ring *ring = g_done_ring[rte_lcore_id()];
+	struct soft_request *req;
+	struct copy_task *copy_req;
+	void *reqs[SOFT_BURST_SIZE];
+	unsigned i, count;
+
+	RTE_VERIFY(ring != NULL);
+
+	count = rte_ring_dequeue_burst(ring, reqs, SOFT_BURST_SIZE);
+	for (i = 0; i < count; i++) {
+		req = reqs[i];
+		copy_req = (struct copy_task *)((uintptr_t)req -
+						offsetof(struct copy_task, offload_ctx));
+		req->cb(copy_req, req->status);
+	}
+}
+
+/*
+ * Vectored copies are left to the memcpy engine: their iovec lists belong
+ *  to the caller and are not guaranteed to outlive the submit call.
+ */
+static struct spdk_copy_engine soft_copy_engine = {
+	.copy		= soft_copy_submit,
+	.fill		= soft_fill_submit,
+	.compare	= soft_compare_submit,
+	.crc32c		= soft_crc32c_submit,
+	.dualcast	= soft_dualcast_submit,
+	.check_io	= soft_check_io,
+};
+
+/*
+ * Rings cannot be freed before DPDK 2.2; there they stay reserved until the
+ *  process exits.
+ */
+static void
+soft_ring_free(struct rte_ring *ring)
+{
+#if RTE_VERSION >= RTE_VERSION_NUM(2, 2, 0, 0)
+	rte_ring_free(ring);
+#endif
+}
+
+static void
+soft_free_done_rings(void)
+{
+	uint32_t lcore;
+
+	for (lcore = 0; lcore < RTE_MAX_LCORE; lcore++) {
+		if (g_done_ring[lcore] != NULL) {
+			soft_ring_free(g_done_ring[lcore]);
+			g_done_ring[lcore] = NULL;
+		}
+	}
+}
+
+size_t
+copy_engine_soft_get_ctx_size(void)
+{
+	return sizeof(struct soft_request);
+}
+
+static int
+soft_helper_start(struct soft_helper *helper, uint32_t index, uint32_t cpu)
+{
+	char ring_name[RTE_RING_NAMESIZE];
+	cpu_set_t cpuset;
+	int rc;
+
+	helper->cpu = cpu;
+
+	snprintf(ring_name, sizeof(ring_name), "copy_helper_%u", index);
+	helper->ring = rte_ring_create(ring_name, SOFT_RING_SIZE, SOCKET_ID_ANY, RING_F_SC_DEQ);
+	if (helper->ring == NULL) {
+		SPDK_ERRLOG("Could not create ring for copy helper on CPU %u\n", cpu);
+		return -1;
+	}
+
+	rc = pthread_create(&helper->thread, NULL, soft_helper_run, helper);
+	if (rc != 0) {
+		SPDK_ERRLOG("Could not start copy helper on CPU %u: %s\n", cpu, strerror(rc));
+		soft_ring_free(helper->ring);
+		helper->ring = NULL;
+		return -1;
+	}
+
+	CPU_ZERO(&cpuset);
+	CPU_SET(cpu, &cpuset);
+	rc = pthread_setaffinity_np(helper->thread, sizeof(cpuset), &cpuset);
+	if (rc != 0) {
+		SPDK_WARNLOG("Could not pin copy helper to CPU %u: %s\n", cpu, strerror(rc));
+	}
+
+	return 0;
+}
+
+struct spdk_copy_engine *
+copy_engine_soft_start(uint64_t helper_mask)
+{
+	char ring_name[RTE_RING_NAMESIZE];
+	uint64_t core_mask = spdk_app_get_core_mask();
+	uint32_t cpu, lcore;
+
+	if (helper_mask & core_mask) {
+		SPDK_ERRLOG("Copy helper cores 0x%" PRIx64 " overlap the reactor mask 0x%" PRIx64 "\n",
+			    helper_mask, core_mask);
+		return NULL;
+	}
+
+	/* we use u64 as CPU core mask */
+	for (lcore = 0; lcore < RTE_MAX_LCORE && lcore < 64; lcore++) {
+		if (!(core_mask & (1ULL << lcore))) {
+			continue;
+		}
+
+		snprintf(ring_name, sizeof(ring_name), "copy_done_%u", lcore);
+		g_done_ring[lcore] = rte_ring_create(ring_name, SOFT_RING_SIZE,
+						     rte_lcore_to_socket_id(lcore), RING_F_SC_DEQ);
+		if (g_done_ring[lcore] == NULL) {
+			SPDK_ERRLOG("Could not create copy completion ring for lcore %u\n", lcore);
+			soft_free_done_rings();
+			return NULL;
+		}
+	}
+
+	g_soft_running = true;
+	for (cpu = 0; cpu < 64 && g_num_helpers < SOFT_MAX_HELPERS; cpu++) {
+		if (!(helper_mask & (1ULL << cpu))) {
+			continue;
+		}
+
+		if (soft_helper_start(&g_helpers[g_num_helpers], g_num_helpers, cpu) != 0) {
+			copy_engine_soft_stop();
+			return NULL;
+		}
+		g_num_helpers++;
+	}
+
+	if (g_num_helpers == 0) {
+		copy_engine_soft_stop();
+		return NULL;
+	}
+
+	SPDK_NOTICELOG("Copies offloaded to %u helper core(s)\n", g_num_helpers);
+	return &soft_copy_engine;
+}
+
+void
+copy_engine_soft_stop(void)
+{
+	uint32_t i;
+
+	if (!g_soft_running) {
+		return;
+	}
+
+	g_soft_running = false;
+	for (i = 0; i < g_num_helpers; i++) {
+		pthread_join(g_helpers[i].thread, NULL);
+		soft_ring_free(g_helpers[i].ring);
+		g_helpers[i].ring = NULL;
+	}
+	g_num_helpers = 0;
+
+	soft_free_done_rings();
+}
@@ -35,10 +35,13 @@
 #include <errno.h>
 
 #include <rte_config.h>
+#include <rte_common.h>
 #include <rte_malloc.h>
 #include <rte_memcpy.h>
 #include <rte_lcore.h>
 #include <rte_debug.h>
+#include <rte_atomic.h>
+#include <rte_spinlock.h>
 
 #include "spdk/copy_engine.h"
 #include "spdk/vtophys.h"
@@ -50,17 +53,36 @@
 #include "spdk/ioat.h"
 
 #define IOAT_MAX_CHANNELS		64
+#define IOAT_MAX_CHANNELS_PER_LCORE	8
+
+/* Copies of at least this size are split across all of an lcore's channels. */
+#define IOAT_DEFAULT_STRIPE_THRESHOLD	(128 * 1024)
+#define IOAT_STRIPE_MIN_PIECE		(32 * 1024)
+#define IOAT_STRIPE_ALIGN		4096
 
 struct ioat_device {
 	struct spdk_ioat_chan *ioat;
+	/** number of lcores using this channel */
+	uint32_t users;
+	/** serializes access when the channel is shared by several lcores */
+	rte_spinlock_t lock;
 	/** linked list pointer for device list */
 	TAILQ_ENTRY(ioat_device) tailq;
 };
 
+struct ioat_lcore_channels {
+	struct ioat_device	*dev[IOAT_MAX_CHANNELS_PER_LCORE];
+	uint32_t		count;
+	/* next channel for an unstriped request, round robin */
+	uint32_t		next;
+};
+
 static TAILQ_HEAD(, ioat_device) g_devices = TAILQ_HEAD_INITIALIZER(g_devices);
 static int g_unbindfromkernel = 0;
 static int g_ioat_channel_count = 0;
-static struct spdk_ioat_chan *g_ioat_chan[RTE_MAX_LCORE];
+static uint64_t g_stripe_threshold = IOAT_DEFAULT_STRIPE_THRESHOLD;
+static uint32_t g_max_channels_per_lcore = IOAT_MAX_CHANNELS_PER_LCORE;
+static struct ioat_lcore_channels g_lcore_channels[RTE_MAX_LCORE];
 
 struct ioat_whitelist {
 	uint32_t bus;
@@ -87,6 +109,10 @@ ioat_find_dev_by_whitelist_bdf(struct spdk_pci_device *dev,
 
 struct ioat_task {
 	copy_completion_cb	cb;
+	/* lcore that submitted the request and gets its completion */
+	uint32_t		lcore;
+	/* pieces of the request still in flight */
+	rte_atomic32_t		remaining;
 };
 
 static int copy_engine_ioat_init(void);
@@ -115,11 +141,45 @@ copy_engine_ioat_exit(void)
 	return;
 }
 
+/*
+ * A channel used by more than one lcore is protected by its lock.  Channels
+ *  owned by a single lcore are used without locking.
+ */
+static inline void
+ioat_device_lock(struct ioat_device *dev)
+{
+	if (dev->users > 1) {
+		rte_spinlock_lock(&dev->lock);
+	}
+}
+
+static inline void
+ioat_device_unlock(struct ioat_device *dev)
+{
+	if (dev->users > 1) {
+		rte_spinlock_unlock(&dev->lock);
+	}
+}
+
+static struct ioat_device *
+ioat_lcore_next_device(struct ioat_lcore_channels *lc)
+{
+	struct ioat_device *dev;
+
+	RTE_VERIFY(lc->count != 0);
+
+	dev = lc->dev[lc->next];
+	if (++lc->next == lc->count) {
+		lc->next = 0;
+	}
+
+	return dev;
+}
+
 static void
-ioat_done(void *cb_arg)
+ioat_task_complete(struct ioat_task *ioat_task)
 {
 	struct copy_task *copy_req;
-	struct ioat_task *ioat_task = cb_arg;
 
 	copy_req = (struct copy_task *)
 		   ((uintptr_t)ioat_task -
@@ -128,31 +188,204 @@ ioat_done(void *cb_arg)
 	ioat_task->cb(copy_req, 0);
 }
 
+static void
+ioat_task_complete_event(spdk_event_t event)
+{
+	ioat_task_complete(spdk_event_get_arg1(event));
+}
+
+/*
+ * Complete the request on the lcore that submitted it.  A request finished
+ *  by another lcore polling a shared channel, or from within the submit path,
+ *  is passed back with an event.
+ */
+static void
+ioat_task_finish(struct ioat_task *ioat_task, bool defer)
+{
+	spdk_event_t event;
+
+	if (!defer && ioat_task->lcore == rte_lcore_id()) {
+		ioat_task_complete(ioat_task);
+		return;
+	}
+
+	event = spdk_event_allocate(ioat_task->lcore, ioat_task_complete_event,
+				    ioat_task, NULL, NULL);
+	spdk_event_call(event);
+}
+
+static void
+ioat_done(void *cb_arg)
+{
+	struct ioat_task *ioat_task = cb_arg;
+
+	if (rte_atomic32_dec_and_test(&ioat_task->remaining)) {
+		ioat_task_finish(ioat_task, false);
+	}
+}
+
+static int64_t
+ioat_copy_single(struct ioat_lcore_channels *lc, struct ioat_task *ioat_task,
+		 void *dst, void *src, uint64_t nbytes)
+{
+	struct ioat_device *dev = ioat_lcore_next_device(lc);
+	int64_t rc;
+
+	rte_atomic32_set(&ioat_task->remaining, 1);
+
+	ioat_device_lock(dev);
+	rc = spdk_ioat_submit_copy(dev->ioat, ioat_task, ioat_done, dst, src, nbytes);
+	ioat_device_unlock(dev);
+
+	return rc;
+}
+
+/*
+ * Split a large copy into one piece per channel of this lcore so that it
+ *  runs on all of them at once.  The request completes when the last piece
+ *  does.
+ */
+static int64_t
+ioat_copy_striped(struct ioat_lcore_channels *lc, struct ioat_task *ioat_task,
+		  void *dst, void *src, uint64_t nbytes)
+{
+	struct ioat_device *dev;
+	uint64_t piece_size, offset, len;
+	uint32_t pieces, submitted = 0;
+
+	pieces = lc->count;
+	if (nbytes / IOAT_STRIPE_MIN_PIECE < pieces) {
+		pieces = nbytes / IOAT_STRIPE_MIN_PIECE;
+	}
+	piece_size = (nbytes + pieces - 1) / pieces;
+	piece_size = (piece_size + IOAT_STRIPE_ALIGN - 1) & ~(uint64_t)(IOAT_STRIPE_ALIGN - 1);
+
+	/* Hold one extra reference so the request cannot finish while pieces are still being submitted. */
+	rte_atomic32_set(&ioat_task->remaining, pieces + 1);
+
+	for (offset = 0; offset < nbytes; offset += len) {
+		len = nbytes - offset;
+		if (len > piece_size) {
+			len = piece_size;
+		}
+
+		dev = ioat_lcore_next_device(lc);
+		ioat_device_lock(dev);
+		if (spdk_ioat_submit_copy(dev->ioat, ioat_task, ioat_done,
+					  (uint8_t *)dst + offset, (uint8_t *)src + offset, len) < 0) {
+			ioat_device_unlock(dev);
+			break;
+		}
+		ioat_device_unlock(dev);
+		submitted++;
+	}
+
+	if (submitted == 0) {
+		return -1;
+	}
+
+	if (offset < nbytes) {
+		/* A ring filled up part way through; the pieces already started cannot be recalled. */
+		rte_memcpy((uint8_t *)dst + offset, (uint8_t *)src + offset, nbytes - offset);
+	}
+
+	if (rte_atomic32_sub_return(&ioat_task->remaining, pieces - submitted + 1) == 0) {
+		ioat_task_finish(ioat_task, true);
+	}
+
+	return nbytes;
+}
+
 static int64_t
 ioat_copy_submit(void *cb_arg, void *dst, void *src, uint64_t nbytes,
 		 copy_completion_cb cb)
 {
 	struct ioat_task *ioat_task = (struct ioat_task *)cb_arg;
-	struct spdk_ioat_chan *chan = g_ioat_chan[rte_lcore_id()];
+	struct ioat_lcore_channels *lc = &g_lcore_channels[rte_lcore_id()];
+
+	ioat_task->cb = cb;
+	ioat_task->lcore = rte_lcore_id();
 
-	RTE_VERIFY(chan != NULL);
+	if (lc->count > 1 && nbytes >= g_stripe_threshold &&
+	    nbytes >= 2 * IOAT_STRIPE_MIN_PIECE) {
+		return ioat_copy_striped(lc, ioat_task, dst, src, nbytes);
+	}
+
+	return ioat_copy_single(lc, ioat_task, dst, src, nbytes);
+}
+
+static int64_t
+ioat_fill_submit(void *cb_arg, void *dst, uint8_t fill, uint64_t nbytes,
+		 copy_completion_cb cb)
+{
+	struct ioat_task *ioat_task = (struct ioat_task *)cb_arg;
+	struct ioat_device *dev = ioat_lcore_next_device(&g_lcore_channels[rte_lcore_id()]);
+	/* The hardware repeats an 8-byte pattern. */
+	uint64_t fill_pattern = fill * 0x0101010101010101ULL;
+	int64_t rc;
 
 	ioat_task->cb = cb;
+	ioat_task->lcore = rte_lcore_id();
+	rte_atomic32_set(&ioat_task->remaining, 1);
+
+	ioat_device_lock(dev);
+	rc = spdk_ioat_submit_fill(dev->ioat, ioat_task, ioat_done, dst, fill_pattern, nbytes);
+	ioat_device_unlock(dev);
 
-	return spdk_ioat_submit_copy(chan, ioat_task, ioat_done, dst, src, nbytes);
+	return rc;
+}
+
+static int64_t
+ioat_copyv_submit(void *cb_arg, struct iovec *dst_iovs, int dst_iovcnt,
+		  struct iovec *src_iovs, int src_iovcnt, copy_completion_cb cb)
+{
+	struct ioat_task *ioat_task = (struct ioat_task *)cb_arg;
+	struct ioat_device *dev;
+	int64_t rc;
+
+	ioat_task->cb = cb;
+	ioat_task->lcore = rte_lcore_id();
+	rte_atomic32_set(&ioat_task->remaining, 1);
+
+	dev = ioat_lcore_next_device(&g_lcore_channels[rte_lcore_id()]);
+
+	/*
+	 * The driver builds every descriptor of the request or none of them, so a
+	 * refused request has started nothing and can be redone on the CPU.
+	 */
+	ioat_device_lock(dev);
+	rc = spdk_ioat_submit_copyv(dev->ioat, ioat_task, ioat_done,
+				    dst_iovs, dst_iovcnt, src_iovs, src_iovcnt);
+	ioat_device_unlock(dev);
+
+	return rc;
 }
 
 static void
 ioat_check_io(void)
 {
-	struct spdk_ioat_chan *chan = g_ioat_chan[rte_lcore_id()];
-
-	RTE_VERIFY(chan != NULL);
-	spdk_ioat_process_events(chan);
+	struct ioat_lcore_channels *lc = &g_lcore_channels[rte_lcore_id()];
+	struct ioat_device *dev;
+	uint32_t i;
+
+	for (i = 0; i < lc->count; i++) {
+		dev = lc->dev[i];
+		if (dev->users > 1) {
+			/* Another lcore is already reaping this channel. */
+			if (!rte_spinlock_trylock(&dev->lock)) {
+				continue;
+			}
+			spdk_ioat_process_events(dev->ioat);
+			rte_spinlock_unlock(&dev->lock);
+		} else {
+			spdk_ioat_process_events(dev->ioat);
+		}
+	}
 }
 
 static struct spdk_copy_engine ioat_copy_engine = {
 	.copy		= ioat_copy_submit,
+	.copyv		= ioat_copyv_submit,
 	.check_io	= ioat_check_io,
 };
 
@@ -219,10 +452,54 @@ attach_cb(void *cb_ctx, struct spdk_pci_device *pci_dev, struct spdk_ioat_chan *
 	}
 
 	dev->ioat = ioat;
+	dev->users = 0;
+	rte_spinlock_init(&dev->lock);
 	TAILQ_INSERT_TAIL(&g_devices, dev, tailq);
 	g_ioat_channel_count++;
 }
 
+/*
+ * Give every lcore in the core mask its own channels when there are enough
+ *  of them, splitting the channels evenly up to g_max_channels_per_lcore
+ *  each.  With fewer channels than lcores, the lcores share channels round
+ *  robin and take the channel lock to use them.
+ */
+static void
+copy_engine_ioat_assign_channels(void)
+{
+	struct ioat_lcore_channels *lc;
+	struct ioat_device *dev;
+	uint64_t core_mask = spdk_app_get_core_mask();
+	uint32_t per_lcore, i;
+	int lcore;
+
+	per_lcore = g_ioat_channel_count / spdk_app_get_core_count();
+	per_lcore = RTE_MIN(per_lcore, g_max_channels_per_lcore);
+	if (per_lcore == 0) {
+		per_lcore = 1;
+		SPDK_NOTICELOG("%d IOAT channels shared by %d cores\n",
+			       g_ioat_channel_count, spdk_app_get_core_count());
+	}
+
+	dev = TAILQ_FIRST(&g_devices);
+	/* we use u64 as CPU core mask */
+	for (lcore = 0; lcore < RTE_MAX_LCORE && lcore < 64; lcore++) {
+		if (!(core_mask & (1ULL << lcore))) {
+			continue;
+		}
+
+		lc = &g_lcore_channels[lcore];
+		for (i = 0; i < per_lcore; i++) {
+			lc->dev[lc->count++] = dev;
+			dev->users++;
+			dev = TAILQ_NEXT(dev, tailq);
+			if (dev == NULL) {
+				dev = TAILQ_FIRST(&g_devices);
+			}
+		}
+	}
+}
+
 static int
 copy_engine_ioat_init(void)
 {
@@ -230,8 +507,8 @@ copy_engine_ioat_init(void)
 	const char *val, *pci_bdf;
 	int i;
 	struct ioat_probe_ctx probe_ctx = {};
-	int lcore;
 	struct ioat_device *dev;
+	bool fill_supported = true;
 
 	if (sp != NULL) {
 		val = spdk_conf_section_get_val(sp, "Disable");
@@ -259,6 +536,16 @@ copy_engine_ioat_init(void)
 				g_unbindfromkernel = 1;
 			}
 		}
+
+		i = spdk_conf_section_get_intval(sp, "StripeThreshold");
+		if (i >= 0) {
+			g_stripe_threshold = i;
+		}
+
+		i = spdk_conf_section_get_intval(sp, "MaxChannelsPerCore");
+		if (i > 0) {
+			g_max_channels_per_lcore = RTE_MIN(i, IOAT_MAX_CHANNELS_PER_LCORE);
+		}
 	}
 
 	if (spdk_ioat_probe(&probe_ctx, probe_cb, attach_cb) != 0) {
@@ -266,23 +553,28 @@ copy_engine_ioat_init(void)
 		return -1;
 	}
 
-	/* We only handle the case where we have enough channels */
-	if (g_ioat_channel_count < spdk_app_get_core_count()) {
-		SPDK_ERRLOG("Not enough IOAT channels for all cores\n");
-		copy_engine_ioat_exit();
+	if (g_ioat_channel_count == 0) {
 		return 0;
 	}
 
-	/* Assign channels to lcores in the active core mask */
-	dev = TAILQ_FIRST(&g_devices);
-	/* we use u64 as CPU core mask */
-	for (lcore = 0; lcore < RTE_MAX_LCORE && lcore < 64; lcore++) {
-		if ((spdk_app_get_core_mask() & (1ULL << lcore))) {
-			g_ioat_chan[lcore] = dev->ioat;
-			dev = TAILQ_NEXT(dev, tailq);
+	copy_engine_ioat_assign_channels();
+
+	TAILQ_FOREACH(dev, &g_devices, tailq) {
+		if (dev->users != 0 &&
+		    !(spdk_ioat_get_dma_capabilities(dev->ioat) & SPDK_IOAT_ENGINE_FILL_SUPPORTED)) {
+			fill_supported = false;
 		}
 	}
 
+	/*
+	 * Offload fill only if every core's channel can do it.  Compare, CRC-32C
+	 *  and dualcast are not supported by the hardware and fall back to the
+	 *  memcpy engine.
+	 */
+	if (fill_supported) {
+		ioat_copy_engine.fill = ioat_fill_submit;
+	}
+
 	SPDK_NOTICELOG("Ioat Copy Engine Offload Enabled\n");
 	spdk_copy_engine_register(&ioat_copy_engine);
 
@@ -0,0 +1,159 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * memcpy() variants that write the destination with non-temporal (streaming)
+ *  stores.  Large copies made this way do not evict the caller's working set
+ *  from the last level cache.  The widest variant the CPU supports is chosen
+ *  at startup.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <rte_config.h>
+#include <rte_cpuflags.h>
+#include <rte_memcpy.h>
+
+#include <immintrin.h>
+
+#include "spdk/copy_engine.h"
+
+/* Copies shorter than this are not worth aligning and fencing. */
+#define MEMCPY_NT_MIN_SIZE	256
+
+typedef void (*memcpy_nt_fn)(uint8_t *dst, const uint8_t *src, size_t nbytes);
+
+/*
+ * Each variant copies nbytes, a multiple of 64, to a 64-byte aligned dst.
+ */
+static void
+memcpy_nt_sse2(uint8_t *dst, const uint8_t *src, size_t nbytes)
+{
+	__m128i x0, x1, x2, x3;
+
+	for (; nbytes > 0; nbytes -= 64, src += 64, dst += 64) {
+		x0 = _mm_loadu_si128((const __m128i *)src);
+		x1 = _mm_loadu_si128((const __m128i *)(src + 16));
+		x2 = _mm_loadu_si128((const __m128i *)(src + 32));
+		x3 = _mm_loadu_si128((const __m128i *)(src + 48));
+		_mm_stream_si128((__m128i *)dst, x0);
+		_mm_stream_si128((__m128i *)(dst + 16), x1);
+		_mm_stream_si128((__m128i *)(dst + 32), x2);
+		_mm_stream_si128((__m128i *)(dst + 48), x3);
+	}
+}
+
+__attribute__((target("avx2")))
+static void
+memcpy_nt_avx2(uint8_t *dst, const uint8_t *src, size_t nbytes)
+{
+	__m256i y0, y1;
+
+	for (; nbytes > 0; nbytes -= 64, src += 64, dst += 64) {
+		y0 = _mm256_loadu_si256((const __m256i *)src);
+		y1 = _mm256_loadu_si256((const __m256i *)(src + 32));
+		_mm256_stream_si256((__m256i *)dst, y0);
+		_mm256_stream_si256((__m256i *)(dst + 32), y1);
+	}
+}
+
+__attribute__((target("avx512f")))
+static void
+memcpy_nt_avx512(uint8_t *dst, const uint8_t *src, size_t nbytes)
+{
+	__m512i z0;
+
+	for (; nbytes > 0; nbytes -= 64, src += 64, dst += 64) {
+		z0 = _mm512_loadu_si512((const void *)src);
+		_mm512_stream_si512((__m512i *)dst, z0);
+	}
+}
+
+static memcpy_nt_fn g_memcpy_nt = memcpy_nt_sse2;
+
+__attribute__((constructor)) static void
+memcpy_nt_select(void)
+{
+	if (rte_cpu_get_flag_enabled(RTE_CPUFLAG_AVX512F) > 0) {
+		g_memcpy_nt = memcpy_nt_avx512;
+		return;
+	}
+	if (rte_cpu_get_flag_enabled(RTE_CPUFLAG_AVX2) > 0) {
+		g_memcpy_nt = memcpy_nt_avx2;
+	}
+}
+
+const char *
+spdk_memcpy_nt_get_isa(void)
+{
+	if (g_memcpy_nt == memcpy_nt_avx512) {
+		return "avx512";
+	}
+	if (g_memcpy_nt == memcpy_nt_avx2) {
+		return "avx2";
+	}
+	return "sse2";
+}
+
+void
+spdk_memcpy_nt(void *dst, const void *src, size_t nbytes)
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+	size_t head, body;
+
+	if (nbytes < MEMCPY_NT_MIN_SIZE) {
+		rte_memcpy(d, s, nbytes);
+		return;
+	}
+
+	/* Copy up to the first 64-byte boundary of dst through the cache. */
+	head = (64 - ((uintptr_t)d & 63)) & 63;
+	if (head) {
+		rte_memcpy(d, s, head);
+		d += head;
+		s += head;
+		nbytes -= head;
+	}
+
+	body = nbytes & ~(size_t)63;
+	g_memcpy_nt(d, s, body);
+
+	if (nbytes > body) {
+		rte_memcpy(d + body, s + body, nbytes - body);
+	}
+
+	/* Streaming stores are weakly ordered; make them visible before the copy is reported done. */
+	_mm_sfence();
+}
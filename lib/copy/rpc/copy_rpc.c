@@ -0,0 +1,105 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <rte_config.h>
+#include <rte_lcore.h>
+
+#include "spdk/copy_engine.h"
+#include "spdk/event.h"
+#include "spdk/rpc.h"
+
+static void
+spdk_rpc_get_copy_engine_stats(struct spdk_jsonrpc_server_conn *conn,
+			       const struct spdk_json_val *params,
+			       const struct spdk_json_val *id)
+{
+	struct spdk_json_write_ctx *w;
+	struct spdk_copy_engine_stats stats;
+	uint64_t core_mask = spdk_app_get_core_mask();
+	uint64_t hw_threshold = spdk_copy_engine_get_hw_threshold();
+	uint32_t lcore;
+
+	if (params != NULL) {
+		spdk_jsonrpc_send_error_response(conn, id, SPDK_JSONRPC_ERROR_INVALID_PARAMS,
+						 "get_copy_engine_stats requires no parameters");
+		return;
+	}
+
+	if (id == NULL) {
+		return;
+	}
+
+	w = spdk_jsonrpc_begin_result(conn, id);
+	spdk_json_write_object_begin(w);
+
+	/* A threshold of UINT64_MAX means calibration failed and everything runs on the CPU. */
+	spdk_json_write_name(w, "hw_threshold");
+	if (hw_threshold == UINT64_MAX) {
+		spdk_json_write_string(w, "disabled");
+	} else {
+		spdk_json_write_uint64(w, hw_threshold);
+	}
+
+	spdk_json_write_name(w, "lcores");
+	spdk_json_write_array_begin(w);
+	/* we use u64 as CPU core mask */
+	for (lcore = 0; lcore < RTE_MAX_LCORE && lcore < 64; lcore++) {
+		if (!(core_mask & (1ULL << lcore))) {
+			continue;
+		}
+
+		spdk_copy_engine_get_stats(lcore, &stats);
+
+		spdk_json_write_object_begin(w);
+		spdk_json_write_name(w, "lcore");
+		spdk_json_write_uint32(w, lcore);
+		spdk_json_write_name(w, "hw_ops");
+		spdk_json_write_uint64(w, stats.hw_ops);
+		spdk_json_write_name(w, "hw_bytes");
+		spdk_json_write_uint64(w, stats.hw_bytes);
+		spdk_json_write_name(w, "cpu_ops");
+		spdk_json_write_uint64(w, stats.cpu_ops);
+		spdk_json_write_name(w, "cpu_bytes");
+		spdk_json_write_uint64(w, stats.cpu_bytes);
+		spdk_json_write_name(w, "cpu_small_ops");
+		spdk_json_write_uint64(w, stats.cpu_small_ops);
+		spdk_json_write_name(w, "cpu_backlog_ops");
+		spdk_json_write_uint64(w, stats.cpu_backlog_ops);
+		spdk_json_write_object_end(w);
+	}
+	spdk_json_write_array_end(w);
+
+	spdk_json_write_object_end(w);
+	spdk_jsonrpc_end_result(conn, w);
+}
+SPDK_RPC_REGISTER("get_copy_engine_stats", spdk_rpc_get_copy_engine_stats)
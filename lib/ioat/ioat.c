@@ -565,12 +565,31 @@ spdk_ioat_detach(struct spdk_ioat_chan *ioat)
 
 #define min(a, b) (((a)<(b))?(a):(b))
 
+/*
+ * Only the last descriptor of a request asks the hardware to write the
+ *  completion address.  Descriptors complete in ring order, so when the last
+ *  one is reported every earlier one is done too, and the skipped writes save
+ *  memory traffic.
+ */
+static void
+ioat_signal_last_only(struct spdk_ioat_chan *ioat, uint32_t first, uint32_t last)
+{
+	struct ioat_descriptor *desc;
+	union spdk_ioat_hw_desc *hw_desc;
+	uint32_t i;
+
+	for (i = first; i != last; i++) {
+		ioat_get_ring_entry(ioat, i, &desc, &hw_desc);
+		hw_desc->generic.u.control.completion_update = 0;
+	}
+}
+
 #define _2MB_PAGE(ptr)		((ptr) & ~(0x200000 - 1))
 #define _2MB_OFFSET(ptr)	((ptr) &  (0x200000 - 1))
 
 int64_t
-spdk_ioat_submit_copy(struct spdk_ioat_chan *ioat, void *cb_arg, spdk_ioat_req_cb cb_fn,
-		      void *dst, const void *src, uint64_t nbytes)
+spdk_ioat_build_copy(struct spdk_ioat_chan *ioat, void *cb_arg, spdk_ioat_req_cb cb_fn,
+		     void *dst, const void *src, uint64_t nbytes)
 {
 	struct ioat_descriptor	*last_desc;
 	uint64_t	remaining, op_size;
@@ -631,6 +650,7 @@ spdk_ioat_submit_copy(struct spdk_ioat_chan *ioat, void *cb_arg, spdk_ioat_req_c
 	if (last_desc) {
 		last_desc->callback_fn = cb_fn;
 		last_desc->callback_arg = cb_arg;
+		ioat_signal_last_only(ioat, orig_head, ioat->head - 1);
 	} else {
 		/*
 		 * Ran out of descriptors in the ring - reset head to leave things as they were
@@ -640,13 +660,166 @@ spdk_ioat_submit_copy(struct spdk_ioat_chan *ioat, void *cb_arg, spdk_ioat_req_c
 		return -1;
 	}
 
-	ioat_flush(ioat);
 	return nbytes;
 }
 
 int64_t
-spdk_ioat_submit_fill(struct spdk_ioat_chan *ioat, void *cb_arg, spdk_ioat_req_cb cb_fn,
-		      void *dst, uint64_t fill_pattern, uint64_t nbytes)
+spdk_ioat_submit_copy(struct spdk_ioat_chan *ioat, void *cb_arg, spdk_ioat_req_cb cb_fn,
+		      void *dst, const void *src, uint64_t nbytes)
+{
+	int64_t rc;
+
+	rc = spdk_ioat_build_copy(ioat, cb_arg, cb_fn, dst, src, nbytes);
+	if (rc < 0) {
+		return rc;
+	}
+
+	ioat_flush(ioat);
+	return rc;
+}
+
+int64_t
+spdk_ioat_build_copyv(struct spdk_ioat_chan *ioat, void *cb_arg, spdk_ioat_req_cb cb_fn,
+		      struct iovec *dst_iovs, int dst_iovcnt,
+		      struct iovec *src_iovs, int src_iovcnt)
+{
+	struct ioat_descriptor	*last_desc = NULL;
+	uint64_t	dst_len = 0, src_len = 0;
+	uint64_t	dst_off = 0, src_off = 0;
+	uint64_t	vdst, vsrc, pdst, psrc, len;
+	uint64_t	vdst_page = UINT64_MAX, vsrc_page = UINT64_MAX;
+	uint64_t	pdst_page = 0, psrc_page = 0;
+	uint64_t	run_dst = 0, run_src = 0, run_len = 0;
+	uint32_t	orig_head;
+	int		d, s;
+
+	if (!ioat) {
+		return -1;
+	}
+
+	for (d = 0; d < dst_iovcnt; d++) {
+		dst_len += dst_iovs[d].iov_len;
+	}
+	for (s = 0; s < src_iovcnt; s++) {
+		src_len += src_iovs[s].iov_len;
+	}
+	if (dst_len != src_len) {
+		return -1;
+	}
+
+	orig_head = ioat->head;
+
+	if (src_len == 0) {
+		last_desc = ioat_prep_null(ioat);
+		goto done;
+	}
+
+	/*
+	 * Walk both lists in pieces that do not cross a 2MB page in either buffer,
+	 *  so each piece is physically contiguous.  Pieces that continue the
+	 *  previous one physically in both source and destination are merged
+	 *  into a single descriptor.
+	 */
+	d = 0;
+	s = 0;
+	while (d < dst_iovcnt && s < src_iovcnt) {
+		vdst = (uint64_t)dst_iovs[d].iov_base + dst_off;
+		vsrc = (uint64_t)src_iovs[s].iov_base + src_off;
+
+		len = min(dst_iovs[d].iov_len - dst_off, src_iovs[s].iov_len - src_off);
+		len = min(len, 0x200000 - _2MB_OFFSET(vdst));
+		len = min(len, 0x200000 - _2MB_OFFSET(vsrc));
+
+		if (len > 0) {
+			if (_2MB_PAGE(vdst) != vdst_page) {
+				vdst_page = _2MB_PAGE(vdst);
+				pdst_page = ioat_vtophys((void *)vdst_page);
+			}
+			if (_2MB_PAGE(vsrc) != vsrc_page) {
+				vsrc_page = _2MB_PAGE(vsrc);
+				psrc_page = ioat_vtophys((void *)vsrc_page);
+			}
+			pdst = pdst_page + _2MB_OFFSET(vdst);
+			psrc = psrc_page + _2MB_OFFSET(vsrc);
+
+			if (run_len > 0 && run_dst + run_len == pdst && run_src + run_len == psrc &&
+			    run_len + len <= ioat->max_xfer_size) {
+				run_len += len;
+			} else {
+				if (run_len > 0) {
+					last_desc = ioat_prep_copy(ioat, run_dst, run_src, run_len);
+					if (last_desc == NULL) {
+						goto done;
+					}
+				}
+				run_dst = pdst;
+				run_src = psrc;
+				run_len = len;
+			}
+
+			/* A piece may still be larger than one descriptor can carry. */
+			while (run_len > ioat->max_xfer_size) {
+				last_desc = ioat_prep_copy(ioat, run_dst, run_src, ioat->max_xfer_size);
+				if (last_desc == NULL) {
+					goto done;
+				}
+				run_dst += ioat->max_xfer_size;
+				run_src += ioat->max_xfer_size;
+				run_len -= ioat->max_xfer_size;
+			}
+		}
+
+		dst_off += len;
+		if (dst_off == dst_iovs[d].iov_len) {
+			d++;
+			dst_off = 0;
+		}
+
+		src_off += len;
+		if (src_off == src_iovs[s].iov_len) {
+			s++;
+			src_off = 0;
+		}
+	}
+
+	last_desc = ioat_prep_copy(ioat, run_dst, run_src, run_len);
+
+done:
+	if (last_desc) {
+		last_desc->callback_fn = cb_fn;
+		last_desc->callback_arg = cb_arg;
+		ioat_signal_last_only(ioat, orig_head, ioat->head - 1);
+	} else {
+		/*
+		 * Ran out of descriptors in the ring - reset head to leave things as they were
+		 * in case we managed to fill out any descriptors.
+		 */
+		ioat->head = orig_head;
+		return -1;
+	}
+
+	return src_len;
+}
+
+int64_t
+spdk_ioat_submit_copyv(struct spdk_ioat_chan *ioat, void *cb_arg, spdk_ioat_req_cb cb_fn,
+		       struct iovec *dst_iovs, int dst_iovcnt,
+		       struct iovec *src_iovs, int src_iovcnt)
+{
+	int64_t rc;
+
+	rc = spdk_ioat_build_copyv(ioat, cb_arg, cb_fn, dst_iovs, dst_iovcnt, src_iovs, src_iovcnt);
+	if (rc < 0) {
+		return rc;
+	}
+
+	ioat_flush(ioat);
+	return rc;
+}
+
+int64_t
+spdk_ioat_build_fill(struct spdk_ioat_chan *ioat, void *cb_arg, spdk_ioat_req_cb cb_fn,
+		     void *dst, uint64_t fill_pattern, uint64_t nbytes)
 {
 	struct ioat_descriptor	*last_desc = NULL;
 	uint64_t	remaining, op_size;
@@ -687,6 +860,7 @@ spdk_ioat_submit_fill(struct spdk_ioat_chan *ioat, void *cb_arg, spdk_ioat_req_c
 	if (last_desc) {
 		last_desc->callback_fn = cb_fn;
 		last_desc->callback_arg = cb_arg;
+		ioat_signal_last_only(ioat, orig_head, ioat->head - 1);
 	} else {
 		/*
 		 * Ran out of descriptors in the ring - reset head to leave things as they were
@@ -696,10 +870,30 @@ spdk_ioat_submit_fill(struct spdk_ioat_chan *ioat, void *cb_arg, spdk_ioat_req_c
 		return -1;
 	}
 
-	ioat_flush(ioat);
 	return nbytes;
 }
 
+int64_t
+spdk_ioat_submit_fill(struct spdk_ioat_chan *ioat, void *cb_arg, spdk_ioat_req_cb cb_fn,
+		      void *dst, uint64_t fill_pattern, uint64_t nbytes)
+{
+	int64_t rc;
+
+	rc = spdk_ioat_build_fill(ioat, cb_arg, cb_fn, dst, fill_pattern, nbytes);
+	if (rc < 0) {
+		return rc;
+	}
+
+	ioat_flush(ioat);
+	return rc;
+}
+
+void
+spdk_ioat_flush(struct spdk_ioat_chan *ioat)
+{
+	ioat_flush(ioat);
+}
+
 uint32_t
 spdk_ioat_get_dma_capabilities(struct spdk_ioat_chan *ioat)
 {
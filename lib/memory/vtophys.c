@@ -31,16 +31,20 @@
  *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <string.h>
 #include <pthread.h>
+#include <sys/mman.h>
 
 #include "rte_config.h"
 #include "rte_eal.h"
 #include "rte_eal_memconfig.h"
 #include "spdk/vtophys.h"
+#include "spdk/queue.h"
 
 /* x86-64 userspace virtual addresses use only the low 47 bits [0..46],
  * which is enough to cover 128 TB.
@@ -57,6 +61,9 @@
 #define SHIFT_4KB	12 /* (1 << 12) == 4KB */
 #define MASK_4KB	((1ULL << SHIFT_4KB) - 1)
 
+#define VALUE_2MB	(1ULL << SHIFT_2MB)
+#define VALUE_4KB	(1ULL << SHIFT_4KB)
+
 #define FN_2MB_TO_4KB(fn)	(fn << (SHIFT_2MB - SHIFT_4KB))
 #define FN_4KB_TO_2MB(fn)	(fn >> (SHIFT_2MB - SHIFT_4KB))
 
@@ -83,9 +90,23 @@ struct map_128tb {
 	struct map_1gb *map[1ULL << (SHIFT_128TB - SHIFT_1GB + 1)];
 };
 
+/* /proc/self/pagemap entry layout (see Documentation/vm/pagemap.txt). */
+#define PAGEMAP_PAGE_PRESENT	(1ULL << 63)
+#define PAGEMAP_PFN_MASK	((1ULL << 55) - 1)
+
+/* Memory region registered by the application with spdk_mem_register(). */
+struct spdk_mem_region {
+	uint64_t			vaddr;
+	uint64_t			len;
+	TAILQ_ENTRY(spdk_mem_region)	tailq;
+};
+
 static struct map_128tb vtophys_map_128tb = {};
 static pthread_mutex_t vtophys_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+static TAILQ_HEAD(, spdk_mem_region) g_mem_regions = TAILQ_HEAD_INITIALIZER(g_mem_regions);
+static pthread_mutex_t g_mem_region_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 static struct map_2mb *
 vtophys_get_map(uint64_t vfn_2mb)
 {
@@ -181,3 +202,188 @@ spdk_vtophys(void *buf)
 
 	return (pfn_2mb << SHIFT_2MB) | ((uint64_t)buf & MASK_2MB);
 }
+
+static uint64_t
+vtophys_get_paddr_pagemap(int fd, uint64_t vaddr)
+{
+	uint64_t entry, pfn;
+	off_t offset;
+
+	offset = (off_t)(vaddr >> SHIFT_4KB) * sizeof(entry);
+	if (pread(fd, &entry, sizeof(entry), offset) != sizeof(entry)) {
+		return SPDK_VTOPHYS_ERROR;
+	}
+
+	if (!(entry & PAGEMAP_PAGE_PRESENT)) {
+		return SPDK_VTOPHYS_ERROR;
+	}
+
+	/* Without CAP_SYS_ADMIN the kernel reports a PFN of 0. */
+	pfn = entry & PAGEMAP_PFN_MASK;
+	if (pfn == 0) {
+		return SPDK_VTOPHYS_ERROR;
+	}
+
+	return pfn << SHIFT_4KB;
+}
+
+/*
+ * Translate one 2MB chunk of a registered region.  The chunk must be backed
+ * by a huge page, i.e. physically contiguous and 2MB aligned.
+ */
+static uint64_t
+vtophys_get_pfn_2mb_pagemap(int fd, uint64_t vfn_2mb)
+{
+	uint64_t vaddr, paddr_first, paddr_last;
+
+	vaddr = vfn_2mb << SHIFT_2MB;
+
+	paddr_first = vtophys_get_paddr_pagemap(fd, vaddr);
+	if (paddr_first == SPDK_VTOPHYS_ERROR || (paddr_first & MASK_2MB) != 0) {
+		return SPDK_VTOPHYS_ERROR;
+	}
+
+	paddr_last = vtophys_get_paddr_pagemap(fd, vaddr + VALUE_2MB - VALUE_4KB);
+	if (paddr_last != paddr_first + VALUE_2MB - VALUE_4KB) {
+		return SPDK_VTOPHYS_ERROR;
+	}
+
+	return paddr_first >> SHIFT_2MB;
+}
+
+static void
+vtophys_clear_range(uint64_t vfn_2mb, uint64_t num_2mb)
+{
+	struct map_2mb *map_2mb;
+	uint64_t i;
+
+	for (i = 0; i < num_2mb; i++) {
+		map_2mb = vtophys_get_map(vfn_2mb + i);
+		if (map_2mb) {
+			map_2mb->pfn_2mb = SPDK_VTOPHYS_ERROR;
+		}
+	}
+}
+
+int
+spdk_mem_register(void *vaddr, size_t len)
+{
+	struct spdk_mem_region *region;
+	struct map_2mb *map_2mb;
+	uint64_t addr, vfn_2mb, pfn_2mb, num_2mb, i;
+	int fd, rc;
+
+	addr = (uint64_t)vaddr;
+	if (len == 0 || (addr & MASK_2MB) || (len & MASK_2MB)) {
+		fprintf(stderr, "%s: region %p len 0x%zx is not 2MB aligned\n", __func__, vaddr, len);
+		return -EINVAL;
+	}
+
+	if ((addr & ~MASK_128TB) || ((addr + len - 1) & ~MASK_128TB) || addr + len < addr) {
+		fprintf(stderr, "%s: invalid usermode virtual address %p\n", __func__, vaddr);
+		return -EINVAL;
+	}
+
+	pthread_mutex_lock(&g_mem_region_mutex);
+
+	TAILQ_FOREACH(region, &g_mem_regions, tailq) {
+		if (addr < region->vaddr + region->len && region->vaddr < addr + len) {
+			fprintf(stderr, "%s: region %p len 0x%zx overlaps a registered region\n",
+				__func__, vaddr, len);
+			rc = -EBUSY;
+			goto err_unlock;
+		}
+	}
+
+	region = calloc(1, sizeof(*region));
+	if (region == NULL) {
+		rc = -ENOMEM;
+		goto err_unlock;
+	}
+	region->vaddr = addr;
+	region->len = len;
+
+	/* Fault in and pin the pages so the translations below stay valid. */
+	if (mlock(vaddr, len) != 0) {
+		rc = -errno;
+		fprintf(stderr, "%s: mlock of %p len 0x%zx failed\n", __func__, vaddr, len);
+		goto err_free;
+	}
+
+	fd = open("/proc/self/pagemap", O_RDONLY);
+	if (fd < 0) {
+		rc = -errno;
+		fprintf(stderr, "%s: could not open /proc/self/pagemap\n", __func__);
+		goto err_munlock;
+	}
+
+	vfn_2mb = addr >> SHIFT_2MB;
+	num_2mb = len >> SHIFT_2MB;
+
+	for (i = 0; i < num_2mb; i++) {
+		pfn_2mb = vtophys_get_pfn_2mb_pagemap(fd, vfn_2mb + i);
+		if (pfn_2mb == SPDK_VTOPHYS_ERROR) {
+			fprintf(stderr, "%s: 2MB vfn 0x%jx is not backed by a huge page\n",
+				__func__, vfn_2mb + i);
+			rc = -EFAULT;
+			goto err_clear;
+		}
+
+		map_2mb = vtophys_get_map(vfn_2mb + i);
+		if (map_2mb == NULL) {
+			rc = -ENOMEM;
+			goto err_clear;
+		}
+		map_2mb->pfn_2mb = pfn_2mb;
+	}
+
+	close(fd);
+
+	TAILQ_INSERT_TAIL(&g_mem_regions, region, tailq);
+	pthread_mutex_unlock(&g_mem_region_mutex);
+
+	return 0;
+
+err_clear:
+	vtophys_clear_range(vfn_2mb, i);
+	close(fd);
+err_munlock:
+	munlock(vaddr, len);
+err_free:
+	free(region);
+err_unlock:
+	pthread_mutex_unlock(&g_mem_region_mutex);
+	return rc;
+}
+
+int
+spdk_mem_unregister(void *vaddr, size_t len)
+{
+	struct spdk_mem_region *region;
+	uint64_t addr;
+
+	addr = (uint64_t)vaddr;
+
+	pthread_mutex_lock(&g_mem_region_mutex);
+
+	TAILQ_FOREACH(region, &g_mem_regions, tailq) {
+		if (region->vaddr == addr && region->len == len) {
+			break;
+		}
+	}
+
+	if (region == NULL) {
+		pthread_mutex_unlock(&g_mem_region_mutex);
+		fprintf(stderr, "%s: region %p len 0x%zx is not registered\n", __func__, vaddr, len);
+		return -EINVAL;
+	}
+
+	TAILQ_REMOVE(&g_mem_regions, region, tailq);
+	vtophys_clear_range(addr >> SHIFT_2MB, len >> SHIFT_2MB);
+	munlock(vaddr, len);
+
+	pthread_mutex_unlock(&g_mem_region_mutex);
+
+	free(region);
+	return 0;
+}
@@ -43,6 +43,8 @@
 #include "nvmf_internal.h"
 #include "subsystem.h"
 #include "transport.h"
+#include "spdk/bdev.h"
+#include "spdk/bdev_db.h"
 #include "spdk/conf.h"
 #include "spdk/log.h"
 
@@ -68,6 +70,10 @@ struct spdk_nvmf_probe_ctx {
 #define SPDK_NVMF_CONFIG_QUEUE_DEPTH_MIN 16
 #define SPDK_NVMF_CONFIG_QUEUE_DEPTH_MAX 1024
 
+#define SPDK_NVMF_CONFIG_IN_CAPSULE_DATA_SIZE_DEFAULT SPDK_NVMF_DEFAULT_IN_CAPSULE_DATA_SIZE
+#define SPDK_NVMF_CONFIG_IN_CAPSULE_DATA_SIZE_MIN 0
+#define SPDK_NVMF_CONFIG_IN_CAPSULE_DATA_SIZE_MAX SPDK_NVMF_MAX_IN_CAPSULE_DATA_SIZE
+
 static int
 spdk_add_nvmf_discovery_subsystem(void)
 {
@@ -89,6 +95,7 @@ spdk_nvmf_parse_nvmf_tgt(void)
 	struct spdk_conf_section *sp;
 	int max_queue_depth;
 	int max_queues_per_sess;
+	int in_capsule_data_size;
 	int rc;
 
 	sp = spdk_conf_find_section(NULL, "Nvmf");
@@ -111,7 +118,16 @@ spdk_nvmf_parse_nvmf_tgt(void)
 	max_queues_per_sess = nvmf_max(max_queues_per_sess, SPDK_NVMF_CONFIG_QUEUES_PER_SESSION_MIN);
 	max_queues_per_sess = nvmf_min(max_queues_per_sess, SPDK_NVMF_CONFIG_QUEUES_PER_SESSION_MAX);
 
-	rc = nvmf_tgt_init(max_queue_depth, max_queues_per_sess);
+	in_capsule_data_size = spdk_conf_section_get_intval(sp, "InCapsuleDataSize");
+	if (in_capsule_data_size < 0) {
+		in_capsule_data_size = SPDK_NVMF_CONFIG_IN_CAPSULE_DATA_SIZE_DEFAULT;
+	}
+	in_capsule_data_size = nvmf_max(in_capsule_data_size, SPDK_NVMF_CONFIG_IN_CAPSULE_DATA_SIZE_MIN);
+	in_capsule_data_size = nvmf_min(in_capsule_data_size, SPDK_NVMF_CONFIG_IN_CAPSULE_DATA_SIZE_MAX);
+	/* IOCCSZ is expressed in 16 byte units. */
+	in_capsule_data_size &= ~0xF;
+
+	rc = nvmf_tgt_init(max_queue_depth, max_queues_per_sess, in_capsule_data_size);
 	if (rc != 0) {
 		SPDK_ERRLOG("nvmf_tgt_init() failed\n");
 		return rc;
@@ -317,6 +333,45 @@ spdk_nvmf_allocate_lcore(uint64_t mask, uint32_t lcore)
 	return lcore;
 }
 
+static int
+spdk_nvmf_parse_virtual_subsystem(struct spdk_conf_section *sp,
+				  struct spdk_nvmf_subsystem *subsystem)
+{
+	const char *sn;
+	char *bdev_name;
+	struct spdk_bdev *bdev;
+	int i;
+
+	sn = spdk_conf_section_get_val(sp, "SN");
+	if (sn != NULL && nvmf_subsystem_set_sn(subsystem, sn) != 0) {
+		return -1;
+	}
+
+	for (i = 0; i < MAX_VIRTUAL_NAMESPACE; i++) {
+		bdev_name = spdk_conf_section_get_nval(sp, "Namespace", i);
+		if (!bdev_name) {
+			break;
+		}
+
+		bdev = spdk_bdev_db_get_by_name(bdev_name);
+		if (bdev == NULL) {
+			SPDK_ERRLOG("Subsystem %d: could not find bdev '%s'\n", sp->num, bdev_name);
+			return -1;
+		}
+
+		if (nvmf_subsystem_add_ns(subsystem, bdev) != 0) {
+			return -1;
+		}
+	}
+
+	if (subsystem->ns_count == 0) {
+		SPDK_ERRLOG("Subsystem %d: missing Namespace directive\n", sp->num);
+		return -1;
+	}
+
+	return 0;
+}
+
 static int
 spdk_nvmf_parse_subsystem(struct spdk_conf_section *sp)
 {
@@ -361,9 +416,7 @@ spdk_nvmf_parse_subsystem(struct spdk_conf_section *sp)
 	if (strcasecmp(mode, "Direct") == 0) {
 		subsystem->mode = NVMF_SUBSYSTEM_MODE_DIRECT;
 	} else if (strcasecmp(mode, "Virtual") == 0) {
-		nvmf_delete_subsystem(subsystem);
-		SPDK_ERRLOG("Virtual Subsystems are not yet supported.\n");
-		return -1;
+		subsystem->mode = NVMF_SUBSYSTEM_MODE_VIRTUAL;
 	} else {
 		nvmf_delete_subsystem(subsystem);
 		SPDK_ERRLOG("Invalid Subsystem mode: %s\n", mode);
@@ -410,6 +463,15 @@ spdk_nvmf_parse_subsystem(struct spdk_conf_section *sp)
 		spdk_nvmf_subsystem_add_host(subsystem, host_nqn);
 	}
 
+	if (subsystem->mode == NVMF_SUBSYSTEM_MODE_VIRTUAL) {
+		/* Parse Namespace sections */
+		ret = spdk_nvmf_parse_virtual_subsystem(sp, subsystem);
+		if (ret < 0) {
+			nvmf_delete_subsystem(subsystem);
+		}
+		return ret;
+	}
+
 	/* Parse NVMe section */
 	bdf = spdk_conf_section_get_val(sp, "NVMe");
 	if (bdf == NULL) {
@@ -0,0 +1,636 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Loopback transport: an in-process host (see loopback.h) submits capsules to
+ * the target through a single-producer/single-consumer submission ring per
+ * queue pair, and the target returns them through a completion ring.  There is
+ * no data movement; requests point directly at the host's buffers.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rte_config.h>
+#include <rte_atomic.h>
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+#include <rte_ring.h>
+
+#include "loopback.h"
+#include "nvmf_internal.h"
+#include "request.h"
+#include "session.h"
+#include "subsystem.h"
+#include "transport.h"
+#include "spdk/event.h"
+#include "spdk/log.h"
+#include "spdk/nvmf_spec.h"
+
+/* Maximum number of capsules taken off a submission ring per poll */
+#define NVMF_LOOPBACK_POLL_BATCH	32
+
+/* Queue pairs handed to the acceptor that have not been picked up yet */
+#define NVMF_LOOPBACK_NEW_CONN_RING_SIZE	256
+
+struct spdk_nvmf_loopback_request {
+	struct spdk_nvmf_request		req;
+	union nvmf_h2c_msg			cmd;
+	union nvmf_c2h_msg			rsp;
+
+	spdk_nvmf_loopback_cb			cb_fn;
+	void					*cb_arg;
+
+	STAILQ_ENTRY(spdk_nvmf_loopback_request) link;
+};
+
+struct spdk_nvmf_loopback_qpair {
+	struct spdk_nvmf_conn			conn;
+
+	uint16_t				qid;
+	uint16_t				queue_depth;
+	struct spdk_nvmf_loopback_request	*reqs;
+
+	/* Host to target */
+	struct rte_ring				*sq;
+
+	/* Target to host */
+	struct rte_ring				*cq;
+
+	/* Host side: requests that can be submitted */
+	STAILQ_HEAD(, spdk_nvmf_loopback_request) free_reqs;
+
+	/* Set by the host when it releases the queue pair */
+	volatile bool				host_closed;
+
+	/* Set while the acceptor waits for the CONNECT of an admin queue to complete */
+	volatile bool				connecting;
+
+	/* Target side state of I/O queues polled on their own core */
+	struct spdk_poller			poller;
+	bool					stopped;
+	bool					failed;
+
+	/* One reference for the host and one for the target */
+	rte_atomic32_t				refcnt;
+
+	TAILQ_ENTRY(spdk_nvmf_loopback_qpair)	link;
+};
+
+static struct {
+	/* Admin queue pairs created by hosts, waiting for the acceptor */
+	struct rte_ring				*new_conns;
+
+	/* Admin queue pairs polled by the acceptor until they are connected */
+	TAILQ_HEAD(, spdk_nvmf_loopback_qpair)	pending_conns;
+
+	struct spdk_poller			acceptor_poller;
+	bool					started;
+} g_loopback = {
+	.pending_conns = TAILQ_HEAD_INITIALIZER(g_loopback.pending_conns),
+};
+
+static inline struct spdk_nvmf_loopback_qpair *
+get_loopback_qpair(struct spdk_nvmf_conn *conn)
+{
+	return (struct spdk_nvmf_loopback_qpair *)((uintptr_t)conn -
+			offsetof(struct spdk_nvmf_loopback_qpair, conn));
+}
+
+static inline struct spdk_nvmf_loopback_request *
+get_loopback_req(struct spdk_nvmf_request *req)
+{
+	return (struct spdk_nvmf_loopback_request *)((uintptr_t)req -
+			offsetof(struct spdk_nvmf_loopback_request, req));
+}
+
+/*
+ * The rings are not created with rte_ring_create() so that they can be freed
+ * again; queue pairs come and go with host connections.
+ */
+static struct rte_ring *
+nvmf_loopback_ring_alloc(const char *name, unsigned count, unsigned flags)
+{
+	struct rte_ring *ring;
+
+	ring = rte_zmalloc(NULL, rte_ring_get_memsize(count), RTE_CACHE_LINE_SIZE);
+	if (ring == NULL) {
+		return NULL;
+	}
+
+	if (rte_ring_init(ring, name, count, flags) != 0) {
+		rte_free(ring);
+		return NULL;
+	}
+
+	return ring;
+}
+
+static void
+nvmf_loopback_qpair_destroy(struct spdk_nvmf_loopback_qpair *qpair)
+{
+	rte_free(qpair->sq);
+	rte_free(qpair->cq);
+	free(qpair->reqs);
+	free(qpair);
+}
+
+static void
+nvmf_loopback_qpair_put(struct spdk_nvmf_loopback_qpair *qpair)
+{
+	if (rte_atomic32_dec_and_test(&qpair->refcnt)) {
+		nvmf_loopback_qpair_destroy(qpair);
+	}
+}
+
+/* Target side */
+
+static int
+nvmf_loopback_request_complete(struct spdk_nvmf_request *req)
+{
+	struct spdk_nvmf_loopback_qpair *qpair = get_loopback_qpair(req->conn);
+
+	if (rte_ring_sp_enqueue(qpair->cq, get_loopback_req(req)) != 0) {
+		SPDK_ERRLOG("Completion ring of conn %p is full\n", req->conn);
+		return -1;
+	}
+
+	if (qpair->connecting) {
+		/* Make the session set up by the CONNECT visible to the acceptor first */
+		rte_wmb();
+		qpair->connecting = false;
+	}
+
+	return 0;
+}
+
+static int
+nvmf_loopback_request_exec(struct spdk_nvmf_loopback_qpair *qpair,
+			   struct spdk_nvmf_loopback_request *lreq)
+{
+	struct spdk_nvmf_request	*req = &lreq->req;
+	struct spdk_nvme_cmd		*cmd = &req->cmd->nvme_cmd;
+	struct spdk_nvme_cpl		*rsp = &req->rsp->nvme_cpl;
+
+	qpair->conn.sq_head++;
+	if (qpair->conn.sq_head == qpair->queue_depth) {
+		qpair->conn.sq_head = 0;
+	}
+
+	memset(req->rsp, 0, sizeof(*req->rsp));
+
+	if (cmd->opc == SPDK_NVME_OPC_FABRIC) {
+		req->xfer = spdk_nvme_opc_get_data_transfer(req->cmd->nvmf_cmd.fctype);
+
+		if (req->cmd->nvmf_cmd.fctype == SPDK_NVMF_FABRIC_COMMAND_CONNECT &&
+		    req->cmd->connect_cmd.qid != qpair->qid) {
+			SPDK_ERRLOG("CONNECT for qid %u on a queue pair created for qid %u\n",
+				    req->cmd->connect_cmd.qid, qpair->qid);
+			rsp->status.sct = SPDK_NVME_SCT_COMMAND_SPECIFIC;
+			rsp->status.sc = SPDK_NVMF_FABRIC_SC_INVALID_PARAM;
+			return spdk_nvmf_request_complete(req);
+		}
+	} else {
+		req->xfer = spdk_nvme_opc_get_data_transfer(cmd->opc);
+	}
+
+	if (req->xfer == SPDK_NVME_DATA_NONE) {
+		req->data = NULL;
+		req->length = 0;
+	} else if (req->data == NULL || req->length > SPDK_NVMF_MAX_RECV_DATA_TRANSFER_SIZE) {
+		SPDK_ERRLOG("Invalid data buffer %p length 0x%x\n", req->data, req->length);
+		rsp->status.sc = SPDK_NVME_SC_DATA_SGL_LENGTH_INVALID;
+		return spdk_nvmf_request_complete(req);
+	}
+
+	return spdk_nvmf_request_exec(req);
+}
+
+static int
+nvmf_loopback_poll_sq(struct spdk_nvmf_loopback_qpair *qpair, unsigned max)
+{
+	void		*reqs[NVMF_LOOPBACK_POLL_BATCH];
+	unsigned	i, count;
+
+	count = rte_ring_sc_dequeue_burst(qpair->sq, reqs, max);
+	for (i = 0; i < count; i++) {
+		if (nvmf_loopback_request_exec(qpair, reqs[i]) < 0) {
+			return -1;
+		}
+	}
+
+	return count;
+}
+
+static int
+nvmf_loopback_conn_poll(struct spdk_nvmf_conn *conn)
+{
+	struct spdk_nvmf_loopback_qpair *qpair = get_loopback_qpair(conn);
+
+	if (qpair->host_closed) {
+		return -1;
+	}
+
+	return nvmf_loopback_poll_sq(qpair, NVMF_LOOPBACK_POLL_BATCH);
+}
+
+static void
+nvmf_loopback_conn_release(spdk_event_t event)
+{
+	struct spdk_nvmf_loopback_qpair *qpair = spdk_event_get_arg1(event);
+
+	nvmf_loopback_qpair_put(qpair);
+}
+
+static void
+nvmf_loopback_handle_disconnect(spdk_event_t event)
+{
+	struct nvmf_session	*session = spdk_event_get_arg1(event);
+	struct spdk_nvmf_conn	*conn = spdk_event_get_arg2(event);
+
+	nvmf_disconnect(session, conn);
+}
+
+/*
+ * An I/O queue polled on its own core failed or was closed by the host.  A
+ * connected queue is torn down by its session on the subsystem's core; one
+ * that never connected is released right here.
+ */
+static void
+nvmf_loopback_conn_error(struct spdk_nvmf_loopback_qpair *qpair)
+{
+	struct spdk_nvmf_conn	*conn = &qpair->conn;
+	spdk_event_t		event;
+
+	qpair->failed = true;
+
+	if (conn->sess == NULL) {
+		qpair->stopped = true;
+		spdk_nvmf_put_conn_lcore(conn->lcore);
+		event = spdk_event_allocate(conn->lcore, nvmf_loopback_conn_release, qpair, NULL, NULL);
+		spdk_poller_unregister(&qpair->poller, event);
+		return;
+	}
+
+	event = spdk_event_allocate(conn->sess->subsys->lcore, nvmf_loopback_handle_disconnect,
+				    conn->sess, conn, NULL);
+	spdk_event_call(event);
+}
+
+static void
+nvmf_loopback_conn_poller(void *arg)
+{
+	struct spdk_nvmf_loopback_qpair *qpair = arg;
+
+	if (qpair->failed) {
+		return;
+	}
+
+	if (nvmf_loopback_conn_poll(&qpair->conn) < 0) {
+		nvmf_loopback_conn_error(qpair);
+	}
+}
+
+static void
+nvmf_loopback_conn_stop(struct spdk_nvmf_conn *conn, struct spdk_event *complete)
+{
+	struct spdk_nvmf_loopback_qpair *qpair = get_loopback_qpair(conn);
+
+	/* No request is started once the poller is gone. */
+	qpair->stopped = true;
+	spdk_poller_unregister(&qpair->poller, complete);
+}
+
+static void
+nvmf_loopback_conn_fini(struct spdk_nvmf_conn *conn)
+{
+	struct spdk_nvmf_loopback_qpair *qpair = get_loopback_qpair(conn);
+	spdk_event_t event;
+
+	if (conn->transport_polled) {
+		spdk_nvmf_put_conn_lcore(conn->lcore);
+
+		if (!qpair->stopped) {
+			/* Torn down along with its session without being stopped first */
+			qpair->stopped = true;
+			event = spdk_event_allocate(conn->lcore, nvmf_loopback_conn_release, qpair, NULL, NULL);
+			spdk_poller_unregister(&qpair->poller, event);
+			return;
+		}
+	}
+
+	nvmf_loopback_qpair_put(qpair);
+}
+
+/*
+ * Admin queues have no session to poll them until their CONNECT completes.
+ * The acceptor feeds them one capsule at a time until then, and releases the
+ * ones the host gives up on.
+ */
+static void
+nvmf_loopback_accept(void *arg)
+{
+	struct spdk_nvmf_loopback_qpair	*qpair, *tmp;
+	void				*new_conns[NVMF_LOOPBACK_POLL_BATCH];
+	unsigned			i, count;
+
+	count = rte_ring_sc_dequeue_burst(g_loopback.new_conns, new_conns, NVMF_LOOPBACK_POLL_BATCH);
+	for (i = 0; i < count; i++) {
+		TAILQ_INSERT_TAIL(&g_loopback.pending_conns,
+				  (struct spdk_nvmf_loopback_qpair *)new_conns[i], link);
+	}
+
+	TAILQ_FOREACH_SAFE(qpair, &g_loopback.pending_conns, link, tmp) {
+		if (qpair->connecting) {
+			continue;
+		}
+		rte_rmb();
+
+		if (qpair->conn.sess != NULL) {
+			/* Connected; its session polls it from now on. */
+			TAILQ_REMOVE(&g_loopback.pending_conns, qpair, link);
+		} else if (qpair->host_closed) {
+			TAILQ_REMOVE(&g_loopback.pending_conns, qpair, link);
+			nvmf_loopback_qpair_put(qpair);
+		} else if (rte_ring_count(qpair->sq) != 0) {
+			qpair->connecting = true;
+			if (nvmf_loopback_poll_sq(qpair, 1) < 0) {
+				SPDK_ERRLOG("Failed to process capsule on pending conn %p\n", &qpair->conn);
+			}
+		}
+	}
+}
+
+static int
+spdk_nvmf_loopback_init(void)
+{
+	SPDK_NOTICELOG("*** Loopback Transport Init ***\n");
+
+	g_loopback.new_conns = nvmf_loopback_ring_alloc("nvmf_loopback_new",
+			       NVMF_LOOPBACK_NEW_CONN_RING_SIZE,
+			       RING_F_SC_DEQ);
+	if (g_loopback.new_conns == NULL) {
+		SPDK_ERRLOG("Unable to allocate loopback connection ring\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int
+spdk_nvmf_loopback_fini(void)
+{
+	struct spdk_nvmf_loopback_qpair	*qpair;
+	void				*new_conn;
+
+	if (g_loopback.new_conns == NULL) {
+		return 0;
+	}
+
+	while (rte_ring_sc_dequeue(g_loopback.new_conns, &new_conn) == 0) {
+		TAILQ_INSERT_TAIL(&g_loopback.pending_conns,
+				  (struct spdk_nvmf_loopback_qpair *)new_conn, link);
+	}
+
+	while (!TAILQ_EMPTY(&g_loopback.pending_conns)) {
+		qpair = TAILQ_FIRST(&g_loopback.pending_conns);
+		TAILQ_REMOVE(&g_loopback.pending_conns, qpair, link);
+		nvmf_loopback_qpair_put(qpair);
+	}
+
+	rte_free(g_loopback.new_conns);
+	g_loopback.new_conns = NULL;
+
+	return 0;
+}
+
+static int
+spdk_nvmf_loopback_acceptor_start(void)
+{
+	if (g_loopback.new_conns == NULL) {
+		return -1;
+	}
+
+	g_loopback.acceptor_poller.fn = nvmf_loopback_accept;
+	g_loopback.acceptor_poller.arg = NULL;
+	spdk_poller_register(&g_loopback.acceptor_poller, rte_lcore_id(), NULL);
+	g_loopback.started = true;
+
+	return 0;
+}
+
+static void
+spdk_nvmf_loopback_acceptor_stop(void)
+{
+	if (!g_loopback.started) {
+		return;
+	}
+
+	g_loopback.started = false;
+	spdk_poller_unregister(&g_loopback.acceptor_poller, NULL);
+}
+
+static void
+nvmf_loopback_discover(struct spdk_nvmf_listen_addr *listen_addr,
+		       struct spdk_nvmf_discovery_log_page_entry *entry)
+{
+	entry->trtype = SPDK_NVMF_TRTYPE_INTRA_HOST;
+	entry->adrfam = SPDK_NVMF_ADRFAM_INTRA_HOST;
+	entry->treq.secure_channel = SPDK_NVMF_TREQ_SECURE_CHANNEL_NOT_SPECIFIED;
+
+	snprintf(entry->trsvcid, sizeof(entry->trsvcid), "%s", listen_addr->trsvc);
+	snprintf(entry->traddr, sizeof(entry->traddr), "%s", listen_addr->traddr);
+}
+
+const struct spdk_nvmf_transport spdk_nvmf_transport_loopback = {
+	.name = "loopback",
+	.transport_init = spdk_nvmf_loopback_init,
+	.transport_fini = spdk_nvmf_loopback_fini,
+	.transport_start = spdk_nvmf_loopback_acceptor_start,
+	.transport_stop = spdk_nvmf_loopback_acceptor_stop,
+
+	.req_complete = nvmf_loopback_request_complete,
+
+	.conn_fini = nvmf_loopback_conn_fini,
+	.conn_poll = nvmf_loopback_conn_poll,
+	.conn_stop = nvmf_loopback_conn_stop,
+
+	.listen_addr_discover = nvmf_loopback_discover,
+};
+
+/* Host side */
+
+struct spdk_nvmf_loopback_qpair *
+spdk_nvmf_loopback_qpair_alloc(uint16_t qid, uint16_t queue_depth)
+{
+	struct spdk_nvmf_loopback_qpair	*qpair;
+	struct spdk_nvmf_loopback_request *lreq;
+	struct spdk_nvmf_conn		*conn;
+	unsigned			ring_size;
+	uint16_t			i;
+
+	if (!g_loopback.started) {
+		SPDK_ERRLOG("Loopback transport is not started\n");
+		return NULL;
+	}
+
+	if (queue_depth == 0 || queue_depth > g_nvmf_tgt.max_queue_depth) {
+		SPDK_ERRLOG("Invalid queue depth %u (max %d)\n", queue_depth, g_nvmf_tgt.max_queue_depth);
+		return NULL;
+	}
+
+	qpair = calloc(1, sizeof(*qpair));
+	if (qpair == NULL) {
+		return NULL;
+	}
+
+	qpair->qid = qid;
+	qpair->queue_depth = queue_depth;
+	STAILQ_INIT(&qpair->free_reqs);
+	rte_atomic32_set(&qpair->refcnt, 2);
+
+	conn = &qpair->conn;
+	conn->transport = &spdk_nvmf_transport_loopback;
+
+	qpair->reqs = calloc(queue_depth, sizeof(*qpair->reqs));
+	if (qpair->reqs == NULL) {
+		goto error;
+	}
+
+	for (i = 0; i < queue_depth; i++) {
+		lreq = &qpair->reqs[i];
+		lreq->req.conn = conn;
+		lreq->req.cmd = &lreq->cmd;
+		lreq->req.rsp = &lreq->rsp;
+		STAILQ_INSERT_TAIL(&qpair->free_reqs, lreq, link);
+	}
+
+	/* A ring holds one entry less than its size. */
+	ring_size = rte_align32pow2(queue_depth + 1);
+	qpair->sq = nvmf_loopback_ring_alloc("nvmf_loopback_sq", ring_size,
+					     RING_F_SP_ENQ | RING_F_SC_DEQ);
+	qpair->cq = nvmf_loopback_ring_alloc("nvmf_loopback_cq", ring_size,
+					     RING_F_SP_ENQ | RING_F_SC_DEQ);
+	if (qpair->sq == NULL || qpair->cq == NULL) {
+		SPDK_ERRLOG("Unable to allocate loopback rings\n");
+		goto error;
+	}
+
+	if (qid == 0) {
+		if (rte_ring_mp_enqueue(g_loopback.new_conns, qpair) != 0) {
+			SPDK_ERRLOG("Too many loopback connections pending\n");
+			goto error;
+		}
+	} else {
+		conn->lcore = spdk_nvmf_get_conn_lcore();
+		conn->transport_polled = true;
+		qpair->poller.fn = nvmf_loopback_conn_poller;
+		qpair->poller.arg = qpair;
+		spdk_poller_register(&qpair->poller, conn->lcore, NULL);
+	}
+
+	SPDK_TRACELOG(SPDK_TRACE_NVMF, "New loopback connection %p qid %u depth %u\n",
+		      conn, qid, queue_depth);
+
+	return qpair;
+
+error:
+	nvmf_loopback_qpair_destroy(qpair);
+	return NULL;
+}
+
+void
+spdk_nvmf_loopback_qpair_free(struct spdk_nvmf_loopback_qpair *qpair)
+{
+	/* The target notices on its next poll and drops its own reference. */
+	rte_wmb();
+	qpair->host_closed = true;
+	nvmf_loopback_qpair_put(qpair);
+}
+
+int
+spdk_nvmf_loopback_submit(struct spdk_nvmf_loopback_qpair *qpair,
+			  const struct spdk_nvme_cmd *cmd,
+			  void *data, uint32_t length,
+			  spdk_nvmf_loopback_cb cb_fn, void *cb_arg)
+{
+	struct spdk_nvmf_loopback_request *lreq;
+
+	lreq = STAILQ_FIRST(&qpair->free_reqs);
+	if (lreq == NULL) {
+		return -ENOMEM;
+	}
+	STAILQ_REMOVE_HEAD(&qpair->free_reqs, link);
+
+	memcpy(&lreq->cmd, cmd, sizeof(lreq->cmd));
+	lreq->req.data = data;
+	lreq->req.length = length;
+	lreq->cb_fn = cb_fn;
+	lreq->cb_arg = cb_arg;
+
+	/* The ring has room for every request, so this cannot fail. */
+	rte_ring_sp_enqueue(qpair->sq, lreq);
+
+	return 0;
+}
+
+int32_t
+spdk_nvmf_loopback_process_completions(struct spdk_nvmf_loopback_qpair *qpair,
+				       uint32_t max_completions)
+{
+	void				*reqs[NVMF_LOOPBACK_POLL_BATCH];
+	struct spdk_nvmf_loopback_request *lreq;
+	struct spdk_nvme_cpl		cpl;
+	unsigned			i, count;
+
+	if (max_completions == 0 || max_completions > NVMF_LOOPBACK_POLL_BATCH) {
+		max_completions = NVMF_LOOPBACK_POLL_BATCH;
+	}
+
+	count = rte_ring_sc_dequeue_burst(qpair->cq, reqs, max_completions);
+	for (i = 0; i < count; i++) {
+		lreq = reqs[i];
+
+		/* Return the request first so the callback can submit again. */
+		cpl = lreq->rsp.nvme_cpl;
+		STAILQ_INSERT_HEAD(&qpair->free_reqs, lreq, link);
+
+		lreq->cb_fn(lreq->cb_arg, &cpl);
+	}
+
+	return count;
+}
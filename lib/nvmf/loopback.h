@@ -0,0 +1,91 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef SPDK_NVMF_LOOPBACK_H
+#define SPDK_NVMF_LOOPBACK_H
+
+#include <stdint.h>
+
+#include "spdk/nvme_spec.h"
+
+/*
+ * Host side of the loopback transport.
+ *
+ * The loopback transport connects an in-process host to the target through a
+ * pair of rings per queue pair, so the target can be exercised and profiled
+ * without a NIC.  The host builds the capsules itself, starting with a Fabrics
+ * CONNECT, and data buffers are handed to the target without copying.
+ * Buffers used with Direct mode subsystems must be DMA-able (rte_malloc).
+ *
+ * A queue pair may only be used by one thread at a time.
+ */
+struct spdk_nvmf_loopback_qpair;
+
+typedef void (*spdk_nvmf_loopback_cb)(void *cb_arg, const struct spdk_nvme_cpl *cpl);
+
+/*
+ * Create a queue pair that will be connected as queue qid.  The admin queue
+ * (qid 0) is polled with its session on the subsystem's core; I/O queues are
+ * polled on a core of their own.  The loopback transport must be started.
+ */
+struct spdk_nvmf_loopback_qpair *
+spdk_nvmf_loopback_qpair_alloc(uint16_t qid, uint16_t queue_depth);
+
+/*
+ * Disconnect and release a queue pair.  All submitted commands must have
+ * completed.
+ */
+void
+spdk_nvmf_loopback_qpair_free(struct spdk_nvmf_loopback_qpair *qpair);
+
+/*
+ * Submit a 64 byte command capsule (an NVMe command or a Fabrics command) with
+ * an optional data buffer.  Returns 0 on success, or -ENOMEM if queue_depth
+ * commands are already outstanding.
+ */
+int
+spdk_nvmf_loopback_submit(struct spdk_nvmf_loopback_qpair *qpair,
+			  const struct spdk_nvme_cmd *cmd,
+			  void *data, uint32_t length,
+			  spdk_nvmf_loopback_cb cb_fn, void *cb_arg);
+
+/*
+ * Call the callbacks of up to max_completions completed commands (0 means a
+ * default batch).  Returns the number of completions processed.
+ */
+int32_t
+spdk_nvmf_loopback_process_completions(struct spdk_nvmf_loopback_qpair *qpair,
+				       uint32_t max_completions);
+
+#endif /* SPDK_NVMF_LOOPBACK_H */
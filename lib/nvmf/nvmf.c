@@ -32,6 +32,7 @@
  */
 
 #include <arpa/inet.h>
+#include <assert.h>
 
 #include <rte_config.h>
 #include <rte_mempool.h>
@@ -52,12 +53,18 @@ struct spdk_nvmf_globals g_nvmf_tgt;
 
 extern struct rte_mempool *request_mempool;
 static unsigned g_num_requests;
+static bool g_owns_request_mempool;
 
 static int
 spdk_nvmf_initialize_pools(void)
 {
 	SPDK_NOTICELOG("\n*** NVMf Pool Creation ***\n");
 
+	if (request_mempool != NULL) {
+		/* Already created by the NVMe bdev module; all NVMe requests must share one pool. */
+		return 0;
+	}
+
 	g_num_requests = MAX_SUBSYSTEMS * g_nvmf_tgt.max_queues_per_session * g_nvmf_tgt.max_queue_depth;
 
 	/* create NVMe backend request pool */
@@ -71,6 +78,7 @@ spdk_nvmf_initialize_pools(void)
 		SPDK_ERRLOG("create NVMe request pool failed\n");
 		return -1;
 	}
+	g_owns_request_mempool = true;
 
 	SPDK_TRACELOG(SPDK_TRACE_DEBUG, "NVMe request_mempool %p, size %" PRIu64 " bytes\n",
 		      request_mempool,
@@ -106,7 +114,9 @@ spdk_nvmf_check_pools(void)
 {
 	int rc = 0;
 
-	rc += spdk_nvmf_check_pool(request_mempool, g_num_requests);
+	if (g_owns_request_mempool) {
+		rc += spdk_nvmf_check_pool(request_mempool, g_num_requests);
+	}
 
 	if (rc == 0) {
 		return 0;
@@ -115,13 +125,57 @@ spdk_nvmf_check_pools(void)
 	}
 }
 
+/*
+ * Pick the core that will process a new I/O connection.  The core with the
+ * fewest I/O connections wins; ties are broken round-robin so that
+ * consecutive connections land on different cores.
+ */
+uint32_t
+spdk_nvmf_get_conn_lcore(void)
+{
+	uint64_t mask = spdk_app_get_core_mask();
+	uint32_t i, lcore, best = SPDK_NVMF_MAX_LCORES;
+
+	pthread_mutex_lock(&g_nvmf_tgt.mutex);
+
+	for (i = 0; i < SPDK_NVMF_MAX_LCORES; i++) {
+		lcore = (g_nvmf_tgt.next_lcore + i) % SPDK_NVMF_MAX_LCORES;
+		if (((mask >> lcore) & 1ULL) == 0) {
+			continue;
+		}
+
+		if (best == SPDK_NVMF_MAX_LCORES ||
+		    g_nvmf_tgt.conns_per_lcore[lcore] < g_nvmf_tgt.conns_per_lcore[best]) {
+			best = lcore;
+		}
+	}
+
+	assert(best < SPDK_NVMF_MAX_LCORES);
+	g_nvmf_tgt.conns_per_lcore[best]++;
+	g_nvmf_tgt.next_lcore = (best + 1) % SPDK_NVMF_MAX_LCORES;
+
+	pthread_mutex_unlock(&g_nvmf_tgt.mutex);
+
+	return best;
+}
+
+void
+spdk_nvmf_put_conn_lcore(uint32_t lcore)
+{
+	pthread_mutex_lock(&g_nvmf_tgt.mutex);
+	assert(g_nvmf_tgt.conns_per_lcore[lcore] > 0);
+	g_nvmf_tgt.conns_per_lcore[lcore]--;
+	pthread_mutex_unlock(&g_nvmf_tgt.mutex);
+}
+
 int
-nvmf_tgt_init(int max_queue_depth, int max_queues_per_sess)
+nvmf_tgt_init(int max_queue_depth, int max_queues_per_sess, uint32_t in_capsule_data_size)
 {
 	int rc;
 
 	g_nvmf_tgt.max_queues_per_session = max_queues_per_sess;
 	g_nvmf_tgt.max_queue_depth = max_queue_depth;
+	g_nvmf_tgt.in_capsule_data_size = in_capsule_data_size;
 
 	rc = pthread_mutex_init(&g_nvmf_tgt.mutex, NULL);
 	if (rc != 0) {
@@ -181,6 +235,7 @@ nvmf_tgt_subsystem_fini(void)
 }
 
 SPDK_SUBSYSTEM_REGISTER(nvmf, nvmf_tgt_subsystem_initialize, nvmf_tgt_subsystem_fini, NULL)
+SPDK_SUBSYSTEM_DEPEND(nvmf, bdev)
 
 SPDK_TRACE_REGISTER_FN(nvmf_trace)
 {
@@ -47,15 +47,24 @@
 #define nvmf_min(a,b) (((a)<(b))?(a):(b))
 #define nvmf_max(a,b) (((a)>(b))?(a):(b))
 
-#define DEFAULT_BB_SIZE (128 * 1024)
+/*
+ * Maximum data transfer size of a single request.  Transports stage the data
+ * in a buffer of at least this size taken from a shared pool.
+ */
+#define SPDK_NVMF_MAX_RECV_DATA_TRANSFER_SIZE  (128 * 1024)
 
 /*
- * NVMf target supports a maximum transfer size that is equal to
- * a single allocated bounce buffer per request.
+ * Size of the data buffer received together with each command capsule.  The
+ * size in use is set with InCapsuleDataSize and advertised in IOCCSZ; it must
+ * fit in a small data pool buffer.
  */
-#define SPDK_NVMF_MAX_RECV_DATA_TRANSFER_SIZE  DEFAULT_BB_SIZE
+#define SPDK_NVMF_DEFAULT_IN_CAPSULE_DATA_SIZE	4096
+#define SPDK_NVMF_MAX_IN_CAPSULE_DATA_SIZE	8192
 
 #define SPDK_NVMF_DEFAULT_NUM_SESSIONS_PER_LCORE 1
+
+/* The reactor core mask is 64 bits wide. */
+#define SPDK_NVMF_MAX_LCORES 64
 #define SPDK_NVMF_DEFAULT_SIN_PORT ((uint16_t)4420)
 
 #define OBJECT_NVMF_IO				0x30
@@ -101,10 +110,20 @@ struct spdk_nvmf_globals {
 	int max_queue_depth;
 	int max_queues_per_session;
 
+	/* Bytes of data a host may send in a command capsule */
+	uint32_t in_capsule_data_size;
+
 	uint16_t	   sin_port;
+
+	/* Number of I/O connections polled on each core; protected by mutex. */
+	uint32_t	   conns_per_lcore[SPDK_NVMF_MAX_LCORES];
+	uint32_t	   next_lcore;
 };
 
-int nvmf_tgt_init(int max_queue_depth, int max_conn_per_sess);
+int nvmf_tgt_init(int max_queue_depth, int max_conn_per_sess, uint32_t in_capsule_data_size);
+
+uint32_t spdk_nvmf_get_conn_lcore(void);
+void spdk_nvmf_put_conn_lcore(uint32_t lcore);
 
 extern struct spdk_nvmf_globals g_nvmf_tgt;
 
@@ -46,6 +46,8 @@
 #include <rte_timer.h>
 #include <rte_lcore.h>
 #include <rte_malloc.h>
+#include <rte_mempool.h>
+#include <rte_memory.h>
 
 #include "nvmf_internal.h"
 #include "request.h"
@@ -53,10 +55,12 @@
 #include "subsystem.h"
 #include "transport.h"
 #include "spdk/assert.h"
+#include "spdk/event.h"
 #include "spdk/log.h"
 #include "spdk/nvmf_spec.h"
 #include "spdk/trace.h"
 
+
 #define ACCEPT_TIMEOUT (rte_get_timer_hz() >> 10) /* ~1ms */
 
 /*
@@ -65,6 +69,117 @@
 #define NVMF_DEFAULT_TX_SGE		1
 #define NVMF_DEFAULT_RX_SGE		2
 
+/* Maximum number of work completions reaped per call to ibv_poll_cq() */
+#define NVMF_RDMA_WC_BATCH_SIZE		32
+
+/*
+ * Response SENDs are posted unsignaled except for every Nth one and the last
+ * one in each doorbell.  A signaled SEND completion implies that all SENDs
+ * posted before it on the same queue pair have completed as well.
+ */
+#define NVMF_RDMA_SEND_SIGNAL_INTERVAL	16
+
+/*
+ * Data buffers for keyed SGL transfers are taken from two shared pools and
+ * only held while a request is using them.
+ */
+#define NVMF_RDMA_SMALL_BUF_MAX_SIZE	8192
+#define NVMF_RDMA_LARGE_BUF_MAX_SIZE	SPDK_NVMF_MAX_RECV_DATA_TRANSFER_SIZE
+#define NVMF_RDMA_SMALL_BUF_POOL_SIZE	8192
+#define NVMF_RDMA_LARGE_BUF_POOL_SIZE	1024
+
+/*
+ * I/O connections running on the same core and protection domain share one
+ * completion queue and one shared receive queue, serviced by a single poller.
+ * The CQ must have room for every entry that the SRQ and the send queues of
+ * the attached connections can generate.
+ */
+#define NVMF_RDMA_SHARED_CQ_SIZE	16384
+#define NVMF_RDMA_SRQ_DEPTH		4096
+#define NVMF_RDMA_CONN_HASH_SIZE	256
+
+/*
+ * Memory registrations covering all of the DPDK hugepage memory, made once
+ * for each protection domain that connections are created on.
+ */
+struct spdk_nvmf_rdma_mem_map {
+	struct ibv_pd				*pd;
+	uint32_t				num_mrs;
+	struct ibv_mr				*mrs[RTE_MAX_MEMSEG];
+	TAILQ_ENTRY(spdk_nvmf_rdma_mem_map)	link;
+};
+
+static TAILQ_HEAD(, spdk_nvmf_rdma_mem_map) g_mem_maps = TAILQ_HEAD_INITIALIZER(g_mem_maps);
+
+/*
+ * The wr_id of every work request points at one of these, placed first in
+ * the structure that owns the work request, so that completions from a shared
+ * CQ can be told apart.
+ */
+enum spdk_nvmf_rdma_wr_type {
+	RDMA_WR_TYPE_RECV,
+	RDMA_WR_TYPE_SEND,
+	RDMA_WR_TYPE_DRAIN,
+};
+
+struct spdk_nvmf_rdma_wr {
+	enum spdk_nvmf_rdma_wr_type		type;
+};
+
+/* A receive buffer: the command capsule followed by in-capsule data */
+struct spdk_nvmf_rdma_recv {
+	struct spdk_nvmf_rdma_wr		rdma_wr;
+
+	union nvmf_h2c_msg			*cmd;
+	void					*in_capsule_buf;
+
+	struct ibv_recv_wr			wr;
+	struct ibv_sge				sgl[NVMF_DEFAULT_RX_SGE];
+
+	/* Saved from the work completion while the receive waits to be processed */
+	uint32_t				byte_len;
+	uint32_t				qp_num;
+
+	STAILQ_ENTRY(spdk_nvmf_rdma_recv)	link;
+};
+
+/* Receive buffers backing either one connection's receive queue or an SRQ */
+struct spdk_nvmf_rdma_recv_set {
+	uint32_t				count;
+	struct spdk_nvmf_rdma_recv		*recvs;
+	union nvmf_h2c_msg			*cmds;
+	uint8_t					*bufs;
+};
+
+struct spdk_nvmf_rdma_request {
+	struct spdk_nvmf_rdma_wr		rdma_wr;
+
+	struct spdk_nvmf_request		req;
+
+	/* Receive holding the command, reposted when the request is released */
+	struct spdk_nvmf_rdma_recv		*recv;
+
+	union nvmf_c2h_msg			rsp;
+
+	/* Pool buffer for keyed SGL data, held from command arrival until the response is sent */
+	void					*data_buf;
+	struct rte_mempool			*data_buf_pool;
+	uint32_t				data_lkey;
+
+	/* RDMA READ or WRITE of the data buffer */
+	struct ibv_send_wr			data_wr;
+	struct ibv_sge				data_sge;
+
+	struct ibv_send_wr			rsp_wr;
+	struct ibv_sge				rsp_sge;
+
+	STAILQ_ENTRY(spdk_nvmf_rdma_request)	link;
+	STAILQ_ENTRY(spdk_nvmf_rdma_request)	send_link;
+	STAILQ_ENTRY(spdk_nvmf_rdma_request)	buf_link;
+};
+
+struct spdk_nvmf_rdma_poll_group;
+
 struct spdk_nvmf_rdma_conn {
 	struct spdk_nvmf_conn			conn;
 
@@ -76,136 +191,201 @@ struct spdk_nvmf_rdma_conn {
 
 	uint16_t				queue_depth;
 
-	STAILQ_HEAD(, spdk_nvmf_rdma_request)	rdma_reqs;
+	struct spdk_nvmf_rdma_request		*reqs;
+	STAILQ_HEAD(, spdk_nvmf_rdma_request)	free_reqs;
 	int					outstanding_reqs;
 
+	/* Receive buffers of a connection with its own receive queue */
+	struct spdk_nvmf_rdma_recv_set		recv_set;
+
+	/* Commands that arrived while every request was in use, in arrival order */
+	STAILQ_HEAD(, spdk_nvmf_rdma_recv)	incoming_queue;
+
+	struct spdk_nvmf_rdma_mem_map		*mem_map;
+
+	/* Requests waiting for a data buffer, in arrival order */
+	STAILQ_HEAD(, spdk_nvmf_rdma_request)	pending_data_buf_queue;
+
+	/*
+	 * Work requests built while processing completions.  They are
+	 * chained together and handed to the NIC with a single
+	 * ibv_post_send()/ibv_post_recv() by nvmf_rdma_flush_wrs().
+	 */
+	struct ibv_send_wr			*send_wr_head;
+	struct ibv_send_wr			*send_wr_tail;
+	struct ibv_recv_wr			*recv_wr_head;
+	struct ibv_recv_wr			*recv_wr_tail;
+
+	/* Last response SEND in the pending chain */
+	struct ibv_send_wr			*last_rsp_wr;
+	uint32_t				sends_since_signal;
+
+	/* Response SENDs posted to the NIC, in posting order */
+	STAILQ_HEAD(, spdk_nvmf_rdma_request)	sends_in_flight;
+
+	/*
+	 * Set on the acceptor core when the host goes away before the
+	 * connection has a session, so that a CONNECT still queued there
+	 * is dropped.
+	 */
+	bool					closing;
+
+	/*
+	 * Set for I/O connections served by a poll group.  Everything below
+	 * is only touched on the connection's core.
+	 */
+	struct spdk_nvmf_rdma_poll_group	*group;
+	bool					attached;
+	bool					stopped;
+	bool					failed;
+	bool					dirty;
+	TAILQ_ENTRY(spdk_nvmf_rdma_conn)	dirty_link;
+	TAILQ_ENTRY(spdk_nvmf_rdma_conn)	hash_link;
+
+	/* Poller of an I/O connection on a device without SRQ support */
+	struct spdk_poller			poller;
+
+	/* CONNECT capsules handed to the acceptor core and not yet returned */
+	uint32_t				connects_in_flight;
+
+	/*
+	 * Teardown state.  The QP of a grouped connection is only destroyed
+	 * once the drain WR posted behind its last SEND has completed and the
+	 * device has reported that it will take no more receives from the SRQ.
+	 */
+	struct spdk_nvmf_rdma_wr		drain_wr;
+	bool					detaching;
+	bool					send_drained;
+	bool					recv_drained;
+
 	TAILQ_ENTRY(spdk_nvmf_rdma_conn)	link;
 };
 
 /* List of RDMA connections that have not yet received a CONNECT capsule */
 static TAILQ_HEAD(, spdk_nvmf_rdma_conn) g_pending_conns = TAILQ_HEAD_INITIALIZER(g_pending_conns);
 
-struct spdk_nvmf_rdma_request {
-	struct spdk_nvmf_request		req;
-	STAILQ_ENTRY(spdk_nvmf_rdma_request)	link;
+/*
+ * A shared CQ and SRQ for the I/O connections on one core and protection
+ * domain.  Groups are created and looked up on the acceptor core; the poller
+ * and the connection lists only run on lcore.
+ */
+struct spdk_nvmf_rdma_poll_group {
+	uint32_t				lcore;
+	struct ibv_pd				*pd;
+	struct spdk_nvmf_rdma_mem_map		*mem_map;
+
+	struct ibv_cq				*cq;
+	uint32_t				cq_size;
 
-	union nvmf_h2c_msg			cmd;
-	struct ibv_mr				*cmd_mr;
+	/* CQ entries promised to the SRQ and to the attached send queues */
+	rte_atomic32_t				cq_reserved;
 
-	union nvmf_c2h_msg			rsp;
-	struct ibv_mr				*rsp_mr;
+	struct ibv_srq				*srq;
+	struct spdk_nvmf_rdma_recv_set		recv_set;
 
-	struct ibv_mr				*bb_mr;
+	/* Receives to repost, handed to the SRQ with one ibv_post_srq_recv() */
+	struct ibv_recv_wr			*srq_wr_head;
+	struct ibv_recv_wr			*srq_wr_tail;
+
+	/* Attached connections, hashed by QP number */
+	TAILQ_HEAD(, spdk_nvmf_rdma_conn)	conn_hash[NVMF_RDMA_CONN_HASH_SIZE];
+
+	/* Connections with work to start or to post at the end of this poll */
+	TAILQ_HEAD(, spdk_nvmf_rdma_conn)	dirty_conns;
+
+	/* Receives for QPs that have not been attached yet */
+	STAILQ_HEAD(, spdk_nvmf_rdma_recv)	unmatched_recvs;
+
+	struct spdk_poller			poller;
+
+	TAILQ_ENTRY(spdk_nvmf_rdma_poll_group)	link;
 };
 
+static TAILQ_HEAD(, spdk_nvmf_rdma_poll_group) g_poll_groups = TAILQ_HEAD_INITIALIZER(g_poll_groups);
+
 struct spdk_nvmf_rdma {
 	struct rte_timer		acceptor_timer;
 	struct rdma_event_channel	*acceptor_event_channel;
 	struct rdma_cm_id		*acceptor_listen_id;
+	uint32_t			acceptor_lcore;
+
+	/* Connections handed to their poll group's core for teardown */
+	rte_atomic32_t			num_detaching;
 };
 
 static struct spdk_nvmf_rdma g_rdma = { };
 
-static struct spdk_nvmf_rdma_request *alloc_rdma_req(struct spdk_nvmf_conn *conn);
-static int nvmf_post_rdma_recv(struct spdk_nvmf_request *req);
-static void free_rdma_req(struct spdk_nvmf_rdma_request *rdma_req);
+static struct rte_mempool *g_small_buf_pool;
+static struct rte_mempool *g_large_buf_pool;
 
-static struct spdk_nvmf_rdma_conn *
-allocate_rdma_conn(struct rdma_cm_id *id, uint16_t queue_depth)
+static void
+nvmf_rdma_free_mem_map(struct spdk_nvmf_rdma_mem_map *map)
 {
-	struct spdk_nvmf_rdma_conn	*rdma_conn;
-	struct spdk_nvmf_conn		*conn;
-	int				rc, i;
-	struct ibv_qp_init_attr		attr;
-	struct spdk_nvmf_rdma_request	*rdma_req;
+	uint32_t i;
 
-	rdma_conn = calloc(1, sizeof(struct spdk_nvmf_rdma_conn));
-	if (rdma_conn == NULL) {
-		SPDK_ERRLOG("Could not allocate new connection.\n");
-		return NULL;
+	for (i = 0; i < map->num_mrs; i++) {
+		if (ibv_dereg_mr(map->mrs[i])) {
+			SPDK_ERRLOG("Unable to de-register hugepage memory region\n");
+		}
 	}
 
-	rdma_conn->queue_depth = queue_depth;
-	rdma_conn->ctx = id->verbs;
-	rdma_conn->cm_id = id;
-	STAILQ_INIT(&rdma_conn->rdma_reqs);
-
-	rdma_conn->comp_channel = ibv_create_comp_channel(id->verbs);
-	if (!rdma_conn->comp_channel) {
-		SPDK_ERRLOG("create completion channel error!\n");
-		goto alloc_error;
-	}
+	free(map);
+}
 
-	rc = fcntl(rdma_conn->comp_channel->fd, F_SETFL, O_NONBLOCK);
-	if (rc < 0) {
-		SPDK_ERRLOG("fcntl to set comp channel to non-blocking failed\n");
-		goto alloc_error;
-	}
+/*
+ * Find or create the registration of the DPDK hugepage memory for pd.  DPDK
+ * memory segments are fixed at initialization, so registering each of them
+ * once covers every buffer allocated from the data pools.
+ */
+static struct spdk_nvmf_rdma_mem_map *
+nvmf_rdma_get_mem_map(struct ibv_pd *pd)
+{
+	struct spdk_nvmf_rdma_mem_map	*map;
+	const struct rte_memseg		*seg;
+	int				i;
 
-	/*
-	 * Size the CQ to handle completions for RECV, SEND, and either READ or WRITE.
-	 */
-	rdma_conn->cq = ibv_create_cq(id->verbs, (queue_depth * 3), rdma_conn, rdma_conn->comp_channel,
-				      0);
-	if (!rdma_conn->cq) {
-		SPDK_ERRLOG("create cq error!\n");
-		goto alloc_error;
+	TAILQ_FOREACH(map, &g_mem_maps, link) {
+		if (map->pd == pd) {
+			return map;
+		}
 	}
 
-	memset(&attr, 0, sizeof(struct ibv_qp_init_attr));
-	attr.qp_type		= IBV_QPT_RC;
-	attr.send_cq		= rdma_conn->cq;
-	attr.recv_cq		= rdma_conn->cq;
-	attr.cap.max_send_wr	= rdma_conn->queue_depth * 2; /* SEND, READ, and WRITE operations */
-	attr.cap.max_recv_wr	= rdma_conn->queue_depth; /* RECV operations */
-	attr.cap.max_send_sge	= NVMF_DEFAULT_TX_SGE;
-	attr.cap.max_recv_sge	= NVMF_DEFAULT_RX_SGE;
-
-	rc = rdma_create_qp(rdma_conn->cm_id, NULL, &attr);
-	if (rc) {
-		SPDK_ERRLOG("rdma_create_qp failed\n");
-		goto alloc_error;
+	map = calloc(1, sizeof(*map));
+	if (map == NULL) {
+		SPDK_ERRLOG("Unable to allocate memory map\n");
+		return NULL;
 	}
-	rdma_conn->qp = rdma_conn->cm_id->qp;
-
-	conn = &rdma_conn->conn;
-	conn->transport = &spdk_nvmf_transport_rdma;
-	id->context = conn;
-
-	SPDK_TRACELOG(SPDK_TRACE_RDMA, "New RDMA Connection: %p\n", conn);
-
-	for (i = 0; i < rdma_conn->queue_depth; i++) {
-		rdma_req = alloc_rdma_req(conn);
-		if (rdma_req == NULL) {
-			goto alloc_error;
-		}
-
-		SPDK_TRACELOG(SPDK_TRACE_RDMA, "rdma_req %p: req %p, rsp %p\n",
-			      rdma_req, &rdma_req->req,
-			      rdma_req->req.rsp);
-
-		if (nvmf_post_rdma_recv(&rdma_req->req)) {
-			SPDK_ERRLOG("Unable to post connection rx desc\n");
-			goto alloc_error;
+	map->pd = pd;
+
+	seg = rte_eal_get_physmem_layout();
+	for (i = 0; i < RTE_MAX_MEMSEG && seg[i].addr != NULL; i++) {
+		map->mrs[map->num_mrs] = ibv_reg_mr(pd, seg[i].addr, seg[i].len, IBV_ACCESS_LOCAL_WRITE);
+		if (map->mrs[map->num_mrs] == NULL) {
+			SPDK_ERRLOG("Unable to register %zu bytes of hugepage memory at %p\n",
+				    (size_t)seg[i].len, seg[i].addr);
+			nvmf_rdma_free_mem_map(map);
+			return NULL;
 		}
-
-		STAILQ_INSERT_TAIL(&rdma_conn->rdma_reqs, rdma_req, link);
+		map->num_mrs++;
 	}
 
-	return rdma_conn;
+	SPDK_TRACELOG(SPDK_TRACE_RDMA, "Registered %u hugepage memory segments for pd %p\n",
+		      map->num_mrs, pd);
 
-alloc_error:
-	STAILQ_FOREACH(rdma_req, &rdma_conn->rdma_reqs, link) {
-		STAILQ_REMOVE(&rdma_conn->rdma_reqs, rdma_req, spdk_nvmf_rdma_request, link);
-		free_rdma_req(rdma_req);
-	}
+	TAILQ_INSERT_TAIL(&g_mem_maps, map, link);
+	return map;
+}
 
-	if (rdma_conn->cq) {
-		ibv_destroy_cq(rdma_conn->cq);
-	}
+static struct ibv_mr *
+nvmf_rdma_mem_map_find(struct spdk_nvmf_rdma_mem_map *map, void *buf, size_t len)
+{
+	uint32_t i;
 
-	if (rdma_conn->comp_channel) {
-		ibv_destroy_comp_channel(rdma_conn->comp_channel);
+	for (i = 0; i < map->num_mrs; i++) {
+		if ((uintptr_t)buf >= (uintptr_t)map->mrs[i]->addr &&
+		    (uintptr_t)buf + len <= (uintptr_t)map->mrs[i]->addr + map->mrs[i]->length) {
+			return map->mrs[i];
+		}
 	}
 
 	return NULL;
@@ -220,114 +400,139 @@ get_rdma_conn(struct spdk_nvmf_conn *conn)
 static inline struct spdk_nvmf_rdma_request *
 get_rdma_req(struct spdk_nvmf_request *req)
 {
-	return (struct spdk_nvmf_rdma_request *)((uintptr_t)req + offsetof(struct spdk_nvmf_rdma_request,
+	return (struct spdk_nvmf_rdma_request *)((uintptr_t)req - offsetof(struct spdk_nvmf_rdma_request,
 			req));
 }
 
 static void
-free_rdma_req(struct spdk_nvmf_rdma_request *rdma_req)
+nvmf_rdma_recv_set_fini(struct spdk_nvmf_rdma_recv_set *set)
+{
+	rte_free(set->recvs);
+	rte_free(set->cmds);
+	rte_free(set->bufs);
+	memset(set, 0, sizeof(*set));
+}
+
+/*
+ * Allocate count receive buffers out of hugepage memory, so that they are
+ * covered by the registrations in map, and build their work requests.
+ */
+static int
+nvmf_rdma_recv_set_init(struct spdk_nvmf_rdma_recv_set *set, uint32_t count,
+			struct spdk_nvmf_rdma_mem_map *map)
 {
-	if (rdma_req->cmd_mr && rdma_dereg_mr(rdma_req->cmd_mr)) {
-		SPDK_ERRLOG("Unable to de-register cmd_mr\n");
+	struct spdk_nvmf_rdma_recv	*recv;
+	struct ibv_mr			*cmds_mr, *bufs_mr = NULL;
+	uint32_t			in_capsule_data_size = g_nvmf_tgt.in_capsule_data_size;
+	uint32_t			i;
+
+	set->count = count;
+	set->recvs = rte_zmalloc("nvmf_rdma_recv", count * sizeof(*set->recvs), 0);
+	set->cmds = rte_zmalloc("nvmf_rdma_cmd", count * sizeof(*set->cmds), 0);
+	if (in_capsule_data_size > 0) {
+		set->bufs = rte_zmalloc("nvmf_in_capsule", (size_t)count * in_capsule_data_size, 0);
+	}
+	if (set->recvs == NULL || set->cmds == NULL ||
+	    (in_capsule_data_size > 0 && set->bufs == NULL)) {
+		SPDK_ERRLOG("Unable to allocate %u receive buffers\n", count);
+		nvmf_rdma_recv_set_fini(set);
+		return -1;
 	}
 
-	if (rdma_req->rsp_mr && rdma_dereg_mr(rdma_req->rsp_mr)) {
-		SPDK_ERRLOG("Unable to de-register rsp_mr\n");
+	cmds_mr = nvmf_rdma_mem_map_find(map, set->cmds, count * sizeof(*set->cmds));
+	if (in_capsule_data_size > 0) {
+		bufs_mr = nvmf_rdma_mem_map_find(map, set->bufs, (size_t)count * in_capsule_data_size);
+	}
+	if (cmds_mr == NULL || (in_capsule_data_size > 0 && bufs_mr == NULL)) {
+		SPDK_ERRLOG("Receive buffers are not registered\n");
+		nvmf_rdma_recv_set_fini(set);
+		return -1;
 	}
 
-	if (rdma_req->bb_mr) {
-		rte_free(rdma_req->bb_mr->addr);
-		if (rdma_dereg_mr(rdma_req->bb_mr)) {
-			SPDK_ERRLOG("Unable to de-register bb_mr\n");
+	for (i = 0; i < count; i++) {
+		recv = &set->recvs[i];
+		recv->rdma_wr.type = RDMA_WR_TYPE_RECV;
+		recv->cmd = &set->cmds[i];
+
+		recv->sgl[0].addr = (uintptr_t)recv->cmd;
+		recv->sgl[0].length = sizeof(*recv->cmd);
+		recv->sgl[0].lkey = cmds_mr->lkey;
+
+		recv->wr.wr_id = (uintptr_t)&recv->rdma_wr;
+		recv->wr.sg_list = recv->sgl;
+		recv->wr.num_sge = 1;
+
+		if (in_capsule_data_size > 0) {
+			/* Data sent in the capsule lands right behind the command. */
+			recv->in_capsule_buf = set->bufs + (size_t)i * in_capsule_data_size;
+			recv->sgl[1].addr = (uintptr_t)recv->in_capsule_buf;
+			recv->sgl[1].length = in_capsule_data_size;
+			recv->sgl[1].lkey = bufs_mr->lkey;
+			recv->wr.num_sge = NVMF_DEFAULT_RX_SGE;
 		}
 	}
 
-	rte_free(rdma_req);
+	return 0;
 }
 
 static void
-spdk_nvmf_rdma_free_reqs(struct spdk_nvmf_conn *conn)
-{
-	struct spdk_nvmf_rdma_conn *rdma_conn = get_rdma_conn(conn);
-	struct spdk_nvmf_rdma_request *rdma_req;
-
-	STAILQ_FOREACH(rdma_req, &rdma_conn->rdma_reqs, link) {
-		STAILQ_REMOVE(&rdma_conn->rdma_reqs, rdma_req, spdk_nvmf_rdma_request, link);
-		free_rdma_req(rdma_req);
-	}
-}
-
-static struct spdk_nvmf_rdma_request *
-alloc_rdma_req(struct spdk_nvmf_conn *conn)
+nvmf_rdma_free_reqs(struct spdk_nvmf_rdma_conn *rdma_conn)
 {
-	struct spdk_nvmf_rdma_conn *rdma_conn = get_rdma_conn(conn);
 	struct spdk_nvmf_rdma_request *rdma_req;
-	void *bb;
-	size_t bb_len;
-
-	rdma_req = rte_zmalloc("nvmf_rdma_req", sizeof(*rdma_req), 0);
-	if (!rdma_req) {
-		SPDK_ERRLOG("Unable to allocate rdma_req\n");
-		return NULL;
-	}
-
-	rdma_req->cmd_mr = rdma_reg_msgs(rdma_conn->cm_id, &rdma_req->cmd, sizeof(rdma_req->cmd));
-	if (rdma_req->cmd_mr == NULL) {
-		SPDK_ERRLOG("Unable to register cmd_mr\n");
-		free_rdma_req(rdma_req);
-		return NULL;
-	}
+	uint16_t i;
 
-	bb_len = DEFAULT_BB_SIZE;
-	bb = rte_zmalloc("nvmf_bb", bb_len, 0);
-	if (!bb) {
-		SPDK_ERRLOG("Unable to get %zu byte bounce buffer\n", bb_len);
-		free_rdma_req(rdma_req);
-		return NULL;
-	}
-	rdma_req->bb_mr = rdma_reg_read(rdma_conn->cm_id, bb, bb_len);
-	if (rdma_req->bb_mr == NULL) {
-		SPDK_ERRLOG("Unable to register bb_mr\n");
-		rte_free(bb);
-		free_rdma_req(rdma_req);
-		return NULL;
+	if (rdma_conn->reqs == NULL) {
+		return;
 	}
 
-	rdma_req->rsp_mr = rdma_reg_msgs(rdma_conn->cm_id, &rdma_req->rsp, sizeof(rdma_req->rsp));
-	if (rdma_req->rsp_mr == NULL) {
-		SPDK_ERRLOG("Unable to register rsp_mr\n");
-		free_rdma_req(rdma_req);
-		return NULL;
+	for (i = 0; i < rdma_conn->queue_depth; i++) {
+		rdma_req = &rdma_conn->reqs[i];
+		if (rdma_req->data_buf) {
+			rte_mempool_put(rdma_req->data_buf_pool, rdma_req->data_buf);
+		}
 	}
 
-	rdma_req->req.cmd = &rdma_req->cmd;
-	rdma_req->req.rsp = &rdma_req->rsp;
-	rdma_req->req.conn = conn;
-
-	return rdma_req;
+	rte_free(rdma_conn->reqs);
+	rdma_conn->reqs = NULL;
 }
 
-static void
-nvmf_rdma_conn_cleanup(struct spdk_nvmf_conn *conn)
+static int
+nvmf_rdma_alloc_reqs(struct spdk_nvmf_rdma_conn *rdma_conn)
 {
-	struct spdk_nvmf_rdma_conn *rdma_conn = get_rdma_conn(conn);
-	int rc;
+	struct spdk_nvmf_rdma_request	*rdma_req;
+	struct ibv_mr			*rsp_mr;
+	size_t				size;
+	uint16_t			i;
+
+	size = rdma_conn->queue_depth * sizeof(*rdma_conn->reqs);
+	rdma_conn->reqs = rte_zmalloc("nvmf_rdma_req", size, 0);
+	if (rdma_conn->reqs == NULL) {
+		SPDK_ERRLOG("Unable to allocate rdma_reqs\n");
+		return -1;
+	}
 
-	SPDK_TRACELOG(SPDK_TRACE_RDMA, "Enter\n");
+	rsp_mr = nvmf_rdma_mem_map_find(rdma_conn->mem_map, rdma_conn->reqs, size);
+	if (rsp_mr == NULL) {
+		SPDK_ERRLOG("rdma_reqs are not registered\n");
+		nvmf_rdma_free_reqs(rdma_conn);
+		return -1;
+	}
 
-	rdma_destroy_qp(rdma_conn->cm_id);
+	for (i = 0; i < rdma_conn->queue_depth; i++) {
+		rdma_req = &rdma_conn->reqs[i];
+		rdma_req->rdma_wr.type = RDMA_WR_TYPE_SEND;
+		rdma_req->req.rsp = &rdma_req->rsp;
+		rdma_req->req.conn = &rdma_conn->conn;
 
-	spdk_nvmf_rdma_free_reqs(conn);
+		/* The response work request never changes, so build it once. */
+		rdma_req->rsp_sge.addr = (uintptr_t)&rdma_req->rsp;
+		rdma_req->rsp_sge.length = sizeof(rdma_req->rsp);
+		rdma_req->rsp_sge.lkey = rsp_mr->lkey;
 
-	rc = ibv_destroy_cq(rdma_conn->cq);
-	if (rc) {
-		SPDK_ERRLOG("ibv_destroy_cq error\n");
+		STAILQ_INSERT_TAIL(&rdma_conn->free_reqs, rdma_req, link);
 	}
 
-	ibv_destroy_comp_channel(rdma_conn->comp_channel);
-	rdma_destroy_id(rdma_conn->cm_id);
-
-	free(rdma_conn);
+	return 0;
 }
 
 static void
@@ -351,7 +556,7 @@ nvmf_ibv_send_wr_init(struct ibv_send_wr *wr,
 	RTE_VERIFY(sg_list != NULL);
 
 	memset(wr, 0, sizeof(*wr));
-	wr->wr_id = (uint64_t)rdma_req;
+	wr->wr_id = (uintptr_t)&rdma_req->rdma_wr;
 	wr->next = NULL;
 	wr->opcode = opcode;
 	wr->send_flags = send_flags;
@@ -373,167 +578,1567 @@ nvmf_ibv_send_wr_set_rkey(struct ibv_send_wr *wr, struct spdk_nvmf_request *req)
 		      wr->wr.rdma.rkey, (void *)wr->wr.rdma.remote_addr);
 }
 
-static int
+static void
+nvmf_rdma_queue_send_wr(struct spdk_nvmf_rdma_conn *rdma_conn, struct ibv_send_wr *wr)
+{
+	wr->next = NULL;
+	if (rdma_conn->send_wr_tail) {
+		rdma_conn->send_wr_tail->next = wr;
+	} else {
+		rdma_conn->send_wr_head = wr;
+	}
+	rdma_conn->send_wr_tail = wr;
+}
+
+static void
+nvmf_rdma_queue_recv_wr(struct ibv_recv_wr **head, struct ibv_recv_wr **tail,
+			struct spdk_nvmf_rdma_recv *recv)
+{
+	struct ibv_recv_wr *wr = &recv->wr;
+
+	nvmf_trace_ibv_sge(&recv->sgl[0]);
+	nvmf_trace_ibv_sge(&recv->sgl[1]);
+
+	wr->next = NULL;
+	if (*tail) {
+		(*tail)->next = wr;
+	} else {
+		*head = wr;
+	}
+	*tail = wr;
+}
+
+static void
 nvmf_post_rdma_read(struct spdk_nvmf_request *req)
 {
-	struct ibv_send_wr wr, *bad_wr = NULL;
 	struct spdk_nvmf_conn *conn = req->conn;
 	struct spdk_nvmf_rdma_conn *rdma_conn = get_rdma_conn(conn);
 	struct spdk_nvmf_rdma_request *rdma_req = get_rdma_req(req);
-	struct ibv_sge sge;
-	int rc;
 
 	SPDK_TRACELOG(SPDK_TRACE_RDMA, "RDMA READ POSTED. Request: %p Connection: %p\n", req, conn);
 
-	sge.addr = (uint64_t)rdma_req->bb_mr->addr;
-	sge.lkey = rdma_req->bb_mr->lkey;
-	sge.length = req->length;
-	nvmf_trace_ibv_sge(&sge);
+	rdma_req->data_sge.addr = (uintptr_t)rdma_req->data_buf;
+	rdma_req->data_sge.lkey = rdma_req->data_lkey;
+	rdma_req->data_sge.length = req->length;
+	nvmf_trace_ibv_sge(&rdma_req->data_sge);
 
-	nvmf_ibv_send_wr_init(&wr, req, &sge, IBV_WR_RDMA_READ, IBV_SEND_SIGNALED);
-	nvmf_ibv_send_wr_set_rkey(&wr, req);
+	nvmf_ibv_send_wr_init(&rdma_req->data_wr, req, &rdma_req->data_sge, IBV_WR_RDMA_READ,
+			      IBV_SEND_SIGNALED);
+	nvmf_ibv_send_wr_set_rkey(&rdma_req->data_wr, req);
 
 	spdk_trace_record(TRACE_RDMA_READ_START, 0, 0, (uint64_t)req, 0);
-	rc = ibv_post_send(rdma_conn->qp, &wr, &bad_wr);
-	if (rc) {
-		SPDK_ERRLOG("Failure posting rdma read send, rc = 0x%x\n", rc);
-	}
-	return (rc);
+	nvmf_rdma_queue_send_wr(rdma_conn, &rdma_req->data_wr);
 }
 
-static int
+static void
 nvmf_post_rdma_write(struct spdk_nvmf_request *req)
 {
-	struct ibv_send_wr wr, *bad_wr = NULL;
 	struct spdk_nvmf_conn *conn = req->conn;
 	struct spdk_nvmf_rdma_conn *rdma_conn = get_rdma_conn(conn);
 	struct spdk_nvmf_rdma_request *rdma_req = get_rdma_req(req);
-	struct ibv_sge sge;
-	int rc;
 
 	SPDK_TRACELOG(SPDK_TRACE_RDMA, "RDMA WRITE POSTED. Request: %p Connection: %p\n", req, conn);
 
-	sge.addr = (uint64_t)rdma_req->bb_mr->addr;
-	sge.lkey = rdma_req->bb_mr->lkey;
-	sge.length = req->length;
-	nvmf_trace_ibv_sge(&sge);
+	rdma_req->data_sge.addr = (uintptr_t)rdma_req->data_buf;
+	rdma_req->data_sge.lkey = rdma_req->data_lkey;
+	rdma_req->data_sge.length = req->length;
+	nvmf_trace_ibv_sge(&rdma_req->data_sge);
 
-	nvmf_ibv_send_wr_init(&wr, req, &sge, IBV_WR_RDMA_WRITE, 0);
-	nvmf_ibv_send_wr_set_rkey(&wr, req);
+	nvmf_ibv_send_wr_init(&rdma_req->data_wr, req, &rdma_req->data_sge, IBV_WR_RDMA_WRITE, 0);
+	nvmf_ibv_send_wr_set_rkey(&rdma_req->data_wr, req);
 
 	spdk_trace_record(TRACE_RDMA_WRITE_START, 0, 0, (uint64_t)req, 0);
-	rc = ibv_post_send(rdma_conn->qp, &wr, &bad_wr);
-	if (rc) {
-		SPDK_ERRLOG("Failure posting rdma write send, rc = 0x%x\n", rc);
+	nvmf_rdma_queue_send_wr(rdma_conn, &rdma_req->data_wr);
+}
+
+/*
+ * Queue a receive buffer to be reposted, either to the connection's own
+ * receive queue or to its poll group's SRQ.
+ */
+static void
+nvmf_post_rdma_recv(struct spdk_nvmf_rdma_conn *rdma_conn, struct spdk_nvmf_rdma_recv *recv)
+{
+	struct spdk_nvmf_rdma_poll_group *group = rdma_conn->group;
+
+	SPDK_TRACELOG(SPDK_TRACE_RDMA, "RDMA RECV POSTED. Recv: %p Connection: %p\n",
+		      recv, &rdma_conn->conn);
+
+	if (group != NULL) {
+		nvmf_rdma_queue_recv_wr(&group->srq_wr_head, &group->srq_wr_tail, recv);
+	} else {
+		nvmf_rdma_queue_recv_wr(&rdma_conn->recv_wr_head, &rdma_conn->recv_wr_tail, recv);
 	}
-	return (rc);
 }
 
-static int
-nvmf_post_rdma_recv(struct spdk_nvmf_request *req)
+static void
+nvmf_post_rdma_send(struct spdk_nvmf_request *req)
 {
-	struct ibv_recv_wr wr, *bad_wr = NULL;
 	struct spdk_nvmf_conn *conn = req->conn;
 	struct spdk_nvmf_rdma_conn *rdma_conn = get_rdma_conn(conn);
 	struct spdk_nvmf_rdma_request *rdma_req = get_rdma_req(req);
-	struct ibv_sge sg_list[2];
+	int send_flags = 0;
+
+	SPDK_TRACELOG(SPDK_TRACE_RDMA, "RDMA SEND POSTED. Request: %p Connection: %p\n", req, conn);
+	nvmf_trace_ibv_sge(&rdma_req->rsp_sge);
+
+	if (++rdma_conn->sends_since_signal >= NVMF_RDMA_SEND_SIGNAL_INTERVAL) {
+		send_flags = IBV_SEND_SIGNALED;
+		rdma_conn->sends_since_signal = 0;
+	}
+
+	nvmf_ibv_send_wr_init(&rdma_req->rsp_wr, req, &rdma_req->rsp_sge, IBV_WR_SEND, send_flags);
+
+	spdk_trace_record(TRACE_NVMF_IO_COMPLETE, 0, 0, (uint64_t)req, 0);
+	nvmf_rdma_queue_send_wr(rdma_conn, &rdma_req->rsp_wr);
+	rdma_conn->last_rsp_wr = &rdma_req->rsp_wr;
+	STAILQ_INSERT_TAIL(&rdma_conn->sends_in_flight, rdma_req, send_link);
+}
+
+/*
+ * Post all work requests queued on the connection, ringing the doorbell at
+ * most once for receives and once for sends.
+ */
+static int
+nvmf_rdma_flush_wrs(struct spdk_nvmf_rdma_conn *rdma_conn)
+{
+	struct ibv_recv_wr *recv_wr, *bad_recv_wr = NULL;
+	struct ibv_send_wr *send_wr, *bad_send_wr = NULL;
 	int rc;
 
-	SPDK_TRACELOG(SPDK_TRACE_RDMA, "RDMA RECV POSTED. Request: %p Connection: %p\n", req, conn);
+	/*
+	 * Detach each chain before posting it.  Once a CONNECT response is on
+	 * the wire, the connection may start being polled on another core.
+	 */
+	recv_wr = rdma_conn->recv_wr_head;
+	if (recv_wr != NULL) {
+		rdma_conn->recv_wr_head = NULL;
+		rdma_conn->recv_wr_tail = NULL;
+
+		rc = ibv_post_recv(rdma_conn->qp, recv_wr, &bad_recv_wr);
+		if (rc) {
+			SPDK_ERRLOG("Failure posting rdma recv, rc = 0x%x\n", rc);
+			return -1;
+		}
+	}
+
+	send_wr = rdma_conn->send_wr_head;
+	if (send_wr != NULL) {
+		/* Every doorbell must end with a signaled SEND so no response is left untracked. */
+		if (rdma_conn->last_rsp_wr != NULL) {
+			rdma_conn->last_rsp_wr->send_flags |= IBV_SEND_SIGNALED;
+			rdma_conn->sends_since_signal = 0;
+		}
+
+		rdma_conn->send_wr_head = NULL;
+		rdma_conn->send_wr_tail = NULL;
+		rdma_conn->last_rsp_wr = NULL;
+
+		rc = ibv_post_send(rdma_conn->qp, send_wr, &bad_send_wr);
+		if (rc) {
+			SPDK_ERRLOG("Failure posting rdma send, rc = 0x%x\n", rc);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* Post the receives queued for the group's SRQ with a single doorbell. */
+static int
+nvmf_rdma_poll_group_flush_recvs(struct spdk_nvmf_rdma_poll_group *group)
+{
+	struct ibv_recv_wr *wr, *bad_wr = NULL;
+	int rc;
+
+	wr = group->srq_wr_head;
+	if (wr == NULL) {
+		return 0;
+	}
+
+	group->srq_wr_head = NULL;
+	group->srq_wr_tail = NULL;
+
+	rc = ibv_post_srq_recv(group->srq, wr, &bad_wr);
+	if (rc) {
+		SPDK_ERRLOG("Failure posting rdma srq recv, rc = 0x%x\n", rc);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Note that a connection served by a poll group has work to start or post.
+ * It is serviced once at the end of the group's current or next poll.
+ */
+static void
+nvmf_rdma_conn_mark_dirty(struct spdk_nvmf_rdma_conn *rdma_conn)
+{
+	if (rdma_conn->group == NULL || rdma_conn->dirty) {
+		return;
+	}
+
+	rdma_conn->dirty = true;
+	TAILQ_INSERT_TAIL(&rdma_conn->group->dirty_conns, rdma_conn, dirty_link);
+}
+
+static int
+spdk_nvmf_rdma_request_complete(struct spdk_nvmf_request *req)
+{
+	struct spdk_nvme_cpl *rsp = &req->rsp->nvme_cpl;
+	struct spdk_nvmf_rdma_conn *rdma_conn = get_rdma_conn(req->conn);
+
+	/* Was the command successful? */
+	if (rsp->status.sc == SPDK_NVME_SC_SUCCESS &&
+	    req->xfer == SPDK_NVME_DATA_CONTROLLER_TO_HOST) {
+		/* Need to transfer data via RDMA Write */
+		nvmf_post_rdma_write(req);
+	}
+
+	/* The WRITE and SEND are posted together on the next flush. */
+	nvmf_post_rdma_send(req);
+
+	if (req->conn->transport_polled && rte_lcore_id() != req->conn->lcore) {
+		/* A CONNECT, completed on the acceptor core; nvmf_rdma_connect_done posts it. */
+		return 0;
+	}
+
+	nvmf_rdma_conn_mark_dirty(rdma_conn);
+
+	return 0;
+}
+
+static void
+spdk_nvmf_rdma_request_release(struct spdk_nvmf_request *req)
+{
+	struct spdk_nvmf_conn *conn = req->conn;
+	struct spdk_nvmf_rdma_conn *rdma_conn = get_rdma_conn(conn);
+	struct spdk_nvmf_rdma_request *rdma_req = get_rdma_req(req);
+
+	if (rdma_req->data_buf) {
+		rte_mempool_put(rdma_req->data_buf_pool, rdma_req->data_buf);
+		rdma_req->data_buf = NULL;
+		req->data = NULL;
+	}
+
+	nvmf_post_rdma_recv(rdma_conn, rdma_req->recv);
+	rdma_req->recv = NULL;
+	STAILQ_INSERT_HEAD(&rdma_conn->free_reqs, rdma_req, link);
+
+	conn->sq_head++;
+	if (conn->sq_head == rdma_conn->queue_depth) {
+		conn->sq_head = 0;
+	}
+
+	/* Commands waiting for a request can go now. */
+	if (!STAILQ_EMPTY(&rdma_conn->incoming_queue)) {
+		nvmf_rdma_conn_mark_dirty(rdma_conn);
+	}
+}
+
+/*
+ * A signaled SEND completed.  It and every unsignaled SEND posted before it
+ * are done, so their requests can be recycled.
+ */
+static void
+nvmf_rdma_complete_sends(struct spdk_nvmf_rdma_conn *rdma_conn,
+			 struct spdk_nvmf_rdma_request *last)
+{
+	struct spdk_nvmf_rdma_request *rdma_req;
+
+	do {
+		rdma_req = STAILQ_FIRST(&rdma_conn->sends_in_flight);
+		assert(rdma_req != NULL);
+		STAILQ_REMOVE_HEAD(&rdma_conn->sends_in_flight, send_link);
+
+		assert(rdma_conn->outstanding_reqs > 0);
+		rdma_conn->outstanding_reqs--;
+		SPDK_TRACELOG(SPDK_TRACE_RDMA,
+			      "RDMA SEND Complete. Request: %p Connection: %p Outstanding I/O: %d\n",
+			      &rdma_req->req, &rdma_conn->conn, rdma_conn->outstanding_reqs);
+		spdk_nvmf_rdma_request_release(&rdma_req->req);
+	} while (rdma_req != last);
+}
+
+/*
+ * Returns 0 if the request can be executed immediately, 1 if it needs a data
+ * buffer for a keyed SGL transfer first, or -1 on error.
+ */
+static int
+spdk_nvmf_request_prep_data(struct spdk_nvmf_request *req,
+			    void *in_cap_data, uint32_t in_cap_len)
+{
+	struct spdk_nvme_cmd *cmd = &req->cmd->nvme_cmd;
+	struct spdk_nvme_cpl *rsp = &req->rsp->nvme_cpl;
+	enum spdk_nvme_data_transfer xfer;
+
+	req->length = 0;
+	req->xfer = SPDK_NVME_DATA_NONE;
+	req->data = NULL;
+
+	if (cmd->opc == SPDK_NVME_OPC_FABRIC) {
+		xfer = spdk_nvme_opc_get_data_transfer(req->cmd->nvmf_cmd.fctype);
+	} else {
+		xfer = spdk_nvme_opc_get_data_transfer(cmd->opc);
+	}
+
+	if (xfer != SPDK_NVME_DATA_NONE) {
+		struct spdk_nvme_sgl_descriptor *sgl = (struct spdk_nvme_sgl_descriptor *)&cmd->dptr.sgl1;
+
+		if (sgl->generic.type == SPDK_NVME_SGL_TYPE_KEYED_DATA_BLOCK &&
+		    (sgl->keyed.subtype == SPDK_NVME_SGL_SUBTYPE_ADDRESS ||
+		     sgl->keyed.subtype == SPDK_NVME_SGL_SUBTYPE_INVALIDATE_KEY)) {
+			if (sgl->keyed.length > SPDK_NVMF_MAX_RECV_DATA_TRANSFER_SIZE) {
+				SPDK_ERRLOG("SGL length 0x%x exceeds max io size 0x%x\n",
+					    sgl->keyed.length, SPDK_NVMF_MAX_RECV_DATA_TRANSFER_SIZE);
+				rsp->status.sc = SPDK_NVME_SC_DATA_SGL_LENGTH_INVALID;
+				return -1;
+			}
+
+			req->length = sgl->keyed.length;
+		} else if (sgl->generic.type == SPDK_NVME_SGL_TYPE_DATA_BLOCK &&
+			   sgl->unkeyed.subtype == SPDK_NVME_SGL_SUBTYPE_OFFSET) {
+			uint64_t offset = sgl->address;
+			uint32_t max_len = in_cap_len;
+
+			SPDK_TRACELOG(SPDK_TRACE_NVMF, "In-capsule data: offset 0x%" PRIx64 ", length 0x%x\n",
+				      offset, sgl->unkeyed.length);
+
+			if (offset > max_len) {
+				SPDK_ERRLOG("In-capsule offset 0x%" PRIx64 " exceeds capsule length 0x%x\n",
+					    offset, max_len);
+				rsp->status.sc = SPDK_NVME_SC_INVALID_SGL_OFFSET;
+				return -1;
+			}
+			max_len -= (uint32_t)offset;
+
+			if (sgl->unkeyed.length > max_len) {
+				SPDK_ERRLOG("In-capsule data length 0x%x exceeds capsule length 0x%x\n",
+					    sgl->unkeyed.length, max_len);
+				rsp->status.sc = SPDK_NVME_SC_DATA_SGL_LENGTH_INVALID;
+				return -1;
+			}
+
+			req->data = in_cap_data + offset;
+			req->length = sgl->unkeyed.length;
+		} else {
+			SPDK_ERRLOG("Invalid NVMf I/O Command SGL:  Type 0x%x, Subtype 0x%x\n",
+				    sgl->generic.type, sgl->generic.subtype);
+			rsp->status.sc = SPDK_NVME_SC_SGL_DESCRIPTOR_TYPE_INVALID;
+			return -1;
+		}
+
+		if (req->length == 0) {
+			xfer = SPDK_NVME_DATA_NONE;
+			req->data = NULL;
+		}
+
+		req->xfer = xfer;
+
+		/*
+		 * Keyed SGL data is moved with RDMA READ or WRITE, which
+		 * needs a registered buffer from the data pools.
+		 */
+		if (xfer != SPDK_NVME_DATA_NONE &&
+		    sgl->generic.type == SPDK_NVME_SGL_TYPE_KEYED_DATA_BLOCK) {
+			return 1;
+		}
+	}
+
+	if (xfer == SPDK_NVME_DATA_NONE) {
+		SPDK_TRACELOG(SPDK_TRACE_NVMF, "No data to transfer\n");
+		assert(req->data == NULL);
+		assert(req->length == 0);
+	} else {
+		assert(req->data != NULL);
+		assert(req->length != 0);
+		SPDK_TRACELOG(SPDK_TRACE_NVMF, "%s data ready\n",
+			      xfer == SPDK_NVME_DATA_HOST_TO_CONTROLLER ? "Host to Controller" :
+			      "Controller to Host");
+	}
+
+	return 0;
+}
+
+/*
+ * Attach a pool buffer to a request with a keyed SGL.
+ * Returns 0 on success, -EAGAIN if the pool is empty, or -EFAULT if the buffer
+ * is not covered by the connection's memory registrations.
+ */
+static int
+nvmf_rdma_request_get_buf(struct spdk_nvmf_rdma_conn *rdma_conn,
+			  struct spdk_nvmf_rdma_request *rdma_req)
+{
+	struct spdk_nvmf_request *req = &rdma_req->req;
+	struct rte_mempool *pool;
+	struct ibv_mr *mr;
+	uint32_t buf_len;
+	void *buf = NULL;
+
+	if (req->length <= NVMF_RDMA_SMALL_BUF_MAX_SIZE) {
+		pool = g_small_buf_pool;
+		buf_len = NVMF_RDMA_SMALL_BUF_MAX_SIZE;
+	} else {
+		pool = g_large_buf_pool;
+		buf_len = NVMF_RDMA_LARGE_BUF_MAX_SIZE;
+	}
+
+	if (rte_mempool_get(pool, &buf) < 0 || buf == NULL) {
+		return -EAGAIN;
+	}
+
+	mr = nvmf_rdma_mem_map_find(rdma_conn->mem_map, buf, buf_len);
+	if (mr == NULL) {
+		SPDK_ERRLOG("Data buffer %p is not registered\n", buf);
+		rte_mempool_put(pool, buf);
+		return -EFAULT;
+	}
+
+	rdma_req->data_buf = buf;
+	rdma_req->data_buf_pool = pool;
+	rdma_req->data_lkey = mr->lkey;
+	req->data = buf;
+
+	return 0;
+}
+
+static void nvmf_rdma_conn_detach_try_finish(struct spdk_nvmf_rdma_conn *rdma_conn);
+
+static void
+nvmf_rdma_connect_done(spdk_event_t event)
+{
+	struct spdk_nvmf_rdma_conn *rdma_conn = spdk_event_get_arg1(event);
+
+	assert(rdma_conn->connects_in_flight > 0);
+	rdma_conn->connects_in_flight--;
+
+	/* Post the CONNECT response from the connection's own core. */
+	nvmf_rdma_conn_mark_dirty(rdma_conn);
+	nvmf_rdma_conn_detach_try_finish(rdma_conn);
+}
+
+/*
+ * Runs on the acceptor core.  The connection cannot be freed while this is
+ * queued: its detach waits until the CONNECT has been handed back to the
+ * group's core.
+ */
+static void
+nvmf_rdma_handle_connect(spdk_event_t event)
+{
+	struct spdk_nvmf_request *req = spdk_event_get_arg1(event);
+	struct spdk_nvmf_rdma_conn *rdma_conn = get_rdma_conn(req->conn);
+	spdk_event_t done;
+
+	if (rdma_conn->closing) {
+		/* The host went away first; the detach reclaims the request. */
+		SPDK_TRACELOG(SPDK_TRACE_RDMA, "Dropping CONNECT on closed conn %p\n", rdma_conn);
+	} else if (spdk_nvmf_request_exec(req) < 0) {
+		SPDK_ERRLOG("CONNECT execution failed\n");
+	}
+
+	done = spdk_event_allocate(rdma_conn->conn.lcore, nvmf_rdma_connect_done,
+				   rdma_conn, NULL, NULL);
+	spdk_event_call(done);
+}
+
+/*
+ * Execute a request whose data is ready.  Until an I/O connection polled on
+ * its own core has a session, its commands are executed on the acceptor core,
+ * where the CONNECT of every other connection is handled too.
+ * Returns 1, or -1 on error.
+ */
+static int
+nvmf_rdma_request_exec(struct spdk_nvmf_rdma_conn *rdma_conn, struct spdk_nvmf_request *req)
+{
+	spdk_event_t event;
+
+	if (rdma_conn->conn.transport_polled && rdma_conn->conn.sess == NULL) {
+		rdma_conn->connects_in_flight++;
+		event = spdk_event_allocate(g_rdma.acceptor_lcore, nvmf_rdma_handle_connect,
+					    req, NULL, NULL);
+		spdk_event_call(event);
+		return 1;
+	}
+
+	if (spdk_nvmf_request_exec(req) < 0) {
+		SPDK_ERRLOG("Command execution failed\n");
+		return -1;
+	}
+
+	return 1;
+}
+
+/*
+ * Hand out data buffers to waiting requests in arrival order and start their
+ * transfers.  Returns the number of times that spdk_nvmf_request_exec was
+ * called, or -1 on error.
+ */
+static int
+nvmf_rdma_process_pending_data_buf(struct spdk_nvmf_rdma_conn *rdma_conn)
+{
+	struct spdk_nvmf_rdma_request *rdma_req;
+	struct spdk_nvmf_request *req;
+	int rc, count = 0;
+
+	while ((rdma_req = STAILQ_FIRST(&rdma_conn->pending_data_buf_queue)) != NULL) {
+		req = &rdma_req->req;
+
+		rc = nvmf_rdma_request_get_buf(rdma_conn, rdma_req);
+		if (rc == -EAGAIN) {
+			break;
+		} else if (rc < 0) {
+			return -1;
+		}
+
+		STAILQ_REMOVE_HEAD(&rdma_conn->pending_data_buf_queue, buf_link);
+
+		if (req->xfer == SPDK_NVME_DATA_HOST_TO_CONTROLLER) {
+			SPDK_TRACELOG(SPDK_TRACE_NVMF, "Initiating Host to Controller data transfer\n");
+			/* Wait for transfer to complete before executing command. */
+			nvmf_post_rdma_read(req);
+		} else {
+			rc = nvmf_rdma_request_exec(rdma_conn, req);
+			if (rc < 0) {
+				return -1;
+			}
+			count += rc;
+		}
+	}
+
+	return count;
+}
+
+/*
+ * Start processing the command held in recv.  Returns the number of times
+ * that spdk_nvmf_request_exec was called, or -1 on error.
+ */
+static int
+nvmf_rdma_request_start(struct spdk_nvmf_rdma_conn *rdma_conn,
+			struct spdk_nvmf_rdma_request *rdma_req,
+			struct spdk_nvmf_rdma_recv *recv)
+{
+	struct spdk_nvmf_conn *conn = &rdma_conn->conn;
+	struct spdk_nvmf_request *req = &rdma_req->req;
+	int rc;
+
+	rdma_req->recv = recv;
+	req->cmd = recv->cmd;
+
+	if (recv->byte_len < sizeof(struct spdk_nvmf_capsule_cmd)) {
+		SPDK_ERRLOG("recv length %u less than capsule header\n", recv->byte_len);
+		return -1;
+	}
+
+	{
+		/* TEMPORARY SPECIAL CASE: For asynchronous event requests, just immediately
+		* re-post the capsule. */
+		struct spdk_nvme_cmd *cmd = &req->cmd->nvme_cmd;
+
+		if (conn->type == CONN_TYPE_AQ &&
+		    cmd->opc == SPDK_NVME_OPC_ASYNC_EVENT_REQUEST) {
+			spdk_nvmf_rdma_request_release(req);
+			return 0;
+		}
+
+	}
+
+	rdma_conn->outstanding_reqs++;
+	SPDK_TRACELOG(SPDK_TRACE_RDMA,
+		      "RDMA RECV Complete. Request: %p Connection: %p Outstanding I/O: %d\n",
+		      req, conn, rdma_conn->outstanding_reqs);
+	spdk_trace_record(TRACE_NVMF_IO_START, 0, 0, (uint64_t)req, 0);
+
+	memset(req->rsp, 0, sizeof(*req->rsp));
+	rc = spdk_nvmf_request_prep_data(req,
+					 recv->in_capsule_buf,
+					 recv->byte_len - sizeof(struct spdk_nvmf_capsule_cmd));
+	if (rc < 0) {
+		SPDK_ERRLOG("prep_data failed\n");
+		if (spdk_nvmf_request_complete(req)) {
+			return -1;
+		}
+		return 0;
+	} else if (rc == 0) {
+		/* Data is immediately available */
+		return nvmf_rdma_request_exec(rdma_conn, req);
+	}
+
+	/* Needs a data buffer; queue behind any request already waiting for one. */
+	STAILQ_INSERT_TAIL(&rdma_conn->pending_data_buf_queue, rdma_req, buf_link);
+	return nvmf_rdma_process_pending_data_buf(rdma_conn);
+}
+
+/*
+ * Start commands that arrived while every request was in use.  Returns the
+ * number of times that spdk_nvmf_request_exec was called, or -1 on error.
+ */
+static int
+nvmf_rdma_process_incoming(struct spdk_nvmf_rdma_conn *rdma_conn)
+{
+	struct spdk_nvmf_rdma_recv *recv;
+	struct spdk_nvmf_rdma_request *rdma_req;
+	int rc, count = 0;
+
+	while ((recv = STAILQ_FIRST(&rdma_conn->incoming_queue)) != NULL &&
+	       (rdma_req = STAILQ_FIRST(&rdma_conn->free_reqs)) != NULL) {
+		STAILQ_REMOVE_HEAD(&rdma_conn->incoming_queue, link);
+		STAILQ_REMOVE_HEAD(&rdma_conn->free_reqs, link);
+
+		rc = nvmf_rdma_request_start(rdma_conn, rdma_req, recv);
+		if (rc < 0) {
+			return -1;
+		}
+		count += rc;
+	}
+
+	return count;
+}
+
+/*
+ * A command capsule arrived.  Returns the number of times that
+ * spdk_nvmf_request_exec was called, or -1 on error.
+ */
+static int
+nvmf_rdma_process_recv(struct spdk_nvmf_rdma_conn *rdma_conn, struct spdk_nvmf_rdma_recv *recv)
+{
+	struct spdk_nvmf_rdma_request *rdma_req;
+
+	if (rdma_conn->stopped || rdma_conn->failed) {
+		/* The connection is going away; just give the buffer back. */
+		nvmf_post_rdma_recv(rdma_conn, recv);
+		return 0;
+	}
+
+	/*
+	 * A shared receive queue does not limit how many commands a single
+	 * connection can have outstanding, so keep arrival order and wait
+	 * for a request to be released.
+	 */
+	rdma_req = STAILQ_FIRST(&rdma_conn->free_reqs);
+	if (rdma_req == NULL || !STAILQ_EMPTY(&rdma_conn->incoming_queue)) {
+		STAILQ_INSERT_TAIL(&rdma_conn->incoming_queue, recv, link);
+		return 0;
+	}
+	STAILQ_REMOVE_HEAD(&rdma_conn->free_reqs, link);
+
+	return nvmf_rdma_request_start(rdma_conn, rdma_req, recv);
+}
+
+/*
+ * A SEND, RDMA READ or RDMA WRITE completed successfully.  Returns the number
+ * of times that spdk_nvmf_request_exec was called, or -1 on error.
+ */
+static int
+nvmf_rdma_process_send_wc(struct spdk_nvmf_rdma_conn *rdma_conn,
+			  struct spdk_nvmf_rdma_request *rdma_req, struct ibv_wc *wc)
+{
+	struct spdk_nvmf_request *req = &rdma_req->req;
+
+	switch (wc->opcode) {
+	case IBV_WC_SEND:
+		nvmf_rdma_complete_sends(rdma_conn, rdma_req);
+		return 0;
+
+	case IBV_WC_RDMA_WRITE:
+		/*
+		 * Will get this event only if we set IBV_SEND_SIGNALED
+		 * flag in rdma_write, to trace rdma write latency
+		 */
+		SPDK_TRACELOG(SPDK_TRACE_RDMA, "RDMA WRITE Complete. Request: %p Connection: %p\n",
+			      req, &rdma_conn->conn);
+		spdk_trace_record(TRACE_RDMA_WRITE_COMPLETE, 0, 0, (uint64_t)req, 0);
+		return 0;
+
+	case IBV_WC_RDMA_READ:
+		SPDK_TRACELOG(SPDK_TRACE_RDMA, "RDMA READ Complete. Request: %p Connection: %p\n",
+			      req, &rdma_conn->conn);
+		spdk_trace_record(TRACE_RDMA_READ_COMPLETE, 0, 0, (uint64_t)req, 0);
+		if (rdma_conn->failed) {
+			return 0;
+		}
+		return nvmf_rdma_request_exec(rdma_conn, req);
+
+	default:
+		SPDK_ERRLOG("Poll cq opcode type unknown!!!!! completion\n");
+		return -1;
+	}
+}
+
+/* Returns the number of times that spdk_nvmf_request_exec was called,
+ * or -1 on error.
+ */
+static int
+spdk_nvmf_rdma_poll(struct spdk_nvmf_conn *conn)
+{
+	struct ibv_wc wc[NVMF_RDMA_WC_BATCH_SIZE];
+	struct spdk_nvmf_rdma_conn *rdma_conn = get_rdma_conn(conn);
+	struct spdk_nvmf_rdma_wr *rdma_wr;
+	struct spdk_nvmf_rdma_recv *recv;
+	int reaped, i, rc, count;
+
+	/* Connections served by a poll group are polled by the group. */
+	if (rdma_conn->group != NULL) {
+		return 0;
+	}
+
+	/* Commands and requests that could not be started last time go first. */
+	count = nvmf_rdma_process_incoming(rdma_conn);
+	if (count < 0) {
+		return -1;
+	}
+
+	rc = nvmf_rdma_process_pending_data_buf(rdma_conn);
+	if (rc < 0) {
+		return -1;
+	}
+	count += rc;
+
+	reaped = ibv_poll_cq(rdma_conn->cq, NVMF_RDMA_WC_BATCH_SIZE, wc);
+	if (reaped < 0) {
+		SPDK_ERRLOG("Poll CQ error!(%d): %s\n",
+			    errno, strerror(errno));
+		return -1;
+	}
+
+	for (i = 0; i < reaped; i++) {
+		if (wc[i].status) {
+			SPDK_TRACELOG(SPDK_TRACE_RDMA, "CQ completion error status %d (%s), exiting handler\n",
+				      wc[i].status, ibv_wc_status_str(wc[i].status));
+			return -1;
+		}
+
+		rdma_wr = (struct spdk_nvmf_rdma_wr *)wc[i].wr_id;
+		if (rdma_wr == NULL) {
+			SPDK_ERRLOG("Got CQ completion for NULL wr_id\n");
+			return -1;
+		}
+
+		if (rdma_wr->type == RDMA_WR_TYPE_RECV) {
+			recv = (struct spdk_nvmf_rdma_recv *)rdma_wr;
+			recv->byte_len = wc[i].byte_len;
+			rc = nvmf_rdma_process_recv(rdma_conn, recv);
+		} else {
+			rc = nvmf_rdma_process_send_wc(rdma_conn, (struct spdk_nvmf_rdma_request *)rdma_wr,
+						       &wc[i]);
+		}
+
+		if (rc < 0) {
+			return -1;
+		}
+		count += rc;
+	}
+
+	/*
+	 * Post everything generated above, plus any responses completed by the
+	 * backend since the last poll, with one doorbell per queue.
+	 */
+	if (nvmf_rdma_flush_wrs(rdma_conn)) {
+		return -1;
+	}
+
+	return count;
+}
+
+static void
+spdk_nvmf_handle_disconnect(spdk_event_t event)
+{
+	struct nvmf_session		*session = spdk_event_get_arg1(event);
+	struct spdk_nvmf_conn		*conn = spdk_event_get_arg2(event);
+
+	nvmf_disconnect(session, conn);
+}
+
+/*
+ * An I/O connection polled on its own core failed.  Stop processing it and
+ * let the subsystem core tear it down.
+ */
+static void
+nvmf_rdma_conn_error(struct spdk_nvmf_rdma_conn *rdma_conn)
+{
+	struct spdk_nvmf_conn	*conn = &rdma_conn->conn;
+	struct nvmf_session	*session = conn->sess;
+	spdk_event_t		event;
+
+	if (rdma_conn->failed) {
+		return;
+	}
+	rdma_conn->failed = true;
+
+	if (session == NULL) {
+		/* Not connected yet; the CM disconnect event cleans it up. */
+		return;
+	}
+
+	SPDK_ERRLOG("Transport poll failed for conn %p; closing connection\n", conn);
+	event = spdk_event_allocate(session->subsys->lcore, spdk_nvmf_handle_disconnect,
+				    session, conn, NULL);
+	spdk_event_call(event);
+}
+
+static struct spdk_nvmf_rdma_conn *
+nvmf_rdma_poll_group_find_conn(struct spdk_nvmf_rdma_poll_group *group, uint32_t qp_num)
+{
+	struct spdk_nvmf_rdma_conn *rdma_conn;
+
+	TAILQ_FOREACH(rdma_conn, &group->conn_hash[qp_num & (NVMF_RDMA_CONN_HASH_SIZE - 1)], hash_link) {
+		if (rdma_conn->qp->qp_num == qp_num) {
+			return rdma_conn;
+		}
+	}
+
+	return NULL;
+}
+
+/* Retry receives that completed before their connection was attached. */
+static void
+nvmf_rdma_poll_group_process_unmatched(struct spdk_nvmf_rdma_poll_group *group)
+{
+	struct spdk_nvmf_rdma_recv *recv, *tmp;
+	struct spdk_nvmf_rdma_conn *rdma_conn;
+
+	STAILQ_FOREACH_SAFE(recv, &group->unmatched_recvs, link, tmp) {
+		rdma_conn = nvmf_rdma_poll_group_find_conn(group, recv->qp_num);
+		if (rdma_conn == NULL) {
+			continue;
+		}
+
+		STAILQ_REMOVE(&group->unmatched_recvs, recv, spdk_nvmf_rdma_recv, link);
+		if (nvmf_rdma_process_recv(rdma_conn, recv) < 0) {
+			nvmf_rdma_conn_error(rdma_conn);
+		} else {
+			nvmf_rdma_conn_mark_dirty(rdma_conn);
+		}
+	}
+}
+
+/*
+ * Reap one batch of completions from the shared CQ and dispatch them to their
+ * connections.  Returns the number of completions reaped.
+ */
+static int
+nvmf_rdma_poll_group_process_cq(struct spdk_nvmf_rdma_poll_group *group)
+{
+	struct ibv_wc wc[NVMF_RDMA_WC_BATCH_SIZE];
+	struct spdk_nvmf_rdma_conn *rdma_conn;
+	struct spdk_nvmf_rdma_request *rdma_req;
+	struct spdk_nvmf_rdma_recv *recv;
+	struct spdk_nvmf_rdma_wr *rdma_wr;
+	int reaped, i, rc;
+
+	reaped = ibv_poll_cq(group->cq, NVMF_RDMA_WC_BATCH_SIZE, wc);
+	if (reaped < 0) {
+		SPDK_ERRLOG("Poll CQ error!(%d): %s\n",
+			    errno, strerror(errno));
+		return 0;
+	}
+
+	for (i = 0; i < reaped; i++) {
+		rdma_wr = (struct spdk_nvmf_rdma_wr *)wc[i].wr_id;
+
+		if (rdma_wr->type == RDMA_WR_TYPE_DRAIN) {
+			/* Every SEND posted before the drain WR has been flushed. */
+			rdma_conn = (struct spdk_nvmf_rdma_conn *)((uintptr_t)rdma_wr -
+					offsetof(struct spdk_nvmf_rdma_conn, drain_wr));
+			rdma_conn->send_drained = true;
+			nvmf_rdma_conn_detach_try_finish(rdma_conn);
+			continue;
+		}
+
+		if (rdma_wr->type == RDMA_WR_TYPE_RECV) {
+			recv = (struct spdk_nvmf_rdma_recv *)rdma_wr;
+			rdma_conn = nvmf_rdma_poll_group_find_conn(group, wc[i].qp_num);
+
+			if (wc[i].status) {
+				SPDK_TRACELOG(SPDK_TRACE_RDMA, "CQ recv error status %d (%s)\n",
+					      wc[i].status, ibv_wc_status_str(wc[i].status));
+				nvmf_rdma_queue_recv_wr(&group->srq_wr_head, &group->srq_wr_tail, recv);
+				if (rdma_conn != NULL) {
+					nvmf_rdma_conn_error(rdma_conn);
+				}
+				continue;
+			}
+
+			recv->byte_len = wc[i].byte_len;
+			if (rdma_conn == NULL) {
+				recv->qp_num = wc[i].qp_num;
+				STAILQ_INSERT_TAIL(&group->unmatched_recvs, recv, link);
+				continue;
+			}
+
+			rc = nvmf_rdma_process_recv(rdma_conn, recv);
+		} else {
+			rdma_req = (struct spdk_nvmf_rdma_request *)rdma_wr;
+			rdma_conn = get_rdma_conn(rdma_req->req.conn);
+
+			if (wc[i].status) {
+				SPDK_TRACELOG(SPDK_TRACE_RDMA, "CQ send error status %d (%s)\n",
+					      wc[i].status, ibv_wc_status_str(wc[i].status));
+				nvmf_rdma_conn_error(rdma_conn);
+				continue;
+			}
+
+			rc = nvmf_rdma_process_send_wc(rdma_conn, rdma_req, &wc[i]);
+		}
+
+		if (rc < 0) {
+			nvmf_rdma_conn_error(rdma_conn);
+		} else {
+			nvmf_rdma_conn_mark_dirty(rdma_conn);
+		}
+	}
+
+	return reaped;
+}
+
+/*
+ * Start queued work on every dirty connection and post its work requests
+ * with one doorbell.  Connections still waiting for data buffers stay dirty
+ * for the next poll.
+ */
+static void
+nvmf_rdma_poll_group_service_conns(struct spdk_nvmf_rdma_poll_group *group)
+{
+	TAILQ_HEAD(, spdk_nvmf_rdma_conn) waiting = TAILQ_HEAD_INITIALIZER(waiting);
+	struct spdk_nvmf_rdma_conn *rdma_conn;
+
+	while ((rdma_conn = TAILQ_FIRST(&group->dirty_conns)) != NULL) {
+		TAILQ_REMOVE(&group->dirty_conns, rdma_conn, dirty_link);
+		rdma_conn->dirty = false;
+
+		if (rdma_conn->failed) {
+			continue;
+		}
+
+		if (nvmf_rdma_process_incoming(rdma_conn) < 0 ||
+		    nvmf_rdma_process_pending_data_buf(rdma_conn) < 0 ||
+		    nvmf_rdma_flush_wrs(rdma_conn)) {
+			nvmf_rdma_conn_error(rdma_conn);
+			continue;
+		}
+
+		if (!rdma_conn->dirty && !STAILQ_EMPTY(&rdma_conn->pending_data_buf_queue)) {
+			rdma_conn->dirty = true;
+			TAILQ_INSERT_TAIL(&waiting, rdma_conn, dirty_link);
+		}
+	}
+
+	while ((rdma_conn = TAILQ_FIRST(&waiting)) != NULL) {
+		TAILQ_REMOVE(&waiting, rdma_conn, dirty_link);
+		TAILQ_INSERT_TAIL(&group->dirty_conns, rdma_conn, dirty_link);
+	}
+}
+
+static void
+nvmf_rdma_poll_group_poll(void *arg)
+{
+	struct spdk_nvmf_rdma_poll_group *group = arg;
+
+	nvmf_rdma_poll_group_process_unmatched(group);
+	nvmf_rdma_poll_group_process_cq(group);
+	nvmf_rdma_poll_group_service_conns(group);
+	nvmf_rdma_poll_group_flush_recvs(group);
+}
+
+static void
+nvmf_rdma_poll_group_destroy(struct spdk_nvmf_rdma_poll_group *group)
+{
+	if (group->srq && ibv_destroy_srq(group->srq)) {
+		SPDK_ERRLOG("ibv_destroy_srq error\n");
+	}
+
+	if (group->cq && ibv_destroy_cq(group->cq)) {
+		SPDK_ERRLOG("ibv_destroy_cq error\n");
+	}
+
+	nvmf_rdma_recv_set_fini(&group->recv_set);
+	free(group);
+}
+
+static struct spdk_nvmf_rdma_poll_group *
+nvmf_rdma_poll_group_create(uint32_t lcore, struct rdma_cm_id *id, uint32_t cq_entries)
+{
+	struct spdk_nvmf_rdma_poll_group	*group;
+	struct ibv_device_attr			ibdev_attr;
+	struct ibv_srq_init_attr		srq_attr;
+	uint32_t				srq_depth, i;
+	int					flags;
+
+	if (ibv_query_device(id->verbs, &ibdev_attr)) {
+		SPDK_ERRLOG("Failed to query RDMA device attributes\n");
+		return NULL;
+	}
+
+	if (ibdev_attr.max_srq == 0) {
+		SPDK_TRACELOG(SPDK_TRACE_RDMA, "Device %s does not support shared receive queues\n",
+			      id->verbs->device->name);
+		return NULL;
+	}
+
+	group = calloc(1, sizeof(*group));
+	if (group == NULL) {
+		SPDK_ERRLOG("Could not allocate poll group\n");
+		return NULL;
+	}
+
+	group->lcore = lcore;
+	group->pd = id->pd;
+	for (i = 0; i < NVMF_RDMA_CONN_HASH_SIZE; i++) {
+		TAILQ_INIT(&group->conn_hash[i]);
+	}
+	TAILQ_INIT(&group->dirty_conns);
+	STAILQ_INIT(&group->unmatched_recvs);
+
+	group->mem_map = nvmf_rdma_get_mem_map(group->pd);
+	if (group->mem_map == NULL) {
+		goto err;
+	}
+
+	/* The acceptor polls for the last WQE events of detaching QPs. */
+	flags = fcntl(id->verbs->async_fd, F_GETFL);
+	if (flags < 0 || fcntl(id->verbs->async_fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+		SPDK_ERRLOG("fcntl to set async fd to non-blocking failed\n");
+		goto err;
+	}
+
+	srq_depth = nvmf_min(NVMF_RDMA_SRQ_DEPTH, (uint32_t)ibdev_attr.max_srq_wr);
+	group->cq_size = nvmf_min(NVMF_RDMA_SHARED_CQ_SIZE, (uint32_t)ibdev_attr.max_cqe);
+	if (srq_depth + cq_entries > group->cq_size) {
+		SPDK_ERRLOG("Shared CQ of %u entries is too small\n", group->cq_size);
+		goto err;
+	}
+
+	group->cq = ibv_create_cq(id->verbs, group->cq_size, group, NULL, 0);
+	if (group->cq == NULL) {
+		SPDK_ERRLOG("create shared cq error!\n");
+		goto err;
+	}
+
+	memset(&srq_attr, 0, sizeof(srq_attr));
+	srq_attr.attr.max_wr = srq_depth;
+	srq_attr.attr.max_sge = NVMF_DEFAULT_RX_SGE;
+	group->srq = ibv_create_srq(group->pd, &srq_attr);
+	if (group->srq == NULL) {
+		SPDK_ERRLOG("create srq error!\n");
+		goto err;
+	}
+
+	if (nvmf_rdma_recv_set_init(&group->recv_set, srq_depth, group->mem_map)) {
+		goto err;
+	}
+
+	for (i = 0; i < srq_depth; i++) {
+		nvmf_rdma_queue_recv_wr(&group->srq_wr_head, &group->srq_wr_tail,
+					&group->recv_set.recvs[i]);
+	}
+
+	if (nvmf_rdma_poll_group_flush_recvs(group)) {
+		goto err;
+	}
+
+	rte_atomic32_set(&group->cq_reserved, srq_depth + cq_entries);
+
+	group->poller.fn = nvmf_rdma_poll_group_poll;
+	group->poller.arg = group;
+	spdk_poller_register(&group->poller, lcore, NULL);
+
+	TAILQ_INSERT_TAIL(&g_poll_groups, group, link);
+
+	SPDK_TRACELOG(SPDK_TRACE_RDMA, "Poll group %p on lcore %u: CQ size %u, SRQ depth %u\n",
+		      group, lcore, group->cq_size, srq_depth);
+
+	return group;
+
+err:
+	nvmf_rdma_poll_group_destroy(group);
+	return NULL;
+}
+
+/*
+ * Find a poll group on lcore for the protection domain of id with room for
+ * cq_entries more completions, creating one if needed.  Called on the
+ * acceptor core.
+ */
+static struct spdk_nvmf_rdma_poll_group *
+nvmf_rdma_poll_group_get(uint32_t lcore, struct rdma_cm_id *id, uint32_t cq_entries)
+{
+	struct spdk_nvmf_rdma_poll_group *group;
+
+	TAILQ_FOREACH(group, &g_poll_groups, link) {
+		if (group->lcore == lcore && group->pd == id->pd &&
+		    (uint32_t)rte_atomic32_read(&group->cq_reserved) + cq_entries <= group->cq_size) {
+			rte_atomic32_add(&group->cq_reserved, cq_entries);
+			return group;
+		}
+	}
+
+	return nvmf_rdma_poll_group_create(lcore, id, cq_entries);
+}
+
+/*
+ * Send queue entries of a connection served by a poll group: a SEND and a
+ * READ or WRITE per request, plus the drain WR posted when it is detached.
+ */
+static inline uint32_t
+nvmf_rdma_group_send_wrs(uint16_t queue_depth)
+{
+	return queue_depth * 2 + 1;
+}
+
+/* Release the verbs resources of a connection; the cm_id is left alone. */
+static void
+nvmf_rdma_conn_free_resources(struct spdk_nvmf_rdma_conn *rdma_conn)
+{
+	struct spdk_nvmf_rdma_poll_group *group = rdma_conn->group;
+
+	if (rdma_conn->qp) {
+		rdma_destroy_qp(rdma_conn->cm_id);
+	}
+
+	nvmf_rdma_free_reqs(rdma_conn);
+	nvmf_rdma_recv_set_fini(&rdma_conn->recv_set);
+
+	if (group != NULL) {
+		rte_atomic32_sub(&group->cq_reserved, nvmf_rdma_group_send_wrs(rdma_conn->queue_depth));
+		spdk_nvmf_put_conn_lcore(group->lcore);
+		return;
+	}
+
+	if (rdma_conn->conn.transport_polled) {
+		spdk_nvmf_put_conn_lcore(rdma_conn->conn.lcore);
+	}
+
+	if (rdma_conn->cq && ibv_destroy_cq(rdma_conn->cq)) {
+		SPDK_ERRLOG("ibv_destroy_cq error\n");
+	}
+
+	if (rdma_conn->comp_channel) {
+		ibv_destroy_comp_channel(rdma_conn->comp_channel);
+	}
+}
+
+static void
+nvmf_rdma_conn_destroy(struct spdk_nvmf_rdma_conn *rdma_conn)
+{
+	nvmf_rdma_conn_free_resources(rdma_conn);
+	rdma_destroy_id(rdma_conn->cm_id);
+
+	free(rdma_conn);
+}
+
+static void
+nvmf_rdma_conn_attach(spdk_event_t event)
+{
+	struct spdk_nvmf_rdma_conn *rdma_conn = spdk_event_get_arg1(event);
+	struct spdk_nvmf_rdma_poll_group *group = rdma_conn->group;
+
+	TAILQ_INSERT_HEAD(&group->conn_hash[rdma_conn->qp->qp_num & (NVMF_RDMA_CONN_HASH_SIZE - 1)],
+			  rdma_conn, hash_link);
+	rdma_conn->attached = true;
+}
+
+/*
+ * Second half of the teardown of an I/O connection polled on its own core,
+ * once no CONNECT is outstanding and the device is done with its QP.  Runs
+ * on the connection's core.
+ */
+static void
+nvmf_rdma_conn_detach_finish(spdk_event_t event)
+{
+	struct spdk_nvmf_rdma_conn	*rdma_conn = spdk_event_get_arg1(event);
+	struct spdk_nvmf_rdma_poll_group *group = rdma_conn->group;
+	struct spdk_nvmf_rdma_recv	*recv, *tmp;
+	uint16_t			i;
+
+	if (group == NULL) {
+		nvmf_rdma_conn_destroy(rdma_conn);
+		rte_atomic32_dec(&g_rdma.num_detaching);
+		return;
+	}
+
+	/* Reap the completions the QP generated before it went quiet. */
+	while (nvmf_rdma_poll_group_process_cq(group) == NVMF_RDMA_WC_BATCH_SIZE) {
+	}
+
+	if (rdma_conn->attached) {
+		TAILQ_REMOVE(&group->conn_hash[rdma_conn->qp->qp_num & (NVMF_RDMA_CONN_HASH_SIZE - 1)],
+			     rdma_conn, hash_link);
+	}
+
+	if (rdma_conn->dirty) {
+		TAILQ_REMOVE(&group->dirty_conns, rdma_conn, dirty_link);
+	}
+
+	/* Give every receive the connection still holds back to the SRQ. */
+	for (i = 0; i < rdma_conn->queue_depth; i++) {
+		recv = rdma_conn->reqs[i].recv;
+		if (recv != NULL) {
+			nvmf_rdma_queue_recv_wr(&group->srq_wr_head, &group->srq_wr_tail, recv);
+		}
+	}
+
+	while ((recv = STAILQ_FIRST(&rdma_conn->incoming_queue)) != NULL) {
+		STAILQ_REMOVE_HEAD(&rdma_conn->incoming_queue, link);
+		nvmf_rdma_queue_recv_wr(&group->srq_wr_head, &group->srq_wr_tail, recv);
+	}
+
+	STAILQ_FOREACH_SAFE(recv, &group->unmatched_recvs, link, tmp) {
+		if (recv->qp_num == rdma_conn->qp->qp_num) {
+			STAILQ_REMOVE(&group->unmatched_recvs, recv, spdk_nvmf_rdma_recv, link);
+			nvmf_rdma_queue_recv_wr(&group->srq_wr_head, &group->srq_wr_tail, recv);
+		}
+	}
+
+	nvmf_rdma_poll_group_flush_recvs(group);
+
+	SPDK_TRACELOG(SPDK_TRACE_RDMA, "Detached conn %p from poll group %p\n", rdma_conn, group);
+
+	nvmf_rdma_conn_destroy(rdma_conn);
+	rte_atomic32_dec(&g_rdma.num_detaching);
+}
+
+static void
+nvmf_rdma_conn_detach_try_finish(struct spdk_nvmf_rdma_conn *rdma_conn)
+{
+	spdk_event_t event;
+
+	if (!rdma_conn->detaching || !rdma_conn->send_drained || !rdma_conn->recv_drained ||
+	    rdma_conn->connects_in_flight > 0) {
+		return;
+	}
+	rdma_conn->detaching = false;
+
+	/* Finish outside of the poller, which may be reaping this completion. */
+	event = spdk_event_allocate(rdma_conn->conn.lcore, nvmf_rdma_conn_detach_finish,
+				    rdma_conn, NULL, NULL);
+	spdk_event_call(event);
+}
+
+/* The device reported that the QP will take no more receives from the SRQ. */
+static void
+nvmf_rdma_conn_last_wqe_reached(spdk_event_t event)
+{
+	struct spdk_nvmf_rdma_conn *rdma_conn = spdk_event_get_arg1(event);
+
+	rdma_conn->recv_drained = true;
+	nvmf_rdma_conn_detach_try_finish(rdma_conn);
+}
+
+static void
+nvmf_rdma_conn_detach(spdk_event_t event)
+{
+	struct spdk_nvmf_rdma_conn	*rdma_conn = spdk_event_get_arg1(event);
+	struct spdk_nvmf_rdma_poll_group *group = rdma_conn->group;
+	struct ibv_send_wr		drain_wr, *bad_wr = NULL;
+	struct ibv_qp_attr		qp_attr;
+
+	if (group == NULL) {
+		/* The poller is gone; only a queued CONNECT can still hold it. */
+		rdma_conn->detaching = true;
+		rdma_conn->send_drained = true;
+		rdma_conn->recv_drained = true;
+		nvmf_rdma_conn_detach_try_finish(rdma_conn);
+		return;
+	}
+
+	SPDK_TRACELOG(SPDK_TRACE_RDMA, "Detaching conn %p from poll group %p\n", rdma_conn, group);
+
+	/*
+	 * Move the QP to the error state so that it stops consuming shared
+	 * receives and flushes its send queue.  Receives it already took
+	 * keep arriving on the shared CQ until the device reports the last
+	 * WQE, and the drain WR completes behind every SEND still posted, so
+	 * the connection stays in the group until both have happened.
+	 */
+	rdma_conn->stopped = true;
+	rdma_conn->failed = true;
+	rdma_conn->detaching = true;
+
+	memset(&qp_attr, 0, sizeof(qp_attr));
+	qp_attr.qp_state = IBV_QPS_ERR;
+	if (ibv_modify_qp(rdma_conn->qp, &qp_attr, IBV_QP_STATE)) {
+		SPDK_ERRLOG("Unable to move QP to the error state; freeing conn %p without draining\n",
+			    rdma_conn);
+		rdma_conn->send_drained = true;
+		rdma_conn->recv_drained = true;
+		nvmf_rdma_conn_detach_try_finish(rdma_conn);
+		return;
+	}
+
+	memset(&drain_wr, 0, sizeof(drain_wr));
+	rdma_conn->drain_wr.type = RDMA_WR_TYPE_DRAIN;
+	drain_wr.wr_id = (uintptr_t)&rdma_conn->drain_wr;
+	drain_wr.opcode = IBV_WR_SEND;
+	drain_wr.send_flags = IBV_SEND_SIGNALED;
+	if (ibv_post_send(rdma_conn->qp, &drain_wr, &bad_wr)) {
+		SPDK_ERRLOG("Unable to post drain WR for conn %p\n", rdma_conn);
+		rdma_conn->send_drained = true;
+	}
+
+	nvmf_rdma_conn_detach_try_finish(rdma_conn);
+}
+
+/*
+ * Hand asynchronous device events to the cores that own the affected
+ * connections.  Runs on the acceptor core.
+ */
+static void
+nvmf_rdma_process_async_events(struct ibv_context *ctx)
+{
+	struct ibv_async_event		async_event;
+	struct spdk_nvmf_rdma_conn	*rdma_conn;
+	spdk_event_t			event;
+
+	while (ibv_get_async_event(ctx, &async_event) == 0) {
+		switch (async_event.event_type) {
+		case IBV_EVENT_QP_LAST_WQE_REACHED:
+			rdma_conn = async_event.element.qp->qp_context;
+			event = spdk_event_allocate(rdma_conn->group->lcore, nvmf_rdma_conn_last_wqe_reached,
+						    rdma_conn, NULL, NULL);
+			spdk_event_call(event);
+			break;
+		default:
+			SPDK_TRACELOG(SPDK_TRACE_RDMA, "Async event: %s\n",
+				      ibv_event_type_str(async_event.event_type));
+			break;
+		}
+
+		ibv_ack_async_event(&async_event);
+	}
+}
+
+/* Poll the async events of every device that a poll group is using. */
+static void
+nvmf_rdma_poll_async_events(void)
+{
+	struct spdk_nvmf_rdma_poll_group *group, *prev;
+
+	TAILQ_FOREACH(group, &g_poll_groups, link) {
+		TAILQ_FOREACH(prev, &g_poll_groups, link) {
+			if (prev == group || prev->pd->context == group->pd->context) {
+				break;
+			}
+		}
+
+		if (prev == group) {
+			nvmf_rdma_process_async_events(group->pd->context);
+		}
+	}
+}
+
+/* Poller of an I/O connection that is not served by a poll group. */
+static void
+nvmf_rdma_conn_poller(void *arg)
+{
+	struct spdk_nvmf_rdma_conn *rdma_conn = arg;
+
+	if (rdma_conn->failed) {
+		return;
+	}
+
+	if (spdk_nvmf_rdma_poll(&rdma_conn->conn) < 0) {
+		nvmf_rdma_conn_error(rdma_conn);
+	}
+}
+
+/*
+ * Create the connection for an accepted cm_id.  I/O queues get a core of
+ * their own right away: they join the poll group of that core if the
+ * device supports shared receive queues, and are polled by a poller of
+ * their own otherwise.
+ */
+static struct spdk_nvmf_rdma_conn *
+allocate_rdma_conn(struct rdma_cm_id *id, uint16_t queue_depth, bool io_queue)
+{
+	struct spdk_nvmf_rdma_conn	*rdma_conn;
+	struct spdk_nvmf_conn		*conn;
+	struct spdk_nvmf_rdma_poll_group *group = NULL;
+	uint32_t			lcore = 0, i;
+	int				rc;
+	struct ibv_qp_init_attr		attr;
+	spdk_event_t			event;
+
+	rdma_conn = calloc(1, sizeof(struct spdk_nvmf_rdma_conn));
+	if (rdma_conn == NULL) {
+		SPDK_ERRLOG("Could not allocate new connection.\n");
+		return NULL;
+	}
+
+	rdma_conn->queue_depth = queue_depth;
+	rdma_conn->ctx = id->verbs;
+	rdma_conn->cm_id = id;
+	STAILQ_INIT(&rdma_conn->free_reqs);
+	STAILQ_INIT(&rdma_conn->incoming_queue);
+	STAILQ_INIT(&rdma_conn->sends_in_flight);
+	STAILQ_INIT(&rdma_conn->pending_data_buf_queue);
+
+	conn = &rdma_conn->conn;
+	conn->transport = &spdk_nvmf_transport_rdma;
+
+	rdma_conn->mem_map = nvmf_rdma_get_mem_map(id->pd);
+	if (rdma_conn->mem_map == NULL) {
+		goto alloc_error;
+	}
+
+	if (io_queue) {
+		lcore = spdk_nvmf_get_conn_lcore();
+		group = nvmf_rdma_poll_group_get(lcore, id, nvmf_rdma_group_send_wrs(queue_depth));
+		if (group == NULL) {
+			SPDK_TRACELOG(SPDK_TRACE_RDMA, "No poll group on lcore %u; using a dedicated CQ\n", lcore);
+			conn->lcore = lcore;
+			conn->transport_polled = true;
+		}
+	}
+
+	memset(&attr, 0, sizeof(struct ibv_qp_init_attr));
+	attr.qp_type		= IBV_QPT_RC;
+	attr.qp_context		= rdma_conn;
+	attr.cap.max_send_wr	= rdma_conn->queue_depth * 2; /* SEND, READ, and WRITE operations */
+	attr.cap.max_send_sge	= NVMF_DEFAULT_TX_SGE;
+
+	if (group != NULL) {
+		rdma_conn->group = group;
+		rdma_conn->cq = group->cq;
+		attr.srq = group->srq;
+		attr.cap.max_send_wr = nvmf_rdma_group_send_wrs(rdma_conn->queue_depth);
+	} else {
+		rdma_conn->comp_channel = ibv_create_comp_channel(id->verbs);
+		if (!rdma_conn->comp_channel) {
+			SPDK_ERRLOG("create completion channel error!\n");
+			goto alloc_error;
+		}
+
+		rc = fcntl(rdma_conn->comp_channel->fd, F_SETFL, O_NONBLOCK);
+		if (rc < 0) {
+			SPDK_ERRLOG("fcntl to set comp channel to non-blocking failed\n");
+			goto alloc_error;
+		}
+
+		/*
+		 * Size the CQ to handle completions for RECV, SEND, and either READ or WRITE.
+		 */
+		rdma_conn->cq = ibv_create_cq(id->verbs, (queue_depth * 3), rdma_conn, rdma_conn->comp_channel,
+					      0);
+		if (!rdma_conn->cq) {
+			SPDK_ERRLOG("create cq error!\n");
+			goto alloc_error;
+		}
+
+		attr.cap.max_recv_wr	= rdma_conn->queue_depth; /* RECV operations */
+		attr.cap.max_recv_sge	= NVMF_DEFAULT_RX_SGE;
+	}
+	attr.send_cq		= rdma_conn->cq;
+	attr.recv_cq		= rdma_conn->cq;
+
+	rc = rdma_create_qp(rdma_conn->cm_id, NULL, &attr);
+	if (rc) {
+		SPDK_ERRLOG("rdma_create_qp failed\n");
+		goto alloc_error;
+	}
+	rdma_conn->qp = rdma_conn->cm_id->qp;
+
+	if (nvmf_rdma_alloc_reqs(rdma_conn)) {
+		goto alloc_error;
+	}
+
+	id->context = conn;
+
+	SPDK_TRACELOG(SPDK_TRACE_RDMA, "New RDMA Connection: %p\n", conn);
+
+	if (group != NULL) {
+		/* Requests on this connection are processed by the group's poller. */
+		conn->lcore = lcore;
+		conn->transport_polled = true;
+
+		event = spdk_event_allocate(lcore, nvmf_rdma_conn_attach, rdma_conn, NULL, NULL);
+		spdk_event_call(event);
+
+		return rdma_conn;
+	}
+
+	if (nvmf_rdma_recv_set_init(&rdma_conn->recv_set, rdma_conn->queue_depth, rdma_conn->mem_map)) {
+		goto alloc_error;
+	}
+
+	for (i = 0; i < rdma_conn->recv_set.count; i++) {
+		nvmf_post_rdma_recv(rdma_conn, &rdma_conn->recv_set.recvs[i]);
+	}
 
-	sg_list[0].addr = (uint64_t)&rdma_req->cmd;
-	sg_list[0].length = sizeof(rdma_req->cmd);
-	sg_list[0].lkey = rdma_req->cmd_mr->lkey;
-	nvmf_trace_ibv_sge(&sg_list[0]);
+	if (nvmf_rdma_flush_wrs(rdma_conn)) {
+		SPDK_ERRLOG("Unable to post connection rx descs\n");
+		goto alloc_error;
+	}
 
-	sg_list[1].addr = (uint64_t)rdma_req->bb_mr->addr;
-	sg_list[1].length = rdma_req->bb_mr->length;
-	sg_list[1].lkey = rdma_req->bb_mr->lkey;
-	nvmf_trace_ibv_sge(&sg_list[1]);
+	if (conn->transport_polled) {
+		/* Polled on its own core from the start, CONNECT included. */
+		rdma_conn->poller.fn = nvmf_rdma_conn_poller;
+		rdma_conn->poller.arg = rdma_conn;
+		spdk_poller_register(&rdma_conn->poller, conn->lcore, NULL);
+	}
 
-	memset(&wr, 0, sizeof(wr));
-	wr.wr_id = (uintptr_t)rdma_req;
-	wr.next = NULL;
-	wr.sg_list = sg_list;
-	wr.num_sge = 2;
+	return rdma_conn;
 
-	rc = ibv_post_recv(rdma_conn->qp, &wr, &bad_wr);
-	if (rc) {
-		SPDK_ERRLOG("Failure posting rdma recv, rc = 0x%x\n", rc);
-	}
-	return (rc);
+alloc_error:
+	nvmf_rdma_conn_free_resources(rdma_conn);
+	free(rdma_conn);
+	return NULL;
 }
 
-static int
-nvmf_post_rdma_send(struct spdk_nvmf_request *req)
+static void
+nvmf_rdma_conn_cleanup(struct spdk_nvmf_conn *conn)
 {
-	struct ibv_send_wr wr, *bad_wr = NULL;
-	struct spdk_nvmf_conn *conn = req->conn;
 	struct spdk_nvmf_rdma_conn *rdma_conn = get_rdma_conn(conn);
-	struct spdk_nvmf_rdma_request *rdma_req = get_rdma_req(req);
-	struct ibv_sge sge;
-	int rc;
+	spdk_event_t event;
 
-	SPDK_TRACELOG(SPDK_TRACE_RDMA, "RDMA SEND POSTED. Request: %p Connection: %p\n", req, conn);
+	SPDK_TRACELOG(SPDK_TRACE_RDMA, "Enter\n");
 
-	sge.addr = (uint64_t)&rdma_req->rsp;
-	sge.length = sizeof(rdma_req->rsp);
-	sge.lkey = rdma_req->rsp_mr->lkey;
-	nvmf_trace_ibv_sge(&sge);
+	if (!conn->transport_polled) {
+		nvmf_rdma_conn_destroy(rdma_conn);
+		return;
+	}
 
-	nvmf_ibv_send_wr_init(&wr, req, &sge, IBV_WR_SEND, IBV_SEND_SIGNALED);
+	/*
+	 * The connection is detached on its own core, where the shared CQ and
+	 * SRQ are touched and where a CONNECT handed to the acceptor comes
+	 * back to.
+	 */
+	rte_atomic32_inc(&g_rdma.num_detaching);
+	event = spdk_event_allocate(conn->lcore, nvmf_rdma_conn_detach, rdma_conn, NULL, NULL);
 
-	spdk_trace_record(TRACE_NVMF_IO_COMPLETE, 0, 0, (uint64_t)req, 0);
-	rc = ibv_post_send(rdma_conn->qp, &wr, &bad_wr);
-	if (rc) {
-		SPDK_ERRLOG("Failure posting rdma send for NVMf completion, rc = 0x%x\n", rc);
+	if (rdma_conn->group == NULL && !rdma_conn->stopped) {
+		/* Torn down without being stopped first */
+		rdma_conn->stopped = true;
+		spdk_poller_unregister(&rdma_conn->poller, event);
+		return;
 	}
-	return (rc);
+
+	spdk_event_call(event);
 }
 
-static int
-spdk_nvmf_rdma_request_complete(struct spdk_nvmf_request *req)
+static void
+nvmf_rdma_conn_stop_on_core(spdk_event_t event)
 {
-	struct spdk_nvme_cpl *rsp = &req->rsp->nvme_cpl;
-	int ret;
-
-	/* Was the command successful? */
-	if (rsp->status.sc == SPDK_NVME_SC_SUCCESS &&
-	    req->xfer == SPDK_NVME_DATA_CONTROLLER_TO_HOST) {
-		/* Need to transfer data via RDMA Write */
-		ret = nvmf_post_rdma_write(req);
-		if (ret) {
-			SPDK_ERRLOG("Unable to post rdma write tx descriptor\n");
-			return -1;
-		}
-	}
-
-	ret = nvmf_post_rdma_send(req);
-	if (ret) {
-		SPDK_ERRLOG("Unable to send response capsule\n");
-		return -1;
-	}
+	struct spdk_nvmf_rdma_conn *rdma_conn = spdk_event_get_arg1(event);
+	struct spdk_event *complete = spdk_event_get_arg2(event);
 
-	return 0;
+	rdma_conn->stopped = true;
+	spdk_event_call(complete);
 }
 
-static int
-spdk_nvmf_rdma_request_release(struct spdk_nvmf_request *req)
+static void
+nvmf_rdma_conn_stop(struct spdk_nvmf_conn *conn, struct spdk_event *complete)
 {
-	struct spdk_nvmf_conn *conn = req->conn;
 	struct spdk_nvmf_rdma_conn *rdma_conn = get_rdma_conn(conn);
+	spdk_event_t event;
 
-	if (nvmf_post_rdma_recv(req)) {
-		SPDK_ERRLOG("Unable to re-post rx descriptor\n");
-		return -1;
-	}
-
-	conn->sq_head++;
-	if (conn->sq_head == rdma_conn->queue_depth) {
-		conn->sq_head = 0;
+	if (rdma_conn->group == NULL) {
+		rdma_conn->stopped = true;
+		spdk_poller_unregister(&rdma_conn->poller, complete);
+		return;
 	}
 
-	return 0;
+	event = spdk_event_allocate(conn->lcore, nvmf_rdma_conn_stop_on_core,
+				    rdma_conn, complete, NULL);
+	spdk_event_call(event);
 }
 
 static int
@@ -605,17 +2210,19 @@ nvmf_rdma_connect(struct rdma_cm_event *event)
 
 	SPDK_TRACELOG(SPDK_TRACE_RDMA, "Final Negotiated Queue Depth: %d\n", queue_depth);
 
-	/* Init the NVMf rdma transport connection */
-	rdma_conn = allocate_rdma_conn(event->id, queue_depth);
+	/*
+	 * Init the NVMf rdma transport connection.  I/O queues are placed on a
+	 * poll group right away, since a QP's CQ and SRQ are fixed when it is
+	 * created.  The admin queue, and any queue whose QID is unknown, gets
+	 * its own CQ and is polled with its session.
+	 */
+	rdma_conn = allocate_rdma_conn(event->id, queue_depth,
+				       private_data != NULL && private_data->qid != 0);
 	if (rdma_conn == NULL) {
 		SPDK_ERRLOG("Error on nvmf connection creation\n");
 		goto err1;
 	}
 
-	/* Add this RDMA connection to the global list until a CONNECT capsule
-	 * is received. */
-	TAILQ_INSERT_TAIL(&g_pending_conns, rdma_conn, link);
-
 	accept_data.recfmt = 0;
 	accept_data.crqsize = rdma_conn->queue_depth;
 	ctrlr_event_data = *rdma_param;
@@ -633,6 +2240,11 @@ nvmf_rdma_connect(struct rdma_cm_event *event)
 	}
 	SPDK_TRACELOG(SPDK_TRACE_RDMA, "Sent back the accept\n");
 
+	/* Connections polled with their session wait here for a CONNECT capsule. */
+	if (!rdma_conn->conn.transport_polled) {
+		TAILQ_INSERT_TAIL(&g_pending_conns, rdma_conn, link);
+	}
+
 	return 0;
 
 err1: {
@@ -640,21 +2252,17 @@ err1: {
 
 		rej_data.status.sc = sts;
 		rdma_reject(event->id, &ctrlr_event_data, sizeof(rej_data));
-		free(rdma_conn);
+		if (rdma_conn != NULL && rdma_conn->conn.transport_polled) {
+			/* Already running on its own core; tear it down there. */
+			nvmf_rdma_conn_cleanup(&rdma_conn->conn);
+		} else {
+			free(rdma_conn);
+		}
 	}
 err0:
 	return -1;
 }
 
-static void
-spdk_nvmf_handle_disconnect(spdk_event_t event)
-{
-	struct nvmf_session		*session = spdk_event_get_arg1(event);
-	struct spdk_nvmf_conn		*conn = spdk_event_get_arg2(event);
-
-	nvmf_disconnect(session, conn);
-}
-
 static int
 nvmf_rdma_disconnect(struct rdma_cm_event *evt)
 {
@@ -680,15 +2288,19 @@ nvmf_rdma_disconnect(struct rdma_cm_event *evt)
 
 	session = conn->sess;
 	if (session == NULL) {
-		/* No session has been established yet. That means the conn
-		 * must be in the pending connections list. Remove it. */
-		TAILQ_REMOVE(&g_pending_conns, rdma_conn, link);
+		/* No session has been established yet. Connections polled with
+		 * their session are still in the pending connections list. */
+		if (!conn->transport_polled) {
+			TAILQ_REMOVE(&g_pending_conns, rdma_conn, link);
+		}
+		/* A CONNECT queued on this core must not run any more. */
+		rdma_conn->closing = true;
 		nvmf_rdma_conn_cleanup(conn);
 		return 0;
 	}
 
 	/* Pass an event to the core that owns this connection */
-	event = spdk_event_allocate(session->subsys->poller.lcore,
+	event = spdk_event_allocate(session->subsys->lcore,
 				    spdk_nvmf_handle_disconnect,
 				    session, conn, NULL);
 	spdk_event_call(event);
@@ -717,110 +2329,6 @@ static const char *CM_EVENT_STR[] = {
 };
 #endif /* DEBUG */
 
-static int
-spdk_nvmf_request_prep_data(struct spdk_nvmf_request *req,
-			    void *in_cap_data, uint32_t in_cap_len,
-			    void *bb, uint32_t bb_len)
-{
-	struct spdk_nvme_cmd *cmd = &req->cmd->nvme_cmd;
-	struct spdk_nvme_cpl *rsp = &req->rsp->nvme_cpl;
-	enum spdk_nvme_data_transfer xfer;
-
-	req->length = 0;
-	req->xfer = SPDK_NVME_DATA_NONE;
-	req->data = NULL;
-
-	if (cmd->opc == SPDK_NVME_OPC_FABRIC) {
-		xfer = spdk_nvme_opc_get_data_transfer(req->cmd->nvmf_cmd.fctype);
-	} else {
-		xfer = spdk_nvme_opc_get_data_transfer(cmd->opc);
-	}
-
-	if (xfer != SPDK_NVME_DATA_NONE) {
-		struct spdk_nvme_sgl_descriptor *sgl = (struct spdk_nvme_sgl_descriptor *)&cmd->dptr.sgl1;
-
-		if (sgl->generic.type == SPDK_NVME_SGL_TYPE_KEYED_DATA_BLOCK &&
-		    (sgl->keyed.subtype == SPDK_NVME_SGL_SUBTYPE_ADDRESS ||
-		     sgl->keyed.subtype == SPDK_NVME_SGL_SUBTYPE_INVALIDATE_KEY)) {
-			if (sgl->keyed.length > bb_len) {
-				SPDK_ERRLOG("SGL length 0x%x exceeds BB length 0x%x\n",
-					    sgl->keyed.length, bb_len);
-				rsp->status.sc = SPDK_NVME_SC_DATA_SGL_LENGTH_INVALID;
-				return -1;
-			}
-
-			req->data = bb;
-			req->length = sgl->keyed.length;
-		} else if (sgl->generic.type == SPDK_NVME_SGL_TYPE_DATA_BLOCK &&
-			   sgl->unkeyed.subtype == SPDK_NVME_SGL_SUBTYPE_OFFSET) {
-			uint64_t offset = sgl->address;
-			uint32_t max_len = in_cap_len;
-
-			SPDK_TRACELOG(SPDK_TRACE_NVMF, "In-capsule data: offset 0x%" PRIx64 ", length 0x%x\n",
-				      offset, sgl->unkeyed.length);
-
-			if (offset > max_len) {
-				SPDK_ERRLOG("In-capsule offset 0x%" PRIx64 " exceeds capsule length 0x%x\n",
-					    offset, max_len);
-				rsp->status.sc = SPDK_NVME_SC_INVALID_SGL_OFFSET;
-				return -1;
-			}
-			max_len -= (uint32_t)offset;
-
-			if (sgl->unkeyed.length > max_len) {
-				SPDK_ERRLOG("In-capsule data length 0x%x exceeds capsule length 0x%x\n",
-					    sgl->unkeyed.length, max_len);
-				rsp->status.sc = SPDK_NVME_SC_DATA_SGL_LENGTH_INVALID;
-				return -1;
-			}
-
-			req->data = in_cap_data + offset;
-			req->length = sgl->unkeyed.length;
-		} else {
-			SPDK_ERRLOG("Invalid NVMf I/O Command SGL:  Type 0x%x, Subtype 0x%x\n",
-				    sgl->generic.type, sgl->generic.subtype);
-			rsp->status.sc = SPDK_NVME_SC_SGL_DESCRIPTOR_TYPE_INVALID;
-			return -1;
-		}
-
-		if (req->length == 0) {
-			xfer = SPDK_NVME_DATA_NONE;
-			req->data = NULL;
-		}
-
-		req->xfer = xfer;
-
-		/*
-		 * For any I/O that requires data to be
-		 * pulled into target BB before processing by
-		 * the backend NVMe device
-		 */
-		if (xfer == SPDK_NVME_DATA_HOST_TO_CONTROLLER) {
-			if (sgl->generic.type == SPDK_NVME_SGL_TYPE_KEYED_DATA_BLOCK) {
-				SPDK_TRACELOG(SPDK_TRACE_NVMF, "Initiating Host to Controller data transfer\n");
-				/* Wait for transfer to complete before executing command. */
-				return 1;
-			}
-		}
-	}
-
-	if (xfer == SPDK_NVME_DATA_NONE) {
-		SPDK_TRACELOG(SPDK_TRACE_NVMF, "No data to transfer\n");
-		assert(req->data == NULL);
-		assert(req->length == 0);
-	} else {
-		assert(req->data != NULL);
-		assert(req->length != 0);
-		SPDK_TRACELOG(SPDK_TRACE_NVMF, "%s data ready\n",
-			      xfer == SPDK_NVME_DATA_HOST_TO_CONTROLLER ? "Host to Controller" :
-			      "Controller to Host");
-	}
-
-	return 0;
-}
-
-static int spdk_nvmf_rdma_poll(struct spdk_nvmf_conn *conn);
-
 static void
 nvmf_rdma_accept(struct rte_timer *timer, void *arg)
 {
@@ -832,6 +2340,8 @@ nvmf_rdma_accept(struct rte_timer *timer, void *arg)
 		return;
 	}
 
+	nvmf_rdma_poll_async_events();
+
 	/* Process pending connections for incoming capsules. The only capsule
 	 * this should ever find is a CONNECT request. */
 	TAILQ_FOREACH_SAFE(rdma_conn, &g_pending_conns, link, tmp) {
@@ -930,6 +2440,7 @@ spdk_nvmf_rdma_acceptor_start(void)
 	sin_port = ntohs(rdma_get_src_port(g_rdma.acceptor_listen_id));
 	SPDK_NOTICELOG("*** NVMf Target Listening on port %d ***\n", sin_port);
 
+	g_rdma.acceptor_lcore = rte_lcore_id();
 	rte_timer_init(&g_rdma.acceptor_timer);
 	rte_timer_reset(&g_rdma.acceptor_timer, ACCEPT_TIMEOUT, PERIODICAL,
 			rte_lcore_id(), nvmf_rdma_accept, NULL);
@@ -954,6 +2465,45 @@ spdk_nvmf_rdma_acceptor_stop(void)
 Initialize with RDMA transport.  Query OFED for device list.
 
 */
+static int
+spdk_nvmf_rdma_initialize_buf_pools(void)
+{
+	int cache_size;
+
+	/*
+	 * Ensure no more than half of the total buffers end up in local caches.
+	 */
+	cache_size = NVMF_RDMA_SMALL_BUF_POOL_SIZE / (2 * spdk_app_get_core_count());
+	if (cache_size > RTE_MEMPOOL_CACHE_MAX_SIZE) {
+		cache_size = RTE_MEMPOOL_CACHE_MAX_SIZE;
+	}
+	g_small_buf_pool = rte_mempool_create("nvmf_rdma_small_buf",
+					      NVMF_RDMA_SMALL_BUF_POOL_SIZE,
+					      NVMF_RDMA_SMALL_BUF_MAX_SIZE,
+					      cache_size, 0, NULL, NULL, NULL, NULL,
+					      SOCKET_ID_ANY, 0);
+	if (!g_small_buf_pool) {
+		SPDK_ERRLOG("create rdma small data buffer pool failed\n");
+		return -1;
+	}
+
+	cache_size = NVMF_RDMA_LARGE_BUF_POOL_SIZE / (2 * spdk_app_get_core_count());
+	if (cache_size > RTE_MEMPOOL_CACHE_MAX_SIZE) {
+		cache_size = RTE_MEMPOOL_CACHE_MAX_SIZE;
+	}
+	g_large_buf_pool = rte_mempool_create("nvmf_rdma_large_buf",
+					      NVMF_RDMA_LARGE_BUF_POOL_SIZE,
+					      NVMF_RDMA_LARGE_BUF_MAX_SIZE,
+					      cache_size, 0, NULL, NULL, NULL, NULL,
+					      SOCKET_ID_ANY, 0);
+	if (!g_large_buf_pool) {
+		SPDK_ERRLOG("create rdma large data buffer pool failed\n");
+		return -1;
+	}
+
+	return 0;
+}
+
 static int
 spdk_nvmf_rdma_init(void)
 {
@@ -1022,148 +2572,86 @@ spdk_nvmf_rdma_init(void)
 
 	ibv_free_device_list(dev_list);
 	SPDK_TRACELOG(SPDK_TRACE_RDMA, "    %d Fabric Intf(s) active\n", num_devices_found);
+
+	if (num_devices_found == 0) {
+		SPDK_NOTICELOG(" No usable RDMA devices found\n");
+		return -1;
+	}
+
+	if (spdk_nvmf_rdma_initialize_buf_pools()) {
+		return -1;
+	}
+
 	return num_devices_found;
 }
 
-static int
-spdk_nvmf_rdma_fini(void)
+static void
+nvmf_rdma_poll_group_destroy_event(spdk_event_t event)
 {
-	/* Nothing to do */
-	return 0;
+	struct spdk_nvmf_rdma_poll_group *group = spdk_event_get_arg1(event);
+
+	TAILQ_REMOVE(&g_poll_groups, group, link);
+	nvmf_rdma_poll_group_destroy(group);
 }
 
-/* Returns the number of times that spdk_nvmf_request_exec was called,
- * or -1 on error.
- */
-static int
-spdk_nvmf_rdma_poll(struct spdk_nvmf_conn *conn)
+/* The reactors have stopped by now, so run the events queued on each core here. */
+static void
+nvmf_rdma_run_events(void)
 {
-	struct ibv_wc wc;
-	struct spdk_nvmf_rdma_conn *rdma_conn = get_rdma_conn(conn);
-	struct spdk_nvmf_rdma_request *rdma_req;
-	struct spdk_nvmf_request *req;
-	int rc, count;
-
-	count = 0;
-	while (true) {
-		rc = ibv_poll_cq(rdma_conn->cq, 1, &wc);
-		if (rc == 0) // No completions at this time
-			break;
+	uint64_t	core_mask = spdk_app_get_core_mask();
+	uint32_t	lcore;
 
-		if (rc < 0) {
-			SPDK_ERRLOG("Poll CQ error!(%d): %s\n",
-				    errno, strerror(errno));
-			return -1;
-		}
-
-		/* OK, process the single successful cq event */
-		if (wc.status) {
-			SPDK_TRACELOG(SPDK_TRACE_RDMA, "CQ completion error status %d (%s), exiting handler\n",
-				      wc.status, ibv_wc_status_str(wc.status));
-			return -1;
-		}
-
-		rdma_req = (struct spdk_nvmf_rdma_request *)wc.wr_id;
-		if (rdma_req == NULL) {
-			SPDK_ERRLOG("Got CQ completion for NULL rdma_req\n");
-			return -1;
+	for (lcore = 0; lcore < 64; lcore++) {
+		if (core_mask & (1ULL << lcore)) {
+			spdk_event_queue_run_all(lcore);
 		}
+	}
+}
 
-		req = &rdma_req->req;
-
-		switch (wc.opcode) {
-		case IBV_WC_SEND:
-			assert(rdma_conn->outstanding_reqs > 0);
-			rdma_conn->outstanding_reqs--;
-			SPDK_TRACELOG(SPDK_TRACE_RDMA,
-				      "RDMA SEND Complete. Request: %p Connection: %p Outstanding I/O: %d\n",
-				      req, conn, rdma_conn->outstanding_reqs);
-			if (spdk_nvmf_rdma_request_release(req)) {
-				return -1;
-			}
-			break;
-
-		case IBV_WC_RDMA_WRITE:
-			/*
-			 * Will get this event only if we set IBV_SEND_SIGNALED
-			 * flag in rdma_write, to trace rdma write latency
-			 */
-			SPDK_TRACELOG(SPDK_TRACE_RDMA, "RDMA WRITE Complete. Request: %p Connection: %p\n",
-				      req, conn);
-			spdk_trace_record(TRACE_RDMA_WRITE_COMPLETE, 0, 0, (uint64_t)req, 0);
-			break;
+static int
+spdk_nvmf_rdma_fini(void)
+{
+	struct spdk_nvmf_rdma_poll_group *group;
+	struct spdk_nvmf_rdma_mem_map *map, *tmp;
+	spdk_event_t event;
+	uint64_t deadline;
 
-		case IBV_WC_RDMA_READ:
-			SPDK_TRACELOG(SPDK_TRACE_RDMA, "RDMA READ Complete. Request: %p Connection: %p\n",
-				      req, conn);
-			spdk_trace_record(TRACE_RDMA_READ_COMPLETE, 0, 0, (uint64_t)req, 0);
-			rc = spdk_nvmf_request_exec(req);
-			if (rc) {
-				SPDK_ERRLOG("request_exec error %d after RDMA Read completion\n", rc);
-				return -1;
-			}
-			count++;
+	/*
+	 * Let the connections that are still detaching drain their QPs,
+	 * polling for them since their pollers no longer run.
+	 */
+	deadline = rte_get_timer_cycles() + rte_get_timer_hz();
+	while (rte_atomic32_read(&g_rdma.num_detaching) > 0) {
+		if (rte_get_timer_cycles() > deadline) {
+			SPDK_ERRLOG("%d RDMA connections did not drain\n",
+				    rte_atomic32_read(&g_rdma.num_detaching));
 			break;
+		}
 
-		case IBV_WC_RECV:
-			if (wc.byte_len < sizeof(struct spdk_nvmf_capsule_cmd)) {
-				SPDK_ERRLOG("recv length %u less than capsule header\n", wc.byte_len);
-				return -1;
-			}
-
-			{
-				/* TEMPORARY SPECIAL CASE: For asynchronous event requests, just immediately
-				* re-post the capsule. */
-				struct spdk_nvme_cmd *cmd = &req->cmd->nvme_cmd;
-
-				if (conn->type == CONN_TYPE_AQ &&
-				    cmd->opc == SPDK_NVME_OPC_ASYNC_EVENT_REQUEST) {
-					spdk_nvmf_rdma_request_release(req);
-					break;
-				}
+		nvmf_rdma_poll_async_events();
+		TAILQ_FOREACH(group, &g_poll_groups, link) {
+			nvmf_rdma_poll_group_poll(group);
+		}
+		nvmf_rdma_run_events();
+	}
 
-			}
+	/* Take each poller off its core before its CQ and SRQ go away. */
+	TAILQ_FOREACH(group, &g_poll_groups, link) {
+		event = spdk_event_allocate(group->lcore, nvmf_rdma_poll_group_destroy_event,
+					    group, NULL, NULL);
+		spdk_poller_unregister(&group->poller, event);
+	}
 
-			rdma_conn->outstanding_reqs++;
-			SPDK_TRACELOG(SPDK_TRACE_RDMA,
-				      "RDMA RECV Complete. Request: %p Connection: %p Outstanding I/O: %d\n",
-				      req, conn, rdma_conn->outstanding_reqs);
-			spdk_trace_record(TRACE_NVMF_IO_START, 0, 0, (uint64_t)req, 0);
-
-			memset(req->rsp, 0, sizeof(*req->rsp));
-			rc = spdk_nvmf_request_prep_data(req,
-							 rdma_req->bb_mr->addr,
-							 wc.byte_len - sizeof(struct spdk_nvmf_capsule_cmd),
-							 rdma_req->bb_mr->addr,
-							 rdma_req->bb_mr->length);
-			if (rc < 0) {
-				SPDK_ERRLOG("prep_data failed\n");
-				return spdk_nvmf_request_complete(req);
-			} else if (rc == 0) {
-				/* Data is immediately available */
-				rc = spdk_nvmf_request_exec(req);
-				if (rc < 0) {
-					SPDK_ERRLOG("Command execution failed\n");
-					return -1;
-				}
-				count++;
-			} else {
-				/* Start transfer of data from host to target */
-				rc = nvmf_post_rdma_read(req);
-				if (rc) {
-					SPDK_ERRLOG("Unable to transfer data from host to target\n");
-					return -1;
-				}
-			}
-			break;
+	while (!TAILQ_EMPTY(&g_poll_groups)) {
+		nvmf_rdma_run_events();
+	}
 
-		default:
-			SPDK_ERRLOG("Poll cq opcode type unknown!!!!! completion\n");
-			return -1;
-		}
+	TAILQ_FOREACH_SAFE(map, &g_mem_maps, link, tmp) {
+		TAILQ_REMOVE(&g_mem_maps, map, link);
+		nvmf_rdma_free_mem_map(map);
 	}
 
-	return count;
+	return 0;
 }
 
 static void
@@ -1193,6 +2681,7 @@ const struct spdk_nvmf_transport spdk_nvmf_transport_rdma = {
 
 	.conn_fini = nvmf_rdma_conn_cleanup,
 	.conn_poll = spdk_nvmf_rdma_poll,
+	.conn_stop = nvmf_rdma_conn_stop,
 
 	.listen_addr_discover = nvmf_rdma_discover,
 };
@@ -236,6 +236,10 @@ nvmf_process_admin_cmd(struct spdk_nvmf_request *req)
 
 	default:
 passthrough:
+		if (subsystem->mode == NVMF_SUBSYSTEM_MODE_VIRTUAL) {
+			return nvmf_virtual_process_admin_cmd(req);
+		}
+
 		SPDK_TRACELOG(SPDK_TRACE_NVMF, "admin_cmd passthrough: opc 0x%02x\n", cmd->opc);
 		rc = spdk_nvme_ctrlr_cmd_admin_raw(subsystem->ctrlr,
 						   cmd,
@@ -257,7 +261,11 @@ nvmf_process_io_cmd(struct spdk_nvmf_request *req)
 	struct spdk_nvmf_subsystem *subsystem = req->conn->sess->subsys;
 	int rc;
 
-	rc = spdk_nvme_ctrlr_cmd_io_raw(subsystem->ctrlr, subsystem->io_qpair,
+	if (subsystem->mode == NVMF_SUBSYSTEM_MODE_VIRTUAL) {
+		return nvmf_virtual_process_io_cmd(req);
+	}
+
+	rc = spdk_nvme_ctrlr_cmd_io_raw(subsystem->ctrlr, req->conn->io_qpair,
 					&req->cmd->nvme_cmd,
 					req->data, req->length,
 					nvmf_complete_cmd,
@@ -352,7 +360,7 @@ nvmf_process_connect(struct spdk_nvmf_request *req)
 	}
 
 	/* Pass an event to the lcore that owns this subsystem */
-	event = spdk_event_allocate(subsystem->poller.lcore, nvmf_handle_connect, req, NULL, NULL);
+	event = spdk_event_allocate(subsystem->lcore, nvmf_handle_connect, req, NULL, NULL);
 	spdk_event_call(event);
 
 	return false;
@@ -34,6 +34,8 @@
 #ifndef NVMF_REQUEST_H
 #define NVMF_REQUEST_H
 
+#include <stdbool.h>
+
 #include "spdk/nvmf_spec.h"
 #include "spdk/queue.h"
 
@@ -70,4 +72,15 @@ spdk_nvmf_request_exec(struct spdk_nvmf_request *req);
 
 int spdk_nvmf_request_complete(struct spdk_nvmf_request *req);
 
+/*
+ * Command handlers for Virtual mode subsystems (virtual.c).  They return true
+ * if the response has been filled out synchronously, or false if the request
+ * will be completed later by a bdev I/O completion.
+ */
+bool
+nvmf_virtual_process_admin_cmd(struct spdk_nvmf_request *req);
+
+bool
+nvmf_virtual_process_io_cmd(struct spdk_nvmf_request *req);
+
 #endif
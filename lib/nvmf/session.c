@@ -38,10 +38,15 @@
 #include "nvmf_internal.h"
 #include "subsystem.h"
 #include "transport.h"
+#include "spdk/bdev.h"
 #include "spdk/log.h"
 #include "spdk/trace.h"
+#include "spdk/nvme.h"
 #include "spdk/nvme_spec.h"
 
+#define NVMF_VIRTUAL_MODEL_NUMBER	"SPDK Virtual Controller"
+#define NVMF_VIRTUAL_FIRMWARE_REVISION	"1.0"
+
 static void
 nvmf_init_discovery_session_properties(struct nvmf_session *session)
 {
@@ -81,6 +86,46 @@ nvmf_init_discovery_session_properties(struct nvmf_session *session)
 	session->vcprop.csts.bits.rdy = 0; /* Init controller as not ready */
 }
 
+/* Identify strings are space padded and not NUL terminated */
+static void
+nvmf_copy_padded(int8_t *dst, size_t dst_size, const char *src)
+{
+	size_t len = strlen(src);
+
+	memset(dst, ' ', dst_size);
+	memcpy(dst, src, len < dst_size ? len : dst_size);
+}
+
+static void
+nvmf_init_virtual_ctrlr_data(struct nvmf_session *session)
+{
+	struct spdk_nvmf_subsystem	*subsys = session->subsys;
+	struct spdk_nvme_ctrlr_data	*cdata = &session->vcdata;
+	bool				dsm = true;
+	uint32_t			i;
+
+	for (i = 0; i < subsys->ns_count; i++) {
+		if (subsys->ns_list[i]->max_unmap_bdesc_count == 0) {
+			dsm = false;
+		}
+	}
+
+	memset(cdata, 0, sizeof(*cdata));
+	/* An emulated controller has no PCI vendor, so VID and SSVID stay 0. */
+	nvmf_copy_padded(cdata->sn, sizeof(cdata->sn), subsys->sn);
+	nvmf_copy_padded(cdata->mn, sizeof(cdata->mn), NVMF_VIRTUAL_MODEL_NUMBER);
+	nvmf_copy_padded((int8_t *)cdata->fr, sizeof(cdata->fr), NVMF_VIRTUAL_FIRMWARE_REVISION);
+	cdata->rab = 6;
+	cdata->sqes.min = 6;
+	cdata->sqes.max = 6;
+	cdata->cqes.min = 4;
+	cdata->cqes.max = 4;
+	cdata->nn = subsys->ns_count;
+	cdata->oncs.dsm = dsm;
+	cdata->vwc.present = 1;
+	cdata->sgls.supported = 1;
+}
+
 static void
 nvmf_init_nvme_session_properties(struct nvmf_session *session)
 {
@@ -93,9 +138,14 @@ nvmf_init_nvme_session_properties(struct nvmf_session *session)
 	  with a specific subsystem session.
 	*/
 
-	/* Init the virtual controller details using actual HW details */
-	cdata = spdk_nvme_ctrlr_get_data(session->subsys->ctrlr);
-	memcpy(&session->vcdata, cdata, sizeof(struct spdk_nvme_ctrlr_data));
+	if (session->subsys->mode == NVMF_SUBSYSTEM_MODE_VIRTUAL) {
+		/* No hardware behind the controller; build the details from its bdevs */
+		nvmf_init_virtual_ctrlr_data(session);
+	} else {
+		/* Init the virtual controller details using actual HW details */
+		cdata = spdk_nvme_ctrlr_get_data(session->subsys->ctrlr);
+		memcpy(&session->vcdata, cdata, sizeof(struct spdk_nvme_ctrlr_data));
+	}
 
 	session->vcdata.aerl = 0;
 	session->vcdata.cntlid = 0;
@@ -112,8 +162,7 @@ nvmf_init_nvme_session_properties(struct nvmf_session *session)
 	nvmfdata->ctrattr = 0; /* dynamic controller model */
 	nvmfdata->msdbd = 1; /* target supports single SGL in capsule */
 
-	/* TODO: this should be set by the transport */
-	nvmfdata->ioccsz += SPDK_NVMF_MAX_RECV_DATA_TRANSFER_SIZE / 16;
+	nvmfdata->ioccsz += g_nvmf_tgt.in_capsule_data_size / 16;
 
 	SPDK_TRACELOG(SPDK_TRACE_NVMF, "	ctrlr data: maxcmd %x\n",
 		      session->vcdata.maxcmd);
@@ -159,20 +208,31 @@ nvmf_init_nvme_session_properties(struct nvmf_session *session)
 		      session->vcprop.csts.raw);
 }
 
+static void
+spdk_nvmf_conn_destruct(struct spdk_nvmf_conn *conn)
+{
+	if (conn->type == CONN_TYPE_IOQ) {
+		nvmf_subsystem_release_conn(conn->sess->subsys, conn);
+	}
+
+	conn->transport->conn_fini(conn);
+}
+
 void
 spdk_nvmf_session_destruct(struct nvmf_session *session)
 {
-	session->subsys->session = NULL;
+	struct spdk_nvmf_subsystem *subsystem = session->subsys;
 
 	while (!TAILQ_EMPTY(&session->connections)) {
 		struct spdk_nvmf_conn *conn = TAILQ_FIRST(&session->connections);
 
 		TAILQ_REMOVE(&session->connections, conn, link);
 		session->num_connections--;
-		conn->transport->conn_fini(conn);
+		spdk_nvmf_conn_destruct(conn);
 	}
 
 	free(session);
+	nvmf_subsystem_remove_session(subsystem);
 }
 
 static void
@@ -256,6 +316,8 @@ spdk_nvmf_session_connect(struct spdk_nvmf_conn *conn,
 		} else {
 			nvmf_init_discovery_session_properties(session);
 		}
+
+		nvmf_subsystem_start_poller(subsystem);
 	} else {
 		conn->type = CONN_TYPE_IOQ;
 		SPDK_TRACELOG(SPDK_TRACE_NVMF, "Connect I/O Queue for controller id 0x%x\n", data->cntlid);
@@ -295,11 +357,23 @@ spdk_nvmf_session_connect(struct spdk_nvmf_conn *conn,
 			rsp->status.sc = SPDK_NVMF_FABRIC_SC_CONTROLLER_BUSY;
 			return;
 		}
+
+		if (!conn->transport_polled) {
+			conn->lcore = subsystem->lcore;
+		}
+
+		if (nvmf_subsystem_assign_conn(subsystem, conn)) {
+			SPDK_ERRLOG("Unable to assign a backend I/O queue pair\n");
+			rsp->status.sct = SPDK_NVME_SCT_COMMAND_SPECIFIC;
+			rsp->status.sc = SPDK_NVMF_FABRIC_SC_CONTROLLER_BUSY;
+			return;
+		}
 	}
 
 	session->num_connections++;
 	TAILQ_INSERT_HEAD(&session->connections, conn, link);
 	conn->sess = session;
+	conn->state = CONN_STATE_RUNNING;
 
 	rsp->status.sc = SPDK_NVME_SC_SUCCESS;
 	rsp->status_code_specific.success.cntlid = 0;
@@ -307,19 +381,53 @@ spdk_nvmf_session_connect(struct spdk_nvmf_conn *conn,
 		      rsp->status_code_specific.success.cntlid);
 }
 
-void
-nvmf_disconnect(struct nvmf_session *session,
-		struct spdk_nvmf_conn *conn)
+static void
+nvmf_conn_remove(struct nvmf_session *session, struct spdk_nvmf_conn *conn)
 {
 	session->num_connections--;
 	TAILQ_REMOVE(&session->connections, conn, link);
-	conn->transport->conn_fini(conn);
+	spdk_nvmf_conn_destruct(conn);
 
 	if (session->num_connections == 0) {
 		spdk_nvmf_session_destruct(session);
 	}
 }
 
+static void
+nvmf_handle_conn_removed(spdk_event_t event)
+{
+	struct nvmf_session	*session = spdk_event_get_arg1(event);
+	struct spdk_nvmf_conn	*conn = spdk_event_get_arg2(event);
+
+	nvmf_conn_remove(session, conn);
+}
+
+void
+nvmf_disconnect(struct nvmf_session *session,
+		struct spdk_nvmf_conn *conn)
+{
+	spdk_event_t event;
+
+	if (conn->state != CONN_STATE_RUNNING) {
+		/* Teardown is already in progress. */
+		return;
+	}
+	conn->state = CONN_STATE_EXITING;
+
+	if (conn->transport_polled) {
+		/*
+		 * The connection stays on the session list until the transport
+		 * has stopped processing it on its core, so the session outlives
+		 * any request still being started there.
+		 */
+		event = spdk_event_allocate(session->subsys->lcore, nvmf_handle_conn_removed,
+					    session, conn, NULL);
+		conn->transport->conn_stop(conn, event);
+	} else {
+		nvmf_conn_remove(session, conn);
+	}
+}
+
 static uint64_t
 nvmf_prop_get_cap(struct nvmf_session *session)
 {
@@ -534,6 +642,11 @@ spdk_nvmf_session_poll(struct nvmf_session *session)
 	struct spdk_nvmf_conn	*conn, *tmp;
 
 	TAILQ_FOREACH_SAFE(conn, &session->connections, link, tmp) {
+		if (conn->transport_polled) {
+			/* Polled by the transport on the connection's own core. */
+			continue;
+		}
+
 		if (conn->transport->conn_poll(conn) < 0) {
 			SPDK_ERRLOG("Transport poll failed for conn %p; closing connection\n", conn);
 			nvmf_disconnect(session, conn);
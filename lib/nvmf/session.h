@@ -38,12 +38,14 @@
 #include <stdbool.h>
 
 #include "request.h"
+#include "spdk/event.h"
 #include "spdk/nvmf_spec.h"
 #include "spdk/queue.h"
 
 /* define a virtual controller limit to the number of QPs supported */
 #define MAX_SESSION_IO_QUEUES 64
 
+struct spdk_nvme_qpair;
 struct spdk_nvmf_transport;
 
 enum conn_type {
@@ -51,13 +53,32 @@ enum conn_type {
 	CONN_TYPE_IOQ = 1,
 };
 
+enum conn_state {
+	CONN_STATE_INVALID = 0,
+	CONN_STATE_RUNNING = 1,
+	CONN_STATE_EXITING = 2,
+};
+
 struct spdk_nvmf_conn {
 	const struct spdk_nvmf_transport	*transport;
 	struct nvmf_session			*sess;
 	enum conn_type				type;
+	enum conn_state				state;
 
 	uint16_t				sq_head;
 
+	/*
+	 * Core that processes this connection's requests.  Transports that
+	 * poll I/O connections themselves set transport_polled and lcore when
+	 * the connection is accepted.  All other connections are polled along
+	 * with their session on the subsystem's core.
+	 */
+	uint32_t				lcore;
+	bool					transport_polled;
+
+	/* Backend NVMe queue pair used by this I/O connection (Direct mode). */
+	struct spdk_nvme_qpair			*io_qpair;
+
 	TAILQ_ENTRY(spdk_nvmf_conn) 		link;
 };
 
@@ -31,45 +31,96 @@
  *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <assert.h>
 #include <ctype.h>
 
 #include "nvmf_internal.h"
 #include "session.h"
 #include "subsystem.h"
 #include "transport.h"
+#include "spdk/bdev.h"
 #include "spdk/log.h"
 #include "spdk/string.h"
 #include "spdk/trace.h"
 #include "spdk/nvmf_spec.h"
 
+/* Number of buckets in the subsystem NQN hash; must be a power of 2. */
+#define NVMF_SUBSYSTEM_HASH_SIZE 1024
+
 static TAILQ_HEAD(, spdk_nvmf_subsystem) g_subsystems = TAILQ_HEAD_INITIALIZER(g_subsystems);
+static TAILQ_HEAD(, spdk_nvmf_subsystem) g_subsystem_hash[NVMF_SUBSYSTEM_HASH_SIZE];
+
+/* Subsystems that have been deleted but are still waiting for their teardown */
+static uint32_t g_num_deleting_subsystems;
+
+/* FNV-1a over the lower-cased NQN, since NQNs are compared case-insensitively. */
+static uint32_t
+nvmf_nqn_hash(const char *nqn)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*nqn) {
+		hash ^= (uint8_t)tolower(*nqn++);
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static struct spdk_nvmf_subsystem *
+nvmf_subsystem_lookup(const char *subnqn)
+{
+	struct spdk_nvmf_subsystem *subsystem;
+
+	TAILQ_FOREACH(subsystem, &g_subsystem_hash[nvmf_nqn_hash(subnqn) & (NVMF_SUBSYSTEM_HASH_SIZE - 1)],
+		      hash_link) {
+		if (strcasecmp(subnqn, subsystem->subnqn) == 0) {
+			return subsystem;
+		}
+	}
+
+	return NULL;
+}
+
+static struct spdk_nvmf_host *
+nvmf_subsystem_lookup_host(struct spdk_nvmf_subsystem *subsystem, const char *hostnqn)
+{
+	struct spdk_nvmf_host *host;
+
+	TAILQ_FOREACH(host, &subsystem->host_hash[nvmf_nqn_hash(hostnqn) & (NVMF_HOST_HASH_SIZE - 1)],
+		      hash_link) {
+		if (strcasecmp(hostnqn, host->nqn) == 0) {
+			return host;
+		}
+	}
+
+	return NULL;
+}
 
 struct spdk_nvmf_subsystem *
 nvmf_find_subsystem(const char *subnqn, const char *hostnqn)
 {
 	struct spdk_nvmf_subsystem	*subsystem;
-	struct spdk_nvmf_host		*host;
 
 	if (!subnqn || !hostnqn) {
 		return NULL;
 	}
 
-	TAILQ_FOREACH(subsystem, &g_subsystems, entries) {
-		if (strcasecmp(subnqn, subsystem->subnqn) == 0) {
-			if (subsystem->num_hosts == 0) {
-				/* No hosts means any host can connect */
-				return subsystem;
-			}
+	subsystem = nvmf_subsystem_lookup(subnqn);
+	if (subsystem == NULL) {
+		return NULL;
+	}
 
-			TAILQ_FOREACH(host, &subsystem->hosts, link) {
-				if (strcasecmp(hostnqn, host->nqn) == 0) {
-					return subsystem;
-				}
-			}
-		}
+	if (subsystem->num_hosts == 0) {
+		/* No hosts means any host can connect */
+		return subsystem;
 	}
 
-	return NULL;
+	if (nvmf_subsystem_lookup_host(subsystem, hostnqn) == NULL) {
+		return NULL;
+	}
+
+	return subsystem;
 }
 
 static void
@@ -83,13 +134,16 @@ spdk_nvmf_subsystem_poller(void *arg)
 		return;
 	}
 
-	/* For NVMe subsystems, check the backing physical device for completions. */
-	if (subsystem->subtype == SPDK_NVMF_SUBTYPE_NVME) {
+	/*
+	 * For Direct mode NVMe subsystems, check the backing physical device for admin
+	 * completions.  I/O queue pairs have pollers of their own on the cores that use them.
+	 */
+	if (subsystem->subtype == SPDK_NVMF_SUBTYPE_NVME &&
+	    subsystem->mode == NVMF_SUBSYSTEM_MODE_DIRECT) {
 		spdk_nvme_ctrlr_process_admin_completions(subsystem->ctrlr);
-		spdk_nvme_qpair_process_completions(subsystem->io_qpair, 0);
 	}
 
-	/* For each connection in the session, check for RDMA completions */
+	/* Check the session's admin connection for transport completions */
 	spdk_nvmf_session_poll(session);
 }
 
@@ -99,6 +153,12 @@ nvmf_create_subsystem(int num, const char *name,
 		      uint32_t lcore)
 {
 	struct spdk_nvmf_subsystem	*subsystem;
+	uint32_t			i;
+
+	if (nvmf_subsystem_lookup(name) != NULL) {
+		SPDK_ERRLOG("Subsystem %s already exists\n", name);
+		return NULL;
+	}
 
 	subsystem = calloc(1, sizeof(struct spdk_nvmf_subsystem));
 	if (subsystem == NULL) {
@@ -110,23 +170,143 @@ nvmf_create_subsystem(int num, const char *name,
 	subsystem->num = num;
 	subsystem->subtype = subtype;
 	snprintf(subsystem->subnqn, sizeof(subsystem->subnqn), "%s", name);
+	/* Default serial number reported by Virtual mode subsystems */
+	snprintf(subsystem->sn, sizeof(subsystem->sn), "SPDK%08d", num);
 	TAILQ_INIT(&subsystem->listen_addrs);
 	TAILQ_INIT(&subsystem->hosts);
+	for (i = 0; i < NVMF_HOST_HASH_SIZE; i++) {
+		TAILQ_INIT(&subsystem->host_hash[i]);
+	}
+	TAILQ_INIT(&subsystem->io_qpairs);
 
+	subsystem->lcore = lcore;
 	subsystem->poller.fn = spdk_nvmf_subsystem_poller;
 	subsystem->poller.arg = subsystem;
-	spdk_poller_register(&subsystem->poller, lcore, NULL);
 
 	TAILQ_INSERT_HEAD(&g_subsystems, subsystem, entries);
+	TAILQ_INSERT_HEAD(&g_subsystem_hash[nvmf_nqn_hash(subsystem->subnqn) & (NVMF_SUBSYSTEM_HASH_SIZE -
+			  1)], subsystem, hash_link);
 
 	return subsystem;
 }
 
+void
+nvmf_subsystem_start_poller(struct spdk_nvmf_subsystem *subsystem)
+{
+	if (subsystem->poller_active) {
+		return;
+	}
+
+	subsystem->poller_active = true;
+	spdk_poller_register(&subsystem->poller, subsystem->lcore, NULL);
+}
+
+void
+nvmf_subsystem_stop_poller(struct spdk_nvmf_subsystem *subsystem)
+{
+	if (!subsystem->poller_active) {
+		return;
+	}
+
+	/*
+	 * A new session registers the poller again with an event queued behind
+	 * this one on the same core, so the two cannot overlap.
+	 */
+	subsystem->poller_active = false;
+	spdk_poller_unregister(&subsystem->poller, NULL);
+}
+
+static void
+nvmf_io_qpair_poller(void *arg)
+{
+	struct spdk_nvmf_io_qpair *io_qpair = arg;
+
+	spdk_nvme_qpair_process_completions(io_qpair->qpair, 0);
+}
+
+static void
+nvmf_subsystem_free(spdk_event_t event)
+{
+	struct spdk_nvmf_subsystem	*subsystem = spdk_event_get_arg1(event);
+	uint32_t			i;
+
+	/* Every backend queue pair has been freed, so the controller can go. */
+	if (subsystem->ctrlr) {
+		spdk_nvme_detach(subsystem->ctrlr);
+	}
+
+	for (i = 0; i < subsystem->ns_count; i++) {
+		subsystem->ns_list[i]->claimed = false;
+	}
+
+	free(subsystem);
+	g_num_deleting_subsystems--;
+}
+
+/*
+ * Finish deleting a subsystem once its session is gone and the last of its
+ * queue pairs has been freed.  The subsystem itself is freed by an event on
+ * its core, queued behind the one that unregisters its poller.
+ */
+static void
+nvmf_subsystem_try_free(struct spdk_nvmf_subsystem *subsystem)
+{
+	spdk_event_t event;
+
+	if (!subsystem->deleting || subsystem->session != NULL ||
+	    subsystem->num_io_qpair_frees != 0 || subsystem->freeing) {
+		return;
+	}
+
+	subsystem->freeing = true;
+	event = spdk_event_allocate(subsystem->lcore, nvmf_subsystem_free, subsystem, NULL, NULL);
+	spdk_event_call(event);
+}
+
+static void
+nvmf_io_qpair_free(spdk_event_t event)
+{
+	struct spdk_nvmf_subsystem	*subsystem = spdk_event_get_arg1(event);
+	struct spdk_nvmf_io_qpair	*io_qpair = spdk_event_get_arg2(event);
+
+	spdk_nvme_ctrlr_free_io_qpair(io_qpair->qpair);
+	free(io_qpair);
+
+	assert(subsystem->num_io_qpair_frees > 0);
+	subsystem->num_io_qpair_frees--;
+	nvmf_subsystem_try_free(subsystem);
+}
+
+static void
+nvmf_io_qpair_put(struct spdk_nvmf_subsystem *subsystem, struct spdk_nvmf_io_qpair *io_qpair)
+{
+	spdk_event_t event;
+
+	TAILQ_REMOVE(&subsystem->io_qpairs, io_qpair, link);
+	subsystem->num_io_qpairs--;
+
+	/* Free the queue pair only once its poller is off its core. */
+	subsystem->num_io_qpair_frees++;
+	event = spdk_event_allocate(subsystem->lcore, nvmf_io_qpair_free, subsystem, io_qpair, NULL);
+	spdk_poller_unregister(&io_qpair->poller, event);
+}
+
+void
+nvmf_subsystem_remove_session(struct spdk_nvmf_subsystem *subsystem)
+{
+	subsystem->session = NULL;
+	nvmf_subsystem_stop_poller(subsystem);
+	nvmf_subsystem_try_free(subsystem);
+}
+
 int
 nvmf_delete_subsystem(struct spdk_nvmf_subsystem *subsystem)
 {
 	struct spdk_nvmf_listen_addr	*listen_addr, *listen_addr_tmp;
 	struct spdk_nvmf_host		*host, *host_tmp;
+	struct spdk_nvmf_io_qpair	*io_qpair, *io_qpair_tmp;
+	struct spdk_nvmf_conn		*conn;
+	struct nvmf_session		*session;
 
 	if (subsystem == NULL) {
 		SPDK_TRACELOG(SPDK_TRACE_NVMF,
@@ -134,6 +314,13 @@ nvmf_delete_subsystem(struct spdk_nvmf_subsystem *subsystem)
 		return 0;
 	}
 
+	/* Hosts can no longer find the subsystem to connect to it. */
+	TAILQ_REMOVE(&g_subsystems, subsystem, entries);
+	TAILQ_REMOVE(&g_subsystem_hash[nvmf_nqn_hash(subsystem->subnqn) & (NVMF_SUBSYSTEM_HASH_SIZE - 1)],
+		     subsystem, hash_link);
+	subsystem->deleting = true;
+	g_num_deleting_subsystems++;
+
 	TAILQ_FOREACH_SAFE(listen_addr, &subsystem->listen_addrs, link, listen_addr_tmp) {
 		TAILQ_REMOVE(&subsystem->listen_addrs, listen_addr, link);
 		free(listen_addr->traddr);
@@ -144,22 +331,38 @@ nvmf_delete_subsystem(struct spdk_nvmf_subsystem *subsystem)
 
 	TAILQ_FOREACH_SAFE(host, &subsystem->hosts, link, host_tmp) {
 		TAILQ_REMOVE(&subsystem->hosts, host, link);
+		TAILQ_REMOVE(&subsystem->host_hash[nvmf_nqn_hash(host->nqn) & (NVMF_HOST_HASH_SIZE - 1)],
+			     host, hash_link);
 		free(host->nqn);
 		free(host);
 		subsystem->num_hosts--;
 	}
 
-	if (subsystem->session) {
-		spdk_nvmf_session_destruct(subsystem->session);
+	/*
+	 * Disconnect every connection the way a host disconnect would.  Those
+	 * that a transport polls on another core are stopped there first, and
+	 * the session goes away along with its last connection.  Disconnecting
+	 * may free the session, so look it up again each time.
+	 */
+	while ((session = subsystem->session) != NULL) {
+		TAILQ_FOREACH(conn, &session->connections, link) {
+			if (conn->state == CONN_STATE_RUNNING) {
+				break;
+			}
+		}
+		if (conn == NULL) {
+			/* The rest are already being torn down. */
+			break;
+		}
+		nvmf_disconnect(session, conn);
 	}
 
-	if (subsystem->ctrlr) {
-		spdk_nvme_detach(subsystem->ctrlr);
+	/* Queue pairs are normally released with their connections. */
+	TAILQ_FOREACH_SAFE(io_qpair, &subsystem->io_qpairs, link, io_qpair_tmp) {
+		nvmf_io_qpair_put(subsystem, io_qpair);
 	}
 
-	TAILQ_REMOVE(&g_subsystems, subsystem, entries);
-
-	free(subsystem);
+	nvmf_subsystem_try_free(subsystem);
 	return 0;
 }
 
@@ -181,15 +384,55 @@ spdk_nvmf_subsystem_add_listener(struct spdk_nvmf_subsystem *subsystem,
 	return 0;
 }
 
+int
+spdk_nvmf_foreach_listen_addr(const struct spdk_nvmf_transport *transport,
+			      int (*fn)(struct spdk_nvmf_listen_addr *listen_addr, void *ctx),
+			      void *ctx)
+{
+	struct spdk_nvmf_subsystem	*subsystem;
+	struct spdk_nvmf_listen_addr	*listen_addr;
+	int				rc;
+
+	TAILQ_FOREACH(subsystem, &g_subsystems, entries) {
+		TAILQ_FOREACH(listen_addr, &subsystem->listen_addrs, link) {
+			if (listen_addr->transport != transport) {
+				continue;
+			}
+
+			rc = fn(listen_addr, ctx);
+			if (rc != 0) {
+				return rc;
+			}
+		}
+	}
+
+	return 0;
+}
+
 int
 spdk_nvmf_subsystem_add_host(struct spdk_nvmf_subsystem *subsystem, char *host_nqn)
 {
 	struct spdk_nvmf_host *host;
 
+	if (nvmf_subsystem_lookup_host(subsystem, host_nqn) != NULL) {
+		/* Already allowed */
+		return 0;
+	}
+
 	host = calloc(1, sizeof(*host));
+	if (host == NULL) {
+		return -1;
+	}
+
 	host->nqn = strdup(host_nqn);
+	if (host->nqn == NULL) {
+		free(host);
+		return -1;
+	}
 
 	TAILQ_INSERT_HEAD(&subsystem->hosts, host, link);
+	TAILQ_INSERT_HEAD(&subsystem->host_hash[nvmf_nqn_hash(host->nqn) & (NVMF_HOST_HASH_SIZE - 1)],
+			  host, hash_link);
 	subsystem->num_hosts++;
 
 	return 0;
@@ -201,16 +444,139 @@ nvmf_subsystem_add_ctrlr(struct spdk_nvmf_subsystem *subsystem,
 {
 	subsystem->ctrlr = ctrlr;
 
-	/* Assume that all I/O will be handled on one thread for now */
-	subsystem->io_qpair = spdk_nvme_ctrlr_alloc_io_qpair(ctrlr, 0);
-	if (subsystem->io_qpair == NULL) {
-		SPDK_ERRLOG("spdk_nvme_ctrlr_alloc_io_qpair() failed\n");
+	/* I/O queue pairs are allocated per connection in nvmf_subsystem_assign_conn(). */
+	return 0;
+}
+
+int
+nvmf_subsystem_add_ns(struct spdk_nvmf_subsystem *subsystem, struct spdk_bdev *bdev)
+{
+	if (subsystem->ns_count >= MAX_VIRTUAL_NAMESPACE) {
+		SPDK_ERRLOG("Subsystem %s: too many namespaces (max %d)\n",
+			    subsystem->subnqn, MAX_VIRTUAL_NAMESPACE);
+		return -1;
+	}
+
+	if (bdev->claimed) {
+		SPDK_ERRLOG("Subsystem %s: bdev %s is already claimed\n",
+			    subsystem->subnqn, bdev->name);
+		return -1;
+	}
+
+	bdev->claimed = true;
+	subsystem->ns_list[subsystem->ns_count++] = bdev;
+
+	SPDK_TRACELOG(SPDK_TRACE_NVMF, "Subsystem %s: namespace %u is bdev %s\n",
+		      subsystem->subnqn, subsystem->ns_count, bdev->name);
+
+	return 0;
+}
+
+int
+nvmf_subsystem_set_sn(struct spdk_nvmf_subsystem *subsystem, const char *sn)
+{
+	if (strlen(sn) > MAX_SN_LEN) {
+		SPDK_ERRLOG("Subsystem %s: serial number '%s' is longer than %d characters\n",
+			    subsystem->subnqn, sn, MAX_SN_LEN);
+		return -1;
+	}
+
+	snprintf(subsystem->sn, sizeof(subsystem->sn), "%s", sn);
+	return 0;
+}
+
+int
+nvmf_subsystem_assign_conn(struct spdk_nvmf_subsystem *subsystem,
+			   struct spdk_nvmf_conn *conn)
+{
+	struct spdk_nvmf_io_qpair	*io_qpair, *shared;
+	struct spdk_nvme_qpair		*qpair;
+
+	conn->io_qpair = NULL;
+
+	if (subsystem->ctrlr == NULL) {
+		return 0;
+	}
+
+	qpair = spdk_nvme_ctrlr_alloc_io_qpair(subsystem->ctrlr, 0);
+	if (qpair != NULL) {
+		io_qpair = calloc(1, sizeof(*io_qpair));
+		if (io_qpair == NULL) {
+			spdk_nvme_ctrlr_free_io_qpair(qpair);
+			return -1;
+		}
+
+		io_qpair->qpair = qpair;
+		io_qpair->lcore = conn->lcore;
+		io_qpair->num_conns = 1;
+		TAILQ_INSERT_TAIL(&subsystem->io_qpairs, io_qpair, link);
+		subsystem->num_io_qpairs++;
+
+		io_qpair->poller.fn = nvmf_io_qpair_poller;
+		io_qpair->poller.arg = io_qpair;
+		spdk_poller_register(&io_qpair->poller, io_qpair->lcore, NULL);
+
+		conn->io_qpair = qpair;
+		return 0;
+	}
+
+	/*
+	 * The controller is out of I/O queue pairs.  Share the least used one
+	 * that is already polled on the connection's core.
+	 */
+	shared = NULL;
+	TAILQ_FOREACH(io_qpair, &subsystem->io_qpairs, link) {
+		if (io_qpair->lcore != conn->lcore) {
+			continue;
+		}
+
+		if (shared == NULL || io_qpair->num_conns < shared->num_conns) {
+			shared = io_qpair;
+		}
+	}
+
+	if (shared == NULL) {
+		SPDK_ERRLOG("Subsystem %s: no backend I/O queue pairs available on lcore %u\n",
+			    subsystem->subnqn, conn->lcore);
 		return -1;
 	}
 
+	SPDK_TRACELOG(SPDK_TRACE_NVMF, "Sharing backend qpair %p (%u conns) on lcore %u\n",
+		      shared->qpair, shared->num_conns, shared->lcore);
+
+	shared->num_conns++;
+	conn->io_qpair = shared->qpair;
 	return 0;
 }
 
+void
+nvmf_subsystem_release_conn(struct spdk_nvmf_subsystem *subsystem,
+			    struct spdk_nvmf_conn *conn)
+{
+	struct spdk_nvmf_io_qpair *io_qpair;
+
+	if (conn->io_qpair == NULL) {
+		return;
+	}
+
+	TAILQ_FOREACH(io_qpair, &subsystem->io_qpairs, link) {
+		if (io_qpair->qpair == conn->io_qpair) {
+			break;
+		}
+	}
+	conn->io_qpair = NULL;
+
+	if (io_qpair == NULL) {
+		SPDK_ERRLOG("Connection %p qpair not found in subsystem %s\n", conn, subsystem->subnqn);
+		return;
+	}
+
+	assert(io_qpair->num_conns > 0);
+	if (--io_qpair->num_conns == 0) {
+		nvmf_io_qpair_put(subsystem, io_qpair);
+	}
+}
+
 void
 spdk_format_discovery_log(struct spdk_nvmf_discovery_log_page *disc_log, uint32_t length)
 {
@@ -249,13 +615,26 @@ spdk_format_discovery_log(struct spdk_nvmf_discovery_log_page *disc_log, uint32_
 int
 spdk_shutdown_nvmf_subsystems(void)
 {
-	struct spdk_nvmf_subsystem *subsystem;
+	struct spdk_nvmf_subsystem	*subsystem;
+	uint64_t			core_mask = spdk_app_get_core_mask();
+	uint32_t			lcore;
 
 	while (!TAILQ_EMPTY(&g_subsystems)) {
 		subsystem = TAILQ_FIRST(&g_subsystems);
-		TAILQ_REMOVE(&g_subsystems, subsystem, entries);
 		nvmf_delete_subsystem(subsystem);
 	}
 
+	/*
+	 * The reactors have already stopped when the target shuts down, so run
+	 * the teardown events queued on each core here until it is finished.
+	 */
+	while (g_num_deleting_subsystems > 0) {
+		for (lcore = 0; lcore < 64; lcore++) {
+			if (core_mask & (1ULL << lcore)) {
+				spdk_event_queue_run_all(lcore);
+			}
+		}
+	}
+
 	return 0;
 }
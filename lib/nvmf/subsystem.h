@@ -40,9 +40,15 @@
 #include "spdk/nvme.h"
 #include "spdk/queue.h"
 
+struct spdk_bdev;
 struct spdk_nvmf_conn;
 
 #define MAX_NQN_SIZE 255
+#define MAX_VIRTUAL_NAMESPACE 16
+#define MAX_SN_LEN 20
+
+/* Number of buckets in the per-subsystem allowed host hash */
+#define NVMF_HOST_HASH_SIZE 16
 
 enum spdk_nvmf_subsystem_mode {
 	NVMF_SUBSYSTEM_MODE_DIRECT	= 0,
@@ -59,6 +65,20 @@ struct spdk_nvmf_listen_addr {
 struct spdk_nvmf_host {
 	char				*nqn;
 	TAILQ_ENTRY(spdk_nvmf_host)	link;
+	TAILQ_ENTRY(spdk_nvmf_host)	hash_link;
+};
+
+/*
+ * Backend NVMe I/O queue pair of a Direct mode subsystem.  A queue pair is
+ * only ever used from the core in lcore, where its poller runs; once the
+ * controller runs out of queue pairs, connections on the same core share one.
+ */
+struct spdk_nvmf_io_qpair {
+	struct spdk_nvme_qpair			*qpair;
+	uint32_t				lcore;
+	uint32_t				num_conns;
+	struct spdk_poller			poller;
+	TAILQ_ENTRY(spdk_nvmf_io_qpair)		link;
 };
 
 /*
@@ -72,18 +92,44 @@ struct spdk_nvmf_subsystem {
 	enum spdk_nvmf_subsystem_mode mode;
 	enum spdk_nvmf_subtype subtype;
 	struct nvmf_session *session;
+
+	/* Direct mode: the physical controller commands are passed through to */
 	struct spdk_nvme_ctrlr *ctrlr;
-	struct spdk_nvme_qpair *io_qpair;
 
+	/* Virtual mode: namespace ID n is backed by ns_list[n - 1] */
+	struct spdk_bdev	*ns_list[MAX_VIRTUAL_NAMESPACE];
+	uint32_t		ns_count;
+	char			sn[MAX_SN_LEN + 1];
+
+	/* Core that handles connects and admin commands for the subsystem */
+	uint32_t		lcore;
+
+	/* Polls the session; only registered while a session exists. */
 	struct spdk_poller	poller;
+	bool			poller_active;
+
+	TAILQ_HEAD(, spdk_nvmf_io_qpair)	io_qpairs;
+	uint32_t				num_io_qpairs;
+
+	/* Queue pairs released but not yet freed on the subsystem's core */
+	uint32_t				num_io_qpair_frees;
+
+	/*
+	 * Set by nvmf_delete_subsystem().  The controller is detached and the
+	 * subsystem freed once the session and all queue pairs are gone.
+	 */
+	bool					deleting;
+	bool					freeing;
 
 	TAILQ_HEAD(, spdk_nvmf_listen_addr)	listen_addrs;
 	uint32_t				num_listen_addrs;
 
 	TAILQ_HEAD(, spdk_nvmf_host)		hosts;
+	TAILQ_HEAD(, spdk_nvmf_host)		host_hash[NVMF_HOST_HASH_SIZE];
 	uint32_t				num_hosts;
 
 	TAILQ_ENTRY(spdk_nvmf_subsystem) entries;
+	TAILQ_ENTRY(spdk_nvmf_subsystem) hash_link;
 };
 
 struct spdk_nvmf_subsystem *
@@ -91,6 +137,11 @@ nvmf_create_subsystem(int num, const char *name,
 		      enum spdk_nvmf_subtype subtype,
 		      uint32_t lcore);
 
+/*
+ * Disconnect the subsystem's connections and free it.  The subsystem is
+ * unlisted immediately; the rest happens asynchronously on the cores that
+ * own the connections and queue pairs.
+ */
 int
 nvmf_delete_subsystem(struct spdk_nvmf_subsystem *subsystem);
 
@@ -106,10 +157,60 @@ int
 spdk_nvmf_subsystem_add_host(struct spdk_nvmf_subsystem *subsystem,
 			     char *host_nqn);
 
+/*
+ * Start and stop polling the subsystem's session on subsystem->lcore.  Called
+ * on that core when a session is created and destroyed, so that subsystems
+ * without a session cost their core nothing.
+ */
+void
+nvmf_subsystem_start_poller(struct spdk_nvmf_subsystem *subsystem);
+
+void
+nvmf_subsystem_stop_poller(struct spdk_nvmf_subsystem *subsystem);
+
+/*
+ * Called on subsystem->lcore when the subsystem's session has been destroyed.
+ * Stops the poller and lets a pending nvmf_delete_subsystem() finish.
+ */
+void
+nvmf_subsystem_remove_session(struct spdk_nvmf_subsystem *subsystem);
+
+/*
+ * Call fn for every listen address of every subsystem that uses transport,
+ * stopping at the first call that returns non-zero.  Returns that value, or 0.
+ */
+int
+spdk_nvmf_foreach_listen_addr(const struct spdk_nvmf_transport *transport,
+			      int (*fn)(struct spdk_nvmf_listen_addr *listen_addr, void *ctx),
+			      void *ctx);
+
 int
 nvmf_subsystem_add_ctrlr(struct spdk_nvmf_subsystem *subsystem,
 			 struct spdk_nvme_ctrlr *ctrlr);
 
+/*
+ * Add bdev as the next namespace of a Virtual mode subsystem.  The bdev is
+ * claimed for the lifetime of the subsystem.
+ */
+int
+nvmf_subsystem_add_ns(struct spdk_nvmf_subsystem *subsystem, struct spdk_bdev *bdev);
+
+int
+nvmf_subsystem_set_sn(struct spdk_nvmf_subsystem *subsystem, const char *sn);
+
+/*
+ * Set up the backend I/O queue pair of a new I/O connection on conn->lcore
+ * (Direct mode only).  Returns 0 on success, or -1 if no queue pair could be
+ * assigned.
+ */
+int
+nvmf_subsystem_assign_conn(struct spdk_nvmf_subsystem *subsystem,
+			   struct spdk_nvmf_conn *conn);
+
+void
+nvmf_subsystem_release_conn(struct spdk_nvmf_subsystem *subsystem,
+			    struct spdk_nvmf_conn *conn);
+
 int
 spdk_shutdown_nvmf_subsystems(void);
 
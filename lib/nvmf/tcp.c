@@ -0,0 +1,1385 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <rte_config.h>
+#include <rte_cycles.h>
+#include <rte_timer.h>
+#include <rte_lcore.h>
+#include <rte_mempool.h>
+#include <rte_version.h>
+
+#include "nvmf_internal.h"
+#include "request.h"
+#include "session.h"
+#include "subsystem.h"
+#include "transport.h"
+#include "spdk/event.h"
+#include "spdk/log.h"
+#include "spdk/nvmf_spec.h"
+
+/*
+ * NVMe/TCP transport.
+ *
+ * Each connection is a non-blocking socket.  Until its CONNECT capsule has
+ * been processed, a connection is polled by the acceptor along with the
+ * listening sockets.  Afterwards, admin queues are polled with their session
+ * and I/O queues by a poller of their own on a core picked when the CONNECT
+ * arrives.
+ *
+ * Header and data digests are not supported, and the target never asks for
+ * PDU data alignment.  Data is received directly into buffers from shared
+ * pools once the PDU headers in front of it have been parsed, and PDUs are
+ * sent with sendmsg() straight from the header and data buffers, gathering
+ * everything queued on a connection into one call per poll.
+ */
+
+#define ACCEPT_TIMEOUT (rte_get_timer_hz() >> 10) /* ~1ms */
+
+#define NVMF_TCP_LISTEN_BACKLOG		512
+
+/* Largest PDU header (ICReq) */
+#define NVMF_TCP_PDU_MAX_HDR_LEN	128
+
+/* Bytes read from the socket at a time when parsing PDU headers */
+#define NVMF_TCP_RECV_BUF_SIZE		8192
+
+/* Maximum number of PDUs received from one connection per poll */
+#define NVMF_TCP_MAX_RECV_PDUS		32
+
+/* Maximum number of iovecs passed to a single sendmsg() */
+#define NVMF_TCP_MAX_SEND_IOVS		32
+
+#define NVMF_TCP_SMALL_BUF_MAX_SIZE	8192
+#define NVMF_TCP_LARGE_BUF_MAX_SIZE	SPDK_NVMF_MAX_RECV_DATA_TRANSFER_SIZE
+#define NVMF_TCP_SMALL_BUF_POOL_SIZE	8192
+#define NVMF_TCP_LARGE_BUF_POOL_SIZE	1024
+
+struct spdk_nvmf_tcp_request;
+
+/* A PDU queued for sending */
+struct spdk_nvmf_tcp_pdu {
+	union {
+		uint8_t					raw[NVMF_TCP_PDU_MAX_HDR_LEN];
+		struct spdk_nvme_tcp_common_pdu_hdr	common;
+		struct spdk_nvme_tcp_ic_req		ic_req;
+		struct spdk_nvme_tcp_ic_resp		ic_resp;
+		struct spdk_nvme_tcp_term_req_hdr	term_req;
+		struct spdk_nvme_tcp_cmd		capsule_cmd;
+		struct spdk_nvme_tcp_rsp		capsule_resp;
+		struct spdk_nvme_tcp_h2c_data_hdr	h2c_data;
+		struct spdk_nvme_tcp_c2h_data_hdr	c2h_data;
+		struct spdk_nvme_tcp_r2t_hdr		r2t;
+	} hdr;
+
+	/* Header and, optionally, data */
+	struct iovec					iov[2];
+	int						iovcnt;
+	uint32_t					len;
+
+	/* Request released once this PDU has been sent */
+	struct spdk_nvmf_tcp_request			*release_req;
+
+	STAILQ_ENTRY(spdk_nvmf_tcp_pdu)			link;
+};
+
+struct spdk_nvmf_tcp_request {
+	struct spdk_nvmf_request		req;
+	union nvmf_h2c_msg			cmd;
+	union nvmf_c2h_msg			rsp;
+
+	/* Transfer tag sent in R2T PDUs: index of the request */
+	uint16_t				ttag;
+
+	/* Data buffer and the pool it came from */
+	void					*buf;
+	struct rte_mempool			*buf_pool;
+
+	/* Bytes of in-capsule data, or of H2C data received so far */
+	uint32_t				in_capsule_len;
+	uint32_t				h2c_offset;
+	bool					awaiting_h2c;
+
+	/* R2T or C2HData, then CapsuleResp */
+	struct spdk_nvmf_tcp_pdu		data_pdu;
+	struct spdk_nvmf_tcp_pdu		rsp_pdu;
+
+	STAILQ_ENTRY(spdk_nvmf_tcp_request)	link;
+};
+
+enum nvmf_tcp_recv_state {
+	/* Receiving the common header */
+	NVMF_TCP_RECV_CH,
+
+	/* Receiving the rest of the PDU header */
+	NVMF_TCP_RECV_PSH,
+
+	/* Header parsed; waiting for a data buffer */
+	NVMF_TCP_RECV_AWAIT_BUF,
+
+	/* Skipping the bytes between the header and the data */
+	NVMF_TCP_RECV_PAD,
+
+	/* Receiving PDU data */
+	NVMF_TCP_RECV_PAYLOAD,
+};
+
+struct spdk_nvmf_tcp_conn {
+	struct spdk_nvmf_conn			conn;
+
+	int					fd;
+	bool					ic_done;
+
+	uint16_t				queue_depth;
+	struct spdk_nvmf_tcp_request		*reqs;
+	STAILQ_HEAD(, spdk_nvmf_tcp_request)	free_reqs;
+
+	/* Receive side */
+	enum nvmf_tcp_recv_state		recv_state;
+	struct spdk_nvmf_tcp_pdu		recv_pdu;
+	uint32_t				recv_offset;
+	struct spdk_nvmf_tcp_request		*recv_req;
+	uint8_t					*payload;
+	uint32_t				payload_len;
+	uint32_t				pad_len;
+
+	/* Bytes read from the socket but not consumed yet */
+	uint32_t				rbuf_head;
+	uint32_t				rbuf_tail;
+	uint8_t					rbuf[NVMF_TCP_RECV_BUF_SIZE];
+
+	/* Send side */
+	STAILQ_HEAD(, spdk_nvmf_tcp_pdu)	send_queue;
+	uint32_t				send_offset;
+	struct spdk_nvmf_tcp_pdu		ic_resp_pdu;
+	struct spdk_nvmf_tcp_pdu		term_req_pdu;
+
+	/* Set while the CONNECT of a pending connection is being processed */
+	volatile bool				connecting;
+
+	/* Poller of a connection with its own core */
+	struct spdk_poller			poller;
+	bool					stopped;
+	bool					failed;
+
+	TAILQ_ENTRY(spdk_nvmf_tcp_conn)		link;
+};
+
+struct spdk_nvmf_tcp_listener {
+	int					fd;
+	char					*traddr;
+	char					*trsvc;
+	TAILQ_ENTRY(spdk_nvmf_tcp_listener)	link;
+};
+
+static struct {
+	TAILQ_HEAD(, spdk_nvmf_tcp_listener)	listeners;
+
+	/* Connections polled by the acceptor until they are connected */
+	TAILQ_HEAD(, spdk_nvmf_tcp_conn)	pending_conns;
+
+	struct rte_timer			acceptor_timer;
+	bool					started;
+
+	struct rte_mempool			*small_buf_pool;
+	struct rte_mempool			*large_buf_pool;
+} g_tcp = {
+	.listeners = TAILQ_HEAD_INITIALIZER(g_tcp.listeners),
+	.pending_conns = TAILQ_HEAD_INITIALIZER(g_tcp.pending_conns),
+};
+
+static inline struct spdk_nvmf_tcp_conn *
+get_tcp_conn(struct spdk_nvmf_conn *conn)
+{
+	return (struct spdk_nvmf_tcp_conn *)((uintptr_t)conn - offsetof(struct spdk_nvmf_tcp_conn, conn));
+}
+
+static inline struct spdk_nvmf_tcp_request *
+get_tcp_req(struct spdk_nvmf_request *req)
+{
+	return (struct spdk_nvmf_tcp_request *)((uintptr_t)req -
+			offsetof(struct spdk_nvmf_tcp_request, req));
+}
+
+/* Sending */
+
+static void
+nvmf_tcp_request_release(struct spdk_nvmf_tcp_conn *tconn, struct spdk_nvmf_tcp_request *tcp_req)
+{
+	if (tcp_req->buf != NULL) {
+		rte_mempool_put(tcp_req->buf_pool, tcp_req->buf);
+		tcp_req->buf = NULL;
+	}
+
+	tcp_req->req.data = NULL;
+	tcp_req->req.length = 0;
+	tcp_req->in_capsule_len = 0;
+	tcp_req->h2c_offset = 0;
+	tcp_req->awaiting_h2c = false;
+	STAILQ_INSERT_HEAD(&tconn->free_reqs, tcp_req, link);
+}
+
+static void
+nvmf_tcp_pdu_init(struct spdk_nvmf_tcp_pdu *pdu, uint8_t pdu_type, uint8_t hlen,
+		  void *data, uint32_t data_len)
+{
+	pdu->hdr.common.pdu_type = pdu_type;
+	pdu->hdr.common.flags = 0;
+	pdu->hdr.common.hlen = hlen;
+	pdu->hdr.common.pdo = data_len ? hlen : 0;
+	pdu->hdr.common.plen = hlen + data_len;
+
+	pdu->iov[0].iov_base = pdu->hdr.raw;
+	pdu->iov[0].iov_len = hlen;
+	pdu->iovcnt = 1;
+	if (data_len) {
+		pdu->iov[1].iov_base = data;
+		pdu->iov[1].iov_len = data_len;
+		pdu->iovcnt = 2;
+	}
+	pdu->len = hlen + data_len;
+	pdu->release_req = NULL;
+}
+
+static inline void
+nvmf_tcp_queue_pdu(struct spdk_nvmf_tcp_conn *tconn, struct spdk_nvmf_tcp_pdu *pdu)
+{
+	STAILQ_INSERT_TAIL(&tconn->send_queue, pdu, link);
+}
+
+/*
+ * Send as much of the queued PDUs as the socket accepts.  Returns 0, or -1 if
+ * the connection failed.
+ */
+static int
+nvmf_tcp_flush(struct spdk_nvmf_tcp_conn *tconn)
+{
+	struct iovec			iovs[NVMF_TCP_MAX_SEND_IOVS];
+	struct msghdr			msg = {};
+	struct spdk_nvmf_tcp_pdu	*pdu;
+	uint32_t			skip, remaining;
+	ssize_t				rc;
+	int				i, iovcnt;
+
+	while (!STAILQ_EMPTY(&tconn->send_queue)) {
+		/* Gather queued PDUs, leaving out what was already sent of the first. */
+		iovcnt = 0;
+		skip = tconn->send_offset;
+		STAILQ_FOREACH(pdu, &tconn->send_queue, link) {
+			if (iovcnt + pdu->iovcnt > NVMF_TCP_MAX_SEND_IOVS) {
+				break;
+			}
+
+			for (i = 0; i < pdu->iovcnt; i++) {
+				if (skip >= pdu->iov[i].iov_len) {
+					skip -= pdu->iov[i].iov_len;
+					continue;
+				}
+
+				iovs[iovcnt].iov_base = (uint8_t *)pdu->iov[i].iov_base + skip;
+				iovs[iovcnt].iov_len = pdu->iov[i].iov_len - skip;
+				iovcnt++;
+				skip = 0;
+			}
+		}
+
+		msg.msg_iov = iovs;
+		msg.msg_iovlen = iovcnt;
+		rc = sendmsg(tconn->fd, &msg, MSG_NOSIGNAL);
+		if (rc < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+				return 0;
+			}
+			SPDK_ERRLOG("sendmsg() failed on conn %p: %s\n", &tconn->conn, strerror(errno));
+			return -1;
+		}
+
+		/* Retire the PDUs that were sent completely. */
+		while ((pdu = STAILQ_FIRST(&tconn->send_queue)) != NULL) {
+			remaining = pdu->len - tconn->send_offset;
+			if ((size_t)rc < remaining) {
+				tconn->send_offset += rc;
+				/* The socket buffer is full. */
+				return 0;
+			}
+
+			rc -= remaining;
+			tconn->send_offset = 0;
+			STAILQ_REMOVE_HEAD(&tconn->send_queue, link);
+			if (pdu->release_req != NULL) {
+				nvmf_tcp_request_release(tconn, pdu->release_req);
+			}
+
+			if (rc == 0) {
+				break;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Report a fatal protocol error to the host.  The connection is closed by the
+ * caller once this returns.
+ */
+static void
+nvmf_tcp_send_term_req(struct spdk_nvmf_tcp_conn *tconn, enum spdk_nvme_tcp_term_req_fes fes,
+		       uint32_t fei)
+{
+	struct spdk_nvmf_tcp_pdu *pdu = &tconn->term_req_pdu;
+
+	SPDK_ERRLOG("Terminating conn %p: fes 0x%x fei 0x%x\n", &tconn->conn, fes, fei);
+
+	memset(&pdu->hdr, 0, sizeof(pdu->hdr));
+	nvmf_tcp_pdu_init(pdu, SPDK_NVME_TCP_PDU_TYPE_C2H_TERM_REQ,
+			  sizeof(struct spdk_nvme_tcp_term_req_hdr), NULL, 0);
+	pdu->hdr.term_req.fes = fes;
+	pdu->hdr.term_req.fei = fei;
+
+	nvmf_tcp_queue_pdu(tconn, pdu);
+	nvmf_tcp_flush(tconn);
+}
+
+static int
+spdk_nvmf_tcp_request_complete(struct spdk_nvmf_request *req)
+{
+	struct spdk_nvmf_tcp_request	*tcp_req = get_tcp_req(req);
+	struct spdk_nvmf_tcp_conn	*tconn = get_tcp_conn(req->conn);
+	struct spdk_nvme_cpl		*rsp = &req->rsp->nvme_cpl;
+	struct spdk_nvmf_tcp_pdu	*pdu;
+
+	if (req->xfer == SPDK_NVME_DATA_CONTROLLER_TO_HOST && req->length > 0 &&
+	    rsp->status.sc == SPDK_NVME_SC_SUCCESS) {
+		pdu = &tcp_req->data_pdu;
+		nvmf_tcp_pdu_init(pdu, SPDK_NVME_TCP_PDU_TYPE_C2H_DATA,
+				  sizeof(struct spdk_nvme_tcp_c2h_data_hdr), req->data, req->length);
+		pdu->hdr.common.flags = SPDK_NVME_TCP_DATA_FLAGS_LAST_PDU;
+		pdu->hdr.c2h_data.cccid = req->cmd->nvme_cmd.cid;
+		pdu->hdr.c2h_data.datao = 0;
+		pdu->hdr.c2h_data.datal = req->length;
+		nvmf_tcp_queue_pdu(tconn, pdu);
+	}
+
+	pdu = &tcp_req->rsp_pdu;
+	nvmf_tcp_pdu_init(pdu, SPDK_NVME_TCP_PDU_TYPE_CAPSULE_RESP,
+			  sizeof(struct spdk_nvme_tcp_rsp), NULL, 0);
+	memcpy(&pdu->hdr.capsule_resp.rccqe, rsp, sizeof(*rsp));
+	pdu->release_req = tcp_req;
+	nvmf_tcp_queue_pdu(tconn, pdu);
+
+	if (tconn->connecting) {
+		/*
+		 * The acceptor does not poll this connection until the CONNECT
+		 * completes, so send the response now.  Publish the session it set
+		 * up before handing the connection back.
+		 */
+		nvmf_tcp_flush(tconn);
+		rte_wmb();
+		tconn->connecting = false;
+	}
+
+	/* Otherwise everything queued is sent together on the next poll. */
+	return 0;
+}
+
+/* Receiving */
+
+/*
+ * Read up to len bytes into dst (or discard them if dst is NULL).  Small reads
+ * are served from a per-connection staging buffer so that PDU headers do not
+ * cost a system call each; large ones go straight to the destination buffer.
+ * Returns the number of bytes read, or -1 if the connection failed.
+ */
+static int
+nvmf_tcp_read(struct spdk_nvmf_tcp_conn *tconn, void *dst, uint32_t len)
+{
+	uint32_t	got = 0, n;
+	ssize_t		rc;
+
+	while (got < len) {
+		n = tconn->rbuf_tail - tconn->rbuf_head;
+		if (n > 0) {
+			n = nvmf_min(n, len - got);
+			if (dst != NULL) {
+				memcpy((uint8_t *)dst + got, tconn->rbuf + tconn->rbuf_head, n);
+			}
+			tconn->rbuf_head += n;
+			got += n;
+			continue;
+		}
+
+		tconn->rbuf_head = tconn->rbuf_tail = 0;
+		if (dst != NULL && len - got >= NVMF_TCP_RECV_BUF_SIZE / 2) {
+			rc = recv(tconn->fd, (uint8_t *)dst + got, len - got, 0);
+			if (rc > 0) {
+				got += rc;
+			}
+		} else {
+			rc = recv(tconn->fd, tconn->rbuf, sizeof(tconn->rbuf), 0);
+			if (rc > 0) {
+				tconn->rbuf_tail = rc;
+			}
+		}
+
+		if (rc == 0) {
+			SPDK_TRACELOG(SPDK_TRACE_TCP, "Host closed conn %p\n", &tconn->conn);
+			return -1;
+		} else if (rc < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+				break;
+			}
+			SPDK_ERRLOG("recv() failed on conn %p: %s\n", &tconn->conn, strerror(errno));
+			return -1;
+		}
+	}
+
+	return got;
+}
+
+static int
+nvmf_tcp_request_get_buf(struct spdk_nvmf_tcp_request *tcp_req, uint32_t length)
+{
+	struct rte_mempool *pool;
+
+	pool = length <= NVMF_TCP_SMALL_BUF_MAX_SIZE ? g_tcp.small_buf_pool : g_tcp.large_buf_pool;
+	if (rte_mempool_get(pool, &tcp_req->buf) != 0) {
+		tcp_req->buf = NULL;
+		return -1;
+	}
+
+	tcp_req->buf_pool = pool;
+	return 0;
+}
+
+static int
+nvmf_tcp_request_exec(struct spdk_nvmf_tcp_conn *tconn, struct spdk_nvmf_tcp_request *tcp_req)
+{
+	struct spdk_nvmf_conn	*conn = &tconn->conn;
+	struct spdk_nvmf_request *req = &tcp_req->req;
+
+	if (req->rsp->nvme_cpl.status.sc != SPDK_NVME_SC_SUCCESS) {
+		/* Rejected while parsing the capsule */
+		return spdk_nvmf_request_complete(req) < 0 ? -1 : 0;
+	}
+
+	if (conn->sess == NULL && req->cmd->nvme_cmd.opc == SPDK_NVME_OPC_FABRIC &&
+	    req->cmd->nvmf_cmd.fctype == SPDK_NVMF_FABRIC_COMMAND_CONNECT) {
+		/*
+		 * I/O queues get a core of their own; the session picks it up
+		 * while processing the CONNECT.
+		 */
+		if (req->cmd->connect_cmd.qid != 0 && !conn->transport_polled) {
+			conn->lcore = spdk_nvmf_get_conn_lcore();
+			conn->transport_polled = true;
+		}
+		tconn->connecting = true;
+	}
+
+	if (spdk_nvmf_request_exec(req) < 0) {
+		SPDK_ERRLOG("Command execution failed\n");
+		return -1;
+	}
+
+	return 1;
+}
+
+/*
+ * Work out where the data of a new command comes from.  Errors that only
+ * concern this command are reported in its response; -1 is returned for
+ * errors that end the connection.
+ */
+static int
+nvmf_tcp_capsule_prep(struct spdk_nvmf_tcp_conn *tconn, struct spdk_nvmf_tcp_request *tcp_req)
+{
+	struct spdk_nvmf_request	*req = &tcp_req->req;
+	struct spdk_nvme_tcp_common_pdu_hdr *ch = &tconn->recv_pdu.hdr.common;
+	struct spdk_nvme_cmd		*cmd = &req->cmd->nvme_cmd;
+	struct spdk_nvme_cpl		*rsp = &req->rsp->nvme_cpl;
+	struct spdk_nvme_sgl_descriptor	*sgl = &cmd->dptr.sgl1;
+
+	if (ch->plen > ch->hlen) {
+		if (ch->pdo < ch->hlen || ch->pdo >= ch->plen) {
+			nvmf_tcp_send_term_req(tconn, SPDK_NVME_TCP_TERM_REQ_FES_INVALID_HEADER_FIELD,
+					       offsetof(struct spdk_nvme_tcp_common_pdu_hdr, pdo));
+			return -1;
+		}
+
+		tcp_req->in_capsule_len = ch->plen - ch->pdo;
+		if (tcp_req->in_capsule_len > g_nvmf_tgt.in_capsule_data_size) {
+			nvmf_tcp_send_term_req(tconn, SPDK_NVME_TCP_TERM_REQ_FES_DATA_TRANSFER_LIMIT_EXCEEDED,
+					       offsetof(struct spdk_nvme_tcp_common_pdu_hdr, plen));
+			return -1;
+		}
+	}
+
+	if (cmd->opc == SPDK_NVME_OPC_FABRIC) {
+		req->xfer = spdk_nvme_opc_get_data_transfer(req->cmd->nvmf_cmd.fctype);
+	} else {
+		req->xfer = spdk_nvme_opc_get_data_transfer(cmd->opc);
+	}
+
+	req->length = 0;
+	req->data = NULL;
+
+	if (req->xfer == SPDK_NVME_DATA_NONE) {
+		/* Nothing to transfer; any in-capsule data is ignored. */
+	} else if (sgl->generic.type == SPDK_NVME_SGL_TYPE_TRANSPORT_DATA_BLOCK &&
+		   sgl->generic.subtype == SPDK_NVME_SGL_SUBTYPE_TRANSPORT) {
+		req->length = sgl->unkeyed.length;
+		if (tcp_req->in_capsule_len != 0) {
+			/* The data comes in H2CData PDUs; the capsule must not carry any. */
+			SPDK_ERRLOG("In-capsule data with a transport SGL\n");
+			rsp->status.sc = SPDK_NVME_SC_SGL_DESCRIPTOR_TYPE_INVALID;
+		} else if (req->length > SPDK_NVMF_MAX_RECV_DATA_TRANSFER_SIZE) {
+			SPDK_ERRLOG("SGL length 0x%x exceeds max io size 0x%x\n",
+				    req->length, SPDK_NVMF_MAX_RECV_DATA_TRANSFER_SIZE);
+			rsp->status.sc = SPDK_NVME_SC_DATA_SGL_LENGTH_INVALID;
+		}
+	} else if (sgl->generic.type == SPDK_NVME_SGL_TYPE_DATA_BLOCK &&
+		   sgl->generic.subtype == SPDK_NVME_SGL_SUBTYPE_OFFSET) {
+		if (req->xfer != SPDK_NVME_DATA_HOST_TO_CONTROLLER) {
+			SPDK_ERRLOG("In-capsule data for a command without host to controller data\n");
+			rsp->status.sc = SPDK_NVME_SC_INVALID_FIELD;
+		} else if (sgl->address > tcp_req->in_capsule_len ||
+			   sgl->unkeyed.length > tcp_req->in_capsule_len - sgl->address) {
+			SPDK_ERRLOG("In-capsule offset 0x%" PRIx64 " length 0x%x exceeds capsule data 0x%x\n",
+				    sgl->address, sgl->unkeyed.length, tcp_req->in_capsule_len);
+			rsp->status.sc = SPDK_NVME_SC_DATA_SGL_LENGTH_INVALID;
+		} else {
+			req->length = sgl->unkeyed.length;
+		}
+	} else {
+		SPDK_ERRLOG("Invalid SGL type 0x%x subtype 0x%x\n", sgl->generic.type, sgl->generic.subtype);
+		rsp->status.sc = SPDK_NVME_SC_SGL_DESCRIPTOR_TYPE_INVALID;
+	}
+
+	if (rsp->status.sc != SPDK_NVME_SC_SUCCESS) {
+		req->length = 0;
+	}
+
+	return 0;
+}
+
+/* A CapsuleCmd PDU header arrived. */
+static int
+nvmf_tcp_handle_capsule_cmd(struct spdk_nvmf_tcp_conn *tconn)
+{
+	struct spdk_nvmf_tcp_request *tcp_req;
+
+	tcp_req = STAILQ_FIRST(&tconn->free_reqs);
+	if (tcp_req == NULL) {
+		SPDK_ERRLOG("Host exceeded the queue depth of conn %p\n", &tconn->conn);
+		nvmf_tcp_send_term_req(tconn, SPDK_NVME_TCP_TERM_REQ_FES_PDU_SEQUENCE_ERROR, 0);
+		return -1;
+	}
+	STAILQ_REMOVE_HEAD(&tconn->free_reqs, link);
+
+	memcpy(&tcp_req->cmd, &tconn->recv_pdu.hdr.capsule_cmd.ccsqe, sizeof(tcp_req->cmd));
+	memset(&tcp_req->rsp, 0, sizeof(tcp_req->rsp));
+
+	tconn->conn.sq_head++;
+	if (tconn->conn.sq_head == tconn->queue_depth) {
+		tconn->conn.sq_head = 0;
+	}
+
+	tconn->recv_req = tcp_req;
+	if (nvmf_tcp_capsule_prep(tconn, tcp_req) < 0) {
+		return -1;
+	}
+
+	if (tcp_req->in_capsule_len > 0 || tcp_req->req.length > 0) {
+		tconn->recv_state = NVMF_TCP_RECV_AWAIT_BUF;
+	}
+
+	return 0;
+}
+
+/* A capsule got its buffer.  Returns the number of commands started, or -1. */
+static int
+nvmf_tcp_capsule_buf_ready(struct spdk_nvmf_tcp_conn *tconn)
+{
+	struct spdk_nvmf_tcp_request	*tcp_req = tconn->recv_req;
+	struct spdk_nvmf_request	*req = &tcp_req->req;
+	struct spdk_nvme_sgl_descriptor	*sgl = &tcp_req->cmd.nvme_cmd.dptr.sgl1;
+	struct spdk_nvmf_tcp_pdu	*pdu;
+
+	if (tcp_req->in_capsule_len > 0) {
+		/* capsule_prep checked the offset against the in-capsule data. */
+		if (req->length > 0 && sgl->generic.type == SPDK_NVME_SGL_TYPE_DATA_BLOCK &&
+		    sgl->generic.subtype == SPDK_NVME_SGL_SUBTYPE_OFFSET) {
+			req->data = (uint8_t *)tcp_req->buf + sgl->address;
+		}
+		tconn->payload = tcp_req->buf;
+		tconn->payload_len = tcp_req->in_capsule_len;
+		tconn->pad_len = tconn->recv_pdu.hdr.common.pdo - tconn->recv_pdu.hdr.common.hlen;
+		tconn->recv_state = tconn->pad_len ? NVMF_TCP_RECV_PAD : NVMF_TCP_RECV_PAYLOAD;
+		return 0;
+	}
+
+	req->data = tcp_req->buf;
+	tconn->recv_state = NVMF_TCP_RECV_CH;
+
+	if (req->xfer == SPDK_NVME_DATA_HOST_TO_CONTROLLER) {
+		/* Ask the host for all of the data at once. */
+		pdu = &tcp_req->data_pdu;
+		nvmf_tcp_pdu_init(pdu, SPDK_NVME_TCP_PDU_TYPE_R2T, sizeof(struct spdk_nvme_tcp_r2t_hdr),
+				  NULL, 0);
+		pdu->hdr.r2t.cccid = tcp_req->cmd.nvme_cmd.cid;
+		pdu->hdr.r2t.ttag = tcp_req->ttag;
+		pdu->hdr.r2t.r2to = 0;
+		pdu->hdr.r2t.r2tl = req->length;
+		tcp_req->awaiting_h2c = true;
+		nvmf_tcp_queue_pdu(tconn, pdu);
+		return 0;
+	}
+
+	return nvmf_tcp_request_exec(tconn, tcp_req);
+}
+
+/* An H2CData PDU header arrived. */
+static int
+nvmf_tcp_handle_h2c_data(struct spdk_nvmf_tcp_conn *tconn)
+{
+	struct spdk_nvme_tcp_h2c_data_hdr	*h2c = &tconn->recv_pdu.hdr.h2c_data;
+	struct spdk_nvmf_tcp_request		*tcp_req;
+
+	if (h2c->ttag >= tconn->queue_depth) {
+		nvmf_tcp_send_term_req(tconn, SPDK_NVME_TCP_TERM_REQ_FES_INVALID_HEADER_FIELD,
+				       offsetof(struct spdk_nvme_tcp_h2c_data_hdr, ttag));
+		return -1;
+	}
+
+	tcp_req = &tconn->reqs[h2c->ttag];
+	if (!tcp_req->awaiting_h2c || tcp_req->cmd.nvme_cmd.cid != h2c->cccid) {
+		nvmf_tcp_send_term_req(tconn, SPDK_NVME_TCP_TERM_REQ_FES_INVALID_HEADER_FIELD,
+				       offsetof(struct spdk_nvme_tcp_h2c_data_hdr, cccid));
+		return -1;
+	}
+
+	if (h2c->datao != tcp_req->h2c_offset || h2c->datal == 0 ||
+	    h2c->datal > tcp_req->req.length - tcp_req->h2c_offset) {
+		nvmf_tcp_send_term_req(tconn, SPDK_NVME_TCP_TERM_REQ_FES_DATA_TRANSFER_OUT_OF_RANGE,
+				       offsetof(struct spdk_nvme_tcp_h2c_data_hdr, datao));
+		return -1;
+	}
+
+	if (h2c->common.pdo < h2c->common.hlen || h2c->common.plen - h2c->common.pdo != h2c->datal) {
+		nvmf_tcp_send_term_req(tconn, SPDK_NVME_TCP_TERM_REQ_FES_INVALID_HEADER_FIELD,
+				       offsetof(struct spdk_nvme_tcp_common_pdu_hdr, plen));
+		return -1;
+	}
+
+	tconn->recv_req = tcp_req;
+	tconn->payload = (uint8_t *)tcp_req->req.data + h2c->datao;
+	tconn->payload_len = h2c->datal;
+	tconn->pad_len = h2c->common.pdo - h2c->common.hlen;
+	tconn->recv_state = tconn->pad_len ? NVMF_TCP_RECV_PAD : NVMF_TCP_RECV_PAYLOAD;
+
+	return 0;
+}
+
+/* The data of a PDU has been received.  Returns the number of commands started, or -1. */
+static int
+nvmf_tcp_payload_done(struct spdk_nvmf_tcp_conn *tconn)
+{
+	struct spdk_nvmf_tcp_request *tcp_req = tconn->recv_req;
+
+	tconn->recv_state = NVMF_TCP_RECV_CH;
+
+	if (tconn->recv_pdu.hdr.common.pdu_type == SPDK_NVME_TCP_PDU_TYPE_CAPSULE_CMD) {
+		return nvmf_tcp_request_exec(tconn, tcp_req);
+	}
+
+	tcp_req->h2c_offset += tconn->payload_len;
+	if (tcp_req->h2c_offset < tcp_req->req.length) {
+		return 0;
+	}
+
+	tcp_req->awaiting_h2c = false;
+	return nvmf_tcp_request_exec(tconn, tcp_req);
+}
+
+static int
+nvmf_tcp_handle_ic_req(struct spdk_nvmf_tcp_conn *tconn)
+{
+	struct spdk_nvme_tcp_ic_req	*ic_req = &tconn->recv_pdu.hdr.ic_req;
+	struct spdk_nvmf_tcp_pdu	*pdu = &tconn->ic_resp_pdu;
+
+	if (ic_req->pfv != SPDK_NVME_TCP_PFV_1_0) {
+		nvmf_tcp_send_term_req(tconn, SPDK_NVME_TCP_TERM_REQ_FES_INVALID_DATA_UNSUPPORTED_PARAMETER,
+				       offsetof(struct spdk_nvme_tcp_ic_req, pfv));
+		return -1;
+	}
+
+	if (ic_req->dgst != 0) {
+		SPDK_NOTICELOG("Conn %p: header and data digests are not supported\n", &tconn->conn);
+	}
+
+	memset(&pdu->hdr, 0, sizeof(pdu->hdr));
+	nvmf_tcp_pdu_init(pdu, SPDK_NVME_TCP_PDU_TYPE_IC_RESP, sizeof(struct spdk_nvme_tcp_ic_resp),
+			  NULL, 0);
+	pdu->hdr.ic_resp.pfv = SPDK_NVME_TCP_PFV_1_0;
+	pdu->hdr.ic_resp.cpda = 0;
+	pdu->hdr.ic_resp.dgst = 0;
+	pdu->hdr.ic_resp.maxh2cdata = SPDK_NVMF_MAX_RECV_DATA_TRANSFER_SIZE;
+	nvmf_tcp_queue_pdu(tconn, pdu);
+
+	tconn->ic_done = true;
+	return 0;
+}
+
+static uint8_t
+nvmf_tcp_expected_hlen(uint8_t pdu_type)
+{
+	switch (pdu_type) {
+	case SPDK_NVME_TCP_PDU_TYPE_IC_REQ:
+		return sizeof(struct spdk_nvme_tcp_ic_req);
+	case SPDK_NVME_TCP_PDU_TYPE_H2C_TERM_REQ:
+		return sizeof(struct spdk_nvme_tcp_term_req_hdr);
+	case SPDK_NVME_TCP_PDU_TYPE_CAPSULE_CMD:
+		return sizeof(struct spdk_nvme_tcp_cmd);
+	case SPDK_NVME_TCP_PDU_TYPE_H2C_DATA:
+		return sizeof(struct spdk_nvme_tcp_h2c_data_hdr);
+	default:
+		return 0;
+	}
+}
+
+static int
+nvmf_tcp_check_ch(struct spdk_nvmf_tcp_conn *tconn)
+{
+	struct spdk_nvme_tcp_common_pdu_hdr *ch = &tconn->recv_pdu.hdr.common;
+	uint8_t hlen;
+
+	hlen = nvmf_tcp_expected_hlen(ch->pdu_type);
+	if (hlen == 0 ||
+	    (ch->pdu_type == SPDK_NVME_TCP_PDU_TYPE_IC_REQ) == tconn->ic_done) {
+		SPDK_ERRLOG("Unexpected PDU type 0x%x\n", ch->pdu_type);
+		nvmf_tcp_send_term_req(tconn, SPDK_NVME_TCP_TERM_REQ_FES_INVALID_HEADER_FIELD,
+				       offsetof(struct spdk_nvme_tcp_common_pdu_hdr, pdu_type));
+		return -1;
+	}
+
+	if (ch->flags & (SPDK_NVME_TCP_CH_FLAGS_HDGSTF | SPDK_NVME_TCP_CH_FLAGS_DDGSTF)) {
+		nvmf_tcp_send_term_req(tconn, SPDK_NVME_TCP_TERM_REQ_FES_INVALID_HEADER_FIELD,
+				       offsetof(struct spdk_nvme_tcp_common_pdu_hdr, flags));
+		return -1;
+	}
+
+	if (ch->hlen != hlen || ch->plen < hlen ||
+	    (ch->pdu_type == SPDK_NVME_TCP_PDU_TYPE_IC_REQ && ch->plen != hlen)) {
+		nvmf_tcp_send_term_req(tconn, SPDK_NVME_TCP_TERM_REQ_FES_INVALID_HEADER_FIELD,
+				       offsetof(struct spdk_nvme_tcp_common_pdu_hdr, hlen));
+		return -1;
+	}
+
+	return 0;
+}
+
+/* A complete PDU header arrived.  Returns the number of commands started, or -1. */
+static int
+nvmf_tcp_handle_psh(struct spdk_nvmf_tcp_conn *tconn)
+{
+	struct spdk_nvme_tcp_common_pdu_hdr *ch = &tconn->recv_pdu.hdr.common;
+	int rc;
+
+	tconn->recv_state = NVMF_TCP_RECV_CH;
+
+	switch (ch->pdu_type) {
+	case SPDK_NVME_TCP_PDU_TYPE_IC_REQ:
+		return nvmf_tcp_handle_ic_req(tconn);
+	case SPDK_NVME_TCP_PDU_TYPE_CAPSULE_CMD:
+		rc = nvmf_tcp_handle_capsule_cmd(tconn);
+		if (rc < 0 || tconn->recv_state != NVMF_TCP_RECV_CH) {
+			return rc;
+		}
+		/* No data: start it right away. */
+		return nvmf_tcp_request_exec(tconn, tconn->recv_req);
+	case SPDK_NVME_TCP_PDU_TYPE_H2C_DATA:
+		return nvmf_tcp_handle_h2c_data(tconn);
+	case SPDK_NVME_TCP_PDU_TYPE_H2C_TERM_REQ:
+		SPDK_ERRLOG("Host terminated conn %p: fes 0x%x\n", &tconn->conn,
+			    tconn->recv_pdu.hdr.term_req.fes);
+		return -1;
+	default:
+		return -1;
+	}
+}
+
+/*
+ * Receive and process PDUs.  Returns the number of times that
+ * spdk_nvmf_request_exec was called, or -1 on error.
+ */
+static int
+nvmf_tcp_recv_pdus(struct spdk_nvmf_tcp_conn *tconn)
+{
+	struct spdk_nvmf_tcp_pdu	*pdu = &tconn->recv_pdu;
+	int				pdus = 0, count = 0;
+	int				rc;
+	uint32_t			want;
+
+	while (pdus < NVMF_TCP_MAX_RECV_PDUS && !tconn->connecting) {
+		switch (tconn->recv_state) {
+		case NVMF_TCP_RECV_CH:
+			want = sizeof(struct spdk_nvme_tcp_common_pdu_hdr);
+			rc = nvmf_tcp_read(tconn, pdu->hdr.raw + tconn->recv_offset, want - tconn->recv_offset);
+			if (rc < 0) {
+				return -1;
+			}
+			tconn->recv_offset += rc;
+			if (tconn->recv_offset < want) {
+				return count;
+			}
+
+			if (nvmf_tcp_check_ch(tconn) < 0) {
+				return -1;
+			}
+			tconn->recv_state = NVMF_TCP_RECV_PSH;
+			break;
+
+		case NVMF_TCP_RECV_PSH:
+			want = pdu->hdr.common.hlen;
+			rc = nvmf_tcp_read(tconn, pdu->hdr.raw + tconn->recv_offset, want - tconn->recv_offset);
+			if (rc < 0) {
+				return -1;
+			}
+			tconn->recv_offset += rc;
+			if (tconn->recv_offset < want) {
+				return count;
+			}
+			tconn->recv_offset = 0;
+
+			rc = nvmf_tcp_handle_psh(tconn);
+			if (rc < 0) {
+				return -1;
+			}
+			count += rc;
+			if (tconn->recv_state == NVMF_TCP_RECV_CH) {
+				pdus++;
+			}
+			break;
+
+		case NVMF_TCP_RECV_AWAIT_BUF:
+			if (nvmf_tcp_request_get_buf(tconn->recv_req, nvmf_max(tconn->recv_req->req.length,
+						     tconn->recv_req->in_capsule_len)) < 0) {
+				/* Try again on the next poll. */
+				return count;
+			}
+
+			rc = nvmf_tcp_capsule_buf_ready(tconn);
+			if (rc < 0) {
+				return -1;
+			}
+			count += rc;
+			if (tconn->recv_state == NVMF_TCP_RECV_CH) {
+				pdus++;
+			}
+			break;
+
+		case NVMF_TCP_RECV_PAD:
+			rc = nvmf_tcp_read(tconn, NULL, tconn->pad_len - tconn->recv_offset);
+			if (rc < 0) {
+				return -1;
+			}
+			tconn->recv_offset += rc;
+			if (tconn->recv_offset < tconn->pad_len) {
+				return count;
+			}
+			tconn->recv_offset = 0;
+			tconn->recv_state = NVMF_TCP_RECV_PAYLOAD;
+			break;
+
+		case NVMF_TCP_RECV_PAYLOAD:
+			rc = nvmf_tcp_read(tconn, tconn->payload + tconn->recv_offset,
+					   tconn->payload_len - tconn->recv_offset);
+			if (rc < 0) {
+				return -1;
+			}
+			tconn->recv_offset += rc;
+			if (tconn->recv_offset < tconn->payload_len) {
+				return count;
+			}
+			tconn->recv_offset = 0;
+
+			rc = nvmf_tcp_payload_done(tconn);
+			if (rc < 0) {
+				return -1;
+			}
+			count += rc;
+			pdus++;
+			break;
+		}
+	}
+
+	return count;
+}
+
+static int
+spdk_nvmf_tcp_poll(struct spdk_nvmf_conn *conn)
+{
+	struct spdk_nvmf_tcp_conn	*tconn = get_tcp_conn(conn);
+	int				count;
+
+	count = nvmf_tcp_recv_pdus(tconn);
+	if (count < 0) {
+		return -1;
+	}
+
+	/* Responses completed since the last poll, and R2Ts and ICResp from this one */
+	if (!tconn->connecting && nvmf_tcp_flush(tconn) < 0) {
+		return -1;
+	}
+
+	return count;
+}
+
+/* Connections */
+
+static struct spdk_nvmf_tcp_conn *
+nvmf_tcp_conn_create(int fd)
+{
+	struct spdk_nvmf_tcp_conn	*tconn;
+	struct spdk_nvmf_tcp_request	*tcp_req;
+	uint16_t			i;
+
+	tconn = calloc(1, sizeof(*tconn));
+	if (tconn == NULL) {
+		return NULL;
+	}
+
+	tconn->fd = fd;
+	tconn->queue_depth = g_nvmf_tgt.max_queue_depth;
+	tconn->recv_state = NVMF_TCP_RECV_CH;
+	tconn->conn.transport = &spdk_nvmf_transport_tcp;
+	STAILQ_INIT(&tconn->free_reqs);
+	STAILQ_INIT(&tconn->send_queue);
+
+	tconn->reqs = calloc(tconn->queue_depth, sizeof(*tconn->reqs));
+	if (tconn->reqs == NULL) {
+		free(tconn);
+		return NULL;
+	}
+
+	for (i = 0; i < tconn->queue_depth; i++) {
+		tcp_req = &tconn->reqs[i];
+		tcp_req->req.conn = &tconn->conn;
+		tcp_req->req.cmd = &tcp_req->cmd;
+		tcp_req->req.rsp = &tcp_req->rsp;
+		tcp_req->ttag = i;
+		STAILQ_INSERT_TAIL(&tconn->free_reqs, tcp_req, link);
+	}
+
+	return tconn;
+}
+
+static void
+nvmf_tcp_conn_destroy(struct spdk_nvmf_tcp_conn *tconn)
+{
+	uint16_t i;
+
+	for (i = 0; i < tconn->queue_depth; i++) {
+		if (tconn->reqs[i].buf != NULL) {
+			rte_mempool_put(tconn->reqs[i].buf_pool, tconn->reqs[i].buf);
+		}
+	}
+
+	close(tconn->fd);
+	free(tconn->reqs);
+	free(tconn);
+}
+
+static void
+nvmf_tcp_conn_destroy_event(spdk_event_t event)
+{
+	nvmf_tcp_conn_destroy(spdk_event_get_arg1(event));
+}
+
+static void
+spdk_nvmf_handle_disconnect(spdk_event_t event)
+{
+	struct nvmf_session	*session = spdk_event_get_arg1(event);
+	struct spdk_nvmf_conn	*conn = spdk_event_get_arg2(event);
+
+	nvmf_disconnect(session, conn);
+}
+
+static void
+nvmf_tcp_conn_poller(void *arg)
+{
+	struct spdk_nvmf_tcp_conn	*tconn = arg;
+	struct spdk_nvmf_conn		*conn = &tconn->conn;
+	spdk_event_t			event;
+
+	if (tconn->failed) {
+		return;
+	}
+
+	if (spdk_nvmf_tcp_poll(conn) < 0) {
+		/* Let the subsystem core tear the connection down. */
+		tconn->failed = true;
+		event = spdk_event_allocate(conn->sess->subsys->lcore, spdk_nvmf_handle_disconnect,
+					    conn->sess, conn, NULL);
+		spdk_event_call(event);
+	}
+}
+
+static void
+nvmf_tcp_conn_stop(struct spdk_nvmf_conn *conn, struct spdk_event *complete)
+{
+	struct spdk_nvmf_tcp_conn *tconn = get_tcp_conn(conn);
+
+	tconn->stopped = true;
+	spdk_poller_unregister(&tconn->poller, complete);
+}
+
+static void
+nvmf_tcp_conn_fini(struct spdk_nvmf_conn *conn)
+{
+	struct spdk_nvmf_tcp_conn	*tconn = get_tcp_conn(conn);
+	spdk_event_t			event;
+
+	if (conn->transport_polled) {
+		spdk_nvmf_put_conn_lcore(conn->lcore);
+
+		if (!tconn->stopped) {
+			/* Torn down along with its session without being stopped first */
+			tconn->stopped = true;
+			event = spdk_event_allocate(conn->lcore, nvmf_tcp_conn_destroy_event, tconn, NULL, NULL);
+			spdk_poller_unregister(&tconn->poller, event);
+			return;
+		}
+	}
+
+	nvmf_tcp_conn_destroy(tconn);
+}
+
+/* Acceptor */
+
+static void
+nvmf_tcp_accept_conns(struct spdk_nvmf_tcp_listener *listener)
+{
+	struct spdk_nvmf_tcp_conn	*tconn;
+	int				fd, flag = 1;
+
+	while (1) {
+		fd = accept4(listener->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+				SPDK_ERRLOG("accept() on %s:%s failed: %s\n", listener->traddr, listener->trsvc,
+					    strerror(errno));
+			}
+			return;
+		}
+
+		if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag)) < 0) {
+			SPDK_ERRLOG("Unable to set TCP_NODELAY: %s\n", strerror(errno));
+		}
+
+		tconn = nvmf_tcp_conn_create(fd);
+		if (tconn == NULL) {
+			SPDK_ERRLOG("Unable to allocate connection\n");
+			close(fd);
+			continue;
+		}
+
+		SPDK_TRACELOG(SPDK_TRACE_TCP, "New TCP connection %p on %s:%s\n", &tconn->conn,
+			      listener->traddr, listener->trsvc);
+		TAILQ_INSERT_TAIL(&g_tcp.pending_conns, tconn, link);
+	}
+}
+
+static void
+nvmf_tcp_accept(struct rte_timer *timer, void *arg)
+{
+	struct spdk_nvmf_tcp_listener	*listener;
+	struct spdk_nvmf_tcp_conn	*tconn, *tmp;
+	struct spdk_nvmf_conn		*conn;
+
+	/* Process pending connections up to and including their CONNECT. */
+	TAILQ_FOREACH_SAFE(tconn, &g_tcp.pending_conns, link, tmp) {
+		conn = &tconn->conn;
+		if (tconn->connecting) {
+			continue;
+		}
+		rte_rmb();
+
+		if (conn->sess != NULL) {
+			/* Connected; hand the connection over to its core. */
+			TAILQ_REMOVE(&g_tcp.pending_conns, tconn, link);
+			if (conn->transport_polled) {
+				tconn->poller.fn = nvmf_tcp_conn_poller;
+				tconn->poller.arg = tconn;
+				spdk_poller_register(&tconn->poller, conn->lcore, NULL);
+			}
+			continue;
+		}
+
+		if (conn->transport_polled) {
+			/* The CONNECT was rejected; the host may try again. */
+			spdk_nvmf_put_conn_lcore(conn->lcore);
+			conn->transport_polled = false;
+		}
+
+		if (spdk_nvmf_tcp_poll(conn) < 0) {
+			TAILQ_REMOVE(&g_tcp.pending_conns, tconn, link);
+			nvmf_tcp_conn_destroy(tconn);
+		}
+	}
+
+	TAILQ_FOREACH(listener, &g_tcp.listeners, link) {
+		nvmf_tcp_accept_conns(listener);
+	}
+}
+
+static int
+nvmf_tcp_listen(struct spdk_nvmf_listen_addr *listen_addr, void *ctx)
+{
+	struct spdk_nvmf_tcp_listener	*listener;
+	struct addrinfo			hints = {}, *res;
+	char				host[INET6_ADDRSTRLEN + 2];
+	char				*p;
+	int				fd, rc, flag = 1;
+
+	TAILQ_FOREACH(listener, &g_tcp.listeners, link) {
+		if (strcmp(listener->traddr, listen_addr->traddr) == 0 &&
+		    strcmp(listener->trsvc, listen_addr->trsvc) == 0) {
+			/* Shared by several subsystems */
+			return 0;
+		}
+	}
+
+	/* IPv6 addresses are configured in brackets. */
+	snprintf(host, sizeof(host), "%s", listen_addr->traddr);
+	if (host[0] == '[') {
+		memmove(host, host + 1, strlen(host));
+		p = strchr(host, ']');
+		if (p != NULL) {
+			*p = '\0';
+		}
+	}
+
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE | AI_NUMERICHOST;
+	rc = getaddrinfo(host, listen_addr->trsvc, &hints, &res);
+	if (rc != 0) {
+		SPDK_ERRLOG("Invalid listen address %s:%s: %s\n", listen_addr->traddr, listen_addr->trsvc,
+			    gai_strerror(rc));
+		return -1;
+	}
+
+	fd = socket(res->ai_family, res->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, res->ai_protocol);
+	if (fd < 0) {
+		SPDK_ERRLOG("socket() failed: %s\n", strerror(errno));
+		freeaddrinfo(res);
+		return -1;
+	}
+
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+
+	rc = bind(fd, res->ai_addr, res->ai_addrlen);
+	freeaddrinfo(res);
+	if (rc < 0 || listen(fd, NVMF_TCP_LISTEN_BACKLOG) < 0) {
+		SPDK_ERRLOG("Unable to listen on %s:%s: %s\n", listen_addr->traddr, listen_addr->trsvc,
+			    strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	listener = calloc(1, sizeof(*listener));
+	if (listener == NULL) {
+		close(fd);
+		return -1;
+	}
+
+	listener->fd = fd;
+	listener->traddr = strdup(listen_addr->traddr);
+	listener->trsvc = strdup(listen_addr->trsvc);
+	TAILQ_INSERT_TAIL(&g_tcp.listeners, listener, link);
+
+	SPDK_NOTICELOG("*** NVMf Target Listening on %s port %s (TCP) ***\n",
+		       listen_addr->traddr, listen_addr->trsvc);
+
+	return 0;
+}
+
+static void
+nvmf_tcp_close_listeners(void)
+{
+	struct spdk_nvmf_tcp_listener *listener;
+
+	while ((listener = TAILQ_FIRST(&g_tcp.listeners)) != NULL) {
+		TAILQ_REMOVE(&g_tcp.listeners, listener, link);
+		close(listener->fd);
+		free(listener->traddr);
+		free(listener->trsvc);
+		free(listener);
+	}
+}
+
+static int
+spdk_nvmf_tcp_acceptor_start(void)
+{
+	if (spdk_nvmf_foreach_listen_addr(&spdk_nvmf_transport_tcp, nvmf_tcp_listen, NULL) != 0) {
+		nvmf_tcp_close_listeners();
+		return -1;
+	}
+
+	if (TAILQ_EMPTY(&g_tcp.listeners)) {
+		/* No subsystem listens on TCP. */
+		return 0;
+	}
+
+	rte_timer_init(&g_tcp.acceptor_timer);
+	rte_timer_reset(&g_tcp.acceptor_timer, ACCEPT_TIMEOUT, PERIODICAL,
+			rte_lcore_id(), nvmf_tcp_accept, NULL);
+	g_tcp.started = true;
+
+	return 0;
+}
+
+static void
+spdk_nvmf_tcp_acceptor_stop(void)
+{
+	SPDK_TRACELOG(SPDK_TRACE_TCP, "TCP acceptor stop\n");
+
+	if (g_tcp.started) {
+		rte_timer_stop_sync(&g_tcp.acceptor_timer);
+		g_tcp.started = false;
+	}
+
+	nvmf_tcp_close_listeners();
+}
+
+static struct rte_mempool *
+nvmf_tcp_create_buf_pool(const char *name, unsigned count, unsigned size)
+{
+	int cache_size;
+
+	/*
+	 * Ensure no more than half of the total buffers end up in local caches.
+	 */
+	cache_size = count / (2 * spdk_app_get_core_count());
+	if (cache_size > RTE_MEMPOOL_CACHE_MAX_SIZE) {
+		cache_size = RTE_MEMPOOL_CACHE_MAX_SIZE;
+	}
+
+	return rte_mempool_create(name, count, size, cache_size, 0, NULL, NULL, NULL, NULL,
+				  SOCKET_ID_ANY, 0);
+}
+
+static int
+spdk_nvmf_tcp_init(void)
+{
+	SPDK_NOTICELOG("*** TCP Transport Init ***\n");
+
+	g_tcp.small_buf_pool = nvmf_tcp_create_buf_pool("nvmf_tcp_small_buf",
+			       NVMF_TCP_SMALL_BUF_POOL_SIZE,
+			       NVMF_TCP_SMALL_BUF_MAX_SIZE);
+	if (!g_tcp.small_buf_pool) {
+		SPDK_ERRLOG("create tcp small data buffer pool failed\n");
+		return -1;
+	}
+
+	g_tcp.large_buf_pool = nvmf_tcp_create_buf_pool("nvmf_tcp_large_buf",
+			       NVMF_TCP_LARGE_BUF_POOL_SIZE,
+			       NVMF_TCP_LARGE_BUF_MAX_SIZE);
+	if (!g_tcp.large_buf_pool) {
+		SPDK_ERRLOG("create tcp large data buffer pool failed\n");
+#if RTE_VERSION >= RTE_VERSION_NUM(16, 7, 0, 1)
+		rte_mempool_free(g_tcp.small_buf_pool);
+#endif
+		g_tcp.small_buf_pool = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+static int
+spdk_nvmf_tcp_fini(void)
+{
+	struct spdk_nvmf_tcp_conn *tconn;
+
+	while ((tconn = TAILQ_FIRST(&g_tcp.pending_conns)) != NULL) {
+		TAILQ_REMOVE(&g_tcp.pending_conns, tconn, link);
+		nvmf_tcp_conn_destroy(tconn);
+	}
+
+	return 0;
+}
+
+static void
+nvmf_tcp_discover(struct spdk_nvmf_listen_addr *listen_addr,
+		  struct spdk_nvmf_discovery_log_page_entry *entry)
+{
+	entry->trtype = SPDK_NVMF_TRTYPE_TCP;
+	entry->adrfam = strchr(listen_addr->traddr, ':') ? SPDK_NVMF_ADRFAM_IPV6 : SPDK_NVMF_ADRFAM_IPV4;
+	entry->treq.secure_channel = SPDK_NVMF_TREQ_SECURE_CHANNEL_NOT_SPECIFIED;
+
+	snprintf(entry->trsvcid, sizeof(entry->trsvcid), "%s", listen_addr->trsvc);
+	snprintf(entry->traddr, sizeof(entry->traddr), "%s", listen_addr->traddr);
+
+	entry->tsas.tcp.sectype = SPDK_NVME_TCP_SECURITY_NONE;
+}
+
+const struct spdk_nvmf_transport spdk_nvmf_transport_tcp = {
+	.name = "tcp",
+	.transport_init = spdk_nvmf_tcp_init,
+	.transport_fini = spdk_nvmf_tcp_fini,
+	.transport_start = spdk_nvmf_tcp_acceptor_start,
+	.transport_stop = spdk_nvmf_tcp_acceptor_stop,
+
+	.req_complete = spdk_nvmf_tcp_request_complete,
+
+	.conn_fini = nvmf_tcp_conn_fini,
+	.conn_poll = spdk_nvmf_tcp_poll,
+	.conn_stop = nvmf_tcp_conn_stop,
+
+	.listen_addr_discover = nvmf_tcp_discover,
+};
+
+SPDK_LOG_REGISTER_TRACE_FLAG("tcp", SPDK_TRACE_TCP)
@@ -33,6 +33,7 @@
 
 #include "transport.h"
 
+#include <stdbool.h>
 #include <stdlib.h>
 #include <strings.h>
 
@@ -43,10 +44,15 @@ static const struct spdk_nvmf_transport *const g_transports[] = {
 #ifdef SPDK_CONFIG_RDMA
 	&spdk_nvmf_transport_rdma,
 #endif
+	&spdk_nvmf_transport_tcp,
+	&spdk_nvmf_transport_loopback,
 };
 
 #define NUM_TRANSPORTS (sizeof(g_transports) / sizeof(*g_transports))
 
+/* Transports that initialized successfully; the others are left alone. */
+static bool g_transport_active[NUM_TRANSPORTS];
+
 int
 spdk_nvmf_transport_init(void)
 {
@@ -56,7 +62,9 @@ spdk_nvmf_transport_init(void)
 	for (i = 0; i != NUM_TRANSPORTS; i++) {
 		if (g_transports[i]->transport_init() < 0) {
 			SPDK_NOTICELOG("%s transport init failed\n", g_transports[i]->name);
+			g_transport_active[i] = false;
 		} else {
+			g_transport_active[i] = true;
 			count++;
 		}
 	}
@@ -71,6 +79,10 @@ spdk_nvmf_transport_fini(void)
 	int count = 0;
 
 	for (i = 0; i != NUM_TRANSPORTS; i++) {
+		if (!g_transport_active[i]) {
+			continue;
+		}
+
 		if (g_transports[i]->transport_fini() < 0) {
 			SPDK_NOTICELOG("%s transport fini failed\n", g_transports[i]->name);
 		} else {
@@ -87,6 +99,10 @@ spdk_nvmf_acceptor_start(void)
 	size_t i;
 
 	for (i = 0; i != NUM_TRANSPORTS; i++) {
+		if (!g_transport_active[i]) {
+			continue;
+		}
+
 		if (g_transports[i]->transport_start() < 0) {
 			return -1;
 		}
@@ -101,7 +117,9 @@ spdk_nvmf_acceptor_stop(void)
 	size_t i;
 
 	for (i = 0; i != NUM_TRANSPORTS; i++) {
-		g_transports[i]->transport_stop();
+		if (g_transport_active[i]) {
+			g_transports[i]->transport_stop();
+		}
 	}
 }
 
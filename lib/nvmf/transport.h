@@ -34,6 +34,7 @@
 #ifndef SPDK_NVMF_TRANSPORT_H
 #define SPDK_NVMF_TRANSPORT_H
 
+struct spdk_event;
 struct spdk_nvmf_conn;
 struct spdk_nvmf_discovery_log_page_entry;
 struct spdk_nvmf_listen_addr;
@@ -80,6 +81,12 @@ struct spdk_nvmf_transport {
 	 */
 	int (*conn_poll)(struct spdk_nvmf_conn *conn);
 
+	/*
+	 * Stop processing a connection that the transport polls itself.
+	 * complete is called once no more requests will be started on it.
+	 */
+	void (*conn_stop)(struct spdk_nvmf_conn *conn, struct spdk_event *complete);
+
 	/**
 	 * Fill out a discovery log entry for a specific listen address.
 	 */
@@ -95,5 +102,7 @@ int spdk_nvmf_acceptor_start(void);
 void spdk_nvmf_acceptor_stop(void);
 
 extern const struct spdk_nvmf_transport spdk_nvmf_transport_rdma;
+extern const struct spdk_nvmf_transport spdk_nvmf_transport_tcp;
+extern const struct spdk_nvmf_transport spdk_nvmf_transport_loopback;
 
 #endif /* SPDK_NVMF_TRANSPORT_H */
@@ -0,0 +1,366 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Virtual mode subsystems emulate an NVMe controller in software.  Each
+ * namespace is backed by an spdk_bdev, and NVM I/O commands are translated
+ * into bdev I/O.  Admin commands common to both modes are handled in
+ * request.c; the ones that depend on the backing storage end up here.
+ */
+
+#include <endian.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "nvmf_internal.h"
+#include "request.h"
+#include "session.h"
+#include "subsystem.h"
+
+#include "spdk/bdev.h"
+#include "spdk/log.h"
+#include "spdk/nvme_spec.h"
+#include "spdk/scsi_spec.h"
+
+#define NVMF_VIRTUAL_ACTIVE_NS_LIST_ENTRIES 1024
+
+static bool
+nvmf_virtual_identify_ns(struct spdk_nvmf_subsystem *subsystem, struct spdk_nvmf_request *req)
+{
+	struct spdk_nvme_cmd *cmd = &req->cmd->nvme_cmd;
+	struct spdk_nvme_cpl *response = &req->rsp->nvme_cpl;
+	struct spdk_nvme_ns_data *nsdata;
+	struct spdk_bdev *bdev;
+
+	if (cmd->nsid == 0 || cmd->nsid > subsystem->ns_count) {
+		SPDK_ERRLOG("Identify Namespace for invalid nsid %u\n", cmd->nsid);
+		response->status.sc = SPDK_NVME_SC_INVALID_NAMESPACE_OR_FORMAT;
+		return true;
+	}
+
+	bdev = subsystem->ns_list[cmd->nsid - 1];
+
+	nsdata = req->data;
+	memset(nsdata, 0, sizeof(*nsdata));
+	nsdata->nsze = bdev->blockcnt;
+	nsdata->ncap = bdev->blockcnt;
+	nsdata->nuse = bdev->blockcnt;
+	nsdata->nlbaf = 0;
+	nsdata->flbas.format = 0;
+	nsdata->lbaf[0].lbads = __builtin_ctzll(bdev->blocklen);
+
+	return true;
+}
+
+static bool
+nvmf_virtual_identify_active_ns_list(struct spdk_nvmf_subsystem *subsystem,
+				     struct spdk_nvmf_request *req)
+{
+	struct spdk_nvme_cmd *cmd = &req->cmd->nvme_cmd;
+	uint32_t *ns_list = req->data;
+	uint32_t nsid, count = 0;
+
+	memset(ns_list, 0, NVMF_VIRTUAL_ACTIVE_NS_LIST_ENTRIES * sizeof(uint32_t));
+
+	/* The list holds the active namespace IDs greater than the one in the command */
+	for (nsid = cmd->nsid + 1; nsid <= subsystem->ns_count; nsid++) {
+		ns_list[count++] = nsid;
+	}
+
+	return true;
+}
+
+static bool
+nvmf_virtual_get_log_page(struct spdk_nvmf_request *req)
+{
+	struct spdk_nvme_cmd *cmd = &req->cmd->nvme_cmd;
+	struct spdk_nvme_cpl *response = &req->rsp->nvme_cpl;
+	uint8_t lid = cmd->cdw10 & 0xFF;
+
+	switch (lid) {
+	case SPDK_NVME_LOG_ERROR:
+	case SPDK_NVME_LOG_HEALTH_INFORMATION:
+	case SPDK_NVME_LOG_FIRMWARE_SLOT:
+		/* Nothing to report for an emulated controller */
+		memset(req->data, 0, req->length);
+		return true;
+	default:
+		SPDK_ERRLOG("Unsupported log page %u\n", lid);
+		response->status.sc = SPDK_NVME_SC_INVALID_FIELD;
+		return true;
+	}
+}
+
+bool
+nvmf_virtual_process_admin_cmd(struct spdk_nvmf_request *req)
+{
+	struct spdk_nvmf_subsystem *subsystem = req->conn->sess->subsys;
+	struct spdk_nvme_cmd *cmd = &req->cmd->nvme_cmd;
+	struct spdk_nvme_cpl *response = &req->rsp->nvme_cpl;
+	uint8_t cns, feature;
+
+	/* pre-set response details for this command */
+	response->status.sc = SPDK_NVME_SC_SUCCESS;
+
+	switch (cmd->opc) {
+	case SPDK_NVME_OPC_IDENTIFY:
+		/* Identify Controller is answered from the session's vcdata in request.c */
+		if (req->data == NULL || req->length < sizeof(struct spdk_nvme_ns_data)) {
+			SPDK_ERRLOG("identify command with no buffer\n");
+			response->status.sc = SPDK_NVME_SC_INVALID_FIELD;
+			return true;
+		}
+
+		cns = cmd->cdw10 & 0xFF;
+		switch (cns) {
+		case SPDK_NVME_IDENTIFY_NS:
+			SPDK_TRACELOG(SPDK_TRACE_NVMF, "Identify Namespace %u\n", cmd->nsid);
+			return nvmf_virtual_identify_ns(subsystem, req);
+		case SPDK_NVME_IDENTIFY_ACTIVE_NS_LIST:
+			SPDK_TRACELOG(SPDK_TRACE_NVMF, "Identify Active Namespace List\n");
+			return nvmf_virtual_identify_active_ns_list(subsystem, req);
+		default:
+			SPDK_ERRLOG("Unsupported identify CNS 0x%02x\n", cns);
+			response->status.sc = SPDK_NVME_SC_INVALID_FIELD;
+			return true;
+		}
+
+	case SPDK_NVME_OPC_GET_LOG_PAGE:
+		if (req->data == NULL) {
+			SPDK_ERRLOG("get log page command with no buffer\n");
+			response->status.sc = SPDK_NVME_SC_INVALID_FIELD;
+			return true;
+		}
+		return nvmf_virtual_get_log_page(req);
+
+	case SPDK_NVME_OPC_GET_FEATURES:
+		feature = cmd->cdw10 & 0xff; /* mask out the FID value */
+		switch (feature) {
+		case SPDK_NVME_FEAT_VOLATILE_WRITE_CACHE:
+			/* Writes may be cached by the bdev until a Flush */
+			response->cdw0 = 1;
+			return true;
+		default:
+			SPDK_ERRLOG("Get Features - unsupported feature 0x%02x\n", feature);
+			response->status.sc = SPDK_NVME_SC_INVALID_FIELD;
+			return true;
+		}
+
+	case SPDK_NVME_OPC_SET_FEATURES:
+		feature = cmd->cdw10 & 0xff; /* mask out the FID value */
+		SPDK_ERRLOG("Set Features - unsupported feature 0x%02x\n", feature);
+		response->status.sc = SPDK_NVME_SC_INVALID_FIELD;
+		return true;
+
+	default:
+		SPDK_ERRLOG("Unsupported admin opc 0x%02x for Virtual subsystem\n", cmd->opc);
+		response->status.sc = SPDK_NVME_SC_INVALID_OPCODE;
+		return true;
+	}
+}
+
+static void
+nvmf_virtual_complete_cmd(spdk_event_t event)
+{
+	struct spdk_nvmf_request *req = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *bdev_io = spdk_event_get_arg2(event);
+	struct spdk_nvme_cpl *response = &req->rsp->nvme_cpl;
+
+	response->status.sct = SPDK_NVME_SCT_GENERIC;
+	if (bdev_io->status == SPDK_BDEV_IO_STATUS_SUCCESS) {
+		response->status.sc = SPDK_NVME_SC_SUCCESS;
+	} else {
+		response->status.sc = SPDK_NVME_SC_INTERNAL_DEVICE_ERROR;
+	}
+
+	spdk_bdev_free_io(bdev_io);
+	spdk_nvmf_request_complete(req);
+}
+
+static bool
+nvmf_virtual_rw_cmd(struct spdk_bdev *bdev, struct spdk_nvmf_request *req)
+{
+	struct spdk_nvme_cmd *cmd = &req->cmd->nvme_cmd;
+	struct spdk_nvme_cpl *response = &req->rsp->nvme_cpl;
+	uint64_t lba_address, lba_count, offset, nbytes;
+	struct spdk_bdev_io *bdev_io;
+
+	lba_address = ((uint64_t)cmd->cdw11 << 32) | cmd->cdw10;
+	lba_count = (cmd->cdw12 & 0xFFFFu) + 1;
+	offset = lba_address * bdev->blocklen;
+	nbytes = lba_count * bdev->blocklen;
+
+	if (lba_address >= bdev->blockcnt || lba_count > bdev->blockcnt - lba_address) {
+		SPDK_ERRLOG("LBA range 0x%" PRIx64 "+%" PRIu64 " beyond end of bdev %s\n",
+			    lba_address, lba_count, bdev->name);
+		response->status.sc = SPDK_NVME_SC_LBA_OUT_OF_RANGE;
+		return true;
+	}
+
+	if (req->data == NULL || nbytes > req->length) {
+		SPDK_ERRLOG("Transfer of %" PRIu64 " bytes exceeds SGL length %u\n",
+			    nbytes, req->length);
+		response->status.sc = SPDK_NVME_SC_DATA_SGL_LENGTH_INVALID;
+		return true;
+	}
+
+	if (cmd->opc == SPDK_NVME_OPC_READ) {
+		bdev_io = spdk_bdev_read(bdev, req->data, nbytes, offset,
+					 nvmf_virtual_complete_cmd, req);
+	} else {
+		bdev_io = spdk_bdev_write(bdev, req->data, nbytes, offset,
+					  nvmf_virtual_complete_cmd, req);
+	}
+
+	if (bdev_io == NULL) {
+		SPDK_ERRLOG("Failed to submit %s to bdev %s\n",
+			    cmd->opc == SPDK_NVME_OPC_READ ? "read" : "write", bdev->name);
+		response->status.sc = SPDK_NVME_SC_INTERNAL_DEVICE_ERROR;
+		return true;
+	}
+
+	return false;
+}
+
+static bool
+nvmf_virtual_flush_cmd(struct spdk_bdev *bdev, struct spdk_nvmf_request *req)
+{
+	struct spdk_nvme_cpl *response = &req->rsp->nvme_cpl;
+
+	if (spdk_bdev_flush(bdev, 0, bdev->blockcnt * bdev->blocklen,
+			    nvmf_virtual_complete_cmd, req) == NULL) {
+		SPDK_ERRLOG("Failed to submit flush to bdev %s\n", bdev->name);
+		response->status.sc = SPDK_NVME_SC_INTERNAL_DEVICE_ERROR;
+		return true;
+	}
+
+	return false;
+}
+
+static bool
+nvmf_virtual_dsm_cmd(struct spdk_bdev *bdev, struct spdk_nvmf_request *req)
+{
+	struct spdk_nvme_cmd *cmd = &req->cmd->nvme_cmd;
+	struct spdk_nvme_cpl *response = &req->rsp->nvme_cpl;
+	struct spdk_nvme_dsm_range *dsm_range;
+	struct spdk_scsi_unmap_bdesc *unmap;
+	uint64_t lba;
+	uint32_t nr, i, length;
+
+	if (!(cmd->cdw11 & SPDK_NVME_DSM_ATTR_DEALLOCATE)) {
+		/* Only deallocate has an effect; the other attributes are hints */
+		response->status.sc = SPDK_NVME_SC_SUCCESS;
+		return true;
+	}
+
+	nr = (cmd->cdw10 & 0xFF) + 1;
+	if (nr > bdev->max_unmap_bdesc_count) {
+		SPDK_ERRLOG("DSM with %u ranges, bdev %s supports %u\n",
+			    nr, bdev->name, bdev->max_unmap_bdesc_count);
+		response->status.sc = SPDK_NVME_SC_INVALID_FIELD;
+		return true;
+	}
+
+	if (req->data == NULL || nr * sizeof(struct spdk_nvme_dsm_range) > req->length) {
+		SPDK_ERRLOG("DSM range list exceeds SGL length %u\n", req->length);
+		response->status.sc = SPDK_NVME_SC_DATA_SGL_LENGTH_INVALID;
+		return true;
+	}
+
+	/*
+	 * A DSM range and an unmap block descriptor are both 16 bytes, so the
+	 * range list is converted in place.  Unmap descriptors are big endian.
+	 */
+	SPDK_STATIC_ASSERT(sizeof(struct spdk_nvme_dsm_range) == sizeof(struct spdk_scsi_unmap_bdesc),
+			   "DSM range and unmap descriptor sizes differ");
+	dsm_range = req->data;
+	unmap = req->data;
+	for (i = 0; i < nr; i++) {
+		lba = dsm_range[i].starting_lba;
+		length = dsm_range[i].length;
+
+		if (lba >= bdev->blockcnt || length > bdev->blockcnt - lba) {
+			SPDK_ERRLOG("DSM range 0x%" PRIx64 "+%u beyond end of bdev %s\n",
+				    lba, length, bdev->name);
+			response->status.sc = SPDK_NVME_SC_LBA_OUT_OF_RANGE;
+			return true;
+		}
+
+		unmap[i].lba = htobe64(lba);
+		unmap[i].block_count = htobe32(length);
+		unmap[i].reserved = 0;
+	}
+
+	if (spdk_bdev_unmap(bdev, unmap, nr, nvmf_virtual_complete_cmd, req) == NULL) {
+		SPDK_ERRLOG("Failed to submit unmap to bdev %s\n", bdev->name);
+		response->status.sc = SPDK_NVME_SC_INTERNAL_DEVICE_ERROR;
+		return true;
+	}
+
+	return false;
+}
+
+bool
+nvmf_virtual_process_io_cmd(struct spdk_nvmf_request *req)
+{
+	struct spdk_nvmf_subsystem *subsystem = req->conn->sess->subsys;
+	struct spdk_nvme_cmd *cmd = &req->cmd->nvme_cmd;
+	struct spdk_nvme_cpl *response = &req->rsp->nvme_cpl;
+	struct spdk_bdev *bdev;
+
+	/* pre-set response details for this command */
+	response->status.sc = SPDK_NVME_SC_SUCCESS;
+
+	if (cmd->nsid == 0 || cmd->nsid > subsystem->ns_count) {
+		SPDK_ERRLOG("I/O command for invalid nsid %u\n", cmd->nsid);
+		response->status.sc = SPDK_NVME_SC_INVALID_NAMESPACE_OR_FORMAT;
+		return true;
+	}
+
+	bdev = subsystem->ns_list[cmd->nsid - 1];
+
+	switch (cmd->opc) {
+	case SPDK_NVME_OPC_READ:
+	case SPDK_NVME_OPC_WRITE:
+		return nvmf_virtual_rw_cmd(bdev, req);
+	case SPDK_NVME_OPC_FLUSH:
+		return nvmf_virtual_flush_cmd(bdev, req);
+	case SPDK_NVME_OPC_DATASET_MANAGEMENT:
+		return nvmf_virtual_dsm_cmd(bdev, req);
+	default:
+		SPDK_ERRLOG("Unsupported I/O opc 0x%02x for Virtual subsystem\n", cmd->opc);
+		response->status.sc = SPDK_NVME_SC_INVALID_OPCODE;
+		return true;
+	}
+}
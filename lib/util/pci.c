@@ -452,6 +452,30 @@ spdk_pci_device_has_non_uio_driver(struct spdk_pci_device *dev)
 		strcmp(driver_begin, "vfio-pci") != 0);
 }
 
+int
+spdk_pci_device_get_socket_id(struct spdk_pci_device *dev)
+{
+	FILE *fd;
+	char filename[SPDK_PCI_PATH_MAX];
+	int socket_id;
+
+	snprintf(filename, sizeof(filename),
+		 SYSFS_PCI_DEVICES "/" PCI_PRI_FMT "/numa_node",
+		 spdk_pci_device_get_domain(dev), spdk_pci_device_get_bus(dev),
+		 spdk_pci_device_get_dev(dev), spdk_pci_device_get_func(dev));
+
+	fd = fopen(filename, "r");
+	if (!fd)
+		return -1;
+
+	/* The kernel reports -1 on machines without NUMA information. */
+	if (fscanf(fd, "%d", &socket_id) != 1)
+		socket_id = -1;
+
+	fclose(fd);
+	return socket_id;
+}
+
 
 int
 spdk_pci_device_unbind_kernel_driver(struct spdk_pci_device *dev)
@@ -678,6 +702,13 @@ spdk_pci_device_has_non_uio_driver(struct spdk_pci_device *dev)
 	}
 }
 
+int
+spdk_pci_device_get_socket_id(struct spdk_pci_device *dev)
+{
+	/* TODO */
+	return -1;
+}
+
 int
 spdk_pci_device_unbind_kernel_driver(struct spdk_pci_device *dev)
 {
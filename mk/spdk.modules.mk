@@ -3,9 +3,17 @@ BLOCKDEV_MODULES += $(SPDK_ROOT_DIR)/lib/bdev/malloc/libspdk_bdev_malloc.a
 BLOCKDEV_MODULES += $(SPDK_ROOT_DIR)/lib/bdev/nvme/libspdk_bdev_nvme.a \
 		    $(SPDK_ROOT_DIR)/lib/nvme/libspdk_nvme.a
 
+BLOCKDEV_MODULES += $(SPDK_ROOT_DIR)/lib/bdev/split/libspdk_bdev_split.a
+BLOCKDEV_MODULES += $(SPDK_ROOT_DIR)/lib/bdev/raid/libspdk_bdev_raid.a
+BLOCKDEV_MODULES += $(SPDK_ROOT_DIR)/lib/bdev/cache/libspdk_bdev_cache.a
+BLOCKDEV_MODULES += $(SPDK_ROOT_DIR)/lib/bdev/logcache/libspdk_bdev_logcache.a
+
 COPY_MODULES += $(SPDK_ROOT_DIR)/lib/copy/ioat/libspdk_copy_ioat.a \
 		$(SPDK_ROOT_DIR)/lib/ioat/libspdk_ioat.a
 
+# Not a module, but its RPC registers itself from a constructor like the modules do.
+COPY_MODULES += $(SPDK_ROOT_DIR)/lib/copy/rpc/libspdk_copy_rpc.a
+
 BLOCKDEV_MODULES_LINKER_ARGS = -Wl,--whole-archive \
 			       $(BLOCKDEV_MODULES) \
 			       -Wl,--no-whole-archive \
@@ -56,6 +56,7 @@ struct bdevperf_task {
 	struct iovec		iov;
 	struct io_target	*target;
 	void			*buf;
+	int			pattern;
 };
 
 static int g_io_size = 0;
@@ -70,6 +71,7 @@ static int g_time_in_sec;
 static int g_show_performance_real_time = 0;
 static bool g_run_failed = false;
 static bool g_zcopy = true;
+static bool g_lease = false;
 
 static struct rte_timer g_perf_timer;
 
@@ -133,6 +135,12 @@ bdevperf_construct_targets(void)
 			continue;
 		}
 
+		if (g_lease && !bdev->lease_supported) {
+			printf("Skipping %s because it does not support leases\n", bdev->name);
+			bdev_entry = bdev_entry->next;
+			continue;
+		}
+
 		target = malloc(sizeof(struct io_target));
 		if (!target) {
 			fprintf(stderr, "Unable to allocate memory for new target.\n");
@@ -177,31 +185,17 @@ end_run(spdk_event_t event)
 struct rte_mempool *task_pool;
 
 static void
-bdevperf_complete(spdk_event_t event)
+bdevperf_task_done(struct bdevperf_task *task)
 {
 	struct io_target	*target;
-	struct bdevperf_task	*task = spdk_event_get_arg1(event);
-	struct spdk_bdev_io	*bdev_io = spdk_event_get_arg2(event);
 	spdk_event_t		complete;
 
-	if (bdev_io->status != SPDK_BDEV_IO_STATUS_SUCCESS) {
-		g_run_failed = true;
-	} else if (g_verify || g_reset || g_unmap) {
-		if (memcmp(task->buf, bdev_io->u.read.buf, g_io_size) != 0) {
-			printf("Buffer mismatch! Disk Offset: %lu\n", bdev_io->u.read.offset);
-			g_run_failed = true;
-		}
-	}
-
 	target = task->target;
 	target->current_queue_depth--;
 	target->io_completed++;
 
-	bdev_io->caller_ctx = NULL;
 	rte_mempool_put(task_pool, task);
 
-	spdk_bdev_free_io(bdev_io);
-
 	/*
 	 * is_draining indicates when time has expired for the test run
 	 * and we are just waiting for the previously submitted I/O
@@ -216,6 +210,61 @@ bdevperf_complete(spdk_event_t event)
 	}
 }
 
+static void
+bdevperf_complete(spdk_event_t event)
+{
+	struct bdevperf_task	*task = spdk_event_get_arg1(event);
+	struct spdk_bdev_io	*bdev_io = spdk_event_get_arg2(event);
+
+	if (bdev_io->status != SPDK_BDEV_IO_STATUS_SUCCESS) {
+		g_run_failed = true;
+	} else if (g_verify || g_reset || g_unmap) {
+		if (memcmp(task->buf, bdev_io->u.read.buf, g_io_size) != 0) {
+			printf("Buffer mismatch! Disk Offset: %lu\n", bdev_io->u.read.offset);
+			g_run_failed = true;
+		}
+	}
+
+	bdev_io->caller_ctx = NULL;
+	spdk_bdev_free_io(bdev_io);
+
+	bdevperf_task_done(task);
+}
+
+static void
+bdevperf_lease_complete(spdk_event_t event)
+{
+	struct bdevperf_task	*task = spdk_event_get_arg1(event);
+	struct spdk_bdev_io	*bdev_io = spdk_event_get_arg2(event);
+	uint64_t		offset = bdev_io->u.lease.offset;
+	bool			write = bdev_io->u.lease.write;
+
+	if (bdev_io->status != SPDK_BDEV_IO_STATUS_SUCCESS) {
+		g_run_failed = true;
+		write = false;
+	} else if (write) {
+		/* Produce the data in place instead of copying it in. */
+		memset(bdev_io->u.lease.buf, task->pattern, g_io_size);
+	} else if (g_verify) {
+		if (memcmp(task->buf, bdev_io->u.lease.buf, g_io_size) != 0) {
+			printf("Buffer mismatch! Disk Offset: %lu\n", offset);
+			g_run_failed = true;
+		}
+	}
+
+	bdev_io->caller_ctx = NULL;
+	spdk_bdev_lease_release(bdev_io);
+
+	if (write && g_verify) {
+		/* Read the data back in */
+		spdk_bdev_lease(task->target->bdev, g_io_size, offset, false,
+				bdevperf_lease_complete, task);
+		return;
+	}
+
+	bdevperf_task_done(task);
+}
+
 static void
 bdevperf_unmap_complete(spdk_event_t event)
 {
@@ -282,6 +331,13 @@ task_ctor(struct rte_mempool *mp, void *arg, void *__task, unsigned id)
 
 static __thread unsigned int seed = 0;
 
+static bool
+bdevperf_next_is_read(void)
+{
+	return (g_rw_percentage == 100) ||
+	       (g_rw_percentage != 0 && ((rand_r(&seed) % 100) < g_rw_percentage));
+}
+
 static void
 bdevperf_submit_single(struct io_target *target)
 {
@@ -308,15 +364,22 @@ bdevperf_submit_single(struct io_target *target)
 		}
 	}
 
-	if (g_verify || g_reset || g_unmap) {
+	if (g_lease) {
+		task->pattern = rand_r(&seed) % 256;
+		if (g_verify) {
+			memset(task->buf, task->pattern, g_io_size);
+		}
+		spdk_bdev_lease(bdev, g_io_size, offset_in_ios * g_io_size,
+				g_verify || !bdevperf_next_is_read(),
+				bdevperf_lease_complete, task);
+	} else if (g_verify || g_reset || g_unmap) {
 		memset(task->buf, rand_r(&seed) % 256, g_io_size);
 		task->iov.iov_base = task->buf;
 		task->iov.iov_len = g_io_size;
 		spdk_bdev_writev(bdev, &task->iov, 1, g_io_size,
 				 offset_in_ios * g_io_size,
 				 bdevperf_verify_write_complete, task);
-	} else if ((g_rw_percentage == 100) ||
-		   (g_rw_percentage != 0 && ((rand_r(&seed) % 100) < g_rw_percentage))) {
+	} else if (bdevperf_next_is_read()) {
 		rbuf = g_zcopy ? NULL : task->buf;
 		spdk_bdev_read(bdev, rbuf, g_io_size,
 			       offset_in_ios * g_io_size,
@@ -419,6 +482,7 @@ static void usage(char *program_name)
 	printf("\t[-M rwmixread (100 for reads, 0 for writes)]\n");
 	printf("\t[-t time in seconds]\n");
 	printf("\t[-S Show performance result in real time]\n");
+	printf("\t[-z Use zero-copy leases instead of reads and writes]\n");
 }
 
 static void
@@ -446,6 +510,10 @@ performance_dump(int io_time)
 			printf("\r %-20s: %10.2f IO/s %10.2f MB/s\n",
 			       target->bdev->name, io_per_second,
 			       mb_per_second);
+			if (target->bdev->num_remote_io != 0) {
+				printf("\r %-20s  %" PRIu64 " of %" PRIu64 " I/O crossed sockets\n",
+				       "", target->bdev->num_remote_io, target->bdev->num_io);
+			}
 			total_io_per_second += io_per_second;
 			total_mb_per_second += mb_per_second;
 			target = target->next;
@@ -513,7 +581,7 @@ main(int argc, char **argv)
 	mix_specified = false;
 	core_mask = NULL;
 
-	while ((op = getopt(argc, argv, "c:m:q:s:t:w:M:S")) != -1) {
+	while ((op = getopt(argc, argv, "c:m:q:s:t:w:M:Sz")) != -1) {
 		switch (op) {
 		case 'c':
 			config_file = optarg;
@@ -540,6 +608,9 @@ main(int argc, char **argv)
 		case 'S':
 			g_show_performance_real_time = 1;
 			break;
+		case 'z':
+			g_lease = true;
+			break;
 		default:
 			usage(argv[0]);
 			exit(1);
@@ -606,6 +677,10 @@ main(int argc, char **argv)
 			core_mask = NULL;
 		}
 		g_verify = true;
+		if (g_lease && strcmp(workload_type, "verify")) {
+			fprintf(stderr, "-z can only be combined with the verify pattern.\n");
+			exit(1);
+		}
 		if (!strcmp(workload_type, "reset")) {
 			g_reset = true;
 		}
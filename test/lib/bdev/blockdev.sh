@@ -10,6 +10,10 @@ testdir=$(readlink -f $(dirname $0))
 
 timing_enter blockdev
 
+timing_enter unit
+$testdir/raid/raid_ut
+timing_exit unit
+
 timing_enter bounds
 $testdir/bdevio/bdevio $testdir/bdev.conf
 process_core
@@ -20,6 +24,20 @@ $testdir/bdevperf/bdevperf -c $testdir/bdev.conf -q 32 -s 4096 -w verify -t 5
 process_core
 timing_exit verify
 
+timing_enter lease
+$testdir/bdevperf/bdevperf -c $testdir/bdev.conf -q 32 -s 4096 -w verify -z -t 5
+process_core
+timing_exit lease
+
+# Verify partitions on their own, since their I/O is handed to the
+#  base blockdev at a different offset.
+timing_enter split
+$testdir/bdevperf/bdevperf -c $testdir/split.conf -q 32 -s 4096 -w verify -t 5
+process_core
+$testdir/bdevperf/bdevperf -c $testdir/split.conf -q 32 -s 4096 -w verify -z -t 5
+process_core
+timing_exit split
+
 # Use size 192KB which both exceeds typical 128KB max NVMe I/O
 #  size and will cross 128KB Intel DC P3700 stripe boundaries.
 timing_enter perf
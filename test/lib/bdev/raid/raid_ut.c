@@ -0,0 +1,264 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "spdk_cunit.h"
+
+#include "blockdev_raid.c"
+
+static int g_children;
+static int g_num_completed;
+static enum spdk_bdev_io_status g_status;
+
+void
+spdk_bdev_register(struct spdk_bdev *bdev)
+{
+}
+
+void
+spdk_vbdev_module_list_add(struct spdk_bdev_module_if *vbdev_module)
+{
+}
+
+struct spdk_bdev *
+spdk_bdev_db_get_by_name(const char *bdev_name)
+{
+	return NULL;
+}
+
+struct spdk_bdev_io *
+spdk_bdev_get_child_io(struct spdk_bdev_io *parent, struct spdk_bdev *bdev,
+		       spdk_bdev_io_completion_cb cb, void *cb_arg)
+{
+	struct spdk_bdev_io *child;
+
+	child = calloc(1, sizeof(*child));
+	SPDK_CU_ASSERT_FATAL(child != NULL);
+	child->bdev = bdev;
+	child->type = parent->type;
+	memcpy(&child->u, &parent->u, sizeof(child->u));
+	child->parent = parent;
+	TAILQ_INSERT_TAIL(&parent->child_io, child, link);
+	parent->children++;
+
+	return child;
+}
+
+int
+spdk_bdev_io_submit(struct spdk_bdev_io *bdev_io)
+{
+	g_children++;
+	return 0;
+}
+
+int
+spdk_bdev_free_io(struct spdk_bdev_io *bdev_io)
+{
+	free(bdev_io);
+	return 0;
+}
+
+void
+spdk_bdev_io_complete(struct spdk_bdev_io *bdev_io, enum spdk_bdev_io_status status)
+{
+	g_num_completed++;
+	g_status = status;
+}
+
+void
+spdk_bdev_io_get_rbuf(struct spdk_bdev_io *bdev_io, spdk_bdev_io_get_rbuf_cb cb)
+{
+	cb(bdev_io);
+}
+
+struct spdk_conf_section *
+spdk_conf_first_section(struct spdk_conf *cp)
+{
+	return NULL;
+}
+
+struct spdk_conf_section *
+spdk_conf_next_section(struct spdk_conf_section *sp)
+{
+	return NULL;
+}
+
+bool
+spdk_conf_section_match_prefix(const struct spdk_conf_section *sp, const char *name_prefix)
+{
+	return false;
+}
+
+char *
+spdk_conf_section_get_val(struct spdk_conf_section *sp, const char *key)
+{
+	return NULL;
+}
+
+char *
+spdk_conf_section_get_nmval(struct spdk_conf_section *sp, const char *key, int idx1, int idx2)
+{
+	return NULL;
+}
+
+int
+spdk_conf_section_get_intval(struct spdk_conf_section *sp, const char *key)
+{
+	return -1;
+}
+
+static void
+ut_init_bdev(struct spdk_bdev *bdev, const char *name)
+{
+	memset(bdev, 0, sizeof(*bdev));
+	snprintf(bdev->name, sizeof(bdev->name), "%s", name);
+	bdev->blocklen = 512;
+	bdev->blockcnt = 1024 * 1024;
+}
+
+static void
+test_duplicate_members(void)
+{
+	struct spdk_bdev bdev0, bdev1;
+	struct spdk_bdev *members[3];
+
+	ut_init_bdev(&bdev0, "Malloc0");
+	ut_init_bdev(&bdev1, "Malloc1");
+
+	/* The same blockdev twice, next to each other or not */
+	members[0] = &bdev0;
+	members[1] = &bdev0;
+	CU_ASSERT(create_raid_disk("Raid0", 0, 64, members, 2) == NULL);
+	CU_ASSERT(create_raid_disk("Raid1", 1, 0, members, 2) == NULL);
+
+	members[1] = &bdev1;
+	members[2] = &bdev0;
+	CU_ASSERT(create_raid_disk("Raid0", 0, 64, members, 3) == NULL);
+	CU_ASSERT(create_raid_disk("Raid1", 1, 0, members, 3) == NULL);
+
+	/* A refused RAID leaves its members free for another one */
+	CU_ASSERT(bdev0.claimed == false);
+	CU_ASSERT(bdev1.claimed == false);
+
+	/* A member that another blockdev already claimed */
+	bdev1.claimed = true;
+	CU_ASSERT(create_raid_disk("Raid0", 0, 64, members, 2) == NULL);
+	CU_ASSERT(bdev0.claimed == false);
+
+	CU_ASSERT(TAILQ_EMPTY(&g_raid_disks));
+}
+
+static void
+test_reset(void)
+{
+	struct spdk_bdev bdev0, bdev1;
+	struct raid_disk *rdisk;
+	struct spdk_bdev_io *bdev_io;
+	struct spdk_bdev_io *child;
+
+	ut_init_bdev(&bdev0, "Malloc0");
+	ut_init_bdev(&bdev1, "Malloc1");
+
+	rdisk = calloc(1, sizeof(*rdisk));
+	SPDK_CU_ASSERT_FATAL(rdisk != NULL);
+	rdisk->level = 1;
+	rdisk->num_members = 2;
+	rdisk->members[0] = &bdev0;
+	rdisk->members[1] = &bdev1;
+	snprintf(rdisk->disk.name, sizeof(rdisk->disk.name), "Raid1");
+
+	bdev_io = calloc(1, sizeof(*bdev_io) + sizeof(struct raid_io));
+	SPDK_CU_ASSERT_FATAL(bdev_io != NULL);
+	bdev_io->ctx = rdisk;
+	bdev_io->type = SPDK_BDEV_IO_TYPE_RESET;
+	TAILQ_INIT(&bdev_io->child_io);
+
+	/* A hard reset would drop other children in flight on the members. */
+	g_children = 0;
+	g_num_completed = 0;
+	bdev_io->u.reset.type = SPDK_BDEV_RESET_HARD;
+	blockdev_raid_submit_request(bdev_io);
+	CU_ASSERT(g_children == 0);
+	CU_ASSERT(g_num_completed == 1);
+	CU_ASSERT(g_status == SPDK_BDEV_IO_STATUS_FAILED);
+
+	/* A soft reset goes to every member. */
+	g_num_completed = 0;
+	bdev_io->u.reset.type = SPDK_BDEV_RESET_SOFT;
+	blockdev_raid_submit_request(bdev_io);
+	CU_ASSERT(g_children == 2);
+	CU_ASSERT(g_num_completed == 0);
+	CU_ASSERT(bdev_io->children == 2);
+	TAILQ_FOREACH(child, &bdev_io->child_io, link) {
+		CU_ASSERT(child->u.reset.type == SPDK_BDEV_RESET_SOFT);
+	}
+
+	while ((child = TAILQ_FIRST(&bdev_io->child_io)) != NULL) {
+		TAILQ_REMOVE(&bdev_io->child_io, child, link);
+		free(child);
+	}
+	free(bdev_io);
+	free(rdisk);
+}
+
+int main(int argc, char **argv)
+{
+	CU_pSuite	suite = NULL;
+	unsigned int	num_failures;
+
+	if (CU_initialize_registry() != CUE_SUCCESS) {
+		return CU_get_error();
+	}
+
+	suite = CU_add_suite("raid", NULL, NULL);
+	if (suite == NULL) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	if (
+		CU_add_test(suite, "duplicate_members", test_duplicate_members) == NULL ||
+		CU_add_test(suite, "reset", test_reset) == NULL) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	CU_basic_set_mode(CU_BRM_VERBOSE);
+	CU_basic_run_tests();
+	num_failures = CU_get_number_of_failures();
+	CU_cleanup_registry();
+	return num_failures;
+}
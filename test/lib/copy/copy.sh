@@ -0,0 +1,16 @@
+#!/usr/bin/env bash
+
+set -xe
+
+testdir=$(readlink -f $(dirname $0))
+rootdir="$testdir/../../.."
+source $rootdir/scripts/autotest_common.sh
+
+timing_enter copy
+
+timing_enter unit
+$valgrind $testdir/copy_engine/copy_engine_ut
+$valgrind $testdir/memcpy_nt/memcpy_nt_ut
+timing_exit unit
+
+timing_exit copy
@@ -0,0 +1,361 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+
+#include "spdk_cunit.h"
+
+#include "copy_engine.c"
+
+/* The helper core engine and the streaming copy are tested separately. */
+struct spdk_copy_engine *
+copy_engine_soft_start(uint64_t helper_mask)
+{
+	return NULL;
+}
+
+void
+copy_engine_soft_stop(void)
+{
+}
+
+size_t
+copy_engine_soft_get_ctx_size(void)
+{
+	return 0;
+}
+
+void
+spdk_memcpy_nt(void *dst, const void *src, size_t nbytes)
+{
+	memcpy(dst, src, nbytes);
+}
+
+const char *
+spdk_memcpy_nt_get_isa(void)
+{
+	return "sse2";
+}
+
+struct spdk_conf_section *
+spdk_conf_find_section(struct spdk_conf *cp, const char *name)
+{
+	return NULL;
+}
+
+char *
+spdk_conf_section_get_val(struct spdk_conf_section *sp, const char *key)
+{
+	return NULL;
+}
+
+int
+spdk_conf_section_get_intval(struct spdk_conf_section *sp, const char *key)
+{
+	return -1;
+}
+
+int
+spdk_app_parse_core_mask(const char *mask, uint64_t *cpumask)
+{
+	return -1;
+}
+
+void
+spdk_add_subsystem(struct spdk_subsystem *subsystem)
+{
+}
+
+static int	g_num_done;
+static int	g_status;
+
+static void
+ut_done(void *ref, int status)
+{
+	g_num_done++;
+	g_status = status;
+}
+
+/* Reap completions and check that exactly one arrived with the given status. */
+static void
+ut_expect_done(int status)
+{
+	g_num_done = 0;
+	g_status = INT32_MIN;
+	spdk_copy_check_io();
+	CU_ASSERT(g_num_done == 1);
+	CU_ASSERT(g_status == status);
+}
+
+static struct copy_task *g_task;
+
+static int
+ut_setup(void)
+{
+	RTE_PER_LCORE(_lcore_id) = 0;
+
+	if (copy_engine_mem_init() != 0) {
+		return -1;
+	}
+
+	g_task = calloc(1, spdk_copy_module_get_max_ctx_size());
+	return g_task == NULL ? -1 : 0;
+}
+
+static int
+ut_cleanup(void)
+{
+	free(g_task);
+	return 0;
+}
+
+static void
+test_fill(void)
+{
+	uint8_t buf[1000];
+
+	memset(buf, 0x11, sizeof(buf));
+	CU_ASSERT(spdk_copy_submit_fill(g_task, buf + 1, 0xa5, 998, ut_done) == 998);
+	ut_expect_done(0);
+	CU_ASSERT(buf[0] == 0x11);
+	CU_ASSERT(buf[1] == 0xa5);
+	CU_ASSERT(buf[998] == 0xa5);
+	CU_ASSERT(buf[999] == 0x11);
+
+	CU_ASSERT(spdk_copy_submit_fill(g_task, buf, 0, 0, ut_done) == 0);
+	ut_expect_done(0);
+	CU_ASSERT(buf[0] == 0x11);
+}
+
+static void
+test_compare(void)
+{
+	uint8_t a[512], b[512];
+	uint32_t i;
+
+	for (i = 0; i < sizeof(a); i++) {
+		a[i] = b[i] = i;
+	}
+
+	CU_ASSERT(spdk_copy_submit_compare(g_task, a, b, sizeof(a), ut_done) == sizeof(a));
+	ut_expect_done(0);
+
+	/* A difference in the last byte */
+	b[511] ^= 1;
+	CU_ASSERT(spdk_copy_submit_compare(g_task, a, b, sizeof(a), ut_done) == sizeof(a));
+	ut_expect_done(-EILSEQ);
+
+	/* ... outside of the compared range */
+	CU_ASSERT(spdk_copy_submit_compare(g_task, a, b, sizeof(a) - 1, ut_done) == sizeof(a) - 1);
+	ut_expect_done(0);
+}
+
+static void
+test_dualcast(void)
+{
+	/* Longer than one dualcast chunk and not a multiple of it */
+	size_t len = 2 * MEM_DUALCAST_CHUNK_SIZE + 123;
+	uint8_t *src, *dst1, *dst2;
+	size_t i;
+
+	src = malloc(len);
+	dst1 = calloc(1, len + 1);
+	dst2 = calloc(1, len + 1);
+	SPDK_CU_ASSERT_FATAL(src != NULL && dst1 != NULL && dst2 != NULL);
+
+	for (i = 0; i < len; i++) {
+		src[i] = i * 7;
+	}
+
+	CU_ASSERT(spdk_copy_submit_dualcast(g_task, dst1, dst2, src, len, ut_done) == (int64_t)len);
+	ut_expect_done(0);
+	CU_ASSERT(memcmp(dst1, src, len) == 0);
+	CU_ASSERT(memcmp(dst2, src, len) == 0);
+	CU_ASSERT(dst1[len] == 0);
+	CU_ASSERT(dst2[len] == 0);
+
+	free(src);
+	free(dst1);
+	free(dst2);
+}
+
+static void
+test_crc32c(void)
+{
+	char check[] = "123456789";
+	uint32_t crc, crc1;
+	uint8_t zeros[32] = {};
+
+	/* The standard CRC-32C check value */
+	CU_ASSERT(spdk_copy_submit_crc32c(g_task, &crc, check, 0, 9, ut_done) == 9);
+	ut_expect_done(0);
+	CU_ASSERT(crc == 0xE3069283);
+
+	/* Chained through seed, the CRC of the parts is the CRC of the whole. */
+	CU_ASSERT(spdk_copy_submit_crc32c(g_task, &crc1, check, 0, 4, ut_done) == 4);
+	ut_expect_done(0);
+	CU_ASSERT(spdk_copy_submit_crc32c(g_task, &crc, check + 4, crc1, 5, ut_done) == 5);
+	ut_expect_done(0);
+	CU_ASSERT(crc == 0xE3069283);
+
+	/* 32 bytes of zeros, from the iSCSI test vectors (RFC 3720 B.4) */
+	CU_ASSERT(spdk_copy_submit_crc32c(g_task, &crc, zeros, 0, sizeof(zeros), ut_done) == 32);
+	ut_expect_done(0);
+	CU_ASSERT(crc == 0x8A9136AA);
+
+	/* No data leaves the seed unchanged. */
+	CU_ASSERT(spdk_copy_submit_crc32c(g_task, &crc, check, 0x12345678, 0, ut_done) == 0);
+	ut_expect_done(0);
+	CU_ASSERT(crc == 0x12345678);
+}
+
+/* A hardware engine with only copy, which refuses requests while g_hw_busy is set */
+static bool	g_hw_busy;
+static int	g_hw_submitted;
+static copy_completion_cb g_hw_cb;
+static void	*g_hw_cb_arg;
+
+static int64_t
+ut_hw_copy(void *cb_arg, void *dst, void *src, uint64_t nbytes, copy_completion_cb cb)
+{
+	if (g_hw_busy) {
+		return -1;
+	}
+
+	memcpy(dst, src, nbytes);
+	g_hw_submitted++;
+	g_hw_cb = cb;
+	g_hw_cb_arg = cb_arg;
+	return nbytes;
+}
+
+static void
+ut_hw_check_io(void)
+{
+	copy_completion_cb cb = g_hw_cb;
+
+	if (cb != NULL) {
+		g_hw_cb = NULL;
+		cb((uint8_t *)g_hw_cb_arg - offsetof(struct copy_task, offload_ctx), 0);
+	}
+}
+
+static struct spdk_copy_engine ut_hw_engine = {
+	.copy		= ut_hw_copy,
+	.check_io	= ut_hw_check_io,
+};
+
+static void
+test_hw_fallback(void)
+{
+	struct spdk_copy_engine_stats stats;
+	uint8_t src[4096], dst[4096];
+	uint32_t crc;
+
+	memset(src, 0x5a, sizeof(src));
+	spdk_copy_engine_register(&ut_hw_engine);
+	g_hw_threshold = 1024;
+
+	/* Copies at or above the threshold go to the hardware... */
+	CU_ASSERT(spdk_copy_submit(g_task, dst, src, sizeof(src), ut_done) == sizeof(src));
+	CU_ASSERT(g_hw_submitted == 1);
+	ut_expect_done(0);
+	CU_ASSERT(g_copy_lcore[0].hw_outstanding == 0);
+
+	/* ...smaller ones to the CPU. */
+	CU_ASSERT(spdk_copy_submit(g_task, dst, src, 512, ut_done) == 512);
+	CU_ASSERT(g_hw_submitted == 1);
+	ut_expect_done(0);
+
+	/* A request the hardware refuses runs on the CPU. */
+	g_hw_busy = true;
+	memset(dst, 0, sizeof(dst));
+	CU_ASSERT(spdk_copy_submit(g_task, dst, src, sizeof(src), ut_done) == sizeof(src));
+	ut_expect_done(0);
+	CU_ASSERT(memcmp(dst, src, sizeof(src)) == 0);
+	CU_ASSERT(g_copy_lcore[0].hw_outstanding == 0);
+	g_hw_busy = false;
+
+	/* Operations the hardware lacks run on the CPU and still complete. */
+	CU_ASSERT(spdk_copy_submit_crc32c(g_task, &crc, src, 0, sizeof(src), ut_done) == sizeof(src));
+	ut_expect_done(0);
+	CU_ASSERT(spdk_copy_submit_fill(g_task, dst, 0, sizeof(dst), ut_done) == sizeof(dst));
+	ut_expect_done(0);
+	CU_ASSERT(dst[0] == 0 && dst[sizeof(dst) - 1] == 0);
+
+	spdk_copy_engine_get_stats(0, &stats);
+	CU_ASSERT(stats.hw_ops == 1);
+	CU_ASSERT(stats.hw_bytes == sizeof(src));
+	CU_ASSERT(stats.cpu_small_ops == 1);
+	CU_ASSERT(stats.cpu_backlog_ops == 1);
+
+	hw_copy_engine = NULL;
+	g_hw_threshold = 0;
+}
+
+int main(int argc, char **argv)
+{
+	CU_pSuite	suite = NULL;
+	unsigned int	num_failures;
+
+	if (CU_initialize_registry() != CUE_SUCCESS) {
+		return CU_get_error();
+	}
+
+	suite = CU_add_suite("copy_engine", ut_setup, ut_cleanup);
+	if (suite == NULL) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	if (
+		CU_add_test(suite, "fill", test_fill) == NULL ||
+		CU_add_test(suite, "compare", test_compare) == NULL ||
+		CU_add_test(suite, "dualcast", test_dualcast) == NULL ||
+		CU_add_test(suite, "crc32c", test_crc32c) == NULL ||
+		CU_add_test(suite, "hw_fallback", test_hw_fallback) == NULL) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	CU_basic_set_mode(CU_BRM_VERBOSE);
+	CU_basic_run_tests();
+	num_failures = CU_get_number_of_failures();
+	CU_cleanup_registry();
+	return num_failures;
+}
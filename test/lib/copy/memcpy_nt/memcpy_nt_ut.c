@@ -0,0 +1,186 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "spdk_cunit.h"
+
+#include "memcpy_nt.c"
+
+#define UT_BUF_SIZE	(16 * 1024)
+#define UT_GUARD	0xee
+
+static uint8_t *g_src;
+static uint8_t *g_dst;
+static uint8_t *g_expected;
+
+/*
+ * Copy nbytes from g_src + src_off to g_dst + dst_off and check the result
+ * against memcpy(), including the bytes on either side of the destination.
+ */
+static void
+ut_check_copy(size_t dst_off, size_t src_off, size_t nbytes)
+{
+	memset(g_dst, UT_GUARD, UT_BUF_SIZE);
+	memset(g_expected, UT_GUARD, UT_BUF_SIZE);
+
+	memcpy(g_expected + dst_off, g_src + src_off, nbytes);
+	spdk_memcpy_nt(g_dst + dst_off, g_src + src_off, nbytes);
+
+	CU_ASSERT(memcmp(g_dst, g_expected, UT_BUF_SIZE) == 0);
+}
+
+/* Run the sizes and alignments below through each variant the CPU supports. */
+static void
+ut_check_variant(memcpy_nt_fn fn)
+{
+	static const size_t sizes[] = {
+		0, 1, 63, 64, MEMCPY_NT_MIN_SIZE - 1, MEMCPY_NT_MIN_SIZE, MEMCPY_NT_MIN_SIZE + 1,
+		1000, 4096, 4096 + 63, 8192 + 17, UT_BUF_SIZE - 128
+	};
+	static const size_t offsets[] = { 0, 1, 8, 31, 32, 63 };
+	size_t i, d, s;
+
+	g_memcpy_nt = fn;
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		for (d = 0; d < sizeof(offsets) / sizeof(offsets[0]); d++) {
+			for (s = 0; s < sizeof(offsets) / sizeof(offsets[0]); s++) {
+				ut_check_copy(offsets[d], offsets[s], sizes[i]);
+			}
+		}
+	}
+}
+
+static void
+test_sse2(void)
+{
+	ut_check_variant(memcpy_nt_sse2);
+}
+
+static void
+test_avx2(void)
+{
+	if (rte_cpu_get_flag_enabled(RTE_CPUFLAG_AVX2) <= 0) {
+		printf("AVX2 not supported; skipped\n");
+		return;
+	}
+	ut_check_variant(memcpy_nt_avx2);
+}
+
+static void
+test_avx512(void)
+{
+	if (rte_cpu_get_flag_enabled(RTE_CPUFLAG_AVX512F) <= 0) {
+		printf("AVX-512 not supported; skipped\n");
+		return;
+	}
+	ut_check_variant(memcpy_nt_avx512);
+}
+
+static void
+test_isa(void)
+{
+	memcpy_nt_select();
+
+	if (rte_cpu_get_flag_enabled(RTE_CPUFLAG_AVX512F) > 0) {
+		CU_ASSERT(strcmp(spdk_memcpy_nt_get_isa(), "avx512") == 0);
+	} else if (rte_cpu_get_flag_enabled(RTE_CPUFLAG_AVX2) > 0) {
+		CU_ASSERT(strcmp(spdk_memcpy_nt_get_isa(), "avx2") == 0);
+	} else {
+		CU_ASSERT(strcmp(spdk_memcpy_nt_get_isa(), "sse2") == 0);
+	}
+}
+
+static int
+ut_setup(void)
+{
+	size_t i;
+
+	/* Page aligned, so that the offsets above are offsets from a 64-byte boundary */
+	if (posix_memalign((void **)&g_src, 4096, UT_BUF_SIZE) != 0 ||
+	    posix_memalign((void **)&g_dst, 4096, UT_BUF_SIZE) != 0 ||
+	    posix_memalign((void **)&g_expected, 4096, UT_BUF_SIZE) != 0) {
+		return -1;
+	}
+
+	for (i = 0; i < UT_BUF_SIZE; i++) {
+		g_src[i] = (i * 13) ^ (i >> 8);
+	}
+
+	return 0;
+}
+
+static int
+ut_cleanup(void)
+{
+	free(g_src);
+	free(g_dst);
+	free(g_expected);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	CU_pSuite	suite = NULL;
+	unsigned int	num_failures;
+
+	if (CU_initialize_registry() != CUE_SUCCESS) {
+		return CU_get_error();
+	}
+
+	suite = CU_add_suite("memcpy_nt", ut_setup, ut_cleanup);
+	if (suite == NULL) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	if (
+		CU_add_test(suite, "sse2", test_sse2) == NULL ||
+		CU_add_test(suite, "avx2", test_avx2) == NULL ||
+		CU_add_test(suite, "avx512", test_avx512) == NULL ||
+		CU_add_test(suite, "isa", test_isa) == NULL) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	CU_basic_set_mode(CU_BRM_VERBOSE);
+	CU_basic_run_tests();
+	num_failures = CU_get_number_of_failures();
+	CU_cleanup_registry();
+	return num_failures;
+}
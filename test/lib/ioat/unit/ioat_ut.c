@@ -83,6 +83,119 @@ static void ioat_state_check(void)
 	CU_ASSERT(is_ioat_halted(7) == 0); /* reserved */
 }
 
+static void ioat_build_flush(void)
+{
+	struct spdk_ioat_chan ioat = {};
+	struct spdk_ioat_registers regs = {};
+	uint8_t src[64], dst[64];
+	uint32_t i;
+
+	ioat.regs = &regs;
+	ioat.ring_size_order = 2;
+	ioat.max_xfer_size = 1ULL << 20;
+	ioat.ring = calloc(1 << ioat.ring_size_order, sizeof(*ioat.ring));
+	ioat.hw_ring = calloc(1 << ioat.ring_size_order, sizeof(*ioat.hw_ring));
+	CU_ASSERT_FATAL(ioat.ring != NULL && ioat.hw_ring != NULL);
+
+	/* Built requests do not touch the doorbell until flushed. */
+	CU_ASSERT(spdk_ioat_build_copy(&ioat, NULL, NULL, dst, src, sizeof(src)) == sizeof(src));
+	CU_ASSERT(spdk_ioat_build_copy(&ioat, NULL, NULL, dst, src, sizeof(src)) == sizeof(src));
+	CU_ASSERT(ioat.head == 2);
+	CU_ASSERT(regs.dmacount == 0);
+
+	spdk_ioat_flush(&ioat);
+	CU_ASSERT(regs.dmacount == 2);
+
+	/* One slot is always left empty; a full ring leaves head unchanged. */
+	CU_ASSERT(spdk_ioat_build_copy(&ioat, NULL, NULL, dst, src, sizeof(src)) == sizeof(src));
+	CU_ASSERT(spdk_ioat_build_copy(&ioat, NULL, NULL, dst, src, sizeof(src)) == -1);
+	CU_ASSERT(ioat.head == 3);
+
+	/* submit_copy is build plus flush. */
+	ioat.tail = ioat.head;
+	CU_ASSERT(spdk_ioat_submit_copy(&ioat, NULL, NULL, dst, src, sizeof(src)) == sizeof(src));
+	CU_ASSERT(regs.dmacount == 4);
+
+	/*
+	 * A copy split into more descriptors than the ring has room for builds
+	 * none of them, so nothing without a callback can reach the hardware.
+	 */
+	ioat.max_xfer_size = 16;
+	CU_ASSERT(spdk_ioat_build_copy(&ioat, NULL, NULL, dst, src, sizeof(src)) == -1);
+	CU_ASSERT(ioat.head == 4);
+	spdk_ioat_flush(&ioat);
+	CU_ASSERT(regs.dmacount == 4);
+
+	for (i = 0; i < (1u << ioat.ring_size_order); i++) {
+		CU_ASSERT(ioat.hw_ring[i].dma.u.control.op == SPDK_IOAT_OP_COPY);
+	}
+
+	free(ioat.ring);
+	free(ioat.hw_ring);
+}
+
+static void ioat_build_copyv(void)
+{
+	struct spdk_ioat_chan ioat = {};
+	struct spdk_ioat_registers regs = {};
+	uint8_t src[256], dst[256];
+	struct iovec src_iovs[4], dst_iovs[2];
+	uint32_t i;
+
+	ioat.regs = &regs;
+	ioat.ring_size_order = 2;
+	ioat.max_xfer_size = 1ULL << 20;
+	ioat.ring = calloc(1 << ioat.ring_size_order, sizeof(*ioat.ring));
+	ioat.hw_ring = calloc(1 << ioat.ring_size_order, sizeof(*ioat.hw_ring));
+	CU_ASSERT_FATAL(ioat.ring != NULL && ioat.hw_ring != NULL);
+
+	/* Adjacent source pieces are merged into a single descriptor. */
+	for (i = 0; i < 4; i++) {
+		src_iovs[i].iov_base = src + i * 64;
+		src_iovs[i].iov_len = 64;
+	}
+	dst_iovs[0].iov_base = dst;
+	dst_iovs[0].iov_len = sizeof(dst);
+	CU_ASSERT(spdk_ioat_build_copyv(&ioat, NULL, NULL, dst_iovs, 1, src_iovs, 4) == sizeof(src));
+	CU_ASSERT(ioat.head == 1);
+	CU_ASSERT(ioat.hw_ring[0].dma.size == sizeof(src));
+	CU_ASSERT(ioat.hw_ring[0].dma.u.control.completion_update == 1);
+
+	/* Lengths that do not add up are rejected. */
+	dst_iovs[0].iov_len = 128;
+	CU_ASSERT(spdk_ioat_build_copyv(&ioat, NULL, NULL, dst_iovs, 1, src_iovs, 4) == -1);
+	CU_ASSERT(ioat.head == 1);
+
+	/* Non-contiguous pieces take a descriptor each; only the last signals. */
+	src_iovs[0].iov_base = src + 128;
+	src_iovs[0].iov_len = 128;
+	src_iovs[1].iov_base = src;
+	src_iovs[1].iov_len = 128;
+	dst_iovs[0].iov_base = dst;
+	dst_iovs[0].iov_len = 128;
+	dst_iovs[1].iov_base = dst + 128;
+	dst_iovs[1].iov_len = 128;
+	CU_ASSERT(spdk_ioat_build_copyv(&ioat, NULL, NULL, dst_iovs, 2, src_iovs, 2) == sizeof(src));
+	CU_ASSERT(ioat.head == 3);
+	CU_ASSERT(ioat.hw_ring[1].dma.u.control.completion_update == 0);
+	CU_ASSERT(ioat.hw_ring[2].dma.u.control.completion_update == 1);
+	CU_ASSERT(regs.dmacount == 0);
+
+	/* A request that does not fit in the ring builds nothing. */
+	ioat.tail = 1;
+	CU_ASSERT(spdk_ioat_submit_copyv(&ioat, NULL, NULL, dst_iovs, 2, src_iovs, 2) == -1);
+	CU_ASSERT(ioat.head == 3);
+	CU_ASSERT(regs.dmacount == 0);
+
+	/* submit_copyv is build plus flush. */
+	ioat.tail = ioat.head;
+	CU_ASSERT(spdk_ioat_submit_copyv(&ioat, NULL, NULL, dst_iovs, 2, src_iovs, 2) == sizeof(src));
+	CU_ASSERT(regs.dmacount == 5);
+
+	free(ioat.ring);
+	free(ioat.hw_ring);
+}
+
 int main(int argc, char **argv)
 {
 	CU_pSuite	suite = NULL;
@@ -99,7 +212,9 @@ int main(int argc, char **argv)
 	}
 
 	if (
-		CU_add_test(suite, "ioat_state_check", ioat_state_check) == NULL) {
+		CU_add_test(suite, "ioat_state_check", ioat_state_check) == NULL ||
+		CU_add_test(suite, "ioat_build_flush", ioat_build_flush) == NULL ||
+		CU_add_test(suite, "ioat_build_copyv", ioat_build_copyv) == NULL) {
 		CU_cleanup_registry();
 		return CU_get_error();
 	}
@@ -34,6 +34,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
 #include <rte_config.h>
 #include <rte_eal.h>
@@ -120,6 +121,62 @@ vtophys_positive_test(void)
 	return rc;
 }
 
+static int
+mem_register_test(void)
+{
+	void *p;
+	size_t len = 4 * SPDK_MEM_REGISTER_ALIGN;
+	int rc = 0;
+
+	p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (p == MAP_FAILED) {
+		printf("mem_register_test skipped (no free huge pages)\n");
+		return 0;
+	}
+
+	if (spdk_mem_register((char *)p + 1, len - SPDK_MEM_REGISTER_ALIGN) == 0) {
+		rc = -1;
+		printf("Err: unaligned region registered\n");
+	}
+
+	if (spdk_mem_register(p, len) != 0) {
+		rc = -1;
+		printf("Err: VA=%p could not be registered\n", p);
+		goto out;
+	}
+
+	if (spdk_vtophys(p) == SPDK_VTOPHYS_ERROR ||
+	    spdk_vtophys((char *)p + len - 1) == SPDK_VTOPHYS_ERROR) {
+		rc = -1;
+		printf("Err: VA=%p is registered but not translated\n", p);
+	}
+
+	if (spdk_mem_register(p, SPDK_MEM_REGISTER_ALIGN) == 0) {
+		rc = -1;
+		printf("Err: overlapping region registered\n");
+	}
+
+	if (spdk_mem_unregister(p, len) != 0) {
+		rc = -1;
+		printf("Err: VA=%p could not be unregistered\n", p);
+	}
+
+	if (spdk_vtophys(p) != SPDK_VTOPHYS_ERROR) {
+		rc = -1;
+		printf("Err: VA=%p is still translated after unregister\n", p);
+	}
+
+out:
+	munmap(p, len);
+
+	if (!rc)
+		printf("mem_register_test passed\n");
+	else
+		printf("mem_register_test failed\n");
+
+	return rc;
+}
 
 int
 main(int argc, char **argv)
@@ -139,5 +196,9 @@ main(int argc, char **argv)
 		return rc;
 
 	rc = vtophys_positive_test();
+	if (rc < 0)
+		return rc;
+
+	rc = mem_register_test();
 	return rc;
 }
@@ -12,6 +12,41 @@ timing_enter unit
 $testdir/request/request_ut
 $testdir/session/session_ut
 $testdir/subsystem/subsystem_ut
+$testdir/virtual/virtual_ut
+$testdir/tcp/tcp_ut
 timing_exit unit
 
+timing_enter nvmfperf
+$testdir/nvmfperf/nvmfperf -c $testdir/loopback.conf -n nqn.2016-06.io.spdk:loopback1 -q 32 -s 4096 -w randrw -M 50 -t 5
+timing_exit nvmfperf
+
+# Write and read back a pattern through the kernel NVMe/TCP host, if there is one.
+if modprobe nvme-tcp 2>/dev/null && hash nvme 2>/dev/null; then
+	timing_enter tcp
+	$rootdir/app/nvmf_tgt/nvmf_tgt -c $testdir/tcp.conf -t nvmf -t tcp &
+	nvmfpid=$!
+	trap "killprocess $nvmfpid; exit 1" SIGINT SIGTERM EXIT
+	sleep 5
+
+	nvme connect -t tcp -a 127.0.0.1 -s 4420 -n nqn.2016-06.io.spdk:tcp1
+	sleep 2
+	trap "nvme disconnect -n nqn.2016-06.io.spdk:tcp1; killprocess $nvmfpid; exit 1" SIGINT SIGTERM EXIT
+	dev=$(nvme list | awk '/SPDK Virtual Controller/ {print $1; exit}')
+	[ -b "$dev" ]
+
+	dd if=/dev/urandom of=/tmp/nvmf_tcp_pattern bs=4096 count=1024
+	dd if=/tmp/nvmf_tcp_pattern of=$dev bs=4096 count=1024 oflag=direct
+	dd if=$dev of=/tmp/nvmf_tcp_readback bs=4096 count=1024 iflag=direct
+	cmp /tmp/nvmf_tcp_pattern /tmp/nvmf_tcp_readback
+	rm -f /tmp/nvmf_tcp_pattern /tmp/nvmf_tcp_readback
+
+	trap - SIGINT SIGTERM EXIT
+	nvme disconnect -n nqn.2016-06.io.spdk:tcp1
+	rmmod nvme-tcp
+	killprocess $nvmfpid
+	timing_exit tcp
+else
+	echo "no kernel NVMe/TCP host; skipping the TCP listener test"
+fi
+
 timing_exit nvmf
@@ -0,0 +1,653 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (C) 2008-2012 Daisuke Aoyama <aoyama@peach.ne.jp>.
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Drives I/O through the NVMf target from inside the target process using the
+ * loopback transport, so that the cost of the target itself can be measured
+ * without a NIC or a remote host.
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <rte_config.h>
+#include <rte_cycles.h>
+#include <rte_debug.h>
+#include <rte_eal.h>
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+#include <rte_timer.h>
+
+#include "spdk/event.h"
+#include "spdk/log.h"
+#include "spdk/nvme_spec.h"
+#include "spdk/nvmf_spec.h"
+
+#include "nvmf/loopback.h"
+#include "nvmf/nvmf_internal.h"
+#include "nvmf/transport.h"
+
+#define NVMFPERF_HOSTNQN		"nqn.2016-06.io.spdk:nvmfperf"
+#define NVMFPERF_ADMIN_QUEUE_DEPTH	32
+
+struct nvmfperf_task {
+	struct nvmfperf_worker		*worker;
+	void				*buf;
+	uint64_t			submit_tsc;
+};
+
+struct nvmfperf_worker {
+	unsigned			lcore;
+	uint16_t			qid;
+	struct spdk_nvmf_loopback_qpair	*qpair;
+	struct spdk_poller		poller;
+	struct spdk_nvmf_fabric_connect_data *connect_data;
+	struct nvmfperf_task		*tasks;
+
+	uint64_t			io_completed;
+	uint64_t			total_tsc;
+	int				current_queue_depth;
+	uint64_t			offset_in_ios;
+	bool				is_draining;
+	struct rte_timer		run_timer;
+};
+
+static struct {
+	struct spdk_nvmf_loopback_qpair	*qpair;
+	struct spdk_poller		poller;
+	void				*buf;
+} g_admin;
+
+static const char *g_subnqn;
+static int g_io_size;
+/* initialize to invalid value so we can detect if user overrides it. */
+static int g_rw_percentage = -1;
+static int g_is_random;
+static int g_queue_depth;
+static int g_time_in_sec;
+static bool g_run_failed = false;
+
+static uint32_t g_block_size;
+static uint64_t g_size_in_ios;
+
+static struct nvmfperf_worker *g_workers[RTE_MAX_LCORE];
+static int g_worker_count;
+
+static void nvmfperf_submit_single(struct nvmfperf_worker *worker, struct nvmfperf_task *task);
+
+static void
+nvmfperf_process_completions(void *arg)
+{
+	struct spdk_nvmf_loopback_qpair **qpair = arg;
+
+	/* The queue pair is released before the poller is gone */
+	if (*qpair != NULL) {
+		spdk_nvmf_loopback_process_completions(*qpair, 0);
+	}
+}
+
+static void
+nvmfperf_stop(spdk_event_t event)
+{
+	spdk_nvmf_transport_loopback.transport_stop();
+	spdk_app_stop(g_run_failed ? 1 : 0);
+}
+
+static void
+nvmfperf_shutdown(void)
+{
+	spdk_event_t event;
+
+	event = spdk_event_allocate(rte_get_master_lcore(), nvmfperf_stop, NULL, NULL, NULL);
+
+	if (g_admin.qpair == NULL) {
+		spdk_event_call(event);
+		return;
+	}
+
+	spdk_poller_unregister(&g_admin.poller, event);
+	spdk_nvmf_loopback_qpair_free(g_admin.qpair);
+	g_admin.qpair = NULL;
+}
+
+static void
+end_run(spdk_event_t event)
+{
+	if (--g_worker_count == 0) {
+		nvmfperf_shutdown();
+	}
+}
+
+static void
+nvmfperf_fail(const char *msg, const struct spdk_nvme_cpl *cpl)
+{
+	fprintf(stderr, "%s failed (sct 0x%x sc 0x%x)\n", msg, cpl->status.sct, cpl->status.sc);
+	g_run_failed = true;
+}
+
+static int
+nvmfperf_connect(struct spdk_nvmf_loopback_qpair *qpair, uint16_t qid, uint16_t queue_depth,
+		 uint16_t cntlid, struct spdk_nvmf_fabric_connect_data *data,
+		 spdk_nvmf_loopback_cb cb_fn, void *cb_arg)
+{
+	struct spdk_nvmf_fabric_connect_cmd cmd = {};
+
+	memset(data, 0, sizeof(*data));
+	data->cntlid = cntlid;
+	snprintf((char *)data->subnqn, sizeof(data->subnqn), "%s", g_subnqn);
+	snprintf((char *)data->hostnqn, sizeof(data->hostnqn), "%s", NVMFPERF_HOSTNQN);
+
+	cmd.opcode = SPDK_NVME_OPC_FABRIC;
+	cmd.fctype = SPDK_NVMF_FABRIC_COMMAND_CONNECT;
+	cmd.qid = qid;
+	cmd.sqsize = queue_depth - 1;
+
+	return spdk_nvmf_loopback_submit(qpair, (struct spdk_nvme_cmd *)&cmd, data, sizeof(*data),
+					 cb_fn, cb_arg);
+}
+
+/* I/O queues */
+
+static void
+nvmfperf_worker_done(struct nvmfperf_worker *worker)
+{
+	spdk_event_t event;
+
+	event = spdk_event_allocate(rte_get_master_lcore(), end_run, NULL, NULL, NULL);
+	spdk_poller_unregister(&worker->poller, event);
+	spdk_nvmf_loopback_qpair_free(worker->qpair);
+	worker->qpair = NULL;
+}
+
+static void
+nvmfperf_io_complete(void *cb_arg, const struct spdk_nvme_cpl *cpl)
+{
+	struct nvmfperf_task	*task = cb_arg;
+	struct nvmfperf_worker	*worker = task->worker;
+
+	if (spdk_nvme_cpl_is_error(cpl)) {
+		nvmfperf_fail("I/O", cpl);
+	}
+
+	worker->current_queue_depth--;
+	worker->io_completed++;
+	worker->total_tsc += rte_get_timer_cycles() - task->submit_tsc;
+
+	/*
+	 * is_draining indicates when time has expired for the test run
+	 * and we are just waiting for the previously submitted I/O
+	 * to complete.  In this case, do not submit a new I/O to replace
+	 * the one just completed.
+	 */
+	if (!worker->is_draining) {
+		nvmfperf_submit_single(worker, task);
+	} else if (worker->current_queue_depth == 0) {
+		nvmfperf_worker_done(worker);
+	}
+}
+
+static __thread unsigned int seed = 0;
+
+static void
+nvmfperf_submit_single(struct nvmfperf_worker *worker, struct nvmfperf_task *task)
+{
+	struct spdk_nvme_cmd	cmd = {};
+	uint64_t		offset_in_ios, lba;
+	uint32_t		lba_count;
+
+	if (g_is_random) {
+		offset_in_ios = rand_r(&seed) % g_size_in_ios;
+	} else {
+		offset_in_ios = worker->offset_in_ios++;
+		if (worker->offset_in_ios == g_size_in_ios) {
+			worker->offset_in_ios = 0;
+		}
+	}
+
+	lba = offset_in_ios * g_io_size / g_block_size;
+	lba_count = g_io_size / g_block_size;
+
+	if ((g_rw_percentage == 100) ||
+	    (g_rw_percentage != 0 && ((rand_r(&seed) % 100) < g_rw_percentage))) {
+		cmd.opc = SPDK_NVME_OPC_READ;
+	} else {
+		cmd.opc = SPDK_NVME_OPC_WRITE;
+	}
+	cmd.nsid = 1;
+	cmd.cdw10 = (uint32_t)lba;
+	cmd.cdw11 = (uint32_t)(lba >> 32);
+	cmd.cdw12 = lba_count - 1;
+
+	task->submit_tsc = rte_get_timer_cycles();
+	if (spdk_nvmf_loopback_submit(worker->qpair, &cmd, task->buf, g_io_size,
+				      nvmfperf_io_complete, task) != 0) {
+		printf("Submission queue full\n");
+		abort();
+	}
+
+	worker->current_queue_depth++;
+}
+
+static void
+end_worker(struct rte_timer *timer, void *arg)
+{
+	struct nvmfperf_worker *worker = arg;
+
+	worker->is_draining = true;
+}
+
+static void
+nvmfperf_io_connect_complete(void *cb_arg, const struct spdk_nvme_cpl *cpl)
+{
+	struct nvmfperf_worker	*worker = cb_arg;
+	int			i;
+
+	rte_free(worker->connect_data);
+	worker->connect_data = NULL;
+
+	if (spdk_nvme_cpl_is_error(cpl)) {
+		nvmfperf_fail("I/O queue CONNECT", cpl);
+		nvmfperf_worker_done(worker);
+		return;
+	}
+
+	/* Start a timer to stop this I/O chain when the run is over */
+	rte_timer_reset(&worker->run_timer, rte_get_timer_hz() * g_time_in_sec, SINGLE,
+			worker->lcore, end_worker, worker);
+
+	for (i = 0; i < g_queue_depth; i++) {
+		nvmfperf_submit_single(worker, &worker->tasks[i]);
+	}
+}
+
+static void
+nvmfperf_worker_start(spdk_event_t event)
+{
+	struct nvmfperf_worker *worker = spdk_event_get_arg1(event);
+
+	worker->qpair = spdk_nvmf_loopback_qpair_alloc(worker->qid, g_queue_depth);
+	if (worker->qpair == NULL) {
+		fprintf(stderr, "Unable to allocate I/O queue %u\n", worker->qid);
+		g_run_failed = true;
+		event = spdk_event_allocate(rte_get_master_lcore(), end_run, NULL, NULL, NULL);
+		spdk_event_call(event);
+		return;
+	}
+
+	worker->poller.fn = nvmfperf_process_completions;
+	worker->poller.arg = &worker->qpair;
+	spdk_poller_register(&worker->poller, worker->lcore, NULL);
+
+	nvmfperf_connect(worker->qpair, worker->qid, g_queue_depth, 0, worker->connect_data,
+			 nvmfperf_io_connect_complete, worker);
+}
+
+static int
+nvmfperf_construct_workers(void)
+{
+	struct nvmfperf_worker	*worker;
+	unsigned		lcore;
+	int			i;
+
+	RTE_LCORE_FOREACH(lcore) {
+		worker = calloc(1, sizeof(*worker));
+		if (worker == NULL) {
+			return -1;
+		}
+
+		worker->lcore = lcore;
+		worker->qid = ++g_worker_count;
+		rte_timer_init(&worker->run_timer);
+		g_workers[lcore] = worker;
+
+		worker->connect_data = rte_zmalloc(NULL, sizeof(*worker->connect_data), 0);
+		worker->tasks = calloc(g_queue_depth, sizeof(*worker->tasks));
+		if (worker->connect_data == NULL || worker->tasks == NULL) {
+			return -1;
+		}
+
+		/* Direct mode subsystems hand these buffers to the NVMe driver */
+		for (i = 0; i < g_queue_depth; i++) {
+			worker->tasks[i].worker = worker;
+			worker->tasks[i].buf = rte_malloc(NULL, g_io_size, 0x1000);
+			if (worker->tasks[i].buf == NULL) {
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* Admin queue */
+
+static void
+nvmfperf_identify_ns_complete(void *cb_arg, const struct spdk_nvme_cpl *cpl)
+{
+	struct spdk_nvme_ns_data	*nsdata = g_admin.buf;
+	unsigned			lcore;
+	spdk_event_t			event;
+
+	if (spdk_nvme_cpl_is_error(cpl)) {
+		nvmfperf_fail("Identify namespace", cpl);
+		nvmfperf_shutdown();
+		return;
+	}
+
+	g_block_size = 1u << nsdata->lbaf[nsdata->flbas.format].lbads;
+	if (g_io_size % g_block_size != 0 || (uint64_t)g_io_size > nsdata->nsze * g_block_size) {
+		fprintf(stderr, "I/O size %d does not fit block size %u and namespace size %" PRIu64 "\n",
+			g_io_size, g_block_size, nsdata->nsze);
+		g_run_failed = true;
+		nvmfperf_shutdown();
+		return;
+	}
+	g_size_in_ios = nsdata->nsze * g_block_size / g_io_size;
+
+	if (nvmfperf_construct_workers() != 0) {
+		fprintf(stderr, "Unable to allocate workers\n");
+		g_run_failed = true;
+		nvmfperf_shutdown();
+		return;
+	}
+
+	printf("Running I/O for %d seconds...\n", g_time_in_sec);
+	fflush(stdout);
+
+	RTE_LCORE_FOREACH(lcore) {
+		event = spdk_event_allocate(lcore, nvmfperf_worker_start, g_workers[lcore], NULL, NULL);
+		spdk_event_call(event);
+	}
+}
+
+static void
+nvmfperf_enable_complete(void *cb_arg, const struct spdk_nvme_cpl *cpl)
+{
+	struct spdk_nvme_cmd cmd = {};
+
+	if (spdk_nvme_cpl_is_error(cpl)) {
+		nvmfperf_fail("Property Set CC", cpl);
+		nvmfperf_shutdown();
+		return;
+	}
+
+	cmd.opc = SPDK_NVME_OPC_IDENTIFY;
+	cmd.nsid = 1;
+	cmd.cdw10 = SPDK_NVME_IDENTIFY_NS;
+
+	spdk_nvmf_loopback_submit(g_admin.qpair, &cmd, g_admin.buf, sizeof(struct spdk_nvme_ns_data),
+				  nvmfperf_identify_ns_complete, NULL);
+}
+
+static void
+nvmfperf_admin_connect_complete(void *cb_arg, const struct spdk_nvme_cpl *cpl)
+{
+	struct spdk_nvmf_fabric_prop_set_cmd	cmd = {};
+	union spdk_nvme_cc_register		cc = {};
+
+	if (spdk_nvme_cpl_is_error(cpl)) {
+		nvmfperf_fail("Admin queue CONNECT", cpl);
+		nvmfperf_shutdown();
+		return;
+	}
+
+	cc.bits.en = 1;
+	cc.bits.iosqes = 6; /* 64 byte submission queue entries */
+	cc.bits.iocqes = 4; /* 16 byte completion queue entries */
+
+	cmd.opcode = SPDK_NVME_OPC_FABRIC;
+	cmd.fctype = SPDK_NVMF_FABRIC_COMMAND_PROPERTY_SET;
+	cmd.attrib.size = SPDK_NVMF_PROP_SIZE_4;
+	cmd.ofst = offsetof(struct spdk_nvme_registers, cc);
+	cmd.value.u32.low = cc.raw;
+
+	spdk_nvmf_loopback_submit(g_admin.qpair, (struct spdk_nvme_cmd *)&cmd, NULL, 0,
+				  nvmfperf_enable_complete, NULL);
+}
+
+static void
+nvmfperf_run(spdk_event_t event)
+{
+	if (spdk_nvmf_transport_loopback.transport_start() < 0) {
+		fprintf(stderr, "Unable to start the loopback transport\n");
+		spdk_app_stop(1);
+		return;
+	}
+
+	g_admin.qpair = spdk_nvmf_loopback_qpair_alloc(0, NVMFPERF_ADMIN_QUEUE_DEPTH);
+	if (g_admin.qpair == NULL) {
+		fprintf(stderr, "Unable to allocate the admin queue\n");
+		g_run_failed = true;
+		nvmfperf_shutdown();
+		return;
+	}
+
+	g_admin.poller.fn = nvmfperf_process_completions;
+	g_admin.poller.arg = &g_admin.qpair;
+	spdk_poller_register(&g_admin.poller, rte_get_master_lcore(), NULL);
+
+	nvmfperf_connect(g_admin.qpair, 0, NVMFPERF_ADMIN_QUEUE_DEPTH, 0xFFFF, g_admin.buf,
+			 nvmfperf_admin_connect_complete, NULL);
+}
+
+static void
+performance_dump(int io_time)
+{
+	unsigned lcore;
+	float io_per_second, mb_per_second, latency_us;
+	float total_io_per_second, total_mb_per_second;
+	uint64_t total_io_completed, total_tsc;
+	struct nvmfperf_worker *worker;
+
+	total_io_per_second = 0;
+	total_mb_per_second = 0;
+	total_io_completed = 0;
+	total_tsc = 0;
+
+	RTE_LCORE_FOREACH(lcore) {
+		worker = g_workers[lcore];
+		if (worker == NULL) {
+			continue;
+		}
+
+		io_per_second = (float)worker->io_completed / io_time;
+		mb_per_second = io_per_second * g_io_size / (1024 * 1024);
+		latency_us = worker->io_completed ?
+			     (float)worker->total_tsc * 1000000 / worker->io_completed / rte_get_timer_hz() : 0;
+		printf("\r Logical core %2u (qid %2u): %10.2f IO/s %10.2f MB/s %10.2f us\n",
+		       lcore, worker->qid, io_per_second, mb_per_second, latency_us);
+
+		total_io_per_second += io_per_second;
+		total_mb_per_second += mb_per_second;
+		total_io_completed += worker->io_completed;
+		total_tsc += worker->total_tsc;
+	}
+
+	latency_us = total_io_completed ?
+		     (float)total_tsc * 1000000 / total_io_completed / rte_get_timer_hz() : 0;
+
+	printf("\r =============================================================\n");
+	printf("\r %-24s: %10.2f IO/s %10.2f MB/s %10.2f us\n",
+	       "Total", total_io_per_second, total_mb_per_second, latency_us);
+	fflush(stdout);
+}
+
+static void usage(char *program_name)
+{
+	printf("%s options\n", program_name);
+	printf("\t[-c configuration file]\n");
+	printf("\t[-n NQN of the subsystem to connect to]\n");
+	printf("\t[-m core mask; each core drives one I/O queue\n");
+	printf("\t\t(default: 0x1 - use core 0 only)]\n");
+	printf("\t[-q io depth]\n");
+	printf("\t[-s io size in bytes]\n");
+	printf("\t[-w io pattern type, must be one of\n");
+	printf("\t\t(read, write, randread, randwrite, rw, randrw)]\n");
+	printf("\t[-M rwmixread (100 for reads, 0 for writes)]\n");
+	printf("\t[-t time in seconds]\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	struct spdk_app_opts opts;
+	const char *config_file;
+	const char *core_mask;
+	const char *workload_type;
+	int op;
+	bool mix_specified;
+
+	/* default value*/
+	config_file = NULL;
+	g_queue_depth = 0;
+	g_io_size = 0;
+	workload_type = NULL;
+	g_time_in_sec = 0;
+	mix_specified = false;
+	core_mask = NULL;
+
+	while ((op = getopt(argc, argv, "c:m:n:q:s:t:w:M:")) != -1) {
+		switch (op) {
+		case 'c':
+			config_file = optarg;
+			break;
+		case 'm':
+			core_mask = optarg;
+			break;
+		case 'n':
+			g_subnqn = optarg;
+			break;
+		case 'q':
+			g_queue_depth = atoi(optarg);
+			break;
+		case 's':
+			g_io_size = atoi(optarg);
+			break;
+		case 't':
+			g_time_in_sec = atoi(optarg);
+			break;
+		case 'w':
+			workload_type = optarg;
+			break;
+		case 'M':
+			g_rw_percentage = atoi(optarg);
+			mix_specified = true;
+			break;
+		default:
+			usage(argv[0]);
+			exit(1);
+		}
+	}
+
+	if (!config_file || !g_subnqn || g_queue_depth <= 0 || g_io_size <= 0 ||
+	    !workload_type || g_time_in_sec <= 0) {
+		usage(argv[0]);
+		exit(1);
+	}
+
+	if (g_io_size > SPDK_NVMF_MAX_RECV_DATA_TRANSFER_SIZE) {
+		fprintf(stderr, "I/O size must not exceed %d bytes\n", SPDK_NVMF_MAX_RECV_DATA_TRANSFER_SIZE);
+		exit(1);
+	}
+
+	if (strcmp(workload_type, "read") &&
+	    strcmp(workload_type, "write") &&
+	    strcmp(workload_type, "randread") &&
+	    strcmp(workload_type, "randwrite") &&
+	    strcmp(workload_type, "rw") &&
+	    strcmp(workload_type, "randrw")) {
+		fprintf(stderr,
+			"io pattern type must be one of\n"
+			"(read, write, randread, randwrite, rw, randrw)\n");
+		exit(1);
+	}
+
+	if (!strcmp(workload_type, "read") ||
+	    !strcmp(workload_type, "randread")) {
+		g_rw_percentage = 100;
+	}
+
+	if (!strcmp(workload_type, "write") ||
+	    !strcmp(workload_type, "randwrite")) {
+		g_rw_percentage = 0;
+	}
+
+	if (!strcmp(workload_type, "rw") ||
+	    !strcmp(workload_type, "randrw")) {
+		if (g_rw_percentage < 0 || g_rw_percentage > 100) {
+			fprintf(stderr,
+				"-M must be specified to value from 0 to 100 "
+				"for rw or randrw.\n");
+			exit(1);
+		}
+	} else if (mix_specified) {
+		fprintf(stderr, "Ignoring -M option... Please use -M option"
+			" only when using rw or randrw.\n");
+	}
+
+	g_is_random = strncmp(workload_type, "rand", 4) == 0;
+
+	optind = 1;  /*reset the optind */
+
+	rte_set_log_level(RTE_LOG_ERR);
+
+	spdk_app_opts_init(&opts);
+	opts.name = "nvmfperf";
+	opts.config_file = config_file;
+	opts.reactor_mask = core_mask;
+	spdk_app_init(&opts);
+
+	g_admin.buf = rte_zmalloc(NULL, 4096, 0x1000);
+	if (g_admin.buf == NULL) {
+		fprintf(stderr, "Unable to allocate admin buffer\n");
+		spdk_app_fini();
+		return 1;
+	}
+
+	spdk_app_start(nvmfperf_run, NULL, NULL);
+
+	if (!g_run_failed) {
+		performance_dump(g_time_in_sec);
+	}
+
+	spdk_app_fini();
+	printf("done.\n");
+	return g_run_failed ? 1 : 0;
+}
@@ -85,6 +85,18 @@ spdk_nvme_ctrlr_cmd_io_raw(struct spdk_nvme_ctrlr *ctrlr,
 	return -1;
 }
 
+bool
+nvmf_virtual_process_admin_cmd(struct spdk_nvmf_request *req)
+{
+	return true;
+}
+
+bool
+nvmf_virtual_process_io_cmd(struct spdk_nvmf_request *req)
+{
+	return true;
+}
+
 void
 nvmf_disconnect(struct nvmf_session *session, struct spdk_nvmf_conn *conn)
 {
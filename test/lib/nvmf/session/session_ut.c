@@ -56,11 +56,68 @@ spdk_nvme_ctrlr_get_data(struct spdk_nvme_ctrlr *ctrlr)
 	return NULL;
 }
 
+int
+nvmf_subsystem_assign_conn(struct spdk_nvmf_subsystem *subsystem, struct spdk_nvmf_conn *conn)
+{
+	return 0;
+}
+
+void
+nvmf_subsystem_release_conn(struct spdk_nvmf_subsystem *subsystem, struct spdk_nvmf_conn *conn)
+{
+}
+
+void
+nvmf_subsystem_start_poller(struct spdk_nvmf_subsystem *subsystem)
+{
+}
+
+void
+nvmf_subsystem_remove_session(struct spdk_nvmf_subsystem *subsystem)
+{
+}
+
+spdk_event_t
+spdk_event_allocate(uint32_t lcore, spdk_event_fn fn, void *arg1, void *arg2, spdk_event_t next)
+{
+	return NULL;
+}
+
 static void
 test_foobar(void)
 {
 }
 
+static void
+test_virtual_ctrlr_data(void)
+{
+	struct spdk_nvmf_subsystem	subsystem = {};
+	struct nvmf_session		session = {};
+	struct spdk_bdev		bdev[2] = {};
+	struct spdk_nvme_ctrlr_data	*cdata = &session.vcdata;
+
+	snprintf(subsystem.sn, sizeof(subsystem.sn), "%s", "SPDK0001");
+	bdev[0].max_unmap_bdesc_count = 1;
+	bdev[1].max_unmap_bdesc_count = 1;
+	subsystem.ns_list[0] = &bdev[0];
+	subsystem.ns_list[1] = &bdev[1];
+	subsystem.ns_count = 2;
+	session.subsys = &subsystem;
+
+	nvmf_init_virtual_ctrlr_data(&session);
+	CU_ASSERT(cdata->vid == 0);
+	CU_ASSERT(cdata->ssvid == 0);
+	CU_ASSERT(memcmp(cdata->sn, "SPDK0001            ", sizeof(cdata->sn)) == 0);
+	CU_ASSERT(cdata->nn == 2);
+	CU_ASSERT(cdata->oncs.dsm == 1);
+	CU_ASSERT(cdata->vwc.present == 1);
+
+	/* DSM is only advertised when every namespace can unmap */
+	bdev[1].max_unmap_bdesc_count = 0;
+	nvmf_init_virtual_ctrlr_data(&session);
+	CU_ASSERT(cdata->oncs.dsm == 0);
+}
+
 int main(int argc, char **argv)
 {
 	CU_pSuite	suite = NULL;
@@ -77,7 +134,8 @@ int main(int argc, char **argv)
 	}
 
 	if (
-		CU_add_test(suite, "foobar", test_foobar) == NULL) {
+		CU_add_test(suite, "foobar", test_foobar) == NULL ||
+		CU_add_test(suite, "virtual_ctrlr_data", test_virtual_ctrlr_data) == NULL) {
 		CU_cleanup_registry();
 		return CU_get_error();
 	}
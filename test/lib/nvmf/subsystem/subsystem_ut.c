@@ -42,19 +42,88 @@
 
 SPDK_LOG_REGISTER_TRACE_FLAG("nvmf", SPDK_TRACE_NVMF)
 
+struct spdk_nvmf_globals g_nvmf_tgt;
+
+/* Events are queued and only run when the test asks for it. */
+static TAILQ_HEAD(, ut_event) g_events = TAILQ_HEAD_INITIALIZER(g_events);
+
+struct ut_event {
+	struct spdk_event	event;
+	TAILQ_ENTRY(ut_event)	link;
+};
+
+static uint32_t g_qpairs_available;
+static uint32_t g_qpairs_allocated;
+static int g_qpairs_at_detach = -1;
+static struct spdk_nvme_ctrlr *g_ctrlr = (struct spdk_nvme_ctrlr *)0x1000;
+
 void
 spdk_poller_register(struct spdk_poller *poller, uint32_t lcore, struct spdk_event *complete)
 {
+	poller->lcore = lcore;
+	if (complete) {
+		spdk_event_call(complete);
+	}
 }
 
-int32_t
-spdk_nvme_ctrlr_process_admin_completions(struct spdk_nvme_ctrlr *ctrlr)
+void
+spdk_poller_unregister(struct spdk_poller *poller, struct spdk_event *complete)
 {
-	return -1;
+	if (complete) {
+		spdk_event_call(complete);
+	}
+}
+
+spdk_event_t
+spdk_event_allocate(uint32_t lcore, spdk_event_fn fn, void *arg1, void *arg2, spdk_event_t next)
+{
+	struct ut_event *ut_event = calloc(1, sizeof(*ut_event));
+
+	SPDK_CU_ASSERT_FATAL(ut_event != NULL);
+	ut_event->event.lcore = lcore;
+	ut_event->event.fn = fn;
+	ut_event->event.arg1 = arg1;
+	ut_event->event.arg2 = arg2;
+	ut_event->event.next = next;
+
+	return &ut_event->event;
+}
+
+void
+spdk_event_call(spdk_event_t event)
+{
+	struct ut_event *ut_event = (struct ut_event *)event;
+
+	TAILQ_INSERT_TAIL(&g_events, ut_event, link);
+}
+
+void
+spdk_event_queue_run_all(uint32_t lcore)
+{
+	struct ut_event *ut_event;
+
+	while (!TAILQ_EMPTY(&g_events)) {
+		ut_event = TAILQ_FIRST(&g_events);
+		TAILQ_REMOVE(&g_events, ut_event, link);
+		ut_event->event.fn(&ut_event->event);
+		free(ut_event);
+	}
+}
+
+uint64_t
+spdk_app_get_core_mask(void)
+{
+	return 0x1;
 }
 
 int32_t
 spdk_nvme_qpair_process_completions(struct spdk_nvme_qpair *qpair, uint32_t max_completions)
+{
+	return 0;
+}
+
+int32_t
+spdk_nvme_ctrlr_process_admin_completions(struct spdk_nvme_ctrlr *ctrlr)
 {
 	return -1;
 }
@@ -62,17 +131,35 @@ spdk_nvme_qpair_process_completions(struct spdk_nvme_qpair *qpair, uint32_t max_
 struct spdk_nvme_qpair *
 spdk_nvme_ctrlr_alloc_io_qpair(struct spdk_nvme_ctrlr *ctrlr, enum spdk_nvme_qprio qprio)
 {
-	return NULL;
+	if (g_qpairs_available == 0) {
+		return NULL;
+	}
+
+	g_qpairs_available--;
+	g_qpairs_allocated++;
+	return malloc(1);
+}
+
+int
+spdk_nvme_ctrlr_free_io_qpair(struct spdk_nvme_qpair *qpair)
+{
+	CU_ASSERT(g_qpairs_allocated > 0);
+	g_qpairs_allocated--;
+	g_qpairs_available++;
+	free(qpair);
+	return 0;
 }
 
 int
 spdk_nvme_detach(struct spdk_nvme_ctrlr *ctrlr)
 {
-	return -1;
+	CU_ASSERT(ctrlr == g_ctrlr);
+	g_qpairs_at_detach = g_qpairs_allocated;
+	return 0;
 }
 
 void
-spdk_nvmf_session_destruct(struct nvmf_session *session)
+nvmf_disconnect(struct nvmf_session *session, struct spdk_nvmf_conn *conn)
 {
 }
 
@@ -82,9 +169,138 @@ spdk_nvmf_session_poll(struct nvmf_session *session)
 	return -1;
 }
 
+static struct spdk_nvmf_subsystem *
+create_direct_subsystem(uint32_t num_qpairs)
+{
+	struct spdk_nvmf_subsystem *subsystem;
+
+	subsystem = nvmf_create_subsystem(1, "nqn.2016-06.io.spdk:subsystem1",
+					  SPDK_NVMF_SUBTYPE_NVME, 0);
+	SPDK_CU_ASSERT_FATAL(subsystem != NULL);
+	subsystem->mode = NVMF_SUBSYSTEM_MODE_DIRECT;
+	nvmf_subsystem_add_ctrlr(subsystem, g_ctrlr);
+
+	g_qpairs_available = num_qpairs;
+	g_qpairs_allocated = 0;
+	g_qpairs_at_detach = -1;
+
+	return subsystem;
+}
+
+static void
+test_assign_release_conn(void)
+{
+	struct spdk_nvmf_subsystem *subsystem = create_direct_subsystem(2);
+	struct spdk_nvmf_conn conn1 = { .lcore = 1 }, conn2 = { .lcore = 2 };
+
+	CU_ASSERT(nvmf_subsystem_assign_conn(subsystem, &conn1) == 0);
+	CU_ASSERT(nvmf_subsystem_assign_conn(subsystem, &conn2) == 0);
+	CU_ASSERT(conn1.io_qpair != NULL);
+	CU_ASSERT(conn2.io_qpair != NULL);
+	CU_ASSERT(conn1.io_qpair != conn2.io_qpair);
+	CU_ASSERT(subsystem->num_io_qpairs == 2);
+	CU_ASSERT(TAILQ_FIRST(&subsystem->io_qpairs)->poller.lcore == 1);
+
+	nvmf_subsystem_release_conn(subsystem, &conn1);
+	CU_ASSERT(conn1.io_qpair == NULL);
+	CU_ASSERT(subsystem->num_io_qpairs == 1);
+
+	/* The queue pair is freed only after its poller has been unregistered. */
+	CU_ASSERT(g_qpairs_allocated == 2);
+	spdk_event_queue_run_all(0);
+	CU_ASSERT(g_qpairs_allocated == 1);
+	CU_ASSERT(subsystem->num_io_qpair_frees == 0);
+
+	/* Releasing twice is harmless. */
+	nvmf_subsystem_release_conn(subsystem, &conn1);
+	CU_ASSERT(subsystem->num_io_qpairs == 1);
+
+	nvmf_subsystem_release_conn(subsystem, &conn2);
+	spdk_event_queue_run_all(0);
+	CU_ASSERT(g_qpairs_allocated == 0);
+	CU_ASSERT(TAILQ_EMPTY(&subsystem->io_qpairs));
+
+	nvmf_delete_subsystem(subsystem);
+	spdk_event_queue_run_all(0);
+	CU_ASSERT(g_num_deleting_subsystems == 0);
+}
+
 static void
-test_foobar(void)
+test_share_qpair(void)
 {
+	struct spdk_nvmf_subsystem *subsystem = create_direct_subsystem(1);
+	struct spdk_nvmf_conn conn1 = { .lcore = 1 }, conn2 = { .lcore = 1 }, conn3 = { .lcore = 2 };
+	struct spdk_nvmf_io_qpair *io_qpair;
+
+	CU_ASSERT(nvmf_subsystem_assign_conn(subsystem, &conn1) == 0);
+
+	/* The controller is out of queue pairs: share the one on the same core. */
+	CU_ASSERT(nvmf_subsystem_assign_conn(subsystem, &conn2) == 0);
+	CU_ASSERT(conn2.io_qpair == conn1.io_qpair);
+	io_qpair = TAILQ_FIRST(&subsystem->io_qpairs);
+	SPDK_CU_ASSERT_FATAL(io_qpair != NULL);
+	CU_ASSERT(io_qpair->num_conns == 2);
+	CU_ASSERT(subsystem->num_io_qpairs == 1);
+
+	/* Queue pairs are never shared across cores. */
+	CU_ASSERT(nvmf_subsystem_assign_conn(subsystem, &conn3) != 0);
+	CU_ASSERT(conn3.io_qpair == NULL);
+
+	/* The shared queue pair lives until its last connection is released. */
+	nvmf_subsystem_release_conn(subsystem, &conn1);
+	spdk_event_queue_run_all(0);
+	CU_ASSERT(io_qpair->num_conns == 1);
+	CU_ASSERT(g_qpairs_allocated == 1);
+
+	nvmf_subsystem_release_conn(subsystem, &conn2);
+	spdk_event_queue_run_all(0);
+	CU_ASSERT(g_qpairs_allocated == 0);
+
+	/* Freeing it makes room for a connection on another core. */
+	CU_ASSERT(nvmf_subsystem_assign_conn(subsystem, &conn3) == 0);
+	nvmf_subsystem_release_conn(subsystem, &conn3);
+
+	nvmf_delete_subsystem(subsystem);
+	spdk_event_queue_run_all(0);
+	CU_ASSERT(g_qpairs_allocated == 0);
+	CU_ASSERT(g_num_deleting_subsystems == 0);
+}
+
+static void
+test_delete_subsystem(void)
+{
+	struct spdk_nvmf_subsystem *subsystem = create_direct_subsystem(2);
+	struct spdk_nvmf_conn conn1 = { .lcore = 1 }, conn2 = { .lcore = 2 };
+
+	CU_ASSERT(nvmf_subsystem_assign_conn(subsystem, &conn1) == 0);
+	CU_ASSERT(nvmf_subsystem_assign_conn(subsystem, &conn2) == 0);
+
+	nvmf_delete_subsystem(subsystem);
+
+	/* Unlisted right away, but the controller waits for its queue pairs. */
+	CU_ASSERT(nvmf_find_subsystem("nqn.2016-06.io.spdk:subsystem1", "host") == NULL);
+	CU_ASSERT(g_qpairs_at_detach == -1);
+	CU_ASSERT(g_num_deleting_subsystems == 1);
+
+	spdk_event_queue_run_all(0);
+	CU_ASSERT(g_qpairs_at_detach == 0);
+	CU_ASSERT(g_qpairs_allocated == 0);
+	CU_ASSERT(g_num_deleting_subsystems == 0);
+}
+
+static void
+test_shutdown_subsystems(void)
+{
+	struct spdk_nvmf_subsystem *subsystem = create_direct_subsystem(1);
+	struct spdk_nvmf_conn conn1 = { .lcore = 1 };
+
+	CU_ASSERT(nvmf_subsystem_assign_conn(subsystem, &conn1) == 0);
+
+	/* Runs the teardown events itself. */
+	spdk_shutdown_nvmf_subsystems();
+	CU_ASSERT(g_qpairs_at_detach == 0);
+	CU_ASSERT(g_num_deleting_subsystems == 0);
+	CU_ASSERT(TAILQ_EMPTY(&g_subsystems));
 }
 
 int main(int argc, char **argv)
@@ -103,7 +319,10 @@ int main(int argc, char **argv)
 	}
 
 	if (
-		CU_add_test(suite, "foobar", test_foobar) == NULL) {
+		CU_add_test(suite, "assign_release_conn", test_assign_release_conn) == NULL ||
+		CU_add_test(suite, "share_qpair", test_share_qpair) == NULL ||
+		CU_add_test(suite, "delete_subsystem", test_delete_subsystem) == NULL ||
+		CU_add_test(suite, "shutdown_subsystems", test_shutdown_subsystems) == NULL) {
 		CU_cleanup_registry();
 		return CU_get_error();
 	}
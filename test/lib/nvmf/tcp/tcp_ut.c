@@ -0,0 +1,578 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <sys/socket.h>
+
+#include "spdk_cunit.h"
+
+#include "tcp.c"
+
+SPDK_LOG_REGISTER_TRACE_FLAG("nvmf", SPDK_TRACE_NVMF)
+
+#define UT_QUEUE_DEPTH		4
+#define UT_IN_CAPSULE_SIZE	4096
+
+struct spdk_nvmf_globals g_nvmf_tgt;
+
+static int g_num_exec;
+
+int
+spdk_nvmf_request_exec(struct spdk_nvmf_request *req)
+{
+	g_num_exec++;
+	return 0;
+}
+
+int
+spdk_nvmf_request_complete(struct spdk_nvmf_request *req)
+{
+	return 0;
+}
+
+void
+nvmf_disconnect(struct nvmf_session *session, struct spdk_nvmf_conn *conn)
+{
+}
+
+int
+spdk_nvmf_foreach_listen_addr(const struct spdk_nvmf_transport *transport,
+			      int (*fn)(struct spdk_nvmf_listen_addr *listen_addr, void *ctx),
+			      void *ctx)
+{
+	return 0;
+}
+
+uint32_t
+spdk_nvmf_get_conn_lcore(void)
+{
+	return 0;
+}
+
+void
+spdk_nvmf_put_conn_lcore(uint32_t lcore)
+{
+}
+
+int
+spdk_app_get_core_count(void)
+{
+	return 1;
+}
+
+spdk_event_t
+spdk_event_allocate(uint32_t lcore, spdk_event_fn fn, void *arg1, void *arg2, spdk_event_t next)
+{
+	return NULL;
+}
+
+void
+spdk_event_call(spdk_event_t event)
+{
+}
+
+void
+spdk_poller_register(struct spdk_poller *poller, uint32_t lcore, struct spdk_event *complete)
+{
+}
+
+void
+spdk_poller_unregister(struct spdk_poller *poller, struct spdk_event *complete)
+{
+}
+
+/*
+ * Connections are created on one end of a socket pair so that the PDUs the
+ * target sends can be read back from the other end.
+ */
+static int g_host_fd;
+
+static struct spdk_nvmf_tcp_conn *
+ut_conn_create(void)
+{
+	struct spdk_nvmf_tcp_conn *tconn;
+	int fds[2];
+
+	g_nvmf_tgt.max_queue_depth = UT_QUEUE_DEPTH;
+	g_nvmf_tgt.in_capsule_data_size = UT_IN_CAPSULE_SIZE;
+
+	SPDK_CU_ASSERT_FATAL(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) == 0);
+	g_host_fd = fds[1];
+
+	tconn = nvmf_tcp_conn_create(fds[0]);
+	SPDK_CU_ASSERT_FATAL(tconn != NULL);
+	return tconn;
+}
+
+static void
+ut_conn_destroy(struct spdk_nvmf_tcp_conn *tconn)
+{
+	nvmf_tcp_conn_destroy(tconn);
+	close(g_host_fd);
+}
+
+/* Check that the target sent a C2HTermReq with the given status and field offset. */
+static void
+ut_expect_term_req(enum spdk_nvme_tcp_term_req_fes fes, uint32_t fei)
+{
+	struct spdk_nvme_tcp_term_req_hdr hdr;
+
+	CU_ASSERT(recv(g_host_fd, &hdr, sizeof(hdr), 0) == sizeof(hdr));
+	CU_ASSERT(hdr.common.pdu_type == SPDK_NVME_TCP_PDU_TYPE_C2H_TERM_REQ);
+	CU_ASSERT(hdr.fes == fes);
+	CU_ASSERT(hdr.fei == fei);
+}
+
+static void
+ut_expect_nothing_sent(void)
+{
+	uint8_t byte;
+
+	CU_ASSERT(recv(g_host_fd, &byte, sizeof(byte), 0) < 0 && errno == EAGAIN);
+}
+
+static void
+ut_set_ch(struct spdk_nvmf_tcp_conn *tconn, uint8_t pdu_type, uint8_t hlen, uint8_t pdo,
+	  uint32_t plen)
+{
+	struct spdk_nvme_tcp_common_pdu_hdr *ch = &tconn->recv_pdu.hdr.common;
+
+	memset(&tconn->recv_pdu.hdr, 0, sizeof(tconn->recv_pdu.hdr));
+	ch->pdu_type = pdu_type;
+	ch->hlen = hlen;
+	ch->pdo = pdo;
+	ch->plen = plen;
+}
+
+static void
+test_check_ch(void)
+{
+	struct spdk_nvmf_tcp_conn *tconn;
+	uint8_t cmd_hlen = sizeof(struct spdk_nvme_tcp_cmd);
+	uint8_t ic_hlen = sizeof(struct spdk_nvme_tcp_ic_req);
+
+	tconn = ut_conn_create();
+
+	/* Anything but ICReq before the connection is initialized */
+	ut_set_ch(tconn, SPDK_NVME_TCP_PDU_TYPE_CAPSULE_CMD, cmd_hlen, 0, cmd_hlen);
+	CU_ASSERT(nvmf_tcp_check_ch(tconn) == -1);
+	ut_expect_term_req(SPDK_NVME_TCP_TERM_REQ_FES_INVALID_HEADER_FIELD,
+			   offsetof(struct spdk_nvme_tcp_common_pdu_hdr, pdu_type));
+
+	/* ICReq carries no data */
+	ut_set_ch(tconn, SPDK_NVME_TCP_PDU_TYPE_IC_REQ, ic_hlen, 0, ic_hlen + 4);
+	CU_ASSERT(nvmf_tcp_check_ch(tconn) == -1);
+	ut_expect_term_req(SPDK_NVME_TCP_TERM_REQ_FES_INVALID_HEADER_FIELD,
+			   offsetof(struct spdk_nvme_tcp_common_pdu_hdr, hlen));
+
+	ut_set_ch(tconn, SPDK_NVME_TCP_PDU_TYPE_IC_REQ, ic_hlen, 0, ic_hlen);
+	CU_ASSERT(nvmf_tcp_check_ch(tconn) == 0);
+	ut_expect_nothing_sent();
+
+	tconn->ic_done = true;
+
+	/* A second ICReq */
+	ut_set_ch(tconn, SPDK_NVME_TCP_PDU_TYPE_IC_REQ, ic_hlen, 0, ic_hlen);
+	CU_ASSERT(nvmf_tcp_check_ch(tconn) == -1);
+	ut_expect_term_req(SPDK_NVME_TCP_TERM_REQ_FES_INVALID_HEADER_FIELD,
+			   offsetof(struct spdk_nvme_tcp_common_pdu_hdr, pdu_type));
+
+	/* A PDU type only the controller sends */
+	ut_set_ch(tconn, SPDK_NVME_TCP_PDU_TYPE_C2H_DATA, sizeof(struct spdk_nvme_tcp_c2h_data_hdr),
+		  0, sizeof(struct spdk_nvme_tcp_c2h_data_hdr));
+	CU_ASSERT(nvmf_tcp_check_ch(tconn) == -1);
+	ut_expect_term_req(SPDK_NVME_TCP_TERM_REQ_FES_INVALID_HEADER_FIELD,
+			   offsetof(struct spdk_nvme_tcp_common_pdu_hdr, pdu_type));
+
+	/* Wrong header length */
+	ut_set_ch(tconn, SPDK_NVME_TCP_PDU_TYPE_CAPSULE_CMD, cmd_hlen - 8, 0, cmd_hlen);
+	CU_ASSERT(nvmf_tcp_check_ch(tconn) == -1);
+	ut_expect_term_req(SPDK_NVME_TCP_TERM_REQ_FES_INVALID_HEADER_FIELD,
+			   offsetof(struct spdk_nvme_tcp_common_pdu_hdr, hlen));
+
+	/* PDU shorter than its header */
+	ut_set_ch(tconn, SPDK_NVME_TCP_PDU_TYPE_CAPSULE_CMD, cmd_hlen, 0, cmd_hlen - 1);
+	CU_ASSERT(nvmf_tcp_check_ch(tconn) == -1);
+	ut_expect_term_req(SPDK_NVME_TCP_TERM_REQ_FES_INVALID_HEADER_FIELD,
+			   offsetof(struct spdk_nvme_tcp_common_pdu_hdr, hlen));
+
+	/* Digests were not negotiated */
+	ut_set_ch(tconn, SPDK_NVME_TCP_PDU_TYPE_CAPSULE_CMD, cmd_hlen, 0, cmd_hlen);
+	tconn->recv_pdu.hdr.common.flags = SPDK_NVME_TCP_CH_FLAGS_HDGSTF;
+	CU_ASSERT(nvmf_tcp_check_ch(tconn) == -1);
+	ut_expect_term_req(SPDK_NVME_TCP_TERM_REQ_FES_INVALID_HEADER_FIELD,
+			   offsetof(struct spdk_nvme_tcp_common_pdu_hdr, flags));
+
+	ut_set_ch(tconn, SPDK_NVME_TCP_PDU_TYPE_CAPSULE_CMD, cmd_hlen, cmd_hlen, cmd_hlen + 512);
+	CU_ASSERT(nvmf_tcp_check_ch(tconn) == 0);
+	ut_expect_nothing_sent();
+
+	ut_conn_destroy(tconn);
+}
+
+static uint8_t g_ut_buf[4096];
+
+static struct spdk_nvmf_tcp_request *
+ut_capsule(struct spdk_nvmf_tcp_conn *tconn, uint8_t opc, uint8_t sgl_type, uint8_t sgl_subtype,
+	   uint64_t address, uint32_t length)
+{
+	struct spdk_nvmf_tcp_request *tcp_req = &tconn->reqs[0];
+	struct spdk_nvme_cmd *cmd = &tcp_req->cmd.nvme_cmd;
+
+	memset(&tcp_req->cmd, 0, sizeof(tcp_req->cmd));
+	memset(&tcp_req->rsp, 0, sizeof(tcp_req->rsp));
+	tcp_req->in_capsule_len = 0;
+	cmd->opc = opc;
+	cmd->dptr.sgl1.generic.type = sgl_type;
+	cmd->dptr.sgl1.generic.subtype = sgl_subtype;
+	cmd->dptr.sgl1.address = address;
+	cmd->dptr.sgl1.unkeyed.length = length;
+
+	return tcp_req;
+}
+
+static void
+test_capsule_prep(void)
+{
+	struct spdk_nvmf_tcp_conn *tconn;
+	struct spdk_nvmf_tcp_request *tcp_req;
+	uint8_t hlen = sizeof(struct spdk_nvme_tcp_cmd);
+
+	tconn = ut_conn_create();
+	tconn->ic_done = true;
+
+	/* Data offset inside the header */
+	ut_set_ch(tconn, SPDK_NVME_TCP_PDU_TYPE_CAPSULE_CMD, hlen, hlen - 4, hlen + 512);
+	tcp_req = ut_capsule(tconn, SPDK_NVME_OPC_WRITE, SPDK_NVME_SGL_TYPE_DATA_BLOCK,
+			     SPDK_NVME_SGL_SUBTYPE_OFFSET, 0, 512);
+	CU_ASSERT(nvmf_tcp_capsule_prep(tconn, tcp_req) == -1);
+	ut_expect_term_req(SPDK_NVME_TCP_TERM_REQ_FES_INVALID_HEADER_FIELD,
+			   offsetof(struct spdk_nvme_tcp_common_pdu_hdr, pdo));
+
+	/* Data offset past the end of the PDU */
+	ut_set_ch(tconn, SPDK_NVME_TCP_PDU_TYPE_CAPSULE_CMD, hlen, hlen + 8, hlen + 8);
+	tcp_req = ut_capsule(tconn, SPDK_NVME_OPC_WRITE, SPDK_NVME_SGL_TYPE_DATA_BLOCK,
+			     SPDK_NVME_SGL_SUBTYPE_OFFSET, 0, 0);
+	tconn->recv_pdu.hdr.common.plen = hlen + 4;
+	CU_ASSERT(nvmf_tcp_capsule_prep(tconn, tcp_req) == -1);
+	ut_expect_term_req(SPDK_NVME_TCP_TERM_REQ_FES_INVALID_HEADER_FIELD,
+			   offsetof(struct spdk_nvme_tcp_common_pdu_hdr, pdo));
+
+	/* More in-capsule data than the target supports */
+	ut_set_ch(tconn, SPDK_NVME_TCP_PDU_TYPE_CAPSULE_CMD, hlen, hlen,
+		  hlen + UT_IN_CAPSULE_SIZE + 512);
+	tcp_req = ut_capsule(tconn, SPDK_NVME_OPC_WRITE, SPDK_NVME_SGL_TYPE_DATA_BLOCK,
+			     SPDK_NVME_SGL_SUBTYPE_OFFSET, 0, UT_IN_CAPSULE_SIZE + 512);
+	CU_ASSERT(nvmf_tcp_capsule_prep(tconn, tcp_req) == -1);
+	ut_expect_term_req(SPDK_NVME_TCP_TERM_REQ_FES_DATA_TRANSFER_LIMIT_EXCEEDED,
+			   offsetof(struct spdk_nvme_tcp_common_pdu_hdr, plen));
+
+	/* In-capsule data exactly at the limit, after some padding */
+	ut_set_ch(tconn, SPDK_NVME_TCP_PDU_TYPE_CAPSULE_CMD, hlen, hlen + 8,
+		  hlen + 8 + UT_IN_CAPSULE_SIZE);
+	tcp_req = ut_capsule(tconn, SPDK_NVME_OPC_WRITE, SPDK_NVME_SGL_TYPE_DATA_BLOCK,
+			     SPDK_NVME_SGL_SUBTYPE_OFFSET, 0, UT_IN_CAPSULE_SIZE);
+	CU_ASSERT(nvmf_tcp_capsule_prep(tconn, tcp_req) == 0);
+	CU_ASSERT(tcp_req->rsp.nvme_cpl.status.sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(tcp_req->in_capsule_len == UT_IN_CAPSULE_SIZE);
+	CU_ASSERT(tcp_req->req.length == UT_IN_CAPSULE_SIZE);
+	CU_ASSERT(tcp_req->req.xfer == SPDK_NVME_DATA_HOST_TO_CONTROLLER);
+
+	/* SGL describing data beyond the in-capsule data: fails the command only */
+	ut_set_ch(tconn, SPDK_NVME_TCP_PDU_TYPE_CAPSULE_CMD, hlen, hlen, hlen + 1024);
+	tcp_req = ut_capsule(tconn, SPDK_NVME_OPC_WRITE, SPDK_NVME_SGL_TYPE_DATA_BLOCK,
+			     SPDK_NVME_SGL_SUBTYPE_OFFSET, 512, 1024);
+	CU_ASSERT(nvmf_tcp_capsule_prep(tconn, tcp_req) == 0);
+	CU_ASSERT(tcp_req->rsp.nvme_cpl.status.sc == SPDK_NVME_SC_DATA_SGL_LENGTH_INVALID);
+	CU_ASSERT(tcp_req->req.length == 0);
+
+	ut_set_ch(tconn, SPDK_NVME_TCP_PDU_TYPE_CAPSULE_CMD, hlen, hlen, hlen + 1024);
+	tcp_req = ut_capsule(tconn, SPDK_NVME_OPC_WRITE, SPDK_NVME_SGL_TYPE_DATA_BLOCK,
+			     SPDK_NVME_SGL_SUBTYPE_OFFSET, 2048, 0);
+	CU_ASSERT(nvmf_tcp_capsule_prep(tconn, tcp_req) == 0);
+	CU_ASSERT(tcp_req->rsp.nvme_cpl.status.sc == SPDK_NVME_SC_DATA_SGL_LENGTH_INVALID);
+	CU_ASSERT(tcp_req->req.length == 0);
+
+	/* Offset and length that wrap around */
+	ut_set_ch(tconn, SPDK_NVME_TCP_PDU_TYPE_CAPSULE_CMD, hlen, hlen, hlen + 1024);
+	tcp_req = ut_capsule(tconn, SPDK_NVME_OPC_WRITE, SPDK_NVME_SGL_TYPE_DATA_BLOCK,
+			     SPDK_NVME_SGL_SUBTYPE_OFFSET, 512, UINT32_MAX);
+	CU_ASSERT(nvmf_tcp_capsule_prep(tconn, tcp_req) == 0);
+	CU_ASSERT(tcp_req->rsp.nvme_cpl.status.sc == SPDK_NVME_SC_DATA_SGL_LENGTH_INVALID);
+
+	/* In-capsule data for a read */
+	ut_set_ch(tconn, SPDK_NVME_TCP_PDU_TYPE_CAPSULE_CMD, hlen, hlen, hlen + 512);
+	tcp_req = ut_capsule(tconn, SPDK_NVME_OPC_READ, SPDK_NVME_SGL_TYPE_DATA_BLOCK,
+			     SPDK_NVME_SGL_SUBTYPE_OFFSET, 0, 512);
+	CU_ASSERT(nvmf_tcp_capsule_prep(tconn, tcp_req) == 0);
+	CU_ASSERT(tcp_req->rsp.nvme_cpl.status.sc == SPDK_NVME_SC_INVALID_FIELD);
+	CU_ASSERT(tcp_req->req.length == 0);
+
+	/* Data transferred with R2T/C2HData */
+	ut_set_ch(tconn, SPDK_NVME_TCP_PDU_TYPE_CAPSULE_CMD, hlen, 0, hlen);
+	tcp_req = ut_capsule(tconn, SPDK_NVME_OPC_READ, SPDK_NVME_SGL_TYPE_TRANSPORT_DATA_BLOCK,
+			     SPDK_NVME_SGL_SUBTYPE_TRANSPORT, 0, SPDK_NVMF_MAX_RECV_DATA_TRANSFER_SIZE);
+	CU_ASSERT(nvmf_tcp_capsule_prep(tconn, tcp_req) == 0);
+	CU_ASSERT(tcp_req->rsp.nvme_cpl.status.sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(tcp_req->in_capsule_len == 0);
+	CU_ASSERT(tcp_req->req.length == SPDK_NVMF_MAX_RECV_DATA_TRANSFER_SIZE);
+	CU_ASSERT(tcp_req->req.xfer == SPDK_NVME_DATA_CONTROLLER_TO_HOST);
+
+	tcp_req = ut_capsule(tconn, SPDK_NVME_OPC_WRITE, SPDK_NVME_SGL_TYPE_TRANSPORT_DATA_BLOCK,
+			     SPDK_NVME_SGL_SUBTYPE_TRANSPORT, 0, SPDK_NVMF_MAX_RECV_DATA_TRANSFER_SIZE + 1);
+	CU_ASSERT(nvmf_tcp_capsule_prep(tconn, tcp_req) == 0);
+	CU_ASSERT(tcp_req->rsp.nvme_cpl.status.sc == SPDK_NVME_SC_DATA_SGL_LENGTH_INVALID);
+	CU_ASSERT(tcp_req->req.length == 0);
+
+	/* In-capsule data with a transport SGL: fails the command, and no data points past it */
+	ut_set_ch(tconn, SPDK_NVME_TCP_PDU_TYPE_CAPSULE_CMD, hlen, hlen, hlen + 8);
+	tcp_req = ut_capsule(tconn, SPDK_NVME_OPC_WRITE, SPDK_NVME_SGL_TYPE_TRANSPORT_DATA_BLOCK,
+			     SPDK_NVME_SGL_SUBTYPE_TRANSPORT, 0x100000, 4096);
+	CU_ASSERT(nvmf_tcp_capsule_prep(tconn, tcp_req) == 0);
+	CU_ASSERT(tcp_req->rsp.nvme_cpl.status.sc == SPDK_NVME_SC_SGL_DESCRIPTOR_TYPE_INVALID);
+	CU_ASSERT(tcp_req->in_capsule_len == 8);
+	CU_ASSERT(tcp_req->req.length == 0);
+	tconn->recv_req = tcp_req;
+	tcp_req->buf = g_ut_buf;
+	tcp_req->req.data = NULL;
+	CU_ASSERT(nvmf_tcp_capsule_buf_ready(tconn) == 0);
+	CU_ASSERT(tcp_req->req.data == NULL);
+	CU_ASSERT(tconn->payload == g_ut_buf);
+	CU_ASSERT(tconn->payload_len == 8);
+	CU_ASSERT(tconn->recv_state == NVMF_TCP_RECV_PAYLOAD);
+	tcp_req->buf = NULL;
+
+	/* Unsupported SGL descriptor */
+	tcp_req = ut_capsule(tconn, SPDK_NVME_OPC_WRITE, SPDK_NVME_SGL_TYPE_KEYED_DATA_BLOCK,
+			     SPDK_NVME_SGL_SUBTYPE_ADDRESS, 0, 512);
+	CU_ASSERT(nvmf_tcp_capsule_prep(tconn, tcp_req) == 0);
+	CU_ASSERT(tcp_req->rsp.nvme_cpl.status.sc == SPDK_NVME_SC_SGL_DESCRIPTOR_TYPE_INVALID);
+
+	ut_expect_nothing_sent();
+	ut_conn_destroy(tconn);
+}
+
+static void
+ut_set_h2c(struct spdk_nvmf_tcp_conn *tconn, uint16_t cccid, uint16_t ttag, uint32_t datao,
+	   uint32_t datal, uint8_t pad)
+{
+	struct spdk_nvme_tcp_h2c_data_hdr *h2c = &tconn->recv_pdu.hdr.h2c_data;
+	uint8_t hlen = sizeof(*h2c);
+
+	ut_set_ch(tconn, SPDK_NVME_TCP_PDU_TYPE_H2C_DATA, hlen, hlen + pad, hlen + pad + datal);
+	h2c->cccid = cccid;
+	h2c->ttag = ttag;
+	h2c->datao = datao;
+	h2c->datal = datal;
+}
+
+static void
+test_h2c_data(void)
+{
+	struct spdk_nvmf_tcp_conn *tconn;
+	struct spdk_nvmf_tcp_request *tcp_req;
+	uint8_t buf[8192];
+
+	tconn = ut_conn_create();
+	tconn->ic_done = true;
+
+	/* Request 2 is waiting for 8 KiB of data, of which 4 KiB arrived already. */
+	tcp_req = &tconn->reqs[2];
+	tcp_req->cmd.nvme_cmd.cid = 0x55;
+	tcp_req->req.data = buf;
+	tcp_req->req.length = sizeof(buf);
+	tcp_req->h2c_offset = 4096;
+	tcp_req->awaiting_h2c = true;
+
+	/* Transfer tag out of range */
+	ut_set_h2c(tconn, 0x55, UT_QUEUE_DEPTH, 4096, 4096, 0);
+	CU_ASSERT(nvmf_tcp_handle_h2c_data(tconn) == -1);
+	ut_expect_term_req(SPDK_NVME_TCP_TERM_REQ_FES_INVALID_HEADER_FIELD,
+			   offsetof(struct spdk_nvme_tcp_h2c_data_hdr, ttag));
+
+	/* Request not waiting for data */
+	ut_set_h2c(tconn, 0x55, 1, 4096, 4096, 0);
+	CU_ASSERT(nvmf_tcp_handle_h2c_data(tconn) == -1);
+	ut_expect_term_req(SPDK_NVME_TCP_TERM_REQ_FES_INVALID_HEADER_FIELD,
+			   offsetof(struct spdk_nvme_tcp_h2c_data_hdr, cccid));
+
+	/* Transfer tag of another command */
+	ut_set_h2c(tconn, 0x56, 2, 4096, 4096, 0);
+	CU_ASSERT(nvmf_tcp_handle_h2c_data(tconn) == -1);
+	ut_expect_term_req(SPDK_NVME_TCP_TERM_REQ_FES_INVALID_HEADER_FIELD,
+			   offsetof(struct spdk_nvme_tcp_h2c_data_hdr, cccid));
+
+	/* Data out of order */
+	ut_set_h2c(tconn, 0x55, 2, 0, 4096, 0);
+	CU_ASSERT(nvmf_tcp_handle_h2c_data(tconn) == -1);
+	ut_expect_term_req(SPDK_NVME_TCP_TERM_REQ_FES_DATA_TRANSFER_OUT_OF_RANGE,
+			   offsetof(struct spdk_nvme_tcp_h2c_data_hdr, datao));
+
+	/* No data */
+	ut_set_h2c(tconn, 0x55, 2, 4096, 0, 0);
+	CU_ASSERT(nvmf_tcp_handle_h2c_data(tconn) == -1);
+	ut_expect_term_req(SPDK_NVME_TCP_TERM_REQ_FES_DATA_TRANSFER_OUT_OF_RANGE,
+			   offsetof(struct spdk_nvme_tcp_h2c_data_hdr, datao));
+
+	/* More data than the command transfers */
+	ut_set_h2c(tconn, 0x55, 2, 4096, 4097, 0);
+	CU_ASSERT(nvmf_tcp_handle_h2c_data(tconn) == -1);
+	ut_expect_term_req(SPDK_NVME_TCP_TERM_REQ_FES_DATA_TRANSFER_OUT_OF_RANGE,
+			   offsetof(struct spdk_nvme_tcp_h2c_data_hdr, datao));
+
+	/* Data offset inside the header */
+	ut_set_h2c(tconn, 0x55, 2, 4096, 4096, 0);
+	tconn->recv_pdu.hdr.common.pdo = sizeof(struct spdk_nvme_tcp_h2c_data_hdr) - 4;
+	CU_ASSERT(nvmf_tcp_handle_h2c_data(tconn) == -1);
+	ut_expect_term_req(SPDK_NVME_TCP_TERM_REQ_FES_INVALID_HEADER_FIELD,
+			   offsetof(struct spdk_nvme_tcp_common_pdu_hdr, plen));
+
+	/* PDU length that does not match DATAL */
+	ut_set_h2c(tconn, 0x55, 2, 4096, 4096, 0);
+	tconn->recv_pdu.hdr.common.plen += 512;
+	CU_ASSERT(nvmf_tcp_handle_h2c_data(tconn) == -1);
+	ut_expect_term_req(SPDK_NVME_TCP_TERM_REQ_FES_INVALID_HEADER_FIELD,
+			   offsetof(struct spdk_nvme_tcp_common_pdu_hdr, plen));
+
+	/* The rest of the data, after some padding */
+	ut_set_h2c(tconn, 0x55, 2, 4096, 4096, 8);
+	CU_ASSERT(nvmf_tcp_handle_h2c_data(tconn) == 0);
+	CU_ASSERT(tconn->recv_req == tcp_req);
+	CU_ASSERT(tconn->payload == buf + 4096);
+	CU_ASSERT(tconn->payload_len == 4096);
+	CU_ASSERT(tconn->pad_len == 8);
+	CU_ASSERT(tconn->recv_state == NVMF_TCP_RECV_PAD);
+	ut_expect_nothing_sent();
+
+	/* Once it is in, the command is started. */
+	g_num_exec = 0;
+	tconn->recv_state = NVMF_TCP_RECV_PAYLOAD;
+	CU_ASSERT(nvmf_tcp_payload_done(tconn) == 1);
+	CU_ASSERT(g_num_exec == 1);
+	CU_ASSERT(!tcp_req->awaiting_h2c);
+	CU_ASSERT(tconn->recv_state == NVMF_TCP_RECV_CH);
+
+	/* No more data is accepted for it. */
+	ut_set_h2c(tconn, 0x55, 2, 8192, 512, 0);
+	CU_ASSERT(nvmf_tcp_handle_h2c_data(tconn) == -1);
+	ut_expect_term_req(SPDK_NVME_TCP_TERM_REQ_FES_INVALID_HEADER_FIELD,
+			   offsetof(struct spdk_nvme_tcp_h2c_data_hdr, cccid));
+
+	tcp_req->req.data = NULL;
+	ut_conn_destroy(tconn);
+}
+
+static void
+test_recv_pdus(void)
+{
+	struct spdk_nvmf_tcp_conn *tconn;
+	struct spdk_nvme_tcp_ic_req ic_req = {};
+	struct spdk_nvme_tcp_ic_resp ic_resp;
+	struct spdk_nvme_tcp_cmd cmd = {};
+
+	tconn = ut_conn_create();
+
+	/* Nothing received yet */
+	CU_ASSERT(spdk_nvmf_tcp_poll(&tconn->conn) == 0);
+
+	ic_req.common.pdu_type = SPDK_NVME_TCP_PDU_TYPE_IC_REQ;
+	ic_req.common.hlen = sizeof(ic_req);
+	ic_req.common.plen = sizeof(ic_req);
+	ic_req.pfv = SPDK_NVME_TCP_PFV_1_0;
+	CU_ASSERT(send(g_host_fd, &ic_req, sizeof(ic_req), 0) == sizeof(ic_req));
+
+	CU_ASSERT(spdk_nvmf_tcp_poll(&tconn->conn) == 0);
+	CU_ASSERT(tconn->ic_done);
+	CU_ASSERT(recv(g_host_fd, &ic_resp, sizeof(ic_resp), 0) == sizeof(ic_resp));
+	CU_ASSERT(ic_resp.common.pdu_type == SPDK_NVME_TCP_PDU_TYPE_IC_RESP);
+	CU_ASSERT(ic_resp.maxh2cdata == SPDK_NVMF_MAX_RECV_DATA_TRANSFER_SIZE);
+
+	/* A command without data, split across two polls, is started right away. */
+	g_num_exec = 0;
+	cmd.common.pdu_type = SPDK_NVME_TCP_PDU_TYPE_CAPSULE_CMD;
+	cmd.common.hlen = sizeof(cmd);
+	cmd.common.plen = sizeof(cmd);
+	cmd.ccsqe.opc = SPDK_NVME_OPC_FLUSH;
+	cmd.ccsqe.cid = 7;
+	CU_ASSERT(send(g_host_fd, &cmd, 20, 0) == 20);
+	CU_ASSERT(spdk_nvmf_tcp_poll(&tconn->conn) == 0);
+	CU_ASSERT(send(g_host_fd, (uint8_t *)&cmd + 20, sizeof(cmd) - 20, 0) == sizeof(cmd) - 20);
+	CU_ASSERT(spdk_nvmf_tcp_poll(&tconn->conn) == 1);
+	CU_ASSERT(g_num_exec == 1);
+	CU_ASSERT(tconn->recv_req->cmd.nvme_cmd.cid == 7);
+
+	/* A malformed header ends the connection. */
+	cmd.common.hlen = sizeof(cmd) - 8;
+	CU_ASSERT(send(g_host_fd, &cmd, sizeof(cmd), 0) == sizeof(cmd));
+	CU_ASSERT(spdk_nvmf_tcp_poll(&tconn->conn) == -1);
+	ut_expect_term_req(SPDK_NVME_TCP_TERM_REQ_FES_INVALID_HEADER_FIELD,
+			   offsetof(struct spdk_nvme_tcp_common_pdu_hdr, hlen));
+
+	ut_conn_destroy(tconn);
+}
+
+int main(int argc, char **argv)
+{
+	CU_pSuite	suite = NULL;
+	unsigned int	num_failures;
+
+	if (CU_initialize_registry() != CUE_SUCCESS) {
+		return CU_get_error();
+	}
+
+	suite = CU_add_suite("nvmf_tcp", NULL, NULL);
+	if (suite == NULL) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	if (
+		CU_add_test(suite, "check_ch", test_check_ch) == NULL ||
+		CU_add_test(suite, "capsule_prep", test_capsule_prep) == NULL ||
+		CU_add_test(suite, "h2c_data", test_h2c_data) == NULL ||
+		CU_add_test(suite, "recv_pdus", test_recv_pdus) == NULL) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	CU_basic_set_mode(CU_BRM_VERBOSE);
+	CU_basic_run_tests();
+	num_failures = CU_get_number_of_failures();
+	CU_cleanup_registry();
+	return num_failures;
+}
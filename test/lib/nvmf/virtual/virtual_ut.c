@@ -0,0 +1,459 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+
+#include "spdk_cunit.h"
+
+#include "virtual.c"
+
+SPDK_LOG_REGISTER_TRACE_FLAG("nvmf", SPDK_TRACE_NVMF)
+
+#define UT_NUM_NS	2
+
+/* The last bdev I/O submitted by the code under test */
+static struct {
+	enum spdk_bdev_io_type		type;
+	struct spdk_bdev		*bdev;
+	void				*buf;
+	uint64_t			nbytes;
+	uint64_t			offset;
+	struct spdk_scsi_unmap_bdesc	*unmap_d;
+	uint16_t			bdesc_count;
+	int				num_submitted;
+} g_io;
+
+static struct spdk_bdev_io	g_bdev_io;
+static bool			g_fail_submit;
+static int			g_num_completed;
+
+static struct spdk_bdev_io *
+ut_submit(enum spdk_bdev_io_type type, struct spdk_bdev *bdev, void *buf, uint64_t nbytes,
+	  uint64_t offset)
+{
+	if (g_fail_submit) {
+		return NULL;
+	}
+
+	g_io.type = type;
+	g_io.bdev = bdev;
+	g_io.buf = buf;
+	g_io.nbytes = nbytes;
+	g_io.offset = offset;
+	g_io.num_submitted++;
+
+	return &g_bdev_io;
+}
+
+struct spdk_bdev_io *
+spdk_bdev_read(struct spdk_bdev *bdev, void *buf, uint64_t nbytes, uint64_t offset,
+	       spdk_bdev_io_completion_cb cb, void *cb_arg)
+{
+	return ut_submit(SPDK_BDEV_IO_TYPE_READ, bdev, buf, nbytes, offset);
+}
+
+struct spdk_bdev_io *
+spdk_bdev_write(struct spdk_bdev *bdev, void *buf, uint64_t nbytes, uint64_t offset,
+		spdk_bdev_io_completion_cb cb, void *cb_arg)
+{
+	return ut_submit(SPDK_BDEV_IO_TYPE_WRITE, bdev, buf, nbytes, offset);
+}
+
+struct spdk_bdev_io *
+spdk_bdev_flush(struct spdk_bdev *bdev, uint64_t offset, uint64_t length,
+		spdk_bdev_io_completion_cb cb, void *cb_arg)
+{
+	return ut_submit(SPDK_BDEV_IO_TYPE_FLUSH, bdev, NULL, length, offset);
+}
+
+struct spdk_bdev_io *
+spdk_bdev_unmap(struct spdk_bdev *bdev, struct spdk_scsi_unmap_bdesc *unmap_d,
+		uint16_t bdesc_count, spdk_bdev_io_completion_cb cb, void *cb_arg)
+{
+	g_io.unmap_d = unmap_d;
+	g_io.bdesc_count = bdesc_count;
+	return ut_submit(SPDK_BDEV_IO_TYPE_UNMAP, bdev, NULL, 0, 0);
+}
+
+int
+spdk_bdev_free_io(struct spdk_bdev_io *bdev_io)
+{
+	return 0;
+}
+
+int
+spdk_nvmf_request_complete(struct spdk_nvmf_request *req)
+{
+	g_num_completed++;
+	return 0;
+}
+
+static struct spdk_bdev			g_bdevs[UT_NUM_NS];
+static struct spdk_nvmf_subsystem	g_subsystem;
+static struct nvmf_session		g_session;
+static struct spdk_nvmf_conn		g_conn;
+static union nvmf_h2c_msg		g_cmd;
+static union nvmf_c2h_msg		g_rsp;
+static uint8_t				g_buf[8192];
+static struct spdk_nvmf_request		g_req;
+
+/* Two namespaces: 1024 blocks of 512 bytes and 256 blocks of 4KB */
+static void
+ut_setup(void)
+{
+	uint32_t i;
+
+	memset(g_bdevs, 0, sizeof(g_bdevs));
+	memset(&g_subsystem, 0, sizeof(g_subsystem));
+	memset(&g_io, 0, sizeof(g_io));
+	g_fail_submit = false;
+	g_num_completed = 0;
+
+	for (i = 0; i < UT_NUM_NS; i++) {
+		snprintf(g_bdevs[i].name, sizeof(g_bdevs[i].name), "Malloc%u", i);
+		g_bdevs[i].max_unmap_bdesc_count = 4;
+		g_subsystem.ns_list[i] = &g_bdevs[i];
+	}
+	g_bdevs[0].blocklen = 512;
+	g_bdevs[0].blockcnt = 1024;
+	g_bdevs[1].blocklen = 4096;
+	g_bdevs[1].blockcnt = 256;
+	g_subsystem.ns_count = UT_NUM_NS;
+
+	g_session.subsys = &g_subsystem;
+	g_conn.sess = &g_session;
+
+	memset(&g_cmd, 0, sizeof(g_cmd));
+	memset(&g_rsp, 0, sizeof(g_rsp));
+	memset(g_buf, 0xFF, sizeof(g_buf));
+	g_req.conn = &g_conn;
+	g_req.cmd = &g_cmd;
+	g_req.rsp = &g_rsp;
+	g_req.data = g_buf;
+	g_req.length = sizeof(g_buf);
+}
+
+static void
+ut_rw_cmd(uint8_t opc, uint32_t nsid, uint64_t lba, uint32_t nlb)
+{
+	g_cmd.nvme_cmd.opc = opc;
+	g_cmd.nvme_cmd.nsid = nsid;
+	g_cmd.nvme_cmd.cdw10 = (uint32_t)lba;
+	g_cmd.nvme_cmd.cdw11 = (uint32_t)(lba >> 32);
+	g_cmd.nvme_cmd.cdw12 = nlb - 1;
+}
+
+static void
+test_identify_ns(void)
+{
+	struct spdk_nvme_ns_data *nsdata = (struct spdk_nvme_ns_data *)g_buf;
+
+	ut_setup();
+	g_cmd.nvme_cmd.opc = SPDK_NVME_OPC_IDENTIFY;
+	g_cmd.nvme_cmd.cdw10 = SPDK_NVME_IDENTIFY_NS;
+
+	/* Namespace 2 describes the second bdev */
+	g_cmd.nvme_cmd.nsid = 2;
+	CU_ASSERT(nvmf_virtual_process_admin_cmd(&g_req) == true);
+	CU_ASSERT(g_rsp.nvme_cpl.status.sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(nsdata->nsze == 256);
+	CU_ASSERT(nsdata->ncap == 256);
+	CU_ASSERT(nsdata->nuse == 256);
+	CU_ASSERT(nsdata->nlbaf == 0);
+	CU_ASSERT(nsdata->lbaf[0].lbads == 12);
+
+	g_cmd.nvme_cmd.nsid = 1;
+	CU_ASSERT(nvmf_virtual_process_admin_cmd(&g_req) == true);
+	CU_ASSERT(g_rsp.nvme_cpl.status.sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(nsdata->nsze == 1024);
+	CU_ASSERT(nsdata->lbaf[0].lbads == 9);
+
+	/* NSID 0 and NSIDs past the last namespace are invalid */
+	g_cmd.nvme_cmd.nsid = 0;
+	CU_ASSERT(nvmf_virtual_process_admin_cmd(&g_req) == true);
+	CU_ASSERT(g_rsp.nvme_cpl.status.sc == SPDK_NVME_SC_INVALID_NAMESPACE_OR_FORMAT);
+
+	g_cmd.nvme_cmd.nsid = UT_NUM_NS + 1;
+	CU_ASSERT(nvmf_virtual_process_admin_cmd(&g_req) == true);
+	CU_ASSERT(g_rsp.nvme_cpl.status.sc == SPDK_NVME_SC_INVALID_NAMESPACE_OR_FORMAT);
+
+	/* No buffer to fill in */
+	g_cmd.nvme_cmd.nsid = 1;
+	g_req.data = NULL;
+	CU_ASSERT(nvmf_virtual_process_admin_cmd(&g_req) == true);
+	CU_ASSERT(g_rsp.nvme_cpl.status.sc == SPDK_NVME_SC_INVALID_FIELD);
+
+	CU_ASSERT(g_io.num_submitted == 0);
+}
+
+static void
+test_identify_active_ns_list(void)
+{
+	uint32_t *ns_list = (uint32_t *)g_buf;
+
+	ut_setup();
+	g_cmd.nvme_cmd.opc = SPDK_NVME_OPC_IDENTIFY;
+	g_cmd.nvme_cmd.cdw10 = SPDK_NVME_IDENTIFY_ACTIVE_NS_LIST;
+
+	g_cmd.nvme_cmd.nsid = 0;
+	CU_ASSERT(nvmf_virtual_process_admin_cmd(&g_req) == true);
+	CU_ASSERT(g_rsp.nvme_cpl.status.sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(ns_list[0] == 1);
+	CU_ASSERT(ns_list[1] == 2);
+	CU_ASSERT(ns_list[2] == 0);
+
+	/* Only the IDs greater than the one in the command are listed */
+	g_cmd.nvme_cmd.nsid = 1;
+	CU_ASSERT(nvmf_virtual_process_admin_cmd(&g_req) == true);
+	CU_ASSERT(ns_list[0] == 2);
+	CU_ASSERT(ns_list[1] == 0);
+
+	g_cmd.nvme_cmd.nsid = 2;
+	CU_ASSERT(nvmf_virtual_process_admin_cmd(&g_req) == true);
+	CU_ASSERT(ns_list[0] == 0);
+}
+
+static void
+test_ns_mapping(void)
+{
+	ut_setup();
+
+	/* Each NSID goes to its own bdev */
+	ut_rw_cmd(SPDK_NVME_OPC_READ, 1, 0, 1);
+	CU_ASSERT(nvmf_virtual_process_io_cmd(&g_req) == false);
+	CU_ASSERT(g_io.bdev == &g_bdevs[0]);
+
+	ut_rw_cmd(SPDK_NVME_OPC_READ, 2, 0, 1);
+	CU_ASSERT(nvmf_virtual_process_io_cmd(&g_req) == false);
+	CU_ASSERT(g_io.bdev == &g_bdevs[1]);
+	CU_ASSERT(g_io.num_submitted == 2);
+
+	ut_rw_cmd(SPDK_NVME_OPC_READ, 0, 0, 1);
+	CU_ASSERT(nvmf_virtual_process_io_cmd(&g_req) == true);
+	CU_ASSERT(g_rsp.nvme_cpl.status.sc == SPDK_NVME_SC_INVALID_NAMESPACE_OR_FORMAT);
+
+	ut_rw_cmd(SPDK_NVME_OPC_READ, UT_NUM_NS + 1, 0, 1);
+	CU_ASSERT(nvmf_virtual_process_io_cmd(&g_req) == true);
+	CU_ASSERT(g_rsp.nvme_cpl.status.sc == SPDK_NVME_SC_INVALID_NAMESPACE_OR_FORMAT);
+	CU_ASSERT(g_io.num_submitted == 2);
+
+	/* Unsupported I/O opcodes are rejected */
+	ut_rw_cmd(SPDK_NVME_OPC_COMPARE, 1, 0, 1);
+	CU_ASSERT(nvmf_virtual_process_io_cmd(&g_req) == true);
+	CU_ASSERT(g_rsp.nvme_cpl.status.sc == SPDK_NVME_SC_INVALID_OPCODE);
+	CU_ASSERT(g_io.num_submitted == 2);
+}
+
+static void
+test_read_write(void)
+{
+	ut_setup();
+
+	/* LBAs and block counts are converted to bytes with the bdev's block size */
+	ut_rw_cmd(SPDK_NVME_OPC_READ, 1, 10, 8);
+	CU_ASSERT(nvmf_virtual_process_io_cmd(&g_req) == false);
+	CU_ASSERT(g_io.type == SPDK_BDEV_IO_TYPE_READ);
+	CU_ASSERT(g_io.buf == g_buf);
+	CU_ASSERT(g_io.offset == 10 * 512);
+	CU_ASSERT(g_io.nbytes == 8 * 512);
+
+	ut_rw_cmd(SPDK_NVME_OPC_WRITE, 2, 255, 1);
+	CU_ASSERT(nvmf_virtual_process_io_cmd(&g_req) == false);
+	CU_ASSERT(g_io.type == SPDK_BDEV_IO_TYPE_WRITE);
+	CU_ASSERT(g_io.offset == 255ULL * 4096);
+	CU_ASSERT(g_io.nbytes == 4096);
+	CU_ASSERT(g_io.num_submitted == 2);
+
+	/* The upper LBA dword is honored and checked against the namespace size */
+	ut_rw_cmd(SPDK_NVME_OPC_READ, 1, 1ULL << 32, 1);
+	CU_ASSERT(nvmf_virtual_process_io_cmd(&g_req) == true);
+	CU_ASSERT(g_rsp.nvme_cpl.status.sc == SPDK_NVME_SC_LBA_OUT_OF_RANGE);
+
+	/* Ranges that run past the last block */
+	ut_rw_cmd(SPDK_NVME_OPC_WRITE, 2, 255, 2);
+	CU_ASSERT(nvmf_virtual_process_io_cmd(&g_req) == true);
+	CU_ASSERT(g_rsp.nvme_cpl.status.sc == SPDK_NVME_SC_LBA_OUT_OF_RANGE);
+
+	ut_rw_cmd(SPDK_NVME_OPC_READ, 1, 1024, 1);
+	CU_ASSERT(nvmf_virtual_process_io_cmd(&g_req) == true);
+	CU_ASSERT(g_rsp.nvme_cpl.status.sc == SPDK_NVME_SC_LBA_OUT_OF_RANGE);
+	CU_ASSERT(g_io.num_submitted == 2);
+
+	/* The transfer must fit in the data buffer */
+	ut_rw_cmd(SPDK_NVME_OPC_READ, 2, 0, 3);
+	CU_ASSERT(nvmf_virtual_process_io_cmd(&g_req) == true);
+	CU_ASSERT(g_rsp.nvme_cpl.status.sc == SPDK_NVME_SC_DATA_SGL_LENGTH_INVALID);
+
+	g_req.data = NULL;
+	ut_rw_cmd(SPDK_NVME_OPC_WRITE, 1, 0, 1);
+	CU_ASSERT(nvmf_virtual_process_io_cmd(&g_req) == true);
+	CU_ASSERT(g_rsp.nvme_cpl.status.sc == SPDK_NVME_SC_DATA_SGL_LENGTH_INVALID);
+	CU_ASSERT(g_io.num_submitted == 2);
+
+	/* A bdev that cannot take the I/O fails the command */
+	g_req.data = g_buf;
+	g_fail_submit = true;
+	ut_rw_cmd(SPDK_NVME_OPC_WRITE, 1, 0, 1);
+	CU_ASSERT(nvmf_virtual_process_io_cmd(&g_req) == true);
+	CU_ASSERT(g_rsp.nvme_cpl.status.sc == SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+}
+
+static void
+test_flush(void)
+{
+	ut_setup();
+
+	g_cmd.nvme_cmd.opc = SPDK_NVME_OPC_FLUSH;
+	g_cmd.nvme_cmd.nsid = 2;
+	CU_ASSERT(nvmf_virtual_process_io_cmd(&g_req) == false);
+	CU_ASSERT(g_io.type == SPDK_BDEV_IO_TYPE_FLUSH);
+	CU_ASSERT(g_io.bdev == &g_bdevs[1]);
+	CU_ASSERT(g_io.offset == 0);
+	CU_ASSERT(g_io.nbytes == 256 * 4096);
+}
+
+static void
+test_dsm(void)
+{
+	struct spdk_nvme_dsm_range *ranges = (struct spdk_nvme_dsm_range *)g_buf;
+	struct spdk_scsi_unmap_bdesc *bdesc = (struct spdk_scsi_unmap_bdesc *)g_buf;
+
+	ut_setup();
+	g_cmd.nvme_cmd.opc = SPDK_NVME_OPC_DATASET_MANAGEMENT;
+	g_cmd.nvme_cmd.nsid = 1;
+	g_cmd.nvme_cmd.cdw10 = 2 - 1;
+	g_cmd.nvme_cmd.cdw11 = SPDK_NVME_DSM_ATTR_DEALLOCATE;
+	memset(ranges, 0, 2 * sizeof(*ranges));
+	ranges[0].starting_lba = 0x100;
+	ranges[0].length = 16;
+	ranges[1].starting_lba = 1000;
+	ranges[1].length = 24;
+
+	/* Ranges become big-endian unmap descriptors, in place */
+	CU_ASSERT(nvmf_virtual_process_io_cmd(&g_req) == false);
+	CU_ASSERT(g_io.type == SPDK_BDEV_IO_TYPE_UNMAP);
+	CU_ASSERT(g_io.bdev == &g_bdevs[0]);
+	CU_ASSERT(g_io.unmap_d == bdesc);
+	CU_ASSERT(g_io.bdesc_count == 2);
+	CU_ASSERT(be64toh(bdesc[0].lba) == 0x100);
+	CU_ASSERT(be32toh(bdesc[0].block_count) == 16);
+	CU_ASSERT(bdesc[0].reserved == 0);
+	CU_ASSERT(be64toh(bdesc[1].lba) == 1000);
+	CU_ASSERT(be32toh(bdesc[1].block_count) == 24);
+	CU_ASSERT(g_io.num_submitted == 1);
+
+	/* A range past the end of the namespace */
+	ranges[0].starting_lba = 1000;
+	ranges[0].length = 25;
+	g_cmd.nvme_cmd.cdw10 = 0;
+	CU_ASSERT(nvmf_virtual_process_io_cmd(&g_req) == true);
+	CU_ASSERT(g_rsp.nvme_cpl.status.sc == SPDK_NVME_SC_LBA_OUT_OF_RANGE);
+
+	/* More ranges than the bdev takes in one unmap */
+	g_cmd.nvme_cmd.cdw10 = 5 - 1;
+	CU_ASSERT(nvmf_virtual_process_io_cmd(&g_req) == true);
+	CU_ASSERT(g_rsp.nvme_cpl.status.sc == SPDK_NVME_SC_INVALID_FIELD);
+
+	/* Range list longer than the data buffer */
+	g_cmd.nvme_cmd.cdw10 = 2 - 1;
+	g_req.length = sizeof(*ranges);
+	CU_ASSERT(nvmf_virtual_process_io_cmd(&g_req) == true);
+	CU_ASSERT(g_rsp.nvme_cpl.status.sc == SPDK_NVME_SC_DATA_SGL_LENGTH_INVALID);
+	CU_ASSERT(g_io.num_submitted == 1);
+
+	/* Without the deallocate attribute the ranges are only hints */
+	g_cmd.nvme_cmd.cdw11 = 0;
+	CU_ASSERT(nvmf_virtual_process_io_cmd(&g_req) == true);
+	CU_ASSERT(g_rsp.nvme_cpl.status.sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(g_io.num_submitted == 1);
+}
+
+static void
+test_complete_cmd(void)
+{
+	struct spdk_event event = {};
+
+	ut_setup();
+	event.arg1 = &g_req;
+	event.arg2 = &g_bdev_io;
+
+	g_bdev_io.status = SPDK_BDEV_IO_STATUS_SUCCESS;
+	g_rsp.nvme_cpl.status.sc = SPDK_NVME_SC_INTERNAL_DEVICE_ERROR;
+	nvmf_virtual_complete_cmd(&event);
+	CU_ASSERT(g_rsp.nvme_cpl.status.sct == SPDK_NVME_SCT_GENERIC);
+	CU_ASSERT(g_rsp.nvme_cpl.status.sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(g_num_completed == 1);
+
+	g_bdev_io.status = SPDK_BDEV_IO_STATUS_FAILED;
+	nvmf_virtual_complete_cmd(&event);
+	CU_ASSERT(g_rsp.nvme_cpl.status.sc == SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+	CU_ASSERT(g_num_completed == 2);
+}
+
+int main(int argc, char **argv)
+{
+	CU_pSuite	suite = NULL;
+	unsigned int	num_failures;
+
+	if (CU_initialize_registry() != CUE_SUCCESS) {
+		return CU_get_error();
+	}
+
+	suite = CU_add_suite("nvmf_virtual", NULL, NULL);
+	if (suite == NULL) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	if (
+		CU_add_test(suite, "identify_ns", test_identify_ns) == NULL ||
+		CU_add_test(suite, "identify_active_ns_list", test_identify_active_ns_list) == NULL ||
+		CU_add_test(suite, "ns_mapping", test_ns_mapping) == NULL ||
+		CU_add_test(suite, "read_write", test_read_write) == NULL ||
+		CU_add_test(suite, "flush", test_flush) == NULL ||
+		CU_add_test(suite, "dsm", test_dsm) == NULL ||
+		CU_add_test(suite, "complete_cmd", test_complete_cmd) == NULL) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	CU_basic_set_mode(CU_BRM_VERBOSE);
+	CU_basic_run_tests();
+	num_failures = CU_get_number_of_failures();
+	CU_cleanup_registry();
+	return num_failures;
+}